@@ -0,0 +1,397 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmark.cpp
+// ============
+// Headless benchmark mode - renders a fixed number of frames along a
+// scripted camera path and reports frame time statistics
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Benchmark.h"
+#include "HeadlessContext.h"
+#include "SceneManager.h"
+#include "SceneGenerator.h"
+#include "ShaderManager.h"
+#include "ShaderUniforms.h"
+#include "JobSystem.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "ProgramCache.h"
+#include "DynamicResolution.h"
+#include "FrameCapture.h"
+#include "SoftwareRasterizer.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+namespace {
+    const char* const DEFAULT_SCENE_FILE = "Scenes/desk.scene";
+    const float PI = 3.14159265f;
+
+    // one orbit around the scene over the measured frames
+    struct CAMERA_PATH
+    {
+        glm::vec3 center;
+        float radius;
+        float height;
+        float farPlane;
+    };
+
+    CAMERA_PATH MakeCameraPath(const SCENE_DESCRIPTION& scene) {
+        glm::vec3 minimum(1e30f);
+        glm::vec3 maximum(-1e30f);
+        for (size_t i = 0; i < scene.objects.Count(); ++i) {
+            minimum = glm::min(minimum, scene.objects.position[i]);
+            maximum = glm::max(maximum, scene.objects.position[i]);
+        }
+        CAMERA_PATH path;
+        path.center = (minimum + maximum) * 0.5f;
+        float extent = glm::max(maximum.x - minimum.x, maximum.z - minimum.z);
+        // the desk scene is seen from about 13 units away
+        path.radius = glm::max(13.0f, extent * 0.75f);
+        path.height = path.radius * 0.4f;
+        path.farPlane = glm::max(100.0f, path.radius * 4.0f);
+        return path;
+    }
+
+    // camera on the path at time t (0..1), with the top, front and
+    // side views of the whole path next to it in multi-view mode
+    void SetPathCamera(ShaderUniforms& uniforms, const CAMERA_PATH& path, float t, float aspect, bool multiView) {
+        float angle = t * 2.0f * PI;
+        glm::vec3 eye = path.center + glm::vec3(sinf(angle) * path.radius, path.height, cosf(angle) * path.radius);
+        glm::mat4 view = glm::lookAt(eye, path.center, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspect, 0.1f, path.farPlane);
+        if (!multiView) {
+            uniforms.SetCamera(view, projection, eye);
+            return;
+        }
+        float halfHeight = path.radius;
+        float distance = path.farPlane * 0.5f;
+        glm::mat4 orthographic = glm::ortho(-halfHeight * aspect, halfHeight * aspect, -halfHeight, halfHeight,
+            0.1f, path.farPlane);
+        glm::vec3 topEye = path.center + glm::vec3(0.0f, distance, 0.0f);
+        glm::vec3 frontEye = path.center + glm::vec3(0.0f, 0.0f, distance);
+        glm::vec3 sideEye = path.center + glm::vec3(distance, 0.0f, 0.0f);
+        CAMERA_VIEW views[4] = {
+            { view, projection, eye },
+            { glm::lookAt(topEye, path.center, glm::vec3(0.0f, 0.0f, -1.0f)), orthographic, topEye },
+            { glm::lookAt(frontEye, path.center, glm::vec3(0.0f, 1.0f, 0.0f)), orthographic, frontEye },
+            { glm::lookAt(sideEye, path.center, glm::vec3(0.0f, 1.0f, 0.0f)), orthographic, sideEye }
+        };
+        uniforms.SetViews(views, 4);
+    }
+
+    // nearest-rank percentile of sorted values
+    double Percentile(const std::vector<double>& sorted, double percent) {
+        size_t rank = (size_t)ceil(percent / 100.0 * sorted.size());
+        return sorted[(rank > 0 ? rank : 1) - 1];
+    }
+
+    bool ReadNumber(int argc, char* argv[], int& index, long& value) {
+        if (index + 1 >= argc) {
+            return false;
+        }
+        char* end = NULL;
+        value = strtol(argv[index + 1], &end, 10);
+        if (*end != '\0' || value < 0) {
+            return false;
+        }
+        ++index;
+        return true;
+    }
+
+    bool ReadMilliseconds(int argc, char* argv[], int& index, double& value) {
+        if (index + 1 >= argc) {
+            return false;
+        }
+        char* end = NULL;
+        value = strtod(argv[index + 1], &end);
+        if (*end != '\0' || value < 0.0) {
+            return false;
+        }
+        ++index;
+        return true;
+    }
+}
+
+BENCHMARK_OPTIONS::BENCHMARK_OPTIONS() {
+    width = 1000;
+    height = 800;
+    frames = 300;
+    warmupFrames = 10;
+    objectCount = 0;
+    lightCount = 0;
+    seed = 1;
+    occlusionCulling = true;
+    frameBudget = 0.0;
+    multiView = false;
+    capturePrefix = NULL;
+    captureRaw = false;
+    software = false;
+    threadCount = 0;
+    sceneFile = DEFAULT_SCENE_FILE;
+}
+
+/***********************************************************
+ *  ParseBenchmarkOptions()
+ *
+ *  This function reads the benchmark options. Unknown
+ *  arguments are left for the rest of the application. A
+ *  missing or invalid value is reported and makes the run
+ *  fail, so a benchmark never measures another setup than
+ *  the one asked for.
+ ***********************************************************/
+BENCHMARK_MODE ParseBenchmarkOptions(int argc, char* argv[], BENCHMARK_OPTIONS& options) {
+    bool benchmark = false;
+    bool invalid = false;
+    for (int i = 1; i < argc; ++i) {
+        const char* option = argv[i];
+        long value = 0;
+        bool valid = true;
+        if (strcmp(option, "--benchmark") == 0) {
+            benchmark = true;
+        }
+        else if (strcmp(option, "--frames") == 0) {
+            valid = ReadNumber(argc, argv, i, value) && value > 0;
+            options.frames = valid ? (int)value : options.frames;
+        }
+        else if (strcmp(option, "--warmup") == 0) {
+            valid = ReadNumber(argc, argv, i, value);
+            options.warmupFrames = valid ? (int)value : options.warmupFrames;
+        }
+        else if (strcmp(option, "--objects") == 0) {
+            // a generated scene is the ground plus at least one copy
+            valid = ReadNumber(argc, argv, i, value) && value >= 2;
+            options.objectCount = valid ? (size_t)value : options.objectCount;
+        }
+        else if (strcmp(option, "--lights") == 0) {
+            valid = ReadNumber(argc, argv, i, value) && value >= 0;
+            options.lightCount = valid ? (size_t)value : options.lightCount;
+        }
+        else if (strcmp(option, "--seed") == 0) {
+            valid = ReadNumber(argc, argv, i, value);
+            options.seed = valid ? (uint32_t)value : options.seed;
+        }
+        else if (strcmp(option, "--no-occlusion") == 0) {
+            options.occlusionCulling = false;
+        }
+        else if (strcmp(option, "--frame-budget") == 0) {
+            double milliseconds = 0.0;
+            valid = ReadMilliseconds(argc, argv, i, milliseconds);
+            options.frameBudget = valid ? milliseconds : options.frameBudget;
+        }
+        else if (strcmp(option, "--multi-view") == 0) {
+            options.multiView = true;
+        }
+        else if (strcmp(option, "--capture") == 0) {
+            valid = i + 1 < argc;
+            if (valid) {
+                options.capturePrefix = argv[++i];
+            }
+        }
+        else if (strcmp(option, "--capture-raw") == 0) {
+            options.captureRaw = true;
+        }
+        else if (strcmp(option, "--software") == 0) {
+            options.software = true;
+        }
+        else if (strcmp(option, "--threads") == 0) {
+            valid = ReadNumber(argc, argv, i, value) && value > 0;
+            options.threadCount = valid ? (int)value : options.threadCount;
+        }
+        else if (strcmp(option, "--scene") == 0) {
+            valid = i + 1 < argc;
+            if (valid) {
+                options.sceneFile = argv[++i];
+            }
+        }
+        else if (strcmp(option, "--size") == 0) {
+            long height = 0;
+            valid = ReadNumber(argc, argv, i, value) && ReadNumber(argc, argv, i, height) && value > 0 && height > 0;
+            if (valid) {
+                options.width = (int)value;
+                options.height = (int)height;
+            }
+        }
+        if (!valid) {
+            std::cout << "ERROR: missing or invalid value for " << option << std::endl;
+            invalid = true;
+        }
+    }
+    if (invalid) {
+        return BENCHMARK_INVALID;
+    }
+    return benchmark ? BENCHMARK_ON : BENCHMARK_OFF;
+}
+
+/***********************************************************
+ *  RunBenchmark()
+ *
+ *  This function renders the warm-up and measured frames in
+ *  a headless context. Every frame ends with glFinish(), so
+ *  a frame time covers both the CPU work and the GPU work
+ *  of the frame. Prints min/median/p99/mean frame times,
+ *  and the mean render scale with a frame budget.
+ *
+ *  With --software no OpenGL context is created: the frames
+ *  are drawn by the software rasterizer at full size.
+ ***********************************************************/
+int RunBenchmark(const BENCHMARK_OPTIONS& options) {
+    HeadlessContext context;
+    if (!options.software && !context.Create(options.width, options.height)) {
+        return EXIT_FAILURE;
+    }
+
+    SCENE_DESCRIPTION scene;
+    if (!LoadSceneFile(options.sceneFile, scene)) {
+        return EXIT_FAILURE;
+    }
+    if (options.objectCount > 0) {
+        SCENE_DESCRIPTION sceneTemplate = scene;
+        if (!GenerateScene(sceneTemplate, options.objectCount, options.lightCount, options.seed, scene)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    // the scene manager takes ownership of the shader manager
+    ShaderManager* pShaderManager = NULL;
+    ShaderUniforms shaderUniforms;
+    if (!options.software) {
+        pShaderManager = new ShaderManager();
+        ProgramCache::LoadShaders(
+            pShaderManager,
+            "Shaders/vertexShader.glsl",
+            "Shaders/fragmentShader.glsl");
+        pShaderManager->use();
+        shaderUniforms.Resolve(pShaderManager->m_programID);
+    }
+    else {
+        if (Profiler::IsEnabled()) {
+            // the profiler's GPU scopes need an OpenGL context
+            std::cout << "INFO: Profiler disabled for the software rasterizer" << std::endl;
+            Profiler::SetEnabled(false);
+        }
+        if (options.frameBudget > 0.0) {
+            std::cout << "INFO: Frame budget ignored by the software rasterizer" << std::endl;
+        }
+    }
+    JobSystem jobSystem(options.threadCount - 1);
+    SoftwareRasterizer rasterizer;
+    rasterizer.SetJobSystem(&jobSystem);
+
+    std::vector<double> frameTimes;
+    frameTimes.reserve(options.frames);
+    double scaleTotal = 0.0;
+    {
+        DynamicResolution dynamicResolution;
+        dynamicResolution.SetFrameBudget(options.frameBudget);
+        FrameCapture frameCapture;
+        SceneManager sceneManager(pShaderManager);
+        sceneManager.SetShaderUniforms(&shaderUniforms);
+        sceneManager.SetJobSystem(&jobSystem);
+        sceneManager.SetOcclusionCulling(options.occlusionCulling);
+        if (options.software) {
+            rasterizer.SetSize(options.width, options.height);
+            sceneManager.SetSoftwareRasterizer(&rasterizer);
+            sceneManager.SetViewportSize(rasterizer.GetWidth(), rasterizer.GetHeight());
+        }
+        sceneManager.LoadScene(scene);
+
+        CAMERA_PATH path = MakeCameraPath(scene);
+        float aspect = (float)options.width / (float)options.height;
+        if (!options.software) {
+            glEnable(GL_DEPTH_TEST);
+            // blended materials as in the window (see ViewManager)
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        }
+
+        int totalFrames = options.warmupFrames + options.frames;
+        for (int frame = 0; frame < totalFrames; ++frame) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            Profiler::BeginFrame();
+            if (options.software) {
+                rasterizer.Clear(glm::vec4(0.1f, 0.1f, 0.1f, 1.0f));
+            }
+            else {
+                dynamicResolution.BeginFrame(context.GetFramebuffer(), options.width, options.height);
+                sceneManager.SetViewportSize(dynamicResolution.GetRenderWidth(), dynamicResolution.GetRenderHeight());
+
+                GLCOUNT(glClearColor(0.1f, 0.1f, 0.1f, 1.0f));
+                GLCOUNT(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
+            }
+
+            int measured = frame - options.warmupFrames;
+            if (measured == 0 && options.capturePrefix != NULL) {
+                frameCapture.Start(options.capturePrefix, options.captureRaw ? CAPTURE_RAW : CAPTURE_PNG);
+            }
+            float t = (measured > 0) ? (float)measured / options.frames : 0.0f;
+            SetPathCamera(shaderUniforms, path, t, aspect, options.multiView);
+            if (options.software) {
+                sceneManager.RenderScene();
+                frameCapture.CapturePixels(rasterizer.GetPixels(), rasterizer.GetWidth(), rasterizer.GetHeight());
+            }
+            else {
+                {
+                    PROFILE_GPU_SCOPE("RenderScene");
+                    sceneManager.RenderScene();
+                }
+                {
+                    PROFILE_GPU_SCOPE("Upscale");
+                    dynamicResolution.Present();
+                    sceneManager.InvalidateState();
+                }
+                {
+                    PROFILE_GPU_SCOPE("Capture");
+                    frameCapture.CaptureFrame(context.GetFramebuffer(), options.width, options.height);
+                }
+                {
+                    PROFILE_GPU_SCOPE("Finish");
+                    glFinish();
+                }
+            }
+
+            Profiler::EndFrame();
+            FrameStats::EndFrame();
+            if (measured >= 0) {
+                scaleTotal += dynamicResolution.GetScale();
+                frameTimes.push_back(std::chrono::duration<double, std::milli>(
+                    std::chrono::steady_clock::now() - start).count());
+            }
+        }
+    }
+
+    std::vector<double> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    double total = 0.0;
+    for (size_t i = 0; i < sorted.size(); ++i) {
+        total += sorted[i];
+    }
+    double mean = total / sorted.size();
+    const FRAME_STATS& stats = FrameStats::Last();
+
+    std::cout << std::fixed << std::setprecision(3)
+        << "INFO: Benchmark " << options.frames << " frames, " << scene.objects.Count() << " objects, "
+        << scene.pointLights.size() << " point lights, "
+        << options.width << "x" << options.height << (options.multiView ? ", 4 views" : "")
+        << (options.software ? ", software rasterizer" : "")
+        << ", " << jobSystem.GetWorkerCount() + 1 << (jobSystem.GetWorkerCount() > 0 ? " threads" : " thread") << std::endl
+        << "INFO:   frame time min " << sorted.front() << " ms, median " << Percentile(sorted, 50.0)
+        << " ms, p99 " << Percentile(sorted, 99.0) << " ms, max " << sorted.back()
+        << " ms, mean " << mean << " ms (" << std::setprecision(1) << 1000.0 / mean << " fps)" << std::endl
+        << "INFO:   last frame: " << stats.drawCalls << " draws, " << stats.glCalls << " GL calls, "
+        << stats.objectsVisible << " visible objects, " << stats.objectsCulled << " culled, "
+        << stats.objectsOccluded << " occluded" << std::endl;
+    if (options.frameBudget > 0.0 && !options.software) {
+        std::cout << std::setprecision(3) << "INFO:   frame budget " << options.frameBudget
+            << " ms, mean render scale " << scaleTotal / frameTimes.size() << std::endl;
+    }
+
+    if (Profiler::IsEnabled()) {
+        Profiler::WriteChromeTrace("profile_trace.json");
+        Profiler::WriteFrameCSV("profile_frames.csv");
+    }
+    return EXIT_SUCCESS;
+}
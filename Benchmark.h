@@ -0,0 +1,74 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmark.h
+// ============
+// Headless benchmark mode - renders a fixed number of frames along a
+// scripted camera path and reports frame time statistics
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/***********************************************************
+ *  BENCHMARK_OPTIONS
+ *
+ *  Settings of a benchmark run, read from the command line:
+ *
+ *    --benchmark           run headless instead of opening a window
+ *    --frames <n>          measured frames (default 300)
+ *    --warmup <n>          unmeasured frames rendered first (default 10)
+ *    --objects <n>         generate a scene with n (at least 2)
+ *                          objects from the scene file (default: use
+ *                          the file as is)
+ *    --lights <n>          point lights added to a generated scene
+ *                          (default 0)
+ *    --seed <n>            scene generator seed (default 1)
+ *    --no-occlusion        only cull objects outside the view frustum
+ *    --scene <file>        scene file (default Scenes/desk.scene)
+ *    --size <w> <h>        framebuffer size (default 1000 800)
+ *    --frame-budget <ms>   scale the render resolution to hold this
+ *                          GPU frame time (default 0: full size)
+ *    --multi-view          draw top, front and side orthographic
+ *                          views next to the camera
+ *    --capture <prefix>    write the measured frames to image files
+ *    --capture-raw         write them as raw RGB instead of PNG
+ *    --software            draw with the software rasterizer instead
+ *                          of OpenGL (no GPU or display needed)
+ *    --threads <n>         threads working on a frame, the calling
+ *                          thread included (default: one per core)
+ ***********************************************************/
+struct BENCHMARK_OPTIONS
+{
+    int width;
+    int height;
+    int frames;
+    int warmupFrames;
+    size_t objectCount;
+    size_t lightCount;
+    uint32_t seed;
+    bool occlusionCulling;
+    double frameBudget;
+    bool multiView;
+    const char* capturePrefix;      // NULL: no capture
+    bool captureRaw;
+    bool software;
+    int threadCount;                // 0: one per core
+    const char* sceneFile;
+
+    BENCHMARK_OPTIONS();
+};
+
+// what the command line asks for
+enum BENCHMARK_MODE
+{
+    BENCHMARK_OFF = 0,          // no --benchmark: open the window
+    BENCHMARK_ON,
+    BENCHMARK_INVALID           // an option has a missing or invalid value
+};
+
+// parse the benchmark options
+BENCHMARK_MODE ParseBenchmarkOptions(int argc, char* argv[], BENCHMARK_OPTIONS& options);
+
+// run the benchmark and return the process exit code
+int RunBenchmark(const BENCHMARK_OPTIONS& options);
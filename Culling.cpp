@@ -0,0 +1,305 @@
+///////////////////////////////////////////////////////////////////////////////
+// culling.cpp
+// ============
+// Bounding boxes, view frustum tests and a bounding volume hierarchy
+// used to find the scene objects that are visible to the camera
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Culling.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+    // objects per leaf before a node is split
+    const uint32_t MAX_LEAF_OBJECTS = 4;
+}
+
+void AABB::Merge(const AABB& other) {
+    minimum = glm::min(minimum, other.minimum);
+    maximum = glm::max(maximum, other.maximum);
+}
+
+AABB AABB::Empty() {
+    AABB box;
+    box.minimum = glm::vec3(FLT_MAX);
+    box.maximum = glm::vec3(-FLT_MAX);
+    return box;
+}
+
+/***********************************************************
+ *  Transformed()
+ *
+ *  This method transforms the box center and projects the
+ *  extents onto the transformed axes, which gives the tight
+ *  box around the transformed box in a single pass.
+ ***********************************************************/
+AABB AABB::Transformed(const glm::mat4& matrix) const {
+    glm::vec3 center = glm::vec3(matrix * glm::vec4(Center(), 1.0f));
+    glm::vec3 extent = Extent();
+    glm::vec3 newExtent;
+    for (int i = 0; i < 3; ++i) {
+        newExtent[i] = fabsf(matrix[0][i]) * extent.x +
+            fabsf(matrix[1][i]) * extent.y +
+            fabsf(matrix[2][i]) * extent.z;
+    }
+    AABB box;
+    box.minimum = center - newExtent;
+    box.maximum = center + newExtent;
+    return box;
+}
+
+/***********************************************************
+ *  Extract()
+ *
+ *  This method extracts the clipping planes from the rows of
+ *  the combined matrix (Gribb/Hartmann). The same planes
+ *  come out of perspective and orthographic projections.
+ ***********************************************************/
+void Frustum::Extract(const glm::mat4& m) {
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; ++i) {
+        rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+    }
+    m_planes[0] = rows[3] + rows[0];    // left
+    m_planes[1] = rows[3] - rows[0];    // right
+    m_planes[2] = rows[3] + rows[1];    // bottom
+    m_planes[3] = rows[3] - rows[1];    // top
+    m_planes[4] = rows[3] + rows[2];    // near
+    m_planes[5] = rows[3] - rows[2];    // far
+
+    for (int i = 0; i < 6; ++i) {
+        float length = glm::length(glm::vec3(m_planes[i]));
+        if (length > 0.0f) {
+            m_planes[i] = m_planes[i] / length;
+        }
+    }
+}
+
+/***********************************************************
+ *  Test()
+ *
+ *  This method compares the box's projected radius with its
+ *  center's distance to every plane.
+ ***********************************************************/
+Frustum::TEST_RESULT Frustum::Test(const AABB& box) const {
+    glm::vec3 center = box.Center();
+    glm::vec3 extent = box.Extent();
+    TEST_RESULT result = INSIDE;
+    for (int i = 0; i < 6; ++i) {
+        glm::vec3 normal = glm::vec3(m_planes[i]);
+        float distance = glm::dot(normal, center) + m_planes[i].w;
+        float radius = glm::dot(glm::abs(normal), extent);
+        if (distance + radius < 0.0f) {
+            return OUTSIDE;
+        }
+        if (distance - radius < 0.0f) {
+            result = INTERSECTING;
+        }
+    }
+    return result;
+}
+
+/***********************************************************
+ *  Build()
+ *
+ *  This method builds the tree top-down, splitting every
+ *  node at the median object center along its longest axis.
+ ***********************************************************/
+void BoundingVolumeHierarchy::Build(const std::vector<AABB>& objectBounds) {
+    m_nodes.clear();
+    m_objectIndices.resize(objectBounds.size());
+    if (objectBounds.empty()) {
+        return;
+    }
+
+    std::vector<glm::vec3> centers(objectBounds.size());
+    for (size_t i = 0; i < objectBounds.size(); ++i) {
+        m_objectIndices[i] = (uint32_t)i;
+        centers[i] = objectBounds[i].Center();
+    }
+
+    // a binary tree with n leaves has at most 2n - 1 nodes
+    m_nodes.reserve(2 * objectBounds.size());
+    NODE root;
+    root.first = 0;
+    root.count = (uint32_t)objectBounds.size();
+    m_nodes.push_back(root);
+    Subdivide(0, objectBounds, centers);
+    Refit(objectBounds);
+}
+
+void BoundingVolumeHierarchy::Subdivide(uint32_t nodeIndex, const std::vector<AABB>& objectBounds, const std::vector<glm::vec3>& centers) {
+    uint32_t first = m_nodes[nodeIndex].first;
+    uint32_t count = m_nodes[nodeIndex].count;
+    if (count <= MAX_LEAF_OBJECTS) {
+        return;
+    }
+
+    // split along the longest axis of the object centers
+    AABB centerBounds = AABB::Empty();
+    for (uint32_t i = first; i < first + count; ++i) {
+        centerBounds.minimum = glm::min(centerBounds.minimum, centers[m_objectIndices[i]]);
+        centerBounds.maximum = glm::max(centerBounds.maximum, centers[m_objectIndices[i]]);
+    }
+    glm::vec3 size = centerBounds.maximum - centerBounds.minimum;
+    int axis = 0;
+    if (size.y > size.x) {
+        axis = 1;
+    }
+    if (size.z > size[axis]) {
+        axis = 2;
+    }
+
+    uint32_t half = count / 2;
+    std::nth_element(
+        m_objectIndices.begin() + first,
+        m_objectIndices.begin() + first + half,
+        m_objectIndices.begin() + first + count,
+        [&centers, axis](uint32_t a, uint32_t b) { return centers[a][axis] < centers[b][axis]; });
+
+    uint32_t left = (uint32_t)m_nodes.size();
+    NODE child;
+    child.first = first;
+    child.count = half;
+    m_nodes.push_back(child);
+    child.first = first + half;
+    child.count = count - half;
+    m_nodes.push_back(child);
+
+    m_nodes[nodeIndex].first = left;
+    m_nodes[nodeIndex].count = 0;
+
+    Subdivide(left, objectBounds, centers);
+    Subdivide(left + 1, objectBounds, centers);
+}
+
+/***********************************************************
+ *  Refit()
+ *
+ *  This method recomputes the node bounds bottom-up. Child
+ *  nodes are always stored after their parent, so a reverse
+ *  walk visits the children first.
+ ***********************************************************/
+void BoundingVolumeHierarchy::Refit(const std::vector<AABB>& objectBounds) {
+    for (size_t n = m_nodes.size(); n-- > 0;) {
+        NODE& node = m_nodes[n];
+        node.bounds = AABB::Empty();
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                node.bounds.Merge(objectBounds[m_objectIndices[i]]);
+            }
+        }
+        else {
+            node.bounds.Merge(m_nodes[node.first].bounds);
+            node.bounds.Merge(m_nodes[node.first + 1].bounds);
+        }
+    }
+}
+
+/***********************************************************
+ *  Query()
+ *
+ *  This method walks the tree, skipping nodes outside every
+ *  frustum and taking nodes fully inside one of them without
+ *  testing their children. Objects in partially visible
+ *  leaves are tested one by one. A node is visited once for
+ *  all frustums, so views that overlap share the traversal.
+ ***********************************************************/
+void BoundingVolumeHierarchy::Query(const Frustum* frustums, size_t frustumCount, const std::vector<AABB>& objectBounds,
+    std::vector<uint32_t>& visibleObjects, uint32_t rootNode) const {
+    if (rootNode >= m_nodes.size() || frustumCount == 0) {
+        return;
+    }
+
+    uint32_t stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = rootNode;
+    while (stackSize > 0) {
+        uint32_t nodeIndex = stack[--stackSize];
+        const NODE& node = m_nodes[nodeIndex];
+
+        Frustum::TEST_RESULT result = TestAny(frustums, frustumCount, node.bounds);
+        if (result == Frustum::OUTSIDE) {
+            continue;
+        }
+        if (result == Frustum::INSIDE) {
+            AppendAll(nodeIndex, visibleObjects);
+            continue;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                uint32_t object = m_objectIndices[i];
+                if (TestAny(frustums, frustumCount, objectBounds[object]) != Frustum::OUTSIDE) {
+                    visibleObjects.push_back(object);
+                }
+            }
+        }
+        else {
+            stack[stackSize++] = node.first;
+            stack[stackSize++] = node.first + 1;
+        }
+    }
+}
+
+Frustum::TEST_RESULT BoundingVolumeHierarchy::TestAny(const Frustum* frustums, size_t frustumCount, const AABB& box) {
+    Frustum::TEST_RESULT combined = Frustum::OUTSIDE;
+    for (size_t f = 0; f < frustumCount; ++f) {
+        Frustum::TEST_RESULT result = frustums[f].Test(box);
+        if (result == Frustum::INSIDE) {
+            return Frustum::INSIDE;
+        }
+        if (result == Frustum::INTERSECTING) {
+            combined = Frustum::INTERSECTING;
+        }
+    }
+    return combined;
+}
+
+/***********************************************************
+ *  GetSubtreeRoots()
+ *
+ *  This method expands the tree breadth first, replacing
+ *  inner nodes by their children, until there are enough
+ *  subtrees or only leaves are left.
+ ***********************************************************/
+void BoundingVolumeHierarchy::GetSubtreeRoots(size_t maxRoots, std::vector<uint32_t>& roots) const {
+    roots.clear();
+    if (m_nodes.empty()) {
+        return;
+    }
+    roots.push_back(0);
+    std::vector<uint32_t> level;
+    while (roots.size() < maxRoots) {
+        level.clear();
+        bool expanded = false;
+        for (size_t i = 0; i < roots.size(); ++i) {
+            const NODE& node = m_nodes[roots[i]];
+            if (node.count > 0) {
+                level.push_back(roots[i]);
+            }
+            else {
+                level.push_back(node.first);
+                level.push_back(node.first + 1);
+                expanded = true;
+            }
+        }
+        if (!expanded) {
+            break;
+        }
+        roots.swap(level);
+    }
+}
+
+void BoundingVolumeHierarchy::AppendAll(uint32_t nodeIndex, std::vector<uint32_t>& visibleObjects) const {
+    const NODE& node = m_nodes[nodeIndex];
+    if (node.count > 0) {
+        visibleObjects.insert(visibleObjects.end(),
+            m_objectIndices.begin() + node.first,
+            m_objectIndices.begin() + node.first + node.count);
+    }
+    else {
+        AppendAll(node.first, visibleObjects);
+        AppendAll(node.first + 1, visibleObjects);
+    }
+}
@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+// culling.h
+// ============
+// Bounding boxes, view frustum tests and a bounding volume hierarchy
+// used to find the scene objects that are visible to the camera
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  AABB
+ *
+ *  Axis-aligned bounding box.
+ ***********************************************************/
+struct AABB
+{
+    glm::vec3 minimum;
+    glm::vec3 maximum;
+
+    glm::vec3 Center() const { return (minimum + maximum) * 0.5f; }
+    glm::vec3 Extent() const { return (maximum - minimum) * 0.5f; }
+
+    // grow the box to also contain another box
+    void Merge(const AABB& other);
+    // box around this box after it is transformed by a matrix
+    AABB Transformed(const glm::mat4& matrix) const;
+    // box that contains nothing, for merging into
+    static AABB Empty();
+};
+
+/***********************************************************
+ *  Frustum
+ *
+ *  The six clipping planes of a view/projection matrix.
+ *  Works for perspective and orthographic projections.
+ ***********************************************************/
+class Frustum
+{
+public:
+    enum TEST_RESULT
+    {
+        OUTSIDE = 0,
+        INTERSECTING,
+        INSIDE
+    };
+
+    // extract the planes from a combined projection * view matrix
+    void Extract(const glm::mat4& viewProjection);
+    // classify a bounding box against the frustum
+    TEST_RESULT Test(const AABB& box) const;
+
+private:
+    // plane normal in xyz, distance in w, pointing inwards
+    glm::vec4 m_planes[6];
+};
+
+/***********************************************************
+ *  BoundingVolumeHierarchy
+ *
+ *  Binary tree of bounding boxes over a set of objects. The
+ *  tree is built once from the object bounds and refitted
+ *  when some of the bounds change.
+ ***********************************************************/
+class BoundingVolumeHierarchy
+{
+public:
+    // build the tree over the given object bounds
+    void Build(const std::vector<AABB>& objectBounds);
+    // update the node bounds after object bounds have changed
+    void Refit(const std::vector<AABB>& objectBounds);
+    // append the indices of the objects inside the frustum, searching
+    // the subtree below rootNode (the whole tree by default)
+    void Query(const Frustum& frustum, const std::vector<AABB>& objectBounds,
+        std::vector<uint32_t>& visibleObjects, uint32_t rootNode = 0) const {
+        Query(&frustum, 1, objectBounds, visibleObjects, rootNode);
+    }
+    // the same for the objects inside any of several frustums, each
+    // object appended once
+    void Query(const Frustum* frustums, size_t frustumCount, const std::vector<AABB>& objectBounds,
+        std::vector<uint32_t>& visibleObjects, uint32_t rootNode = 0) const;
+    // split the tree into about maxRoots disjoint subtrees that can be
+    // queried independently
+    void GetSubtreeRoots(size_t maxRoots, std::vector<uint32_t>& roots) const;
+
+    size_t GetNodeCount() const { return m_nodes.size(); }
+
+private:
+    struct NODE
+    {
+        AABB bounds;
+        // leaves: first entry in m_objectIndices;
+        // inner nodes: index of the left child (right = left + 1)
+        uint32_t first;
+        // number of objects in a leaf, 0 for inner nodes
+        uint32_t count;
+    };
+
+    std::vector<NODE> m_nodes;
+    // object indices ordered so every leaf covers a contiguous range
+    std::vector<uint32_t> m_objectIndices;
+
+    // split a node in two while it holds too many objects
+    void Subdivide(uint32_t nodeIndex, const std::vector<AABB>& objectBounds, const std::vector<glm::vec3>& centers);
+    // classify a box against several frustums: INSIDE if it is
+    // inside any of them, OUTSIDE if it is outside all of them
+    static Frustum::TEST_RESULT TestAny(const Frustum* frustums, size_t frustumCount, const AABB& box);
+    // add every object below a node without further tests
+    void AppendAll(uint32_t nodeIndex, std::vector<uint32_t>& visibleObjects) const;
+};
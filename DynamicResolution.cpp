@@ -0,0 +1,300 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.cpp
+// ============
+// Offscreen scene rendering at a resolution scaled to hold a GPU frame
+// time budget, upscaled and sharpened into the output framebuffer
+///////////////////////////////////////////////////////////////////////////////
+
+#include "DynamicResolution.h"
+#include "ProgramCache.h"
+#include "FrameStats.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+    // render scale limits; below half the output resolution the
+    // upscaled image gets too blurry to be worth the time saved
+    const float MIN_SCALE = 0.5f;
+    const float MAX_SCALE = 1.0f;
+    // render scales are multiples of this, so small frame time
+    // changes do not change the scale
+    const float SCALE_STEP = 1.0f / 16.0f;
+    // weight of the newest frame time in the smoothed frame time
+    const double FRAME_TIME_SMOOTHING = 0.1;
+    // frame times measured at the current scale before it may change
+    const int MIN_FRAME_SAMPLES = 8;
+    // frames timed but not counted after the resources are created
+    const int WARMUP_FRAMES = 4;
+    // a smoothed frame time below this fraction of the budget raises
+    // the scale by one step; one step adds at most 27% more pixels,
+    // which keeps the raised frame time under the budget
+    const double RAISE_THRESHOLD = 0.75;
+    // sharpen filter strength at the minimum scale
+    const float MAX_SHARPNESS = 0.5f;
+}
+
+/***********************************************************
+ *  DynamicResolution()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+DynamicResolution::DynamicResolution() {
+    m_frameBudget = 0.0;
+    m_scale = MAX_SCALE;
+    m_gpuTime = -1.0;
+    m_frameSamples = 0;
+    m_framebuffer = 0;
+    m_colorTexture = 0;
+    m_depthRenderbuffer = 0;
+    m_outputFramebuffer = 0;
+    m_outputWidth = 0;
+    m_outputHeight = 0;
+    m_renderWidth = 0;
+    m_renderHeight = 0;
+    m_pUpscaleShader = NULL;
+    m_emptyVertexArray = 0;
+    for (int i = 0; i < QUERY_COUNT; ++i) {
+        m_queries[i] = 0;
+        m_queryScales[i] = 0.0f;
+    }
+    m_queryFrame = 0;
+}
+
+/***********************************************************
+ *  ~DynamicResolution()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+DynamicResolution::~DynamicResolution() {
+    DeleteResources();
+}
+
+/***********************************************************
+ *  SetFrameBudget()
+ *
+ *  This method sets the GPU frame time to hold. Scaling
+ *  starts over from the full output resolution.
+ ***********************************************************/
+void DynamicResolution::SetFrameBudget(double milliseconds) {
+    m_frameBudget = std::max(milliseconds, 0.0);
+    m_scale = MAX_SCALE;
+    m_gpuTime = -1.0;
+    m_frameSamples = 0;
+}
+
+/***********************************************************
+ *  CreateResources()
+ *
+ *  This method loads the upscale program and creates the
+ *  offscreen framebuffer and the timer queries. The source
+ *  image is bound to its texture unit for good; no other
+ *  code uses that unit. Texture unit 0 is left active.
+ ***********************************************************/
+void DynamicResolution::CreateResources() {
+    m_pUpscaleShader = new ShaderManager();
+    ProgramCache::LoadShaders(
+        m_pUpscaleShader,
+        "Shaders/upscaleVertexShader.glsl",
+        "Shaders/upscaleFragmentShader.glsl");
+    GLuint program = m_pUpscaleShader->m_programID;
+    m_sourceImage.location = glGetUniformLocation(program, "sourceImage");
+    m_sourceRegion.location = glGetUniformLocation(program, "sourceRegion");
+    m_sharpness.location = glGetUniformLocation(program, "sharpness");
+    glUseProgram(program);
+    m_sourceImage.Set(UPSCALE_SOURCE_UNIT);
+
+    // the full screen triangle is made from gl_VertexID, but core
+    // profiles still need a vertex array bound to draw
+    glGenVertexArrays(1, &m_emptyVertexArray);
+
+    glGenTextures(1, &m_colorTexture);
+    glActiveTexture(GL_TEXTURE0 + UPSCALE_SOURCE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_colorTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
+    glGenRenderbuffers(1, &m_depthRenderbuffer);
+    glGenFramebuffers(1, &m_framebuffer);
+
+    glGenQueries(QUERY_COUNT, m_queries);
+}
+
+/***********************************************************
+ *  DeleteResources()
+ *
+ *  This method releases everything CreateResources() made.
+ ***********************************************************/
+void DynamicResolution::DeleteResources() {
+    if (m_pUpscaleShader == NULL) {
+        return;
+    }
+    glDeleteQueries(QUERY_COUNT, m_queries);
+    glDeleteFramebuffers(1, &m_framebuffer);
+    glDeleteRenderbuffers(1, &m_depthRenderbuffer);
+    glDeleteTextures(1, &m_colorTexture);
+    glDeleteVertexArrays(1, &m_emptyVertexArray);
+    delete m_pUpscaleShader;
+    m_pUpscaleShader = NULL;
+    m_framebuffer = m_depthRenderbuffer = m_colorTexture = m_emptyVertexArray = 0;
+    m_outputWidth = m_outputHeight = 0;
+}
+
+/***********************************************************
+ *  ResizeFramebuffer()
+ *
+ *  This method reallocates the offscreen color and depth
+ *  images at the output size, the largest size the scene
+ *  is ever drawn at.
+ ***********************************************************/
+void DynamicResolution::ResizeFramebuffer(int width, int height) {
+    glActiveTexture(GL_TEXTURE0 + UPSCALE_SOURCE_UNIT);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glActiveTexture(GL_TEXTURE0);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRenderbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR: dynamic resolution framebuffer of " << width << "x" << height
+            << " is incomplete" << std::endl;
+    }
+    m_outputWidth = width;
+    m_outputHeight = height;
+}
+
+/***********************************************************
+ *  ReadFrameTime()
+ *
+ *  This method reads the timer query about to be reused,
+ *  if the GPU has finished with it, into the smoothed frame
+ *  time. Frames drawn at another scale are ignored, and so
+ *  are the first frames, which include one-time driver work
+ *  (shader compiles, first uploads).
+ ***********************************************************/
+void DynamicResolution::ReadFrameTime() {
+    int slot = m_queryFrame % QUERY_COUNT;
+    if (m_queryFrame < WARMUP_FRAMES + QUERY_COUNT || m_queryScales[slot] != m_scale) {
+        return;
+    }
+    GLint available = 0;
+    glGetQueryObjectiv(m_queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+        return;
+    }
+    GLuint64 elapsed = 0;
+    glGetQueryObjectui64v(m_queries[slot], GL_QUERY_RESULT, &elapsed);
+    double milliseconds = elapsed / 1000000.0;
+    m_gpuTime = (m_gpuTime < 0.0) ? milliseconds :
+        m_gpuTime + (milliseconds - m_gpuTime) * FRAME_TIME_SMOOTHING;
+    ++m_frameSamples;
+}
+
+/***********************************************************
+ *  AdjustScale()
+ *
+ *  This method changes the render scale once enough frames
+ *  have been timed at the current one. The cost of a frame
+ *  grows with its pixel count, so an over budget scale is
+ *  cut by the square root of the overshoot at once, while
+ *  an under budget one only grows by a single step.
+ ***********************************************************/
+void DynamicResolution::AdjustScale() {
+    if (m_frameSamples < MIN_FRAME_SAMPLES) {
+        return;
+    }
+    float scale = m_scale;
+    if (m_gpuTime > m_frameBudget) {
+        scale = floorf(m_scale * (float)sqrt(m_frameBudget / m_gpuTime) / SCALE_STEP) * SCALE_STEP;
+    }
+    else if (m_gpuTime < m_frameBudget * RAISE_THRESHOLD) {
+        scale = m_scale + SCALE_STEP;
+    }
+    scale = std::min(std::max(scale, MIN_SCALE), MAX_SCALE);
+    if (scale == m_scale) {
+        return;
+    }
+    std::cout << "INFO: render scale " << (int)(m_scale * 100.0f + 0.5f) << "% -> "
+        << (int)(scale * 100.0f + 0.5f) << "%, GPU frame time " << m_gpuTime
+        << " ms of a " << m_frameBudget << " ms budget" << std::endl;
+    m_scale = scale;
+    m_gpuTime = -1.0;
+    m_frameSamples = 0;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method picks the frame's render size, binds the
+ *  framebuffer to draw the scene into and starts timing the
+ *  frame's GPU work.
+ ***********************************************************/
+void DynamicResolution::BeginFrame(GLuint outputFramebuffer, int width, int height) {
+    m_outputFramebuffer = outputFramebuffer;
+    if (!IsEnabled()) {
+        m_renderWidth = width;
+        m_renderHeight = height;
+        glBindFramebuffer(GL_FRAMEBUFFER, outputFramebuffer);
+        glViewport(0, 0, width, height);
+        FrameStats::Current().glCalls += 2;
+        return;
+    }
+
+    if (m_pUpscaleShader == NULL) {
+        CreateResources();
+    }
+    if (width != m_outputWidth || height != m_outputHeight) {
+        ResizeFramebuffer(width, height);
+    }
+    ReadFrameTime();
+    AdjustScale();
+
+    m_renderWidth = std::max((int)(width * m_scale + 0.5f), 1);
+    m_renderHeight = std::max((int)(height * m_scale + 0.5f), 1);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glViewport(0, 0, m_renderWidth, m_renderHeight);
+
+    int slot = m_queryFrame % QUERY_COUNT;
+    m_queryScales[slot] = m_scale;
+    glBeginQuery(GL_TIME_ELAPSED, m_queries[slot]);
+    ++m_queryFrame;
+    FrameStats::Current().glCalls += 3;
+}
+
+/***********************************************************
+ *  Present()
+ *
+ *  This method draws one full screen triangle into the
+ *  output framebuffer that upscales and sharpens the drawn
+ *  part of the offscreen image, then stops timing the
+ *  frame. Clamping the texture coordinates to the drawn
+ *  part keeps stale texels of larger frames out of the
+ *  filter.
+ ***********************************************************/
+void DynamicResolution::Present() {
+    if (!IsEnabled()) {
+        return;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_outputFramebuffer);
+    glViewport(0, 0, m_outputWidth, m_outputHeight);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glUseProgram(m_pUpscaleShader->m_programID);
+    m_sourceRegion.Set(glm::vec4(
+        (float)m_renderWidth / m_outputWidth, (float)m_renderHeight / m_outputHeight,
+        1.0f / m_outputWidth, 1.0f / m_outputHeight));
+    m_sharpness.Set(MAX_SHARPNESS * (MAX_SCALE - m_scale) / (MAX_SCALE - MIN_SCALE));
+    glBindVertexArray(m_emptyVertexArray);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+    glEndQuery(GL_TIME_ELAPSED);
+    FrameStats::Current().glCalls += 7;
+    ++FrameStats::Current().drawCalls;
+    ++FrameStats::Current().drawCommands;
+}
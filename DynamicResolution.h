@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// dynamicresolution.h
+// ============
+// Offscreen scene rendering at a resolution scaled to hold a GPU frame
+// time budget, upscaled and sharpened into the output framebuffer
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ShaderManager.h"
+#include "ShaderUniforms.h"
+#include <GL/glew.h>
+
+/***********************************************************
+ *  DynamicResolution
+ *
+ *  The scene is drawn into the lower left part of an
+ *  offscreen color + depth framebuffer the size of the
+ *  output, so changing the render scale never reallocates
+ *  anything. The GPU time of every frame is measured with
+ *  a GL_TIME_ELAPSED query read back several frames later
+ *  (the CPU never waits for it). A smoothed frame time over
+ *  the budget lowers the scale at once; one well under the
+ *  budget raises it again, slowly, so the scale does not
+ *  oscillate. Present() upscales the rendered part with
+ *  bilinear filtering and a sharpen filter whose strength
+ *  grows as the scale drops. Without a budget the scene is
+ *  drawn straight into the output framebuffer.
+ ***********************************************************/
+class DynamicResolution
+{
+public:
+    // texture unit of the upscale pass source image, after the
+    // material table unit
+    enum TEXTURE_UNIT
+    {
+        UPSCALE_SOURCE_UNIT = 5
+    };
+
+    // constructor
+    DynamicResolution();
+    // destructor
+    ~DynamicResolution();
+
+    // GPU frame time in milliseconds to stay within, 0 to always
+    // render at the output resolution
+    void SetFrameBudget(double milliseconds);
+    bool IsEnabled() const { return m_frameBudget > 0.0; }
+
+    // start a frame for a width x height output framebuffer: binds
+    // the framebuffer the scene is drawn into and sets its viewport
+    void BeginFrame(GLuint outputFramebuffer, int width, int height);
+    // upscale the frame into the output framebuffer; changes the
+    // program, vertex array, depth test and blending state, so
+    // state caches must be invalidated afterwards
+    void Present();
+
+    // fraction of the output width and height the scene is drawn at
+    float GetScale() const { return m_scale; }
+    int GetRenderWidth() const { return m_renderWidth; }
+    int GetRenderHeight() const { return m_renderHeight; }
+
+private:
+    // frames a timer query result is waited for before it is read
+    static const int QUERY_COUNT = 4;
+
+    double m_frameBudget;
+    float m_scale;
+    // smoothed GPU frame time in milliseconds, negative until measured
+    double m_gpuTime;
+    // frame times measured at the current scale
+    int m_frameSamples;
+
+    // offscreen framebuffer with its color texture and depth renderbuffer
+    GLuint m_framebuffer;
+    GLuint m_colorTexture;
+    GLuint m_depthRenderbuffer;
+    GLuint m_outputFramebuffer;
+    int m_outputWidth;
+    int m_outputHeight;
+    int m_renderWidth;
+    int m_renderHeight;
+
+    // upscale and sharpen program
+    ShaderManager* m_pUpscaleShader;
+    GLuint m_emptyVertexArray;
+    Uniform<int> m_sourceImage;
+    Uniform<glm::vec4> m_sourceRegion;
+    Uniform<float> m_sharpness;
+
+    // ring of frame timer queries
+    GLuint m_queries[QUERY_COUNT];
+    // render scale of the frame each query timed
+    float m_queryScales[QUERY_COUNT];
+    // timer queries issued so far
+    int m_queryFrame;
+
+    // create the upscale program and the offscreen framebuffer
+    void CreateResources();
+    void DeleteResources();
+    // size the offscreen framebuffer for a new output size
+    void ResizeFramebuffer(int width, int height);
+    // read the oldest finished timer query into the smoothed frame time
+    void ReadFrameTime();
+    // choose the render scale for the next frame
+    void AdjustScale();
+};
@@ -0,0 +1,443 @@
+///////////////////////////////////////////////////////////////////////////////
+// framecapture.cpp
+// ============
+// Frame capture to image files through asynchronous pixel pack buffer
+// readback, with the encoding done on worker threads
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameCapture.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <utility>
+
+namespace {
+    // images waiting for the encoders before capturing waits
+    const size_t MAX_QUEUED_IMAGES = 8;
+    // most encoder threads
+    const unsigned int MAX_ENCODERS = 2;
+    // nanoseconds a fence wait blocks before it is retried
+    const GLuint64 FENCE_TIMEOUT = 1000000000;
+    // largest block of an uncompressed deflate stream
+    const size_t MAX_STORED_BLOCK = 65535;
+
+    // CRC-32 (as used by PNG) of a memory block, continuing crc
+    uint32_t Crc32(uint32_t crc, const unsigned char* data, size_t size) {
+        struct CRC_TABLE
+        {
+            uint32_t entries[256];
+            CRC_TABLE() {
+                for (uint32_t n = 0; n < 256; ++n) {
+                    uint32_t c = n;
+                    for (int k = 0; k < 8; ++k) {
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    }
+                    entries[n] = c;
+                }
+            }
+        };
+        static const CRC_TABLE table;
+        crc = ~crc;
+        for (size_t i = 0; i < size; ++i) {
+            crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    // Adler-32 checksum of a memory block (the zlib stream checksum)
+    uint32_t Adler32(const unsigned char* data, size_t size) {
+        uint32_t a = 1;
+        uint32_t b = 0;
+        while (size > 0) {
+            // the sums cannot overflow within this many bytes
+            size_t count = std::min<size_t>(size, 5552);
+            for (size_t i = 0; i < count; ++i) {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            data += count;
+            size -= count;
+        }
+        return (b << 16) | a;
+    }
+
+    void AppendBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+        out.push_back((unsigned char)(value >> 24));
+        out.push_back((unsigned char)(value >> 16));
+        out.push_back((unsigned char)(value >> 8));
+        out.push_back((unsigned char)value);
+    }
+
+    void AppendChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size) {
+        AppendBigEndian(out, (uint32_t)size);
+        size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data, data + size);
+        AppendBigEndian(out, Crc32(0, out.data() + start, out.size() - start));
+    }
+
+    // RGB rows top to bottom from RGBA rows bottom to top, each row
+    // preceded by a PNG filter type byte unless filterBytes is false
+    void FlipToRGB(const unsigned char* pixels, int width, int height, bool filterBytes,
+        std::vector<unsigned char>& rows) {
+        size_t rowSize = (size_t)width * 3 + (filterBytes ? 1 : 0);
+        rows.resize(rowSize * height);
+        for (int y = 0; y < height; ++y) {
+            const unsigned char* source = pixels + (size_t)(height - 1 - y) * width * 4;
+            unsigned char* target = rows.data() + rowSize * y;
+            if (filterBytes) {
+                *target++ = 0;
+            }
+            for (int x = 0; x < width; ++x) {
+                target[0] = source[0];
+                target[1] = source[1];
+                target[2] = source[2];
+                target += 3;
+                source += 4;
+            }
+        }
+    }
+
+    /***********************************************************
+     *  EncodePNG()
+     *
+     *  This function encodes an 8-bit RGB PNG whose image data
+     *  is a zlib stream of uncompressed deflate blocks: larger
+     *  files, but encoding is only a copy and two checksums, so
+     *  the encoders keep up with the frame rate.
+     ***********************************************************/
+    void EncodePNG(const std::vector<unsigned char>& rows, int width, int height, std::vector<unsigned char>& png) {
+        std::vector<unsigned char> stream;
+        size_t blockCount = std::max<size_t>((rows.size() + MAX_STORED_BLOCK - 1) / MAX_STORED_BLOCK, 1);
+        stream.reserve(rows.size() + blockCount * 5 + 6);
+        stream.push_back(0x78);
+        stream.push_back(0x01);
+        size_t offset = 0;
+        do {
+            size_t size = std::min(rows.size() - offset, MAX_STORED_BLOCK);
+            bool last = (offset + size == rows.size());
+            stream.push_back(last ? 1 : 0);
+            stream.push_back((unsigned char)size);
+            stream.push_back((unsigned char)(size >> 8));
+            stream.push_back((unsigned char)~size);
+            stream.push_back((unsigned char)(~size >> 8));
+            stream.insert(stream.end(), rows.begin() + offset, rows.begin() + offset + size);
+            offset += size;
+        } while (offset < rows.size());
+        AppendBigEndian(stream, Adler32(rows.data(), rows.size()));
+
+        static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        png.assign(SIGNATURE, SIGNATURE + 8);
+        std::vector<unsigned char> header;
+        AppendBigEndian(header, (uint32_t)width);
+        AppendBigEndian(header, (uint32_t)height);
+        // 8 bits per channel, RGB, deflate, no filtering method, no interlacing
+        const unsigned char format[5] = { 8, 2, 0, 0, 0 };
+        header.insert(header.end(), format, format + 5);
+        AppendChunk(png, "IHDR", header.data(), header.size());
+        AppendChunk(png, "IDAT", stream.data(), stream.size());
+        AppendChunk(png, "IEND", NULL, 0);
+    }
+}
+
+/***********************************************************
+ *  FrameCapture()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FrameCapture::FrameCapture() {
+    m_capturing = false;
+    m_format = CAPTURE_PNG;
+    for (int i = 0; i < RING_SIZE; ++i) {
+        m_slots[i].buffer = 0;
+        m_slots[i].capacity = 0;
+        m_slots[i].fence = NULL;
+        m_slots[i].width = 0;
+        m_slots[i].height = 0;
+        m_slots[i].frameNumber = 0;
+    }
+    m_nextSlot = 0;
+    m_frameNumber = 0;
+    m_readbackWaits = 0;
+    m_encoderWaits = 0;
+    m_writeErrors = 0;
+    m_stopping = false;
+}
+
+/***********************************************************
+ *  ~FrameCapture()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FrameCapture::~FrameCapture() {
+    Finish();
+}
+
+/***********************************************************
+ *  Start()
+ *
+ *  This method starts the encoder threads and turns frame
+ *  capture on.
+ ***********************************************************/
+void FrameCapture::Start(const char* filePrefix, CAPTURE_FORMAT format) {
+    Finish();
+    m_filePrefix = filePrefix;
+    m_format = format;
+    m_frameNumber = 0;
+    m_readbackWaits = 0;
+    m_encoderWaits = 0;
+    m_writeErrors = 0;
+    m_stopping = false;
+    unsigned int encoders = std::max(1u, std::min(std::thread::hardware_concurrency() / 2, MAX_ENCODERS));
+    for (unsigned int i = 0; i < encoders; ++i) {
+        m_workers.push_back(std::thread([this]() { EncodeImages(); }));
+    }
+    m_capturing = true;
+}
+
+/***********************************************************
+ *  CaptureFrame()
+ *
+ *  This method first hands every readback that has finished
+ *  to the encoders, oldest first, without waiting. Then it
+ *  queues the readback of the current frame into the next
+ *  slot, which only has to be waited for when the GPU is a
+ *  whole ring behind.
+ ***********************************************************/
+void FrameCapture::CaptureFrame(GLuint framebuffer, int width, int height) {
+    if (!m_capturing || width <= 0 || height <= 0) {
+        return;
+    }
+    PROFILE_CPU_SCOPE("CaptureFrame");
+    for (int i = 0; i < RING_SIZE; ++i) {
+        int slot = (m_nextSlot + i) % RING_SIZE;
+        if (m_slots[slot].fence != NULL && !CollectSlot(slot, false)) {
+            break;
+        }
+    }
+    READBACK_SLOT& slot = m_slots[m_nextSlot];
+    if (slot.fence != NULL) {
+        ++m_readbackWaits;
+        CollectSlot(m_nextSlot, true);
+    }
+
+    size_t size = (size_t)width * height * 4;
+    if (slot.buffer == 0) {
+        GLCOUNT(glGenBuffers(1, &slot.buffer));
+    }
+    GLCOUNT(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer));
+    if (size > slot.capacity) {
+        GLCOUNT(glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ));
+        slot.capacity = size;
+    }
+    GLCOUNT(glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer));
+    // with a pack buffer bound the pixels go into the buffer, and the
+    // call returns without waiting for the frame to be rendered
+    GLCOUNT(glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0));
+    GLCOUNT(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++FrameStats::Current().glCalls;
+    slot.width = width;
+    slot.height = height;
+    slot.frameNumber = m_frameNumber++;
+    m_nextSlot = (m_nextSlot + 1) % RING_SIZE;
+}
+
+/***********************************************************
+ *  CollectSlot()
+ *
+ *  This method copies the pixels of a finished readback
+ *  into memory the encoders own and queues them, waiting
+ *  while the encoder queue is full.
+ ***********************************************************/
+bool FrameCapture::CollectSlot(int slotIndex, bool wait) {
+    READBACK_SLOT& slot = m_slots[slotIndex];
+    GLenum result = glClientWaitSync(slot.fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        if (!wait) {
+            return false;
+        }
+        PROFILE_CPU_SCOPE("WaitForReadback");
+        do {
+            result = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    glDeleteSync(slot.fence);
+    slot.fence = NULL;
+    if (result == GL_WAIT_FAILED) {
+        std::cout << "ERROR: waiting for the readback of captured frame " << slot.frameNumber << " failed" << std::endl;
+        return true;
+    }
+
+    size_t size = (size_t)slot.width * slot.height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)size, GL_MAP_READ_BIT);
+    if (data != NULL) {
+        QueueImage((const unsigned char*)data, slot.width, slot.height, slot.frameNumber);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    FrameStats::Current().glCalls += (data != NULL) ? 6 : 5;
+    if (data == NULL) {
+        std::cout << "ERROR: could not map the readback of captured frame " << slot.frameNumber << std::endl;
+    }
+    return true;
+}
+
+/***********************************************************
+ *  CapturePixels()
+ *
+ *  This method queues a frame that was rendered into CPU
+ *  memory; there is nothing to read back, so only a full
+ *  encoder queue can make it wait.
+ ***********************************************************/
+void FrameCapture::CapturePixels(const unsigned char* pixels, int width, int height) {
+    if (!m_capturing || width <= 0 || height <= 0) {
+        return;
+    }
+    PROFILE_CPU_SCOPE("CaptureFrame");
+    QueueImage(pixels, width, height, m_frameNumber++);
+}
+
+/***********************************************************
+ *  QueueImage()
+ *
+ *  This method copies an image into pixel storage left
+ *  over from an earlier image, if there is any, and queues
+ *  it for the encoders, waiting while the queue is full.
+ ***********************************************************/
+void FrameCapture::QueueImage(const unsigned char* pixels, int width, int height, unsigned int frameNumber) {
+    CAPTURED_IMAGE image;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_freePixels.empty()) {
+            image.pixels.swap(m_freePixels.back());
+            m_freePixels.pop_back();
+        }
+    }
+    image.pixels.assign(pixels, pixels + (size_t)width * height * 4);
+    image.width = width;
+    image.height = height;
+    image.frameNumber = frameNumber;
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if (m_queue.size() >= MAX_QUEUED_IMAGES) {
+        PROFILE_CPU_SCOPE("WaitForEncoders");
+        ++m_encoderWaits;
+        m_imageTaken.wait(lock, [this]() { return m_queue.size() < MAX_QUEUED_IMAGES; });
+    }
+    m_queue.push_back(std::move(image));
+    m_imageQueued.notify_one();
+}
+
+/***********************************************************
+ *  Finish()
+ *
+ *  This method waits for the readbacks still in flight,
+ *  lets the encoders write every queued image and stops
+ *  them, then deletes the pixel pack buffers.
+ ***********************************************************/
+void FrameCapture::Finish() {
+    if (!m_capturing) {
+        return;
+    }
+    for (int i = 0; i < RING_SIZE; ++i) {
+        int slot = (m_nextSlot + i) % RING_SIZE;
+        if (m_slots[slot].fence != NULL) {
+            CollectSlot(slot, true);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_imageQueued.notify_all();
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        m_workers[i].join();
+    }
+    m_workers.clear();
+    m_freePixels.clear();
+    for (int i = 0; i < RING_SIZE; ++i) {
+        if (m_slots[i].buffer != 0) {
+            glDeleteBuffers(1, &m_slots[i].buffer);
+        }
+        m_slots[i].buffer = 0;
+        m_slots[i].capacity = 0;
+    }
+    m_capturing = false;
+
+    std::cout << "INFO: Captured " << (m_frameNumber - m_writeErrors) << " frames to " << m_filePrefix
+        << "*; waited for readbacks " << m_readbackWaits << " times, for the encoders "
+        << m_encoderWaits << " times" << std::endl;
+    if (m_writeErrors > 0) {
+        std::cout << "ERROR: " << m_writeErrors << " captured frames could not be written" << std::endl;
+    }
+}
+
+/***********************************************************
+ *  EncodeImages()
+ *
+ *  This method runs on each encoder thread, writing queued
+ *  images until capture stops and the queue is empty.
+ ***********************************************************/
+void FrameCapture::EncodeImages() {
+    for (;;) {
+        CAPTURED_IMAGE image;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_imageQueued.wait(lock, [this]() { return m_stopping || !m_queue.empty(); });
+            if (m_queue.empty()) {
+                return;
+            }
+            image = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+        m_imageTaken.notify_one();
+
+        bool written = WriteImage(image);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!written) {
+            ++m_writeErrors;
+        }
+        m_freePixels.push_back(std::move(image.pixels));
+    }
+}
+
+/***********************************************************
+ *  WriteImage()
+ *
+ *  This method writes a captured image as a PNG or raw RGB
+ *  file named after its frame number.
+ ***********************************************************/
+bool FrameCapture::WriteImage(const CAPTURED_IMAGE& image) const {
+    char number[16];
+    snprintf(number, sizeof(number), "%06u", image.frameNumber);
+    std::string path = m_filePrefix + number + ((m_format == CAPTURE_PNG) ? ".png" : ".raw");
+
+    std::vector<unsigned char> rows;
+    std::vector<unsigned char> png;
+    FlipToRGB(image.pixels.data(), image.width, image.height, m_format == CAPTURE_PNG, rows);
+    const std::vector<unsigned char>* data = &rows;
+    if (m_format == CAPTURE_PNG) {
+        EncodePNG(rows, image.width, image.height, png);
+        data = &png;
+    }
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(data->data(), 1, data->size(), file) == data->size();
+    ok = (fclose(file) == 0) && ok;
+    if (!ok) {
+        remove(path.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// framecapture.h
+// ============
+// Frame capture to image files through asynchronous pixel pack buffer
+// readback, with the encoding done on worker threads
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// file format of captured frames
+enum CAPTURE_FORMAT
+{
+    CAPTURE_PNG = 0,
+    CAPTURE_RAW         // 8-bit RGB, rows top to bottom, no header
+};
+
+/***********************************************************
+ *  FrameCapture
+ *
+ *  CaptureFrame() only queues a glReadPixels into the next
+ *  of a ring of pixel pack buffers and fences it, so the
+ *  CPU never waits for the frame to finish rendering. A
+ *  frame's pixels are copied out of its buffer once its
+ *  fence has passed, usually RING_SIZE frames later, and
+ *  handed to the encoder threads, which write the files.
+ *  The CPU only waits when the ring or the encoder queue
+ *  is full; those waits are counted and reported.
+ ***********************************************************/
+class FrameCapture
+{
+public:
+    // pixel pack buffers in flight
+    static const int RING_SIZE = 3;
+
+    // constructor
+    FrameCapture();
+    // destructor (writes all captured frames first)
+    ~FrameCapture();
+
+    // start capturing: frames are written to filePrefix followed by
+    // the frame number and the format's extension
+    void Start(const char* filePrefix, CAPTURE_FORMAT format);
+    bool IsCapturing() const { return m_capturing; }
+
+    // capture the color buffer of a framebuffer (0 for the window's
+    // back buffer); leaves the framebuffer bound for reading
+    void CaptureFrame(GLuint framebuffer, int width, int height);
+    // capture a frame rendered on the CPU: RGBA pixels, rows bottom
+    // to top, as read back from OpenGL; they are copied right away
+    void CapturePixels(const unsigned char* pixels, int width, int height);
+    // read back and write every captured frame, then report
+    void Finish();
+
+private:
+    struct READBACK_SLOT
+    {
+        GLuint buffer;
+        size_t capacity;
+        // signalled when the readback into the buffer is done;
+        // NULL while the slot holds no frame
+        GLsync fence;
+        int width;
+        int height;
+        unsigned int frameNumber;
+    };
+
+    struct CAPTURED_IMAGE
+    {
+        std::vector<unsigned char> pixels;   // RGBA, rows bottom to top
+        int width;
+        int height;
+        unsigned int frameNumber;
+    };
+
+    bool m_capturing;
+    std::string m_filePrefix;
+    CAPTURE_FORMAT m_format;
+    READBACK_SLOT m_slots[RING_SIZE];
+    // slot the next frame is read back into; the oldest in flight
+    int m_nextSlot;
+    unsigned int m_frameNumber;
+    // frames the CPU had to wait for a readback or the encoders
+    unsigned int m_readbackWaits;
+    unsigned int m_encoderWaits;
+    unsigned int m_writeErrors;
+
+    // encoder threads and the images waiting for them
+    std::vector<std::thread> m_workers;
+    std::deque<CAPTURED_IMAGE> m_queue;
+    // pixel storage of written images, reused for later frames
+    std::vector<std::vector<unsigned char> > m_freePixels;
+    std::mutex m_mutex;
+    std::condition_variable m_imageQueued;
+    std::condition_variable m_imageTaken;
+    bool m_stopping;
+
+    // copy a finished slot's pixels out and queue them for encoding;
+    // waits for the readback unless wait is false, and returns
+    // false when it did not finish yet
+    bool CollectSlot(int slot, bool wait);
+    // copy an image into memory the encoders own and queue it,
+    // waiting while the queue is full
+    void QueueImage(const unsigned char* pixels, int width, int height, unsigned int frameNumber);
+    // encoder thread loop
+    void EncodeImages();
+    // write one image file
+    bool WriteImage(const CAPTURED_IMAGE& image) const;
+};
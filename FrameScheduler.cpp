@@ -0,0 +1,214 @@
+///////////////////////////////////////////////////////////////////////////////
+// framescheduler.cpp
+// ============
+// Decides when the main loop draws a frame - continuously, or only when
+// something on screen changed (render on demand) - and paces the frames
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameScheduler.h"
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+namespace {
+    // on-demand frame rate cap until one is set
+    const double DEFAULT_MIN_FRAME_INTERVAL = 1.0 / 60.0;
+    // the last part of a frame wait that is spun rather than slept,
+    // covering the sleep overshoot of common OS schedulers
+    const double SPIN_TIME = 0.002;
+    // seconds between input latency reports
+    const double LATENCY_REPORT_INTERVAL = 5.0;
+    // most frames drawn between reading input and showing it
+    const int MAX_INPUT_LAG = 2;
+
+    bool g_onDemand = false;
+    // seconds between frame starts at the frame rate cap
+    double g_minFrameInterval = DEFAULT_MIN_FRAME_INTERVAL;
+    // the cap was set, so continuous mode is paced too
+    bool g_frameRateCapped = false;
+    // a redraw was requested since the last frame; true at startup
+    // so the first frame is always drawn
+    bool g_redrawRequested = true;
+    // the last input processing asked to keep drawing
+    bool g_continuous = false;
+    double g_lastFrameStart = -1.0;
+
+    // time of the oldest input not read by a drawn frame yet, and of
+    // the oldest input read by each frame in flight, newest first;
+    // negative if none
+    double g_pendingInputTime = -1.0;
+    double g_frameInputTimes[MAX_INPUT_LAG + 1] = { -1.0, -1.0, -1.0 };
+    // frames drawn after the one that read an input before it shows
+    int g_inputLag = 0;
+    // input to present latencies since the last report
+    double g_latencyTotal = 0.0;
+    double g_latencyMax = 0.0;
+    unsigned int g_latencyCount = 0;
+    double g_lastLatencyReport = 0.0;
+
+    // seconds left before the frame rate cap allows the next frame
+    double TimeUntilNextFrame() {
+        if (g_lastFrameStart < 0.0) {
+            return 0.0;
+        }
+        return g_lastFrameStart + g_minFrameInterval - glfwGetTime();
+    }
+
+    // block until a time, sleeping for all but the last SPIN_TIME
+    void WaitUntil(double time) {
+        for (;;) {
+            double remaining = time - glfwGetTime();
+            if (remaining <= 0.0) {
+                return;
+            }
+            if (remaining > SPIN_TIME) {
+                std::this_thread::sleep_for(std::chrono::duration<double>(remaining - SPIN_TIME));
+            }
+            else {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    // add a frame's input latency and report the statistics
+    // every LATENCY_REPORT_INTERVAL seconds
+    void RecordLatency(double presentTime) {
+        double& inputTime = g_frameInputTimes[g_inputLag];
+        if (inputTime >= 0.0) {
+            double latency = presentTime - inputTime;
+            g_latencyTotal += latency;
+            g_latencyMax = std::max(g_latencyMax, latency);
+            ++g_latencyCount;
+            inputTime = -1.0;
+        }
+        if (g_latencyCount > 0 && presentTime - g_lastLatencyReport >= LATENCY_REPORT_INTERVAL) {
+            std::cout << "INFO: input to present latency mean " << g_latencyTotal / g_latencyCount * 1000.0
+                << " ms, max " << g_latencyMax * 1000.0 << " ms over " << g_latencyCount << " frames" << std::endl;
+            g_latencyTotal = 0.0;
+            g_latencyMax = 0.0;
+            g_latencyCount = 0;
+            g_lastLatencyReport = presentTime;
+        }
+    }
+}
+
+void FrameScheduler::SetOnDemand(bool onDemand) {
+    g_onDemand = onDemand;
+}
+
+bool FrameScheduler::IsOnDemand() {
+    return g_onDemand;
+}
+
+void FrameScheduler::SetMaxFrameRate(double framesPerSecond) {
+    g_minFrameInterval = (framesPerSecond > 0.0) ? 1.0 / framesPerSecond : 0.0;
+    g_frameRateCapped = (framesPerSecond > 0.0);
+}
+
+/***********************************************************
+ *  SetSwapInterval()
+ *
+ *  This function sets the swap interval of the current
+ *  context. Adaptive vsync needs the swap control tear
+ *  extension; without it vsync stays fully on.
+ ***********************************************************/
+void FrameScheduler::SetSwapInterval(int interval) {
+    if (interval < 0 && !glfwExtensionSupported("WGL_EXT_swap_control_tear") &&
+        !glfwExtensionSupported("GLX_EXT_swap_control_tear")) {
+        std::cout << "INFO: adaptive vsync is not supported, using a swap interval of 1" << std::endl;
+        interval = 1;
+    }
+    glfwSwapInterval(interval);
+}
+
+void FrameScheduler::RequestRedraw() {
+    g_redrawRequested = true;
+}
+
+void FrameScheduler::RequestContinuousRedraw() {
+    g_redrawRequested = true;
+    g_continuous = true;
+}
+
+void FrameScheduler::SetInputLag(int frames) {
+    g_inputLag = std::min(std::max(frames, 0), MAX_INPUT_LAG);
+}
+
+void FrameScheduler::MarkInput() {
+    if (g_pendingInputTime < 0.0) {
+        g_pendingInputTime = glfwGetTime();
+    }
+}
+
+/***********************************************************
+ *  WaitForEvents()
+ *
+ *  This function polls the window events in continuous
+ *  mode, after waiting for the frame rate cap if one is
+ *  set. In on-demand mode it blocks until an event arrives,
+ *  or - while a redraw is pending - only until the frame
+ *  rate cap allows the next frame.
+ ***********************************************************/
+void FrameScheduler::WaitForEvents() {
+    if (!g_onDemand) {
+        if (g_frameRateCapped && g_lastFrameStart >= 0.0) {
+            WaitUntil(g_lastFrameStart + g_minFrameInterval);
+        }
+        glfwPollEvents();
+        return;
+    }
+
+    if (g_redrawRequested || g_continuous) {
+        double wait = TimeUntilNextFrame();
+        if (wait > SPIN_TIME) {
+            glfwWaitEventsTimeout(wait - SPIN_TIME);
+        }
+        else {
+            glfwPollEvents();
+        }
+    }
+    else {
+        glfwWaitEvents();
+    }
+    // input processing renews this while the change goes on
+    g_continuous = false;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This function returns true when a frame should be drawn:
+ *  always in continuous mode, otherwise when a redraw is
+ *  pending and the frame rate cap allows it, spinning out
+ *  the last moments before the allowed start. The pending
+ *  request and input are taken here, so redraws requested
+ *  while the frame is being drawn lead to another frame.
+ ***********************************************************/
+bool FrameScheduler::BeginFrame() {
+    if (g_onDemand) {
+        if (!g_redrawRequested) {
+            return false;
+        }
+        double wait = TimeUntilNextFrame();
+        if (wait > SPIN_TIME) {
+            return false;
+        }
+        if (wait > 0.0) {
+            WaitUntil(g_lastFrameStart + g_minFrameInterval);
+        }
+        g_redrawRequested = false;
+    }
+    g_lastFrameStart = glfwGetTime();
+    for (int i = MAX_INPUT_LAG; i > 0; --i) {
+        g_frameInputTimes[i] = g_frameInputTimes[i - 1];
+    }
+    g_frameInputTimes[0] = g_pendingInputTime;
+    g_pendingInputTime = -1.0;
+    return true;
+}
+
+void FrameScheduler::EndFrame() {
+    RecordLatency(glfwGetTime());
+}
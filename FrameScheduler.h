@@ -0,0 +1,62 @@
+///////////////////////////////////////////////////////////////////////////////
+// framescheduler.h
+// ============
+// Decides when the main loop draws a frame - continuously, or only when
+// something on screen changed (render on demand) - and paces the frames
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/***********************************************************
+ *  FrameScheduler
+ *
+ *  In continuous mode every loop iteration draws a frame.
+ *  In on-demand mode the main loop sleeps in glfwWaitEvents
+ *  until input, a window event or a scene edit requests a
+ *  redraw. Changes that keep going without further events
+ *  (a held movement key) request a continuous redraw, which
+ *  keeps the loop running at up to the maximum frame rate
+ *  until the requests stop.
+ *
+ *  The frame rate cap applies to continuous mode too once
+ *  it is set. Frames are paced by their start times: the
+ *  wait for the next frame sleeps until shortly before its
+ *  start and spins for the rest, since sleeps can overshoot
+ *  by a scheduler tick. The wait comes before the window
+ *  events are polled, so the input a frame is drawn with is
+ *  read as late as possible. The time from the first input
+ *  that changes the view to the swap of the frame showing
+ *  it is measured and reported every few seconds.
+ ***********************************************************/
+namespace FrameScheduler
+{
+    // draw only when a redraw was requested (default: continuously)
+    void SetOnDemand(bool onDemand);
+    bool IsOnDemand();
+    // frame rate cap while redraws keep coming in, and in continuous
+    // mode once set (0 = no cap)
+    void SetMaxFrameRate(double framesPerSecond);
+    // vertical blanks to wait for per buffer swap: 0 disables vsync,
+    // -1 is adaptive vsync where supported (late frames tear instead
+    // of waiting); needs the window's OpenGL context to be current
+    void SetSwapInterval(int interval);
+
+    // something visible changed since the last frame
+    void RequestRedraw();
+    // something visible is changing and will still be changing
+    // at the next frame without any new event arriving
+    void RequestContinuousRedraw();
+    // input that changes the view arrived; the latency until the
+    // frame showing it is presented is measured
+    void MarkInput();
+    // frames drawn after the one that read an input before the input
+    // shows, e.g. 1 when draw lists are built a frame ahead (max 2)
+    void SetInputLag(int frames);
+
+    // process window events, sleeping until there is work in on-demand mode
+    void WaitForEvents();
+    // true when the loop should draw a frame now
+    bool BeginFrame();
+    // the frame has been drawn and its buffers swapped
+    void EndFrame();
+}
@@ -0,0 +1,61 @@
+///////////////////////////////////////////////////////////////////////////////
+// framestats.cpp
+// ============
+// Per-frame counters for the OpenGL work issued by the application
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameStats.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+    FRAME_STATS g_CurrentFrame = {};
+    FRAME_STATS g_LastFrame = {};
+    FRAME_STATS g_LastPrinted = {};
+}
+
+FRAME_STATS& FrameStats::Current() {
+    return g_CurrentFrame;
+}
+
+const FRAME_STATS& FrameStats::Last() {
+    return g_LastFrame;
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This function keeps the counters of the finished frame
+ *  and resets the counters for the next one.
+ ***********************************************************/
+void FrameStats::EndFrame() {
+    g_LastFrame = g_CurrentFrame;
+    memset(&g_CurrentFrame, 0, sizeof(g_CurrentFrame));
+}
+
+/***********************************************************
+ *  PrintOnChange()
+ *
+ *  This function prints the last frame's counters, but only
+ *  when they differ from the previously printed values, so
+ *  a static scene reports once.
+ ***********************************************************/
+void FrameStats::PrintOnChange() {
+    if (memcmp(&g_LastFrame, &g_LastPrinted, sizeof(g_LastFrame)) == 0) {
+        return;
+    }
+    g_LastPrinted = g_LastFrame;
+
+    std::cout << "INFO: GL calls per frame: " << g_LastFrame.glCalls
+        << " (uniforms: " << g_LastFrame.uniformCalls
+        << ", buffer uploads: " << g_LastFrame.bufferUploads
+        << ", mesh draws: " << g_LastFrame.drawCalls
+        << ", draw commands: " << g_LastFrame.drawCommands
+        << ", state changes: " << g_LastFrame.stateChanges
+        << ", avoided: " << g_LastFrame.stateChangesAvoided
+        << ", visible objects: " << g_LastFrame.objectsVisible
+        << ", culled: " << g_LastFrame.objectsCulled
+        << ", occluded: " << g_LastFrame.objectsOccluded
+        << ", visible point lights: " << g_LastFrame.lightsVisible
+        << ", cluster light entries: " << g_LastFrame.clusterLightEntries << ")" << std::endl;
+}
@@ -0,0 +1,58 @@
+///////////////////////////////////////////////////////////////////////////////
+// framestats.h
+// ============
+// Per-frame counters for the OpenGL work issued by the application
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/***********************************************************
+ *  FRAME_STATS
+ *
+ *  Counters gathered while a frame is being built. Draw
+ *  calls issued inside ShapeMeshes are counted as one call
+ *  per Draw*Mesh() request.
+ ***********************************************************/
+struct FRAME_STATS
+{
+    // every OpenGL call issued by the application code
+    unsigned int glCalls;
+    // glUniform* calls
+    unsigned int uniformCalls;
+    // uniform buffer uploads
+    unsigned int bufferUploads;
+    // mesh draw requests
+    unsigned int drawCalls;
+    // draws issued by those requests (a multi-draw issues several)
+    unsigned int drawCommands;
+    // state changes issued through the state cache
+    unsigned int stateChanges;
+    // redundant state changes filtered out by the state cache
+    unsigned int stateChangesAvoided;
+    // scene objects inside and outside the view frustum
+    unsigned int objectsVisible;
+    unsigned int objectsCulled;
+    // scene objects inside the view frustum but hidden behind others
+    unsigned int objectsOccluded;
+    // point lights touching the view frustum, and the light index
+    // entries of the light clusters they were assigned to
+    unsigned int lightsVisible;
+    unsigned int clusterLightEntries;
+};
+
+namespace FrameStats
+{
+    // counters for the frame currently being built
+    FRAME_STATS& Current();
+    // counters of the last completed frame
+    const FRAME_STATS& Last();
+    // finish the current frame and start a new one
+    void EndFrame();
+    // print the last frame's counters when they have changed
+    void PrintOnChange();
+}
+
+// issue an OpenGL call and count it in the frame statistics
+#define GLCOUNT(call) do { call; ++FrameStats::Current().glCalls; } while (0)
+// issue a mesh draw request and count it in the frame statistics
+#define GLDRAW(call) do { call; ++FrameStats::Current().glCalls; ++FrameStats::Current().drawCalls; } while (0)
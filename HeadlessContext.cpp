@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////////
+// headlesscontext.cpp
+// ============
+// Window-less OpenGL context rendering into an offscreen framebuffer
+///////////////////////////////////////////////////////////////////////////////
+
+#include "HeadlessContext.h"
+#include <iostream>
+
+#if defined(__linux__)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+namespace {
+#if defined(__linux__)
+    // core profile versions to try, newest first
+    const int CONTEXT_VERSIONS[][2] = { { 4, 6 }, { 4, 5 }, { 4, 3 }, { 3, 3 } };
+#endif
+}
+
+HeadlessContext::HeadlessContext() {
+    m_display = NULL;
+    m_context = NULL;
+    m_framebuffer = 0;
+    m_renderbuffers[0] = 0;
+    m_renderbuffers[1] = 0;
+}
+
+HeadlessContext::~HeadlessContext() {
+    Destroy();
+}
+
+/***********************************************************
+ *  Create()
+ *
+ *  This method opens the surfaceless Mesa EGL platform (or
+ *  the default display when that extension is missing),
+ *  creates the newest core profile context it supports,
+ *  initializes GLEW for it and sets up the framebuffer.
+ ***********************************************************/
+bool HeadlessContext::Create(int width, int height) {
+#if defined(__linux__)
+    EGLDisplay display = EGL_NO_DISPLAY;
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != NULL) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        std::cout << "ERROR: could not initialize an EGL display" << std::endl;
+        return false;
+    }
+    eglBindAPI(EGL_OPENGL_API);
+
+    EGLContext context = EGL_NO_CONTEXT;
+    for (size_t i = 0; i < sizeof(CONTEXT_VERSIONS) / sizeof(CONTEXT_VERSIONS[0]) && context == EGL_NO_CONTEXT; ++i) {
+        const EGLint attributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, CONTEXT_VERSIONS[i][0],
+            EGL_CONTEXT_MINOR_VERSION, CONTEXT_VERSIONS[i][1],
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+    }
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        std::cout << "ERROR: could not create a surfaceless OpenGL context" << std::endl;
+        eglTerminate(display);
+        return false;
+    }
+    m_display = display;
+    m_context = context;
+
+    // there is no window system context for glewInit() to look at
+    glewExperimental = GL_TRUE;
+    if (glewContextInit() != GLEW_OK) {
+        std::cout << "ERROR: could not initialize GLEW for the headless context" << std::endl;
+        Destroy();
+        return false;
+    }
+    std::cout << "INFO: Headless OpenGL " << glGetString(GL_VERSION)
+        << " on " << glGetString(GL_RENDERER) << std::endl;
+
+    glGenFramebuffers(1, &m_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+    glGenRenderbuffers(2, m_renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_renderbuffers[0]);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_renderbuffers[1]);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cout << "ERROR: offscreen framebuffer is incomplete" << std::endl;
+        Destroy();
+        return false;
+    }
+    glViewport(0, 0, width, height);
+    return true;
+#else
+    (void)width;
+    (void)height;
+    std::cout << "ERROR: headless rendering needs EGL, which is not available on this platform" << std::endl;
+    return false;
+#endif
+}
+
+void HeadlessContext::Destroy() {
+#if defined(__linux__)
+    if (m_context == NULL) {
+        return;
+    }
+    if (m_framebuffer != 0) {
+        glDeleteFramebuffers(1, &m_framebuffer);
+        glDeleteRenderbuffers(2, m_renderbuffers);
+        m_framebuffer = 0;
+    }
+    eglMakeCurrent((EGLDisplay)m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext((EGLDisplay)m_display, (EGLContext)m_context);
+    eglTerminate((EGLDisplay)m_display);
+    m_context = NULL;
+    m_display = NULL;
+#endif
+}
@@ -0,0 +1,43 @@
+///////////////////////////////////////////////////////////////////////////////
+// headlesscontext.h
+// ============
+// Window-less OpenGL context rendering into an offscreen framebuffer
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+/***********************************************************
+ *  HeadlessContext
+ *
+ *  This class creates an OpenGL core profile context on a
+ *  surfaceless EGL display (Mesa llvmpipe works without a
+ *  GPU or display server) and an offscreen color + depth
+ *  framebuffer to render into. Only available where EGL is,
+ *  which in practice means Linux.
+ ***********************************************************/
+class HeadlessContext
+{
+public:
+    // constructor
+    HeadlessContext();
+    // destructor
+    ~HeadlessContext();
+
+    // create the context and a width x height framebuffer and make
+    // them current; returns false if no context could be created
+    bool Create(int width, int height);
+    // release the framebuffer and the context
+    void Destroy();
+
+    GLuint GetFramebuffer() const { return m_framebuffer; }
+
+private:
+    // EGL handles, kept opaque so users need no EGL headers
+    void* m_display;
+    void* m_context;
+    GLuint m_framebuffer;
+    // color and depth renderbuffers
+    GLuint m_renderbuffers[2];
+};
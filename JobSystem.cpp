@@ -0,0 +1,187 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.cpp
+// ============
+// Work-stealing job scheduler used to spread the CPU side of a frame
+// across all cores
+///////////////////////////////////////////////////////////////////////////////
+
+#include "JobSystem.h"
+#include <iostream>
+
+namespace {
+    // job system and queue owned by the current worker thread
+    thread_local const JobSystem* t_pOwner = NULL;
+    thread_local unsigned int t_queueIndex = 0;
+}
+
+JobSystem::JobSystem(int workerCount) {
+    if (workerCount < 0) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        workerCount = (cores > 1) ? (int)cores - 1 : 1;
+    }
+    m_queuedJobs = 0;
+    m_quit = false;
+
+    for (int i = 0; i <= workerCount; ++i) {
+        m_queues.push_back(std::unique_ptr<JOB_QUEUE>(new JOB_QUEUE()));
+    }
+    for (int i = 0; i < workerCount; ++i) {
+        m_workers.push_back(std::thread(&JobSystem::WorkerLoop, this, (unsigned int)i + 1));
+    }
+    std::cout << "INFO: Job system started with " << workerCount << " worker threads" << std::endl;
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_quit = true;
+    }
+    m_wakeUp.notify_all();
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        m_workers[i].join();
+    }
+}
+
+/***********************************************************
+ *  Run()
+ *
+ *  This method pushes a job onto the calling thread's queue
+ *  and wakes up one sleeping worker to pick it up.
+ ***********************************************************/
+void JobSystem::Run(JOB_FUNCTION job, JobCounter* counter) {
+    if (counter != NULL) {
+        counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    JOB_QUEUE& queue = *m_queues[GetQueueIndex()];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        JOB entry;
+        entry.function = std::move(job);
+        entry.counter = counter;
+        queue.jobs.push_back(std::move(entry));
+    }
+    {
+        // taken so a worker cannot miss the wake-up between
+        // checking the job count and going to sleep
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        ++m_queuedJobs;
+    }
+    m_wakeUp.notify_one();
+}
+
+/***********************************************************
+ *  Wait()
+ *
+ *  This method keeps the calling thread busy with queued
+ *  jobs until the counter drops to zero.
+ ***********************************************************/
+void JobSystem::Wait(const JobCounter& counter) {
+    unsigned int queueIndex = GetQueueIndex();
+    while (!counter.IsDone()) {
+        if (!RunOneJob(queueIndex)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/***********************************************************
+ *  ParallelFor()
+ *
+ *  This method queues one job per range and helps running
+ *  them. Loops too small to split run on the calling thread.
+ ***********************************************************/
+void JobSystem::ParallelFor(size_t count, size_t grainSize, const RANGE_FUNCTION& body) {
+    if (count == 0) {
+        return;
+    }
+    if (grainSize == 0) {
+        grainSize = 1;
+    }
+    // no more ranges than threads that can run them
+    size_t threads = m_workers.size() + 1;
+    size_t ranges = (count + grainSize - 1) / grainSize;
+    if (ranges > threads) {
+        ranges = threads;
+    }
+    if (ranges <= 1) {
+        body(0, count);
+        return;
+    }
+
+    JobCounter counter;
+    size_t rangeSize = (count + ranges - 1) / ranges;
+    // the calling thread takes the first range itself
+    for (size_t begin = rangeSize; begin < count; begin += rangeSize) {
+        size_t end = (begin + rangeSize < count) ? begin + rangeSize : count;
+        Run([&body, begin, end]() { body(begin, end); }, &counter);
+    }
+    body(0, rangeSize);
+    Wait(counter);
+}
+
+unsigned int JobSystem::GetQueueIndex() const {
+    return (t_pOwner == this) ? t_queueIndex : 0;
+}
+
+bool JobSystem::PopJob(unsigned int queueIndex, JOB& job) {
+    JOB_QUEUE& queue = *m_queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.jobs.empty()) {
+        return false;
+    }
+    job = std::move(queue.jobs.back());
+    queue.jobs.pop_back();
+    return true;
+}
+
+bool JobSystem::StealJob(unsigned int thiefIndex, JOB& job) {
+    size_t queueCount = m_queues.size();
+    for (size_t i = 1; i < queueCount; ++i) {
+        JOB_QUEUE& queue = *m_queues[(thiefIndex + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty()) {
+            job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool JobSystem::RunOneJob(unsigned int queueIndex) {
+    JOB job;
+    if (!PopJob(queueIndex, job) && !StealJob(queueIndex, job)) {
+        return false;
+    }
+    --m_queuedJobs;
+    Execute(job);
+    return true;
+}
+
+void JobSystem::Execute(JOB& job) {
+    job.function();
+    if (job.counter != NULL) {
+        job.counter->pending.fetch_sub(1, std::memory_order_release);
+    }
+}
+
+/***********************************************************
+ *  WorkerLoop()
+ *
+ *  This method runs jobs on a worker thread, sleeping while
+ *  no job is queued anywhere.
+ ***********************************************************/
+void JobSystem::WorkerLoop(unsigned int queueIndex) {
+    t_pOwner = this;
+    t_queueIndex = queueIndex;
+    for (;;) {
+        if (RunOneJob(queueIndex)) {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_wakeUp.wait(lock, [this]() { return m_quit || m_queuedJobs > 0; });
+        if (m_quit) {
+            return;
+        }
+    }
+}
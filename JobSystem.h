@@ -0,0 +1,101 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.h
+// ============
+// Work-stealing job scheduler used to spread the CPU side of a frame
+// across all cores
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  JobCounter
+ *
+ *  Number of unfinished jobs in a group. A job decrements
+ *  its counter when it completes, so waiting on a counter
+ *  waits for the whole group.
+ ***********************************************************/
+struct JobCounter
+{
+    std::atomic<int> pending;
+
+    JobCounter() : pending(0) {}
+    bool IsDone() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+/***********************************************************
+ *  JobSystem
+ *
+ *  This class runs jobs on a pool of worker threads. Every
+ *  thread owns a job queue: it pushes and pops jobs at the
+ *  back of its own queue and, when that is empty, steals the
+ *  oldest job from the front of another thread's queue.
+ *  Threads that are not workers (the main/GL thread) share
+ *  queue 0. A thread waiting for a counter runs queued jobs
+ *  instead of blocking, so jobs may wait on other jobs.
+ ***********************************************************/
+class JobSystem
+{
+public:
+    typedef std::function<void()> JOB_FUNCTION;
+    // body of a parallel loop, called for the range [begin, end)
+    typedef std::function<void(size_t begin, size_t end)> RANGE_FUNCTION;
+
+    // constructor (negative workers = one per core besides the calling
+    // thread; with 0 the calling thread runs every job while it waits)
+    explicit JobSystem(int workerCount = -1);
+    // destructor (waits for the workers to finish their current job)
+    ~JobSystem();
+
+    // queue a job; counter may be NULL for fire-and-forget jobs
+    void Run(JOB_FUNCTION job, JobCounter* counter);
+    // run jobs until every job counted by counter has finished
+    void Wait(const JobCounter& counter);
+    // split [0, count) into ranges of at least grainSize elements,
+    // run them in parallel and return when all are done
+    void ParallelFor(size_t count, size_t grainSize, const RANGE_FUNCTION& body);
+
+    unsigned int GetWorkerCount() const { return (unsigned int)m_workers.size(); }
+
+private:
+    struct JOB
+    {
+        JOB_FUNCTION function;
+        JobCounter* counter;
+    };
+
+    struct JOB_QUEUE
+    {
+        std::mutex mutex;
+        std::deque<JOB> jobs;
+    };
+
+    // queue 0 is shared by non-worker threads, queue i + 1 belongs to worker i
+    std::vector<std::unique_ptr<JOB_QUEUE>> m_queues;
+    std::vector<std::thread> m_workers;
+    // number of queued jobs over all queues, used to put idle workers to sleep
+    std::atomic<int> m_queuedJobs;
+    std::atomic<bool> m_quit;
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wakeUp;
+
+    // index of the queue owned by the calling thread
+    unsigned int GetQueueIndex() const;
+    // take the newest job of a thread's own queue
+    bool PopJob(unsigned int queueIndex, JOB& job);
+    // take the oldest job of any other queue
+    bool StealJob(unsigned int thiefIndex, JOB& job);
+    // run one queued job if there is any
+    bool RunOneJob(unsigned int queueIndex);
+    void Execute(JOB& job);
+    void WorkerLoop(unsigned int queueIndex);
+};
@@ -0,0 +1,341 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.cpp
+// ============
+// Clustered forward lighting - the view frustum is split into a grid of
+// clusters and every cluster gets the list of point lights reaching it,
+// so a pixel only shades the lights that can affect it
+///////////////////////////////////////////////////////////////////////////////
+
+#include "LightClusters.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // smallest near plane distance the depth slices are spaced from;
+    // orthographic projections may put the near plane at or behind 0
+    const float MIN_NEAR_PLANE = 0.01f;
+    // buffer textures are never created empty
+    const size_t MIN_BUFFER_SIZE = 16;
+    // smallest number of lights handed to one job
+    const size_t LIGHT_GRAIN_SIZE = 256;
+
+    int Clamp(int value, int minimum, int maximum) {
+        return std::min(std::max(value, minimum), maximum);
+    }
+
+    // depth slice holding a view depth
+    int GetSlice(float depth, const glm::vec4& slicing) {
+        return Clamp((int)floorf(logf(depth) * slicing.x + slicing.y), 0, LightClusters::GRID_Z - 1);
+    }
+
+    // view space point at a depth that projects to an NDC x/y position
+    glm::vec3 GetViewPoint(const glm::mat4& projection, float ndcX, float ndcY, float depth) {
+        float z = -depth;
+        float w = projection[2][3] * z + projection[3][3];
+        float x = (ndcX * w - projection[2][0] * z - projection[3][0]) / projection[0][0];
+        float y = (ndcY * w - projection[2][1] * z - projection[3][1]) / projection[1][1];
+        return glm::vec3(x, y, z);
+    }
+
+    // true when a sphere touches an axis-aligned box
+    bool SphereTouchesBox(const glm::vec3& center, float radius, const glm::vec3& minimum, const glm::vec3& maximum) {
+        glm::vec3 offset = center - glm::clamp(center, minimum, maximum);
+        return glm::dot(offset, offset) <= radius * radius;
+    }
+}
+
+/***********************************************************
+ *  LightClusters()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+LightClusters::LightClusters() {
+    m_uploadEnabled = true;
+    m_lightData.buffer = m_lightData.texture = 0;
+    m_clusterRanges.buffer = m_clusterRanges.texture = 0;
+    m_lightIndices.buffer = m_lightIndices.texture = 0;
+    m_clusterMinimum.resize(CLUSTER_COUNT);
+    m_clusterMaximum.resize(CLUSTER_COUNT);
+    m_clusterLights.resize(CLUSTER_COUNT);
+}
+
+/***********************************************************
+ *  ~LightClusters()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+LightClusters::~LightClusters() {
+    LIGHT_BUFFER* buffers[3] = { &m_lightData, &m_clusterRanges, &m_lightIndices };
+    for (int i = 0; i < 3; ++i) {
+        if (buffers[i]->buffer != 0) {
+            glDeleteTextures(1, &buffers[i]->texture);
+            glDeleteBuffers(1, &buffers[i]->buffer);
+            buffers[i]->buffer = buffers[i]->texture = 0;
+        }
+    }
+}
+
+/***********************************************************
+ *  GetDepthSlicing()
+ *
+ *  This function returns the scale and bias that turn the
+ *  log of a view depth into its depth slice, for the near
+ *  and far planes of a perspective or orthographic
+ *  projection. Slice k starts at near * (far / near)^(k / Z).
+ ***********************************************************/
+glm::vec4 LightClusters::GetDepthSlicing(const glm::mat4& projection) {
+    float nearPlane;
+    float farPlane;
+    if (projection[2][3] != 0.0f) {
+        // perspective: clip w is -z
+        nearPlane = projection[3][2] / (projection[2][2] - 1.0f);
+        farPlane = projection[3][2] / (projection[2][2] + 1.0f);
+    }
+    else {
+        nearPlane = (projection[3][2] + 1.0f) / projection[2][2];
+        farPlane = (projection[3][2] - 1.0f) / projection[2][2];
+    }
+    nearPlane = std::max(nearPlane, MIN_NEAR_PLANE);
+    farPlane = std::max(farPlane, nearPlane * 2.0f);
+
+    float scale = GRID_Z / logf(farPlane / nearPlane);
+    return glm::vec4(scale, -logf(nearPlane) * scale, nearPlane, farPlane);
+}
+
+/***********************************************************
+ *  SetLights()
+ *
+ *  This method keeps the scene point lights and, unless
+ *  uploading is off, uploads them as two texels each:
+ *  position and radius, then color and intensity. Lights
+ *  are kept in world space, so they are only uploaded
+ *  again when the scene changes.
+ ***********************************************************/
+void LightClusters::SetLights(const std::vector<SCENE_POINT_LIGHT>& lights) {
+    m_lights = lights;
+    if (!m_uploadEnabled) {
+        return;
+    }
+    if (m_lightData.buffer == 0) {
+        CreateBuffers();
+    }
+
+    std::vector<glm::vec4> texels(m_lights.size() * 2);
+    for (size_t i = 0; i < m_lights.size(); ++i) {
+        texels[i * 2] = glm::vec4(m_lights[i].position, m_lights[i].radius);
+        texels[i * 2 + 1] = glm::vec4(m_lights[i].color, m_lights[i].intensity);
+    }
+    UploadBuffer(m_lightData, texels.data(), texels.size() * sizeof(glm::vec4));
+}
+
+/***********************************************************
+ *  Assign()
+ *
+ *  This method builds the light lists of every cluster for
+ *  a view. Each light's view space bounding box gives the
+ *  range of tiles and slices it may touch; the clusters in
+ *  that range are then tested against the light's sphere.
+ *  Every job fills the clusters of its own depth slices, so
+ *  the jobs never write to the same list.
+ ***********************************************************/
+void LightClusters::Assign(const glm::mat4& view, const glm::mat4& projection,
+    JobSystem* pJobSystem, LIGHT_CLUSTER_LIST& list) {
+    PROFILE_CPU_SCOPE("AssignLights");
+    glm::vec4 slicing = GetDepthSlicing(projection);
+    BuildClusterBounds(projection, slicing, pJobSystem);
+
+    // cluster range of every light, empty for lights outside the frustum
+    m_lightRanges.resize(m_lights.size());
+    m_viewPositions.resize(m_lights.size());
+    pJobSystem->ParallelFor(m_lights.size(), LIGHT_GRAIN_SIZE,
+        [this, &view, &projection, &slicing](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            LIGHT_RANGE& range = m_lightRanges[i];
+            range.minimum[0] = range.minimum[1] = range.minimum[2] = 0;
+            range.maximum[0] = range.maximum[1] = range.maximum[2] = -1;
+
+            glm::vec3 center = glm::vec3(view * glm::vec4(m_lights[i].position, 1.0f));
+            float radius = m_lights[i].radius;
+            float depth = -center.z;
+            m_viewPositions[i] = center;
+            if (depth + radius < slicing.z || depth - radius > slicing.w) {
+                continue;
+            }
+
+            // screen rectangle of the box around the sphere; corners in
+            // front of the near plane are moved onto it, which only
+            // widens the rectangle
+            glm::vec2 ndcMinimum(1e30f);
+            glm::vec2 ndcMaximum(-1e30f);
+            for (int corner = 0; corner < 8; ++corner) {
+                glm::vec4 point(
+                    center.x + ((corner & 1) ? radius : -radius),
+                    center.y + ((corner & 2) ? radius : -radius),
+                    -std::max(depth + ((corner & 4) ? radius : -radius), slicing.z),
+                    1.0f);
+                glm::vec4 clip = projection * point;
+                glm::vec2 ndc = glm::vec2(clip) / clip.w;
+                ndcMinimum = glm::min(ndcMinimum, ndc);
+                ndcMaximum = glm::max(ndcMaximum, ndc);
+            }
+            if (ndcMaximum.x < -1.0f || ndcMinimum.x > 1.0f || ndcMaximum.y < -1.0f || ndcMinimum.y > 1.0f) {
+                continue;
+            }
+
+            range.minimum[0] = Clamp((int)floorf((ndcMinimum.x * 0.5f + 0.5f) * GRID_X), 0, GRID_X - 1);
+            range.maximum[0] = Clamp((int)floorf((ndcMaximum.x * 0.5f + 0.5f) * GRID_X), 0, GRID_X - 1);
+            range.minimum[1] = Clamp((int)floorf((ndcMinimum.y * 0.5f + 0.5f) * GRID_Y), 0, GRID_Y - 1);
+            range.maximum[1] = Clamp((int)floorf((ndcMaximum.y * 0.5f + 0.5f) * GRID_Y), 0, GRID_Y - 1);
+            range.minimum[2] = GetSlice(std::max(depth - radius, slicing.z), slicing);
+            range.maximum[2] = GetSlice(std::min(depth + radius, slicing.w), slicing);
+        }
+    });
+
+    // the light lists of each slice's clusters
+    pJobSystem->ParallelFor(GRID_Z, 1, [this](size_t begin, size_t end) {
+        for (int slice = (int)begin; slice < (int)end; ++slice) {
+            int first = slice * GRID_X * GRID_Y;
+            for (int c = first; c < first + GRID_X * GRID_Y; ++c) {
+                m_clusterLights[c].clear();
+            }
+            for (size_t i = 0; i < m_lights.size(); ++i) {
+                const LIGHT_RANGE& range = m_lightRanges[i];
+                if (slice < range.minimum[2] || slice > range.maximum[2]) {
+                    continue;
+                }
+                for (int y = range.minimum[1]; y <= range.maximum[1]; ++y) {
+                    for (int x = range.minimum[0]; x <= range.maximum[0]; ++x) {
+                        int cluster = first + y * GRID_X + x;
+                        if (SphereTouchesBox(m_viewPositions[i], m_lights[i].radius,
+                            m_clusterMinimum[cluster], m_clusterMaximum[cluster])) {
+                            m_clusterLights[cluster].push_back((GLuint)i);
+                        }
+                    }
+                }
+            }
+        }
+    });
+
+    // pack the lists one after another
+    list.clusters.resize(CLUSTER_COUNT);
+    GLuint offset = 0;
+    for (int c = 0; c < CLUSTER_COUNT; ++c) {
+        list.clusters[c] = glm::uvec2(offset, (GLuint)m_clusterLights[c].size());
+        offset += (GLuint)m_clusterLights[c].size();
+    }
+    list.lightIndices.resize(offset);
+    pJobSystem->ParallelFor(CLUSTER_COUNT, GRID_X * GRID_Y, [this, &list](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; ++c) {
+            std::copy(m_clusterLights[c].begin(), m_clusterLights[c].end(),
+                list.lightIndices.begin() + list.clusters[c].x);
+        }
+    });
+
+    list.lightsVisible = 0;
+    for (size_t i = 0; i < m_lightRanges.size(); ++i) {
+        if (m_lightRanges[i].maximum[2] >= 0) {
+            ++list.lightsVisible;
+        }
+    }
+}
+
+/***********************************************************
+ *  Upload()
+ *
+ *  This method uploads the cluster ranges and light indices
+ *  of a view. The buffer textures stay bound to their
+ *  texture units.
+ ***********************************************************/
+void LightClusters::Upload(const LIGHT_CLUSTER_LIST& list) {
+    if (m_lightData.buffer == 0) {
+        CreateBuffers();
+    }
+    UploadBuffer(m_clusterRanges, list.clusters.data(), list.clusters.size() * sizeof(glm::uvec2));
+    UploadBuffer(m_lightIndices, list.lightIndices.data(), list.lightIndices.size() * sizeof(GLuint));
+    FrameStats::Current().lightsVisible += list.lightsVisible;
+    FrameStats::Current().clusterLightEntries += (unsigned int)list.lightIndices.size();
+}
+
+/***********************************************************
+ *  BuildClusterBounds()
+ *
+ *  This method computes the view space bounding box of
+ *  every cluster from the corners of its screen tile at the
+ *  near and far depth of its slice.
+ ***********************************************************/
+void LightClusters::BuildClusterBounds(const glm::mat4& projection, const glm::vec4& slicing, JobSystem* pJobSystem) {
+    pJobSystem->ParallelFor(GRID_Z, 1, [this, &projection, &slicing](size_t begin, size_t end) {
+        for (int slice = (int)begin; slice < (int)end; ++slice) {
+            float depths[2] = {
+                expf((slice - slicing.y) / slicing.x),
+                expf((slice + 1 - slicing.y) / slicing.x) };
+            for (int y = 0; y < GRID_Y; ++y) {
+                for (int x = 0; x < GRID_X; ++x) {
+                    glm::vec3 minimum(1e30f);
+                    glm::vec3 maximum(-1e30f);
+                    for (int corner = 0; corner < 8; ++corner) {
+                        float ndcX = (x + (corner & 1)) * (2.0f / GRID_X) - 1.0f;
+                        float ndcY = (y + ((corner >> 1) & 1)) * (2.0f / GRID_Y) - 1.0f;
+                        glm::vec3 point = GetViewPoint(projection, ndcX, ndcY, depths[corner >> 2]);
+                        minimum = glm::min(minimum, point);
+                        maximum = glm::max(maximum, point);
+                    }
+                    int cluster = (slice * GRID_Y + y) * GRID_X + x;
+                    m_clusterMinimum[cluster] = minimum;
+                    m_clusterMaximum[cluster] = maximum;
+                }
+            }
+        }
+    });
+}
+
+/***********************************************************
+ *  CreateBuffers()
+ *
+ *  This method creates the three buffer textures and binds
+ *  them to their texture units for good; no other code
+ *  uses those units. Texture unit 0 is left active.
+ ***********************************************************/
+void LightClusters::CreateBuffers() {
+    struct BUFFER_SETUP
+    {
+        LIGHT_BUFFER* target;
+        GLenum format;
+        int unit;
+    };
+    const BUFFER_SETUP setups[3] = {
+        { &m_lightData, GL_RGBA32F, LIGHT_DATA_UNIT },
+        { &m_clusterRanges, GL_RG32UI, CLUSTER_LIGHTS_UNIT },
+        { &m_lightIndices, GL_R32UI, LIGHT_INDICES_UNIT } };
+
+    for (int i = 0; i < 3; ++i) {
+        LIGHT_BUFFER& target = *setups[i].target;
+        glGenBuffers(1, &target.buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, target.buffer);
+        glBufferData(GL_TEXTURE_BUFFER, MIN_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+        glGenTextures(1, &target.texture);
+        glActiveTexture(GL_TEXTURE0 + setups[i].unit);
+        glBindTexture(GL_TEXTURE_BUFFER, target.texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, setups[i].format, target.buffer);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+/***********************************************************
+ *  UploadBuffer()
+ *
+ *  This method orphans the storage of a buffer texture and
+ *  writes the new contents, so the upload never waits for
+ *  draws still reading the previous contents.
+ ***********************************************************/
+void LightClusters::UploadBuffer(const LIGHT_BUFFER& target, const void* data, size_t size) {
+    glBindBuffer(GL_TEXTURE_BUFFER, target.buffer);
+    glBufferData(GL_TEXTURE_BUFFER, std::max(size, MIN_BUFFER_SIZE), NULL, GL_STREAM_DRAW);
+    if (size > 0) {
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, size, data);
+    }
+    FrameStats::Current().glCalls += (size > 0) ? 3 : 2;
+    ++FrameStats::Current().bufferUploads;
+}
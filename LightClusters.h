@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+// lightclusters.h
+// ============
+// Clustered forward lighting - the view frustum is split into a grid of
+// clusters and every cluster gets the list of point lights reaching it,
+// so a pixel only shades the lights that can affect it
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SceneLoader.h"
+#include "JobSystem.h"
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  LIGHT_CLUSTER_LIST
+ *
+ *  Light assignment of one view, built on the CPU and
+ *  uploaded with the draw list it belongs to.
+ ***********************************************************/
+struct LIGHT_CLUSTER_LIST
+{
+    // first entry in lightIndices and light count of each cluster
+    std::vector<glm::uvec2> clusters;
+    // point light indices of all clusters, one cluster after another
+    std::vector<GLuint> lightIndices;
+    // point lights that touch the view frustum
+    unsigned int lightsVisible;
+
+    LIGHT_CLUSTER_LIST() : lightsVisible(0) {}
+};
+
+/***********************************************************
+ *  LightClusters
+ *
+ *  The frustum is divided into GRID_X x GRID_Y screen tiles
+ *  and GRID_Z depth slices. The slices are spaced
+ *  exponentially between the near and far planes, so
+ *  clusters stay roughly cube shaped at every distance.
+ *  Assign() tests the lights against the clusters on the
+ *  job system, one depth slice per job. The light data,
+ *  cluster ranges and light indices reach the fragment
+ *  shader as buffer textures.
+ ***********************************************************/
+class LightClusters
+{
+public:
+    static const int GRID_X = 16;
+    static const int GRID_Y = 9;
+    static const int GRID_Z = 24;
+    static const int CLUSTER_COUNT = GRID_X * GRID_Y * GRID_Z;
+
+    // texture units of the lightData, clusterLights and
+    // lightIndices buffer textures
+    enum TEXTURE_UNIT
+    {
+        LIGHT_DATA_UNIT = 1,
+        CLUSTER_LIGHTS_UNIT,
+        LIGHT_INDICES_UNIT
+    };
+
+    // constructor
+    LightClusters();
+    // destructor
+    ~LightClusters();
+
+    // replace the point lights and upload their data; no
+    // assignment may be running
+    void SetLights(const std::vector<SCENE_POINT_LIGHT>& lights);
+    // keep the lights on the CPU only, without creating or filling
+    // the buffer textures (for software rasterization)
+    void SetUploadEnabled(bool enabled) { m_uploadEnabled = enabled; }
+    // assign the point lights to the clusters of a view (no
+    // OpenGL calls, one assignment at a time)
+    void Assign(const glm::mat4& view, const glm::mat4& projection,
+        JobSystem* pJobSystem, LIGHT_CLUSTER_LIST& list);
+    // upload the cluster ranges and light indices of a view
+    void Upload(const LIGHT_CLUSTER_LIST& list);
+
+    size_t GetLightCount() const { return m_lights.size(); }
+
+    // depth slice of view depth d is log(d) * x + y; z and w hold
+    // the near and far plane distances of the projection
+    static glm::vec4 GetDepthSlicing(const glm::mat4& projection);
+
+private:
+    // buffer texture holding the data of one kind
+    struct LIGHT_BUFFER
+    {
+        GLuint buffer;
+        GLuint texture;
+    };
+
+    // clusters a light may touch, from its bounding box
+    struct LIGHT_RANGE
+    {
+        int minimum[3];
+        int maximum[3];
+    };
+
+    // scene point lights
+    std::vector<SCENE_POINT_LIGHT> m_lights;
+    // false when the light data is not uploaded to OpenGL
+    bool m_uploadEnabled;
+    // per-view scratch data of Assign()
+    std::vector<LIGHT_RANGE> m_lightRanges;
+    std::vector<glm::vec3> m_viewPositions;
+    std::vector<glm::vec3> m_clusterMinimum;
+    std::vector<glm::vec3> m_clusterMaximum;
+    std::vector<std::vector<GLuint>> m_clusterLights;
+
+    LIGHT_BUFFER m_lightData;
+    LIGHT_BUFFER m_clusterRanges;
+    LIGHT_BUFFER m_lightIndices;
+
+    // create the buffer textures and bind them to their units
+    void CreateBuffers();
+    // replace the contents of a buffer texture
+    void UploadBuffer(const LIGHT_BUFFER& target, const void* data, size_t size);
+    // view space bounds of every cluster
+    void BuildClusterBounds(const glm::mat4& projection, const glm::vec4& slicing, JobSystem* pJobSystem);
+};
@@ -11,8 +11,17 @@
 
 #include "SceneManager.h"
 #include "ViewManager.h"
-#include "ShapeMeshes.h"
 #include "ShaderManager.h"
+#include "ShaderUniforms.h"
+#include "FrameStats.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Benchmark.h"
+#include "FrameScheduler.h"
+#include "ProgramCache.h"
+#include "DynamicResolution.h"
+#include "FrameCapture.h"
+#include <cstring>
 
 // Namespace for declaring global variables
 namespace
@@ -27,8 +36,57 @@ namespace
 	SceneManager* g_SceneManager = nullptr;
 	// shader manager object for dynamic interaction with the shader code
 	ShaderManager* g_ShaderManager = nullptr;
+	// resolved uniform handles and per-frame uniform buffer
+	ShaderUniforms* g_ShaderUniforms = nullptr;
+	// worker threads for the per-frame CPU work
+	JobSystem* g_JobSystem = nullptr;
 	// view manager object for managing the 3D view setup and projection to 2D
 	ViewManager* g_ViewManager = nullptr;
+	// scales the scene's render resolution to hold the frame budget
+	DynamicResolution* g_DynamicResolution = nullptr;
+	// writes the drawn frames to image files when capturing
+	FrameCapture* g_FrameCapture = nullptr;
+
+	// default GPU frame time budget in milliseconds (60 fps)
+	const double DEFAULT_FRAME_BUDGET = 1000.0 / 60.0;
+
+	// read the whole number following the option at index; false
+	// when it is missing, not a number or below the minimum
+	bool ReadInteger(int argc, char* argv[], int& index, long minimum, long& value)
+	{
+		if (index + 1 >= argc)
+		{
+			return false;
+		}
+		const char* text = argv[index + 1];
+		char* end = NULL;
+		value = strtol(text, &end, 10);
+		if (end == text || *end != '\0' || value < minimum)
+		{
+			return false;
+		}
+		++index;
+		return true;
+	}
+
+	// read the decimal number following the option at index; false
+	// when it is missing, not a number or below the minimum
+	bool ReadDecimal(int argc, char* argv[], int& index, double minimum, double& value)
+	{
+		if (index + 1 >= argc)
+		{
+			return false;
+		}
+		const char* text = argv[index + 1];
+		char* end = NULL;
+		value = strtod(text, &end);
+		if (end == text || *end != '\0' || !(value >= minimum))
+		{
+			return false;
+		}
+		++index;
+		return true;
+	}
 }
 
 // Function declarations - all functions that are called manually
@@ -45,6 +103,113 @@ bool InitializeGLEW();
  ***********************************************************/
 int main(int argc, char* argv[])
 {
+	// --profile records CPU/GPU timings and writes them out on exit
+	// --on-demand only draws frames when something changed
+	// --max-fps <n> caps the frame rate (of --on-demand while interacting)
+	// --swap-interval <n> waits for n vertical blanks per frame (0 turns
+	//   vsync off, -1 is adaptive vsync)
+	// --no-late-latch builds each frame's draw list a frame ahead, which
+	//   overlaps CPU and GPU work but draws a frame older camera
+	// --no-occlusion only culls objects outside the view frustum
+	// --frame-budget <ms> GPU frame time the render resolution is
+	//   scaled to hold (0 always renders at the window resolution)
+	// --multi-view starts with the camera shown next to the top,
+	//   front and side views (M key)
+	// --capture <prefix> writes every drawn frame to <prefix>NNNNNN.png
+	// --capture-raw writes the captured frames as raw RGB instead
+	bool occlusionCulling = true;
+	double frameBudget = DEFAULT_FRAME_BUDGET;
+	bool swapIntervalSet = false;
+	int swapInterval = 1;
+	bool lateLatching = true;
+	bool multiView = false;
+	const char* capturePrefix = NULL;
+	CAPTURE_FORMAT captureFormat = CAPTURE_PNG;
+	bool optionsValid = true;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* option = argv[i];
+		bool valid = true;
+		if (strcmp(option, "--profile") == 0)
+		{
+			Profiler::SetEnabled(true);
+		}
+		else if (strcmp(option, "--on-demand") == 0)
+		{
+			FrameScheduler::SetOnDemand(true);
+		}
+		else if (strcmp(option, "--max-fps") == 0)
+		{
+			double maxFrameRate = 0.0;
+			valid = ReadDecimal(argc, argv, i, 0.0, maxFrameRate);
+			if (valid)
+			{
+				FrameScheduler::SetMaxFrameRate(maxFrameRate);
+			}
+		}
+		else if (strcmp(option, "--no-occlusion") == 0)
+		{
+			occlusionCulling = false;
+		}
+		else if (strcmp(option, "--frame-budget") == 0)
+		{
+			valid = ReadDecimal(argc, argv, i, 0.0, frameBudget);
+		}
+		else if (strcmp(option, "--swap-interval") == 0)
+		{
+			// -1 is adaptive vsync
+			long interval = 0;
+			valid = ReadInteger(argc, argv, i, -1, interval);
+			if (valid)
+			{
+				swapIntervalSet = true;
+				swapInterval = (int)interval;
+			}
+		}
+		else if (strcmp(option, "--no-late-latch") == 0)
+		{
+			lateLatching = false;
+		}
+		else if (strcmp(option, "--multi-view") == 0)
+		{
+			multiView = true;
+		}
+		else if (strcmp(option, "--capture") == 0)
+		{
+			valid = i + 1 < argc;
+			if (valid)
+			{
+				capturePrefix = argv[++i];
+			}
+		}
+		else if (strcmp(option, "--capture-raw") == 0)
+		{
+			captureFormat = CAPTURE_RAW;
+		}
+		if (!valid)
+		{
+			std::cout << "ERROR: missing or invalid value for " << option << std::endl;
+			optionsValid = false;
+		}
+	}
+	// never run with another setup than the one asked for
+	if (!optionsValid)
+	{
+		return(EXIT_FAILURE);
+	}
+
+	// --benchmark renders a scripted run headless and exits
+	BENCHMARK_OPTIONS benchmarkOptions;
+	BENCHMARK_MODE benchmarkMode = ParseBenchmarkOptions(argc, argv, benchmarkOptions);
+	if (benchmarkMode == BENCHMARK_INVALID)
+	{
+		return(EXIT_FAILURE);
+	}
+	if (benchmarkMode == BENCHMARK_ON)
+	{
+		return RunBenchmark(benchmarkOptions);
+	}
+
 	// if GLFW fails initialization, then terminate the application
 	if (InitializeGLFW() == false)
 	{
@@ -66,42 +231,147 @@ int main(int argc, char* argv[])
 		return(EXIT_FAILURE);
 	}
 
-	// load the shader code from the external GLSL files
-	g_ShaderManager->LoadShaders(
-		"../../Utilities/shaders/vertexShader.glsl",
-		"../../Utilities/shaders/fragmentShader.glsl");
+	// otherwise the driver's default swap interval is kept
+	if (swapIntervalSet)
+	{
+		FrameScheduler::SetSwapInterval(swapInterval);
+	}
+
+	// load the shader program, compiling the external GLSL files
+	// only when no up to date program binary is cached
+	ProgramCache::LoadShaders(
+		g_ShaderManager,
+		"Shaders/vertexShader.glsl",
+		"Shaders/fragmentShader.glsl");
 	g_ShaderManager->use();
 
+	// resolve the uniform locations once, now that the program is linked
+	g_ShaderUniforms = new ShaderUniforms();
+	g_ShaderUniforms->Resolve(g_ShaderManager->m_programID);
+	g_ViewManager->SetShaderUniforms(g_ShaderUniforms);
+	g_ViewManager->SetMultiView(multiView);
+
 	// try to create a new scene manager object and prepare the 3D scene
+	g_JobSystem = new JobSystem();
 	g_SceneManager = new SceneManager(g_ShaderManager);
+	g_SceneManager->SetShaderUniforms(g_ShaderUniforms);
+	g_SceneManager->SetJobSystem(g_JobSystem);
+	g_SceneManager->SetOcclusionCulling(occlusionCulling);
+	g_SceneManager->SetLateLatching(lateLatching);
+	// input read for a draw list built a frame ahead shows a frame later
+	FrameScheduler::SetInputLag(lateLatching ? 0 : 1);
 	g_SceneManager->PrepareScene();
 
+	// the scene is drawn offscreen and upscaled to the window
+	g_DynamicResolution = new DynamicResolution();
+	g_DynamicResolution->SetFrameBudget(frameBudget);
+
+	// captured frames are read back asynchronously and encoded on
+	// worker threads, so capturing does not stall the frame
+	g_FrameCapture = new FrameCapture();
+	if (NULL != capturePrefix)
+	{
+		g_FrameCapture->Start(capturePrefix, captureFormat);
+	}
+
+	// Enable z-depth
+	glEnable(GL_DEPTH_TEST);
+
 	// loop will keep running until the application is closed 
 	// or until an error has occurred
 	while (!glfwWindowShouldClose(g_Window))
 	{
-		// Enable z-depth
-		glEnable(GL_DEPTH_TEST);
+		// a minimized window has nothing to draw into
+		int framebufferWidth = 0;
+		int framebufferHeight = 0;
+		g_ViewManager->GetFramebufferSize(framebufferWidth, framebufferHeight);
+		if (framebufferWidth == 0 || framebufferHeight == 0)
+		{
+			glfwWaitEvents();
+			continue;
+		}
+
+		// move the camera by the latest input, which may request a frame
+		g_ViewManager->ProcessInput();
+
+		// in render-on-demand mode frames are only drawn when the
+		// view or the scene changed
+		if (FrameScheduler::BeginFrame())
+		{
+			Profiler::BeginFrame();
+
+			// convert from 3D object space to 2D view
+			{
+				PROFILE_GPU_SCOPE("PrepareSceneView");
+				g_ViewManager->PrepareSceneView();
+			}
+
+			// draw into the (possibly scaled down) scene framebuffer
+			g_DynamicResolution->BeginFrame(0, framebufferWidth, framebufferHeight);
+			g_SceneManager->SetViewportSize(g_DynamicResolution->GetRenderWidth(),
+				g_DynamicResolution->GetRenderHeight());
+
+			// Clear the frame and z buffers
+			GLCOUNT(glClearColor(0.1f, 0.1f, 0.1f, 1.0f));
+			GLCOUNT(glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT));
 
-		// Clear the frame and z buffers
-		glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			// refresh the 3D scene
+			{
+				PROFILE_GPU_SCOPE("RenderScene");
+				g_SceneManager->RenderScene();
+			}
 
-		// convert from 3D object space to 2D view
-		g_ViewManager->PrepareSceneView();
+			// upscale the scene into the window
+			{
+				PROFILE_GPU_SCOPE("Upscale");
+				g_DynamicResolution->Present();
+				g_SceneManager->InvalidateState();
+			}
 
-		// refresh the 3D scene
-		g_SceneManager->RenderScene();
+			// queue the readback of the finished frame before the
+			// back buffer is swapped away
+			{
+				PROFILE_GPU_SCOPE("Capture");
+				g_FrameCapture->CaptureFrame(0, framebufferWidth, framebufferHeight);
+			}
 
+			// Flips the the back buffer with the front buffer every frame.
+			{
+				PROFILE_GPU_SCOPE("SwapBuffers");
+				glfwSwapBuffers(g_Window);
+			}
+			Profiler::EndFrame();
+			FrameScheduler::EndFrame();
 
-		// Flips the the back buffer with the front buffer every frame.
-		glfwSwapBuffers(g_Window);
+			// report the GL calls issued for the frame whenever they change
+			FrameStats::EndFrame();
+			FrameStats::PrintOnChange();
+		}
 
-		// query the latest GLFW events
-		glfwPollEvents();
+		// wait for the next frame's start under the frame rate cap, then
+		// query the latest GLFW events (waiting for them in
+		// render-on-demand mode), so the next frame latches fresh input
+		FrameScheduler::WaitForEvents();
 	}
 
-	// clear the allocated manager objects from memory
+	if (Profiler::IsEnabled())
+	{
+		Profiler::WriteChromeTrace("profile_trace.json");
+		Profiler::WriteFrameCSV("profile_frames.csv");
+	}
+
+	// clear the allocated manager objects from memory; the frame
+	// capture writes out the frames still in flight first
+	if (NULL != g_FrameCapture)
+	{
+		delete g_FrameCapture;
+		g_FrameCapture = NULL;
+	}
+	if (NULL != g_DynamicResolution)
+	{
+		delete g_DynamicResolution;
+		g_DynamicResolution = NULL;
+	}
 	if (NULL != g_SceneManager)
 	{
 		delete g_SceneManager;
@@ -112,6 +382,16 @@ int main(int argc, char* argv[])
 		delete g_ViewManager;
 		g_ViewManager = NULL;
 	}
+	if (NULL != g_JobSystem)
+	{
+		delete g_JobSystem;
+		g_JobSystem = NULL;
+	}
+	if (NULL != g_ShaderUniforms)
+	{
+		delete g_ShaderUniforms;
+		g_ShaderUniforms = NULL;
+	}
 	if (NULL != g_ShaderManager)
 	{
 		delete g_ShaderManager;
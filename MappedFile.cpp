@@ -0,0 +1,157 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.cpp
+// ============
+// Read-only memory mapping of a whole file, and replacing a file that
+// others may have mapped
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MappedFile.h"
+#include <cstdio>
+#include <string>
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/***********************************************************
+ *  MappedFile()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MappedFile::MappedFile() {
+    m_pData = NULL;
+    m_size = 0;
+#if defined(_WIN32)
+    m_fileHandle = INVALID_HANDLE_VALUE;
+    m_mappingHandle = NULL;
+#endif
+}
+
+/***********************************************************
+ *  ~MappedFile()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+MappedFile::~MappedFile() {
+    Close();
+}
+
+/***********************************************************
+ *  Open()
+ *
+ *  This method maps the whole file read-only. Empty files
+ *  cannot be mapped and are reported as failures.
+ ***********************************************************/
+bool MappedFile::Open(const char* filename) {
+    Close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0) {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (view == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_fileHandle = file;
+    m_mappingHandle = mapping;
+    m_pData = (const unsigned char*)view;
+    m_size = (size_t)size.QuadPart;
+#else
+    int file = open(filename, O_RDONLY);
+    if (file < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(file, &info) != 0 || info.st_size <= 0) {
+        close(file);
+        return false;
+    }
+    void* view = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+    // the mapping stays valid after the descriptor is closed
+    close(file);
+    if (view == MAP_FAILED) {
+        return false;
+    }
+    m_pData = (const unsigned char*)view;
+    m_size = (size_t)info.st_size;
+#endif
+    return true;
+}
+
+/***********************************************************
+ *  Close()
+ *
+ *  This method unmaps the file.
+ ***********************************************************/
+void MappedFile::Close() {
+    if (m_pData == NULL) {
+        return;
+    }
+#if defined(_WIN32)
+    UnmapViewOfFile(m_pData);
+    CloseHandle(m_mappingHandle);
+    CloseHandle(m_fileHandle);
+    m_fileHandle = INVALID_HANDLE_VALUE;
+    m_mappingHandle = NULL;
+#else
+    munmap((void*)m_pData, m_size);
+#endif
+    m_pData = NULL;
+    m_size = 0;
+}
+
+/***********************************************************
+ *  WriteFileAtomic()
+ *
+ *  This function writes the data to a temporary file next
+ *  to the target, named after the process so concurrent
+ *  writers do not share it, and renames it over the target
+ *  in one step. A reader therefore sees either the old or
+ *  the new file, never a truncated one, and a process that
+ *  has the old file mapped keeps its pages. On Windows the
+ *  rename fails while another process has the target open.
+ ***********************************************************/
+bool WriteFileAtomic(const char* filename, const void* data, size_t size) {
+#if defined(_WIN32)
+    unsigned long processID = (unsigned long)GetCurrentProcessId();
+#else
+    unsigned long processID = (unsigned long)getpid();
+#endif
+    std::string temporary = std::string(filename) + "." + std::to_string(processID) + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (file == NULL) {
+        return false;
+    }
+    bool ok = fwrite(data, 1, size, file) == size;
+    ok = (fclose(file) == 0) && ok;
+#if defined(_WIN32)
+    ok = ok && MoveFileExA(temporary.c_str(), filename, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+    ok = ok && rename(temporary.c_str(), filename) == 0;
+#endif
+    if (!ok) {
+        remove(temporary.c_str());
+    }
+    return ok;
+}
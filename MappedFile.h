@@ -0,0 +1,52 @@
+///////////////////////////////////////////////////////////////////////////////
+// mappedfile.h
+// ============
+// Read-only memory mapping of a whole file, and replacing a file that
+// others may have mapped
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+
+/***********************************************************
+ *  MappedFile
+ *
+ *  Maps a file into memory for reading, so its contents can
+ *  be handed to OpenGL without copying them into a buffer
+ *  first. The pages are read in by the OS on first access.
+ ***********************************************************/
+class MappedFile
+{
+public:
+    // constructor
+    MappedFile();
+    // destructor
+    ~MappedFile();
+
+    // map a file, closing any previously mapped one
+    bool Open(const char* filename);
+    // unmap the file
+    void Close();
+
+    bool IsOpen() const { return m_pData != NULL; }
+    const unsigned char* GetData() const { return m_pData; }
+    size_t GetSize() const { return m_size; }
+
+private:
+    const unsigned char* m_pData;
+    size_t m_size;
+#if defined(_WIN32)
+    void* m_fileHandle;
+    void* m_mappingHandle;
+#endif
+
+    // a mapping has exactly one owner
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+// write a file under a temporary name and rename it over filename, so
+// processes that have the old file open or mapped keep reading it whole;
+// nothing is left behind on failure
+bool WriteFileAtomic(const char* filename, const void* data, size_t size);
@@ -0,0 +1,70 @@
+///////////////////////////////////////////////////////////////////////////////
+// materialtable.cpp
+// ============
+// Scene materials in one GPU buffer texture, indexed by the material id
+// each instance carries, so draws never upload material values
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MaterialTable.h"
+#include "FrameStats.h"
+#include <algorithm>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  MaterialTable()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MaterialTable::MaterialTable() {
+    m_buffer = 0;
+    m_texture = 0;
+    m_materialCount = 0;
+}
+
+/***********************************************************
+ *  ~MaterialTable()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+MaterialTable::~MaterialTable() {
+    if (m_buffer != 0) {
+        glDeleteTextures(1, &m_texture);
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = m_texture = 0;
+    }
+}
+
+/***********************************************************
+ *  SetMaterials()
+ *
+ *  This method uploads two texels per material, creating
+ *  the buffer texture on first use and binding it to its
+ *  texture unit for good; no other code uses that unit.
+ *  Texture unit 0 is left active.
+ ***********************************************************/
+void MaterialTable::SetMaterials(const std::vector<SCENE_MATERIAL>& materials) {
+    // an empty table still gets one (unused) material
+    std::vector<glm::vec4> texels(std::max<size_t>(materials.size(), 1) * 2, glm::vec4(0.0f));
+    for (size_t i = 0; i < materials.size(); ++i) {
+        texels[i * 2] = materials[i].color;
+        texels[i * 2 + 1] = glm::vec4(materials[i].specularStrength, 0.0f, 0.0f, 0.0f);
+    }
+    m_materialCount = materials.size();
+
+    if (m_buffer == 0) {
+        glGenBuffers(1, &m_buffer);
+        glGenTextures(1, &m_texture);
+        glActiveTexture(GL_TEXTURE0 + MATERIAL_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, m_texture);
+        glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(glm::vec4), texels.data(), GL_STATIC_DRAW);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, m_buffer);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    else {
+        glBindBuffer(GL_TEXTURE_BUFFER, m_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, texels.size() * sizeof(glm::vec4), texels.data(), GL_STATIC_DRAW);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    ++FrameStats::Current().bufferUploads;
+}
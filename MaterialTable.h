@@ -0,0 +1,48 @@
+///////////////////////////////////////////////////////////////////////////////
+// materialtable.h
+// ============
+// Scene materials in one GPU buffer texture, indexed by the material id
+// each instance carries, so draws never upload material values
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SceneLoader.h"
+#include <GL/glew.h>
+#include <vector>
+
+/***********************************************************
+ *  MaterialTable
+ *
+ *  Every material of the loaded scene takes two RGBA32F
+ *  texels of the materialData buffer texture: its color,
+ *  then its specular strength (the other three channels
+ *  are free for future material values). The table is
+ *  written once per scene; the shaders read a material
+ *  with texelFetch at twice its id.
+ ***********************************************************/
+class MaterialTable
+{
+public:
+    // texture unit of the materialData buffer texture, after the
+    // light cluster units
+    enum TEXTURE_UNIT
+    {
+        MATERIAL_DATA_UNIT = 4
+    };
+
+    // constructor
+    MaterialTable();
+    // destructor
+    ~MaterialTable();
+
+    // replace the table with the scene's materials
+    void SetMaterials(const std::vector<SCENE_MATERIAL>& materials);
+
+    size_t GetMaterialCount() const { return m_materialCount; }
+
+private:
+    GLuint m_buffer;
+    GLuint m_texture;
+    size_t m_materialCount;
+};
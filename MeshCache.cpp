@@ -0,0 +1,189 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshcache.cpp
+// ============
+// Versioned binary file of generated meshes, memory mapped so the meshes
+// can be uploaded without being generated or parsed again
+///////////////////////////////////////////////////////////////////////////////
+
+#include "MeshCache.h"
+#include <cstring>
+#include <iostream>
+
+namespace {
+    // identifies cache files, and their layout version; bump the
+    // version whenever a mesh generator changes its output
+    const uint32_t CACHE_MAGIC = 0x4853454D;    // "MESH"
+    const uint32_t CACHE_VERSION = 1;
+
+    bool SameKey(const MESH_KEY& a, const MESH_KEY& b) {
+        return a.shape == b.shape && a.tessellation[0] == b.tessellation[0] &&
+            a.tessellation[1] == b.tessellation[1];
+    }
+
+    // true when count elements of elementSize bytes at offset lie
+    // inside a block of size bytes and are 4 byte aligned
+    bool RangeInside(uint64_t offset, uint64_t count, uint64_t elementSize, size_t size) {
+        return offset % 4 == 0 && offset + count * elementSize <= (uint64_t)size;
+    }
+}
+
+/***********************************************************
+ *  MeshCache()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+MeshCache::MeshCache() {
+    m_floatsPerVertex = 0;
+    m_pData = NULL;
+    m_size = 0;
+    m_pEntries = NULL;
+    m_entryCount = 0;
+}
+
+/***********************************************************
+ *  Open()
+ *
+ *  This method maps a cache file and checks that it was
+ *  written for this layout and vertex format.
+ ***********************************************************/
+bool MeshCache::Open(const char* filename, uint32_t floatsPerVertex) {
+    m_filename = filename;
+    m_floatsPerVertex = floatsPerVertex;
+    m_pData = NULL;
+    m_size = 0;
+    m_pEntries = NULL;
+    m_entryCount = 0;
+    std::vector<unsigned char>().swap(m_memory);
+    if (!m_file.Open(filename)) {
+        return false;
+    }
+    if (!Attach(m_file.GetData(), m_file.GetSize())) {
+        std::cout << "INFO: Mesh cache " << filename << " is out of date" << std::endl;
+        m_file.Close();
+        return false;
+    }
+    return true;
+}
+
+/***********************************************************
+ *  Attach()
+ *
+ *  This method takes a block of cache contents into use if
+ *  its header matches and every entry's data lies inside
+ *  it. Nothing else is read, so the mesh data pages are
+ *  only touched when they are uploaded.
+ ***********************************************************/
+bool MeshCache::Attach(const unsigned char* data, size_t size) {
+    if (size < sizeof(FILE_HEADER)) {
+        return false;
+    }
+    FILE_HEADER header;
+    memcpy(&header, data, sizeof(header));
+    if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION ||
+        header.floatsPerVertex != m_floatsPerVertex ||
+        !RangeInside(sizeof(header), header.entryCount, sizeof(FILE_ENTRY), size)) {
+        return false;
+    }
+    const FILE_ENTRY* entries = (const FILE_ENTRY*)(data + sizeof(header));
+    for (uint32_t i = 0; i < header.entryCount; ++i) {
+        if (!RangeInside(entries[i].vertexOffset, entries[i].vertexCount, sizeof(float) * m_floatsPerVertex, size) ||
+            !RangeInside(entries[i].indexOffset, entries[i].indexCount, sizeof(uint32_t), size)) {
+            return false;
+        }
+    }
+    m_pData = data;
+    m_size = size;
+    m_pEntries = entries;
+    m_entryCount = header.entryCount;
+    return true;
+}
+
+/***********************************************************
+ *  Find()
+ *
+ *  This method returns the data of a cached mesh.
+ ***********************************************************/
+bool MeshCache::Find(const MESH_KEY& key, CACHED_MESH& mesh) const {
+    for (size_t i = 0; i < m_entryCount; ++i) {
+        const FILE_ENTRY& entry = m_pEntries[i];
+        if (SameKey(entry.key, key)) {
+            mesh.vertices = (const float*)(m_pData + entry.vertexOffset);
+            mesh.vertexCount = entry.vertexCount;
+            mesh.indices = (const uint32_t*)(m_pData + entry.indexOffset);
+            mesh.indexCount = entry.indexCount;
+            return true;
+        }
+    }
+    return false;
+}
+
+/***********************************************************
+ *  Add()
+ *
+ *  This method lays out the cached meshes followed by the
+ *  new ones in a new block that replaces the cache file,
+ *  which is then mapped again. If the file cannot be
+ *  written the block is kept in memory, so the meshes are
+ *  still available and generated again on the next run.
+ ***********************************************************/
+void MeshCache::Add(const MESH_KEY* keys, const CACHED_MESH* meshes, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    std::vector<MESH_KEY> allKeys;
+    std::vector<CACHED_MESH> allMeshes;
+    for (size_t i = 0; i < m_entryCount; ++i) {
+        CACHED_MESH mesh;
+        Find(m_pEntries[i].key, mesh);
+        allKeys.push_back(m_pEntries[i].key);
+        allMeshes.push_back(mesh);
+    }
+    allKeys.insert(allKeys.end(), keys, keys + count);
+    allMeshes.insert(allMeshes.end(), meshes, meshes + count);
+
+    size_t vertexSize = sizeof(float) * m_floatsPerVertex;
+    size_t size = sizeof(FILE_HEADER) + sizeof(FILE_ENTRY) * allMeshes.size();
+    for (size_t i = 0; i < allMeshes.size(); ++i) {
+        size += vertexSize * allMeshes[i].vertexCount + sizeof(uint32_t) * allMeshes[i].indexCount;
+    }
+    std::vector<unsigned char> data(size);
+    FILE_HEADER header = { CACHE_MAGIC, CACHE_VERSION, m_floatsPerVertex, (uint32_t)allMeshes.size() };
+    memcpy(data.data(), &header, sizeof(header));
+    size_t offset = sizeof(FILE_HEADER) + sizeof(FILE_ENTRY) * allMeshes.size();
+    for (size_t i = 0; i < allMeshes.size(); ++i) {
+        const CACHED_MESH& mesh = allMeshes[i];
+        FILE_ENTRY entry;
+        memset(&entry, 0, sizeof(entry));
+        entry.key = allKeys[i];
+        entry.vertexOffset = (uint32_t)offset;
+        entry.vertexCount = mesh.vertexCount;
+        memcpy(data.data() + offset, mesh.vertices, vertexSize * mesh.vertexCount);
+        offset += vertexSize * mesh.vertexCount;
+        entry.indexOffset = (uint32_t)offset;
+        entry.indexCount = mesh.indexCount;
+        memcpy(data.data() + offset, mesh.indices, sizeof(uint32_t) * mesh.indexCount);
+        offset += sizeof(uint32_t) * mesh.indexCount;
+        memcpy(data.data() + sizeof(FILE_HEADER) + sizeof(FILE_ENTRY) * i, &entry, sizeof(entry));
+    }
+
+    // the old mapping is no longer needed, and Windows cannot replace
+    // a file while it is mapped
+    m_file.Close();
+    std::vector<unsigned char>().swap(m_memory);
+    m_pData = NULL;
+    m_pEntries = NULL;
+    m_entryCount = 0;
+
+    // other running instances may have the old file mapped, so it is
+    // replaced rather than overwritten
+    bool saved = WriteFileAtomic(m_filename.c_str(), data.data(), data.size());
+    if (saved && m_file.Open(m_filename.c_str()) && Attach(m_file.GetData(), m_file.GetSize())) {
+        std::cout << "INFO: Saved mesh cache " << m_filename << " (" << m_entryCount << " meshes, "
+            << data.size() << " bytes)" << std::endl;
+        return;
+    }
+    std::cout << "ERROR: Could not write mesh cache " << m_filename << std::endl;
+    m_file.Close();
+    m_memory.swap(data);
+    Attach(m_memory.data(), m_memory.size());
+}
@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////
+// meshcache.h
+// ============
+// Versioned binary file of generated meshes, memory mapped so the meshes
+// can be uploaded without being generated or parsed again
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  MESH_KEY
+ *
+ *  Identifies a generated mesh: the shape and the
+ *  tessellation it was generated with (unused values 0).
+ ***********************************************************/
+struct MESH_KEY
+{
+    uint32_t shape;
+    uint32_t tessellation[2];
+};
+
+/***********************************************************
+ *  CACHED_MESH
+ *
+ *  Vertices and triangle indices of a mesh. For meshes in
+ *  the cache they point into the cache's memory.
+ ***********************************************************/
+struct CACHED_MESH
+{
+    const float* vertices;
+    uint32_t vertexCount;
+    const uint32_t* indices;
+    uint32_t indexCount;
+};
+
+/***********************************************************
+ *  MeshCache
+ *
+ *  The cache file holds a header, a table of entries and
+ *  the vertex and index data of every entry, laid out as it
+ *  is uploaded. Opening it only checks the header and the
+ *  table bounds; the mesh data is read straight from the
+ *  mapping. A file written for another layout version or
+ *  vertex format is ignored and replaced when meshes are
+ *  added.
+ ***********************************************************/
+class MeshCache
+{
+public:
+    // constructor
+    MeshCache();
+
+    // map a cache file with vertices of floatsPerVertex floats; a
+    // missing or stale file leaves the cache empty but is still
+    // where added meshes are saved
+    bool Open(const char* filename, uint32_t floatsPerVertex);
+    // look up a mesh; false when it is not in the cache
+    bool Find(const MESH_KEY& key, CACHED_MESH& mesh) const;
+    // add meshes and save the cache file. All cached meshes move,
+    // so meshes found before must be looked up again
+    void Add(const MESH_KEY* keys, const CACHED_MESH* meshes, size_t count);
+
+    size_t GetMeshCount() const { return m_entryCount; }
+
+private:
+    struct FILE_HEADER
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t floatsPerVertex;
+        uint32_t entryCount;
+    };
+
+    // data offsets are in bytes from the start of the file
+    struct FILE_ENTRY
+    {
+        MESH_KEY key;
+        uint32_t vertexOffset;
+        uint32_t vertexCount;
+        uint32_t indexOffset;
+        uint32_t indexCount;
+        uint32_t reserved;
+    };
+
+    std::string m_filename;
+    uint32_t m_floatsPerVertex;
+    MappedFile m_file;
+    // the cache contents when they could not be saved and mapped
+    std::vector<unsigned char> m_memory;
+    // the cache contents in use, from the file or from memory
+    const unsigned char* m_pData;
+    size_t m_size;
+    const FILE_ENTRY* m_pEntries;
+    size_t m_entryCount;
+
+    // use a block of cache contents if it is valid
+    bool Attach(const unsigned char* data, size_t size);
+};
@@ -0,0 +1,281 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionbuffer.cpp
+// ============
+// Low resolution software depth buffer of the largest visible objects
+// and its hierarchical-Z pyramid, used to skip objects hidden behind them
+///////////////////////////////////////////////////////////////////////////////
+
+#include "OcclusionBuffer.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // clip w below which a vertex counts as behind the near plane
+    const float MIN_CLIP_W = 1e-4f;
+    // buffer rows rasterized by one job
+    const int BAND_HEIGHT = 8;
+    // depth of a pixel no occluder covers
+    const float FAR_DEPTH = 1.0f;
+
+    int LevelSize(int size, int level) {
+        return std::max(size >> level, 1);
+    }
+
+    // twice the signed area of the triangle abc, positive when counter-clockwise
+    float EdgeFunction(const glm::vec3& a, const glm::vec3& b, float x, float y) {
+        return (b.x - a.x) * (y - a.y) - (b.y - a.y) * (x - a.x);
+    }
+}
+
+/***********************************************************
+ *  OcclusionBuffer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+OcclusionBuffer::OcclusionBuffer() {
+    m_viewProjection = glm::mat4(1.0f);
+    int levelCount = 1;
+    while (LevelSize(WIDTH, levelCount - 1) > 1 || LevelSize(HEIGHT, levelCount - 1) > 1) {
+        ++levelCount;
+    }
+    m_levels.resize(levelCount);
+    for (int level = 0; level < levelCount; ++level) {
+        m_levels[level].assign((size_t)LevelSize(WIDTH, level) * LevelSize(HEIGHT, level), FAR_DEPTH);
+    }
+}
+
+/***********************************************************
+ *  Begin()
+ *
+ *  This method starts collecting the occluders of a view.
+ ***********************************************************/
+void OcclusionBuffer::Begin(const glm::mat4& viewProjection) {
+    m_viewProjection = viewProjection;
+    m_triangles.clear();
+}
+
+/***********************************************************
+ *  AddOccluder()
+ *
+ *  This method transforms the triangles of a mesh instance
+ *  into buffer pixels and keeps them for Finish().
+ ***********************************************************/
+void OcclusionBuffer::AddOccluder(const MESH_GEOMETRY& mesh, const glm::mat4& modelMatrix) {
+    if (mesh.indexCount == 0) {
+        return;
+    }
+    size_t vertexCount = 0;
+    for (size_t i = 0; i < mesh.indexCount; ++i) {
+        vertexCount = std::max(vertexCount, (size_t)mesh.indices[i] + 1);
+    }
+
+    glm::mat4 transform = m_viewProjection * modelMatrix;
+    m_clipVertices.resize(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) {
+        const GLfloat* position = mesh.vertices + v * mesh.vertexStride;
+        m_clipVertices[v] = transform * glm::vec4(position[0], position[1], position[2], 1.0f);
+    }
+
+    for (size_t i = 0; i + 2 < mesh.indexCount; i += 3) {
+        SCREEN_TRIANGLE triangle;
+        bool inFront = true;
+        for (int corner = 0; corner < 3 && inFront; ++corner) {
+            const glm::vec4& clip = m_clipVertices[mesh.indices[i + corner]];
+            inFront = clip.w > MIN_CLIP_W;
+            if (inFront) {
+                triangle.vertices[corner] = glm::vec3(
+                    (clip.x / clip.w * 0.5f + 0.5f) * WIDTH,
+                    (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT,
+                    clip.z / clip.w);
+            }
+        }
+        if (inFront) {
+            m_triangles.push_back(triangle);
+        }
+    }
+}
+
+/***********************************************************
+ *  Finish()
+ *
+ *  This method rasterizes the occluders, one band of rows
+ *  per job, and builds the depth pyramid.
+ ***********************************************************/
+void OcclusionBuffer::Finish(JobSystem* pJobSystem) {
+    PROFILE_CPU_SCOPE("RasterizeOccluders");
+    int bandCount = (HEIGHT + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    pJobSystem->ParallelFor(bandCount, 1, [this](size_t begin, size_t end) {
+        for (size_t band = begin; band < end; ++band) {
+            int firstRow = (int)band * BAND_HEIGHT;
+            RasterizeRows(firstRow, std::min(firstRow + BAND_HEIGHT, HEIGHT));
+        }
+    });
+    BuildPyramid();
+}
+
+/***********************************************************
+ *  RasterizeRows()
+ *
+ *  This method clears a band of rows and draws every
+ *  triangle into it. Pixels are covered when their center
+ *  is inside the triangle, so triangles sharing an edge
+ *  leave no gaps, and take the largest depth the
+ *  triangle's plane reaches inside the pixel.
+ ***********************************************************/
+void OcclusionBuffer::RasterizeRows(int firstRow, int endRow) {
+    std::vector<float>& depth = m_levels[0];
+    std::fill(depth.begin() + (size_t)firstRow * WIDTH, depth.begin() + (size_t)endRow * WIDTH, FAR_DEPTH);
+
+    for (size_t t = 0; t < m_triangles.size(); ++t) {
+        glm::vec3 a = m_triangles[t].vertices[0];
+        glm::vec3 b = m_triangles[t].vertices[1];
+        glm::vec3 c = m_triangles[t].vertices[2];
+        float area = EdgeFunction(a, b, c.x, c.y);
+        if (area < 0.0f) {
+            std::swap(b, c);
+            area = -area;
+        }
+        if (area < 1e-6f) {
+            continue;
+        }
+
+        // pixels whose centers are inside the triangle's bounds
+        int minX = std::max((int)ceilf(std::min(a.x, std::min(b.x, c.x)) - 0.5f), 0);
+        int endX = std::min((int)floorf(std::max(a.x, std::max(b.x, c.x)) - 0.5f) + 1, WIDTH);
+        int minY = std::max((int)ceilf(std::min(a.y, std::min(b.y, c.y)) - 0.5f), firstRow);
+        int endY = std::min((int)floorf(std::max(a.y, std::max(b.y, c.y)) - 0.5f) + 1, endRow);
+        if (minX >= endX || minY >= endY) {
+            continue;
+        }
+
+        float depthX = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+        float depthY = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+        float depthMargin = 0.5f * (fabsf(depthX) + fabsf(depthY));
+        float maxDepth = std::max(a.z, std::max(b.z, c.z));
+
+        for (int y = minY; y < endY; ++y) {
+            float centerY = y + 0.5f;
+            float* row = &depth[(size_t)y * WIDTH];
+            for (int x = minX; x < endX; ++x) {
+                float centerX = x + 0.5f;
+                if (EdgeFunction(a, b, centerX, centerY) < 0.0f ||
+                    EdgeFunction(b, c, centerX, centerY) < 0.0f ||
+                    EdgeFunction(c, a, centerX, centerY) < 0.0f) {
+                    continue;
+                }
+                float pixelDepth = a.z + depthX * (centerX - a.x) + depthY * (centerY - a.y) + depthMargin;
+                row[x] = std::min(row[x], std::min(pixelDepth, maxDepth));
+            }
+        }
+    }
+}
+
+/***********************************************************
+ *  BuildPyramid()
+ *
+ *  This method fills each level above the depth buffer with
+ *  the farthest depth of the 2x2 texels below every texel.
+ ***********************************************************/
+void OcclusionBuffer::BuildPyramid() {
+    for (size_t level = 1; level < m_levels.size(); ++level) {
+        const std::vector<float>& source = m_levels[level - 1];
+        std::vector<float>& target = m_levels[level];
+        int sourceWidth = LevelSize(WIDTH, (int)level - 1);
+        int sourceHeight = LevelSize(HEIGHT, (int)level - 1);
+        int width = LevelSize(WIDTH, (int)level);
+        int height = LevelSize(HEIGHT, (int)level);
+        for (int y = 0; y < height; ++y) {
+            int y0 = std::min(y * 2, sourceHeight - 1);
+            int y1 = std::min(y * 2 + 1, sourceHeight - 1);
+            for (int x = 0; x < width; ++x) {
+                int x0 = std::min(x * 2, sourceWidth - 1);
+                int x1 = std::min(x * 2 + 1, sourceWidth - 1);
+                target[(size_t)y * width + x] = std::max(
+                    std::max(source[(size_t)y0 * sourceWidth + x0], source[(size_t)y0 * sourceWidth + x1]),
+                    std::max(source[(size_t)y1 * sourceWidth + x0], source[(size_t)y1 * sourceWidth + x1]));
+            }
+        }
+    }
+}
+
+/***********************************************************
+ *  ProjectBox()
+ *
+ *  This method finds the buffer pixel rectangle and the
+ *  nearest NDC depth of the eight box corners.
+ ***********************************************************/
+bool OcclusionBuffer::ProjectBox(const AABB& box, SCREEN_BOUNDS& bounds) const {
+    bounds.minimum = glm::vec2(1e30f);
+    bounds.maximum = glm::vec2(-1e30f);
+    bounds.nearestDepth = 1e30f;
+    for (int corner = 0; corner < 8; ++corner) {
+        glm::vec4 point(
+            (corner & 1) ? box.maximum.x : box.minimum.x,
+            (corner & 2) ? box.maximum.y : box.minimum.y,
+            (corner & 4) ? box.maximum.z : box.minimum.z,
+            1.0f);
+        glm::vec4 clip = m_viewProjection * point;
+        if (clip.w <= MIN_CLIP_W) {
+            return false;
+        }
+        glm::vec2 pixel((clip.x / clip.w * 0.5f + 0.5f) * WIDTH, (clip.y / clip.w * 0.5f + 0.5f) * HEIGHT);
+        bounds.minimum = glm::min(bounds.minimum, pixel);
+        bounds.maximum = glm::max(bounds.maximum, pixel);
+        bounds.nearestDepth = std::min(bounds.nearestDepth, clip.z / clip.w);
+    }
+    return true;
+}
+
+/***********************************************************
+ *  GetScreenArea()
+ *
+ *  This method returns the part of the screen the box's
+ *  projected rectangle covers, for choosing occluders.
+ ***********************************************************/
+float OcclusionBuffer::GetScreenArea(const AABB& box) const {
+    SCREEN_BOUNDS bounds;
+    if (!ProjectBox(box, bounds)) {
+        return 0.0f;
+    }
+    glm::vec2 minimum = glm::max(bounds.minimum, glm::vec2(0.0f));
+    glm::vec2 maximum = glm::min(bounds.maximum, glm::vec2((float)WIDTH, (float)HEIGHT));
+    if (minimum.x >= maximum.x || minimum.y >= maximum.y) {
+        return 0.0f;
+    }
+    return (maximum.x - minimum.x) * (maximum.y - minimum.y) / (WIDTH * HEIGHT);
+}
+
+/***********************************************************
+ *  IsOccluded()
+ *
+ *  This method picks the pyramid level on which the box's
+ *  rectangle spans at most 2x2 texels and compares the
+ *  box's nearest depth with their farthest depth. The
+ *  rectangle is grown by one pixel, because pixels on an
+ *  occluder's outline are only partly covered by it.
+ ***********************************************************/
+bool OcclusionBuffer::IsOccluded(const AABB& box) const {
+    SCREEN_BOUNDS bounds;
+    if (!ProjectBox(box, bounds)) {
+        return false;
+    }
+    int x0 = std::min(std::max((int)floorf(bounds.minimum.x) - 1, 0), WIDTH - 1);
+    int x1 = std::min(std::max((int)floorf(bounds.maximum.x) + 1, 0), WIDTH - 1);
+    int y0 = std::min(std::max((int)floorf(bounds.minimum.y) - 1, 0), HEIGHT - 1);
+    int y1 = std::min(std::max((int)floorf(bounds.maximum.y) + 1, 0), HEIGHT - 1);
+
+    int level = 0;
+    while ((x1 >> level) - (x0 >> level) > 1 || (y1 >> level) - (y0 >> level) > 1) {
+        ++level;
+    }
+    const std::vector<float>& depth = m_levels[level];
+    int width = LevelSize(WIDTH, level);
+    float farthest = -1e30f;
+    for (int y = y0 >> level; y <= (y1 >> level); ++y) {
+        for (int x = x0 >> level; x <= (x1 >> level); ++x) {
+            farthest = std::max(farthest, depth[(size_t)y * width + x]);
+        }
+    }
+    return bounds.nearestDepth > farthest;
+}
@@ -0,0 +1,81 @@
+///////////////////////////////////////////////////////////////////////////////
+// occlusionbuffer.h
+// ============
+// Low resolution software depth buffer of the largest visible objects
+// and its hierarchical-Z pyramid, used to skip objects hidden behind them
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Culling.h"
+#include "JobSystem.h"
+#include "PrimitiveMeshes.h"
+#include <vector>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  OcclusionBuffer
+ *
+ *  The occluder triangles are rasterized on the CPU into a
+ *  WIDTH x HEIGHT buffer of NDC depths, in horizontal bands
+ *  on the job system. A covered pixel takes the farthest
+ *  depth of the triangle inside the pixel, and every level
+ *  of the pyramid above it keeps the farthest depth of the
+ *  2x2 texels below. A box is hidden when its nearest point
+ *  lies behind the farthest depth of the (at most 2x2)
+ *  texels covering it, plus a one pixel border, on one
+ *  level.
+ ***********************************************************/
+class OcclusionBuffer
+{
+public:
+    static const int WIDTH = 256;
+    static const int HEIGHT = 128;
+
+    // constructor
+    OcclusionBuffer();
+
+    // start a new view and forget the previous occluders
+    void Begin(const glm::mat4& viewProjection);
+    // add the triangles of a mesh instance; triangles reaching
+    // behind the near plane are left out
+    void AddOccluder(const MESH_GEOMETRY& mesh, const glm::mat4& modelMatrix);
+    // rasterize the occluders and build the pyramid
+    void Finish(JobSystem* pJobSystem);
+
+    // fraction of the screen covered by the projected box, 0 when
+    // the box reaches behind the near plane
+    float GetScreenArea(const AABB& box) const;
+    // true when the box is hidden behind the occluders; may be
+    // called from several threads after Finish()
+    bool IsOccluded(const AABB& box) const;
+
+private:
+    // triangle in buffer pixels (x, y) and NDC depth (z)
+    struct SCREEN_TRIANGLE
+    {
+        glm::vec3 vertices[3];
+    };
+
+    // screen rectangle and nearest depth of a projected box
+    struct SCREEN_BOUNDS
+    {
+        glm::vec2 minimum;
+        glm::vec2 maximum;
+        float nearestDepth;
+    };
+
+    glm::mat4 m_viewProjection;
+    std::vector<SCREEN_TRIANGLE> m_triangles;
+    // clip space vertices of the occluder being added
+    std::vector<glm::vec4> m_clipVertices;
+    // m_levels[0] is the depth buffer, each next level half its size
+    std::vector<std::vector<float>> m_levels;
+
+    // project a box; false when it reaches behind the near plane
+    bool ProjectBox(const AABB& box, SCREEN_BOUNDS& bounds) const;
+    // rasterize every triangle into the rows [firstRow, endRow)
+    void RasterizeRows(int firstRow, int endRow);
+    // fill the levels above the depth buffer
+    void BuildPyramid();
+};
@@ -0,0 +1,619 @@
+///////////////////////////////////////////////////////////////////////////////
+// primitivemeshes.cpp
+// ============
+// Indexed basic shape meshes in shared buffers, drawn with per-instance
+// model matrices, texture array layers and material ids
+///////////////////////////////////////////////////////////////////////////////
+
+#include "PrimitiveMeshes.h"
+#include "FrameStats.h"
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+    const float PI = 3.14159265358979f;
+
+    // floats per vertex - position (3), normal (3), texture coordinate (2)
+    const int FLOATS_PER_VERTEX = 8;
+    // first attribute location of the per-instance model matrix
+    const GLuint INSTANCE_MATRIX_LOCATION = 3;
+    // attribute location of the per-instance texture array layer and
+    // material id
+    const GLuint INSTANCE_SURFACE_LOCATION = 7;
+
+    // cache of the generated meshes, in the working directory
+    const char* const MESH_CACHE_FILE = "primitives.meshcache";
+
+    // tessellation of the round shapes
+    const int CYLINDER_SLICES = 36;
+    const int CONE_SLICES = 36;
+    const int TORUS_MAIN_SEGMENTS = 30;
+    const int TORUS_TUBE_SEGMENTS = 30;
+    const float TORUS_MAIN_RADIUS = 1.0f;
+    const float TORUS_TUBE_RADIUS = 0.1f;
+
+    struct MeshData
+    {
+        std::vector<GLfloat> vertices;
+        std::vector<GLuint> indices;
+
+        GLuint VertexCount() const { return (GLuint)(vertices.size() / FLOATS_PER_VERTEX); }
+
+        void AddVertex(float x, float y, float z, float nx, float ny, float nz, float u, float v) {
+            GLfloat vertex[FLOATS_PER_VERTEX] = { x, y, z, nx, ny, nz, u, v };
+            vertices.insert(vertices.end(), vertex, vertex + FLOATS_PER_VERTEX);
+        }
+
+        void AddTriangle(GLuint a, GLuint b, GLuint c) {
+            indices.push_back(a);
+            indices.push_back(b);
+            indices.push_back(c);
+        }
+
+        void AddQuad(GLuint a, GLuint b, GLuint c, GLuint d) {
+            AddTriangle(a, b, c);
+            AddTriangle(a, c, d);
+        }
+    };
+
+    // plane from -1 to 1 in X and Z, facing up
+    void GeneratePlane(MeshData& mesh) {
+        mesh.AddVertex(-1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f);
+        mesh.AddVertex(-1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+        mesh.AddVertex(1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f);
+        mesh.AddVertex(1.0f, 0.0f, -1.0f, 0.0f, 1.0f, 0.0f, 1.0f, 1.0f);
+        mesh.AddQuad(0, 1, 2, 3);
+    }
+
+    // unit box centered on the origin
+    void GenerateBox(MeshData& mesh) {
+        // face normal, then the two in-plane axes of the face
+        const float faces[6][9] = {
+            {  0,  0,  1,   1,  0,  0,   0,  1,  0 },
+            {  0,  0, -1,  -1,  0,  0,   0,  1,  0 },
+            {  1,  0,  0,   0,  0, -1,   0,  1,  0 },
+            { -1,  0,  0,   0,  0,  1,   0,  1,  0 },
+            {  0,  1,  0,   1,  0,  0,   0,  0, -1 },
+            {  0, -1,  0,   1,  0,  0,   0,  0,  1 },
+        };
+        const float corners[4][2] = { { -1, -1 }, { 1, -1 }, { 1, 1 }, { -1, 1 } };
+
+        for (int f = 0; f < 6; ++f) {
+            const float* n = faces[f];
+            GLuint first = mesh.VertexCount();
+            for (int c = 0; c < 4; ++c) {
+                float s = corners[c][0] * 0.5f;
+                float t = corners[c][1] * 0.5f;
+                mesh.AddVertex(
+                    n[0] * 0.5f + n[3] * s + n[6] * t,
+                    n[1] * 0.5f + n[4] * s + n[7] * t,
+                    n[2] * 0.5f + n[5] * s + n[8] * t,
+                    n[0], n[1], n[2],
+                    corners[c][0] * 0.5f + 0.5f, corners[c][1] * 0.5f + 0.5f);
+            }
+            mesh.AddQuad(first, first + 1, first + 2, first + 3);
+        }
+    }
+
+    // flat disc of radius 1 at height y, facing up or down
+    void AddDisc(MeshData& mesh, int slices, float y, bool facingUp) {
+        float ny = facingUp ? 1.0f : -1.0f;
+        GLuint center = mesh.VertexCount();
+        mesh.AddVertex(0.0f, y, 0.0f, 0.0f, ny, 0.0f, 0.5f, 0.5f);
+        for (int i = 0; i <= slices; ++i) {
+            float angle = 2.0f * PI * i / slices;
+            float x = cosf(angle);
+            float z = sinf(angle);
+            mesh.AddVertex(x, y, z, 0.0f, ny, 0.0f, 0.5f + 0.5f * x, 0.5f + 0.5f * z);
+        }
+        for (int i = 0; i < slices; ++i) {
+            if (facingUp) {
+                mesh.AddTriangle(center, center + 2 + i, center + 1 + i);
+            }
+            else {
+                mesh.AddTriangle(center, center + 1 + i, center + 2 + i);
+            }
+        }
+    }
+
+    // cylinder of radius 1 from y = 0 to y = 1
+    void GenerateCylinder(MeshData& mesh) {
+        AddDisc(mesh, CYLINDER_SLICES, 0.0f, false);
+        AddDisc(mesh, CYLINDER_SLICES, 1.0f, true);
+
+        GLuint first = mesh.VertexCount();
+        for (int i = 0; i <= CYLINDER_SLICES; ++i) {
+            float u = (float)i / CYLINDER_SLICES;
+            float angle = 2.0f * PI * u;
+            float x = cosf(angle);
+            float z = sinf(angle);
+            mesh.AddVertex(x, 0.0f, z, x, 0.0f, z, u, 0.0f);
+            mesh.AddVertex(x, 1.0f, z, x, 0.0f, z, u, 1.0f);
+        }
+        for (int i = 0; i < CYLINDER_SLICES; ++i) {
+            GLuint a = first + 2 * i;
+            mesh.AddQuad(a, a + 1, a + 3, a + 2);
+        }
+    }
+
+    // cone with a base of radius 1 at y = 0 and its tip at y = 1
+    void GenerateCone(MeshData& mesh) {
+        AddDisc(mesh, CONE_SLICES, 0.0f, false);
+
+        // slanted side normal for a height and radius of 1
+        const float slope = 1.0f / sqrtf(2.0f);
+        GLuint first = mesh.VertexCount();
+        for (int i = 0; i <= CONE_SLICES; ++i) {
+            float u = (float)i / CONE_SLICES;
+            float angle = 2.0f * PI * u;
+            float x = cosf(angle);
+            float z = sinf(angle);
+            mesh.AddVertex(x, 0.0f, z, x * slope, slope, z * slope, u, 0.0f);
+            mesh.AddVertex(0.0f, 1.0f, 0.0f, x * slope, slope, z * slope, u, 1.0f);
+        }
+        for (int i = 0; i < CONE_SLICES; ++i) {
+            GLuint a = first + 2 * i;
+            mesh.AddTriangle(a, a + 1, a + 2);
+        }
+    }
+
+    // torus in the XY plane around the origin
+    void GenerateTorus(MeshData& mesh) {
+        for (int i = 0; i <= TORUS_MAIN_SEGMENTS; ++i) {
+            float u = (float)i / TORUS_MAIN_SEGMENTS;
+            float theta = 2.0f * PI * u;
+            for (int j = 0; j <= TORUS_TUBE_SEGMENTS; ++j) {
+                float v = (float)j / TORUS_TUBE_SEGMENTS;
+                float phi = 2.0f * PI * v;
+                float nx = cosf(phi) * cosf(theta);
+                float ny = cosf(phi) * sinf(theta);
+                float nz = sinf(phi);
+                float ring = TORUS_MAIN_RADIUS + TORUS_TUBE_RADIUS * cosf(phi);
+                mesh.AddVertex(ring * cosf(theta), ring * sinf(theta), TORUS_TUBE_RADIUS * nz,
+                    nx, ny, nz, u, v);
+            }
+        }
+        GLuint stride = TORUS_TUBE_SEGMENTS + 1;
+        for (int i = 0; i < TORUS_MAIN_SEGMENTS; ++i) {
+            for (int j = 0; j < TORUS_TUBE_SEGMENTS; ++j) {
+                GLuint a = i * stride + j;
+                mesh.AddQuad(a, a + stride, a + stride + 1, a + 1);
+            }
+        }
+    }
+
+    void GenerateMesh(MESH_ID mesh, MeshData& data) {
+        switch (mesh) {
+        case MESH_PLANE:    GeneratePlane(data); break;
+        case MESH_BOX:      GenerateBox(data); break;
+        case MESH_CYLINDER: GenerateCylinder(data); break;
+        case MESH_CONE:     GenerateCone(data); break;
+        case MESH_TORUS:    GenerateTorus(data); break;
+        default: break;
+        }
+    }
+
+    // mesh cache key of a shape with its current tessellation, so
+    // changing the tessellation generates the mesh again
+    MESH_KEY GetMeshKey(MESH_ID mesh) {
+        MESH_KEY key = { (uint32_t)mesh, { 0, 0 } };
+        switch (mesh) {
+        case MESH_CYLINDER: key.tessellation[0] = CYLINDER_SLICES; break;
+        case MESH_CONE:     key.tessellation[0] = CONE_SLICES; break;
+        case MESH_TORUS:
+            key.tessellation[0] = TORUS_MAIN_SEGMENTS;
+            key.tessellation[1] = TORUS_TUBE_SEGMENTS;
+            break;
+        default: break;
+        }
+        return key;
+    }
+}
+
+/***********************************************************
+ *  PrimitiveMeshes()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+PrimitiveMeshes::PrimitiveMeshes() {
+    for (int i = 0; i < MESH_COUNT; ++i) {
+        m_meshes[i].firstIndex = 0;
+        m_meshes[i].indexCount = 0;
+        m_meshes[i].baseVertex = 0;
+        m_meshes[i].references = 0;
+        m_meshes[i].data.vertices = NULL;
+        m_meshes[i].data.vertexCount = 0;
+        m_meshes[i].data.indices = NULL;
+        m_meshes[i].data.indexCount = 0;
+    }
+    m_meshCacheOpen = false;
+    m_uploadEnabled = true;
+    m_vertexArray = 0;
+    m_vertexBuffer = 0;
+    m_indexBuffer = 0;
+    m_instanceBuffer = 0;
+    m_instanceMatrixOffset = 0;
+    m_instanceSurfaceOffset = 0;
+    m_instanceDivisor = 1;
+    m_indirectBuffer = 0;
+    m_indirectCapacity = 0;
+    m_multiDrawIndirect = false;
+}
+
+/***********************************************************
+ *  ~PrimitiveMeshes()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+PrimitiveMeshes::~PrimitiveMeshes() {
+    if (m_vertexArray != 0) {
+        GLuint buffers[3] = { m_vertexBuffer, m_indexBuffer, m_indirectBuffer };
+        glDeleteVertexArrays(1, &m_vertexArray);
+        glDeleteBuffers(3, buffers);
+    }
+}
+
+/***********************************************************
+ *  CreateBuffers()
+ *
+ *  This method creates the shared vertex array object and
+ *  buffers, and points the vertex attributes into them. The
+ *  instance attributes are pointed at the instance data by
+ *  SetInstanceSource().
+ ***********************************************************/
+void PrimitiveMeshes::CreateBuffers() {
+    if (m_vertexArray != 0) {
+        return;
+    }
+    glGenVertexArrays(1, &m_vertexArray);
+    glGenBuffers(1, &m_vertexBuffer);
+    glGenBuffers(1, &m_indexBuffer);
+    glGenBuffers(1, &m_indirectBuffer);
+
+    glBindVertexArray(m_vertexArray);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+
+    // per-vertex position, normal and texture coordinate
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    GLsizei stride = sizeof(GLfloat) * FLOATS_PER_VERTEX;
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 3));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 6));
+    glEnableVertexAttribArray(2);
+
+    // per-instance model matrix, one column per attribute location
+    for (GLuint column = 0; column < 4; ++column) {
+        glEnableVertexAttribArray(INSTANCE_MATRIX_LOCATION + column);
+        glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + column, 1);
+    }
+    glEnableVertexAttribArray(INSTANCE_SURFACE_LOCATION);
+    glVertexAttribDivisor(INSTANCE_SURFACE_LOCATION, 1);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+#ifdef __APPLE__
+    // OpenGL 4.1 has no indirect multi-draws
+    m_multiDrawIndirect = false;
+#else
+    m_multiDrawIndirect = GLEW_ARB_multi_draw_indirect ? true : false;
+#endif
+}
+
+/***********************************************************
+ *  AcquireMesh()
+ *
+ *  This method adds a reference to a mesh.
+ ***********************************************************/
+void PrimitiveMeshes::AcquireMesh(MESH_ID mesh) {
+    if (mesh >= 0 && mesh < MESH_COUNT) {
+        ++m_meshes[mesh].references;
+    }
+}
+
+/***********************************************************
+ *  ReleaseMesh()
+ *
+ *  This method drops a reference to a mesh.
+ ***********************************************************/
+void PrimitiveMeshes::ReleaseMesh(MESH_ID mesh) {
+    if (mesh >= 0 && mesh < MESH_COUNT && m_meshes[mesh].references > 0) {
+        --m_meshes[mesh].references;
+    }
+}
+
+/***********************************************************
+ *  LoadMeshes()
+ *
+ *  This method looks up the referenced meshes in the mesh
+ *  cache, generates the ones it does not hold yet in
+ *  parallel and adds them to it. The referenced meshes are
+ *  then laid out one after another and uploaded straight
+ *  from the cache, replacing the shared buffers in one go,
+ *  unless uploading is off.
+ ***********************************************************/
+void PrimitiveMeshes::LoadMeshes(JobSystem* pJobSystem) {
+    bool changed = false;
+    for (int i = 0; i < MESH_COUNT; ++i) {
+        changed = changed || ((m_meshes[i].references > 0) != (m_meshes[i].indexCount > 0));
+    }
+    if (!changed) {
+        return;
+    }
+
+    if (!m_meshCacheOpen) {
+        m_meshCache.Open(MESH_CACHE_FILE, FLOATS_PER_VERTEX);
+        m_meshCacheOpen = true;
+    }
+    std::vector<MESH_ID> missing;
+    for (int i = 0; i < MESH_COUNT; ++i) {
+        CACHED_MESH cached;
+        if (m_meshes[i].references > 0 && !m_meshCache.Find(GetMeshKey((MESH_ID)i), cached)) {
+            missing.push_back((MESH_ID)i);
+        }
+    }
+    if (!missing.empty()) {
+        std::vector<MeshData> generated(missing.size());
+        JobSystem::RANGE_FUNCTION generate = [&missing, &generated](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                GenerateMesh(missing[i], generated[i]);
+            }
+        };
+        if (pJobSystem != NULL) {
+            pJobSystem->ParallelFor(missing.size(), 1, generate);
+        }
+        else {
+            generate(0, missing.size());
+        }
+        std::vector<MESH_KEY> keys(missing.size());
+        std::vector<CACHED_MESH> meshes(missing.size());
+        for (size_t i = 0; i < missing.size(); ++i) {
+            keys[i] = GetMeshKey(missing[i]);
+            meshes[i].vertices = generated[i].vertices.data();
+            meshes[i].vertexCount = generated[i].VertexCount();
+            meshes[i].indices = generated[i].indices.data();
+            meshes[i].indexCount = (uint32_t)generated[i].indices.size();
+        }
+        m_meshCache.Add(keys.data(), meshes.data(), missing.size());
+    }
+
+    // lay out the referenced meshes; the cache moves when meshes
+    // are added, so every mesh is looked up again
+    size_t vertexCount = 0;
+    size_t indexCount = 0;
+    for (int i = 0; i < MESH_COUNT; ++i) {
+        MESH_RANGE& range = m_meshes[i];
+        CACHED_MESH cached = { NULL, 0, NULL, 0 };
+        if (range.references > 0) {
+            m_meshCache.Find(GetMeshKey((MESH_ID)i), cached);
+        }
+        range.data = cached;
+        range.firstIndex = (GLuint)indexCount;
+        range.indexCount = (GLsizei)cached.indexCount;
+        range.baseVertex = (GLint)vertexCount;
+        vertexCount += cached.vertexCount;
+        indexCount += cached.indexCount;
+    }
+    if (!m_uploadEnabled) {
+        // software rasterization reads the meshes from the cache
+        std::cout << "INFO: Loaded meshes into memory only (" << missing.size() << " generated, "
+            << vertexCount << " vertices)" << std::endl;
+        return;
+    }
+
+    CreateBuffers();
+    glBindVertexArray(m_vertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(GLfloat) * FLOATS_PER_VERTEX, NULL, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+    int loaded = 0;
+    for (int i = 0; i < MESH_COUNT; ++i) {
+        const MESH_RANGE& range = m_meshes[i];
+        if (range.indexCount == 0) {
+            continue;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)range.baseVertex * sizeof(GLfloat) * FLOATS_PER_VERTEX,
+            (GLsizeiptr)range.data.vertexCount * sizeof(GLfloat) * FLOATS_PER_VERTEX, range.data.vertices);
+        glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)range.firstIndex * sizeof(GLuint),
+            (GLsizeiptr)range.indexCount * sizeof(GLuint), range.data.indices);
+        ++loaded;
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    std::cout << "INFO: Loaded " << loaded << " meshes (" << missing.size() << " generated, "
+        << vertexCount << " vertices)" << std::endl;
+}
+
+/***********************************************************
+ *  SetInstanceAttributes()
+ *
+ *  This method points the instance attributes of the bound
+ *  vertex array object into the instance source.
+ ***********************************************************/
+void PrimitiveMeshes::SetInstanceAttributes(GLuint firstInstance) {
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    size_t base = m_instanceMatrixOffset + sizeof(glm::mat4) * firstInstance;
+    for (GLuint column = 0; column < 4; ++column) {
+        glVertexAttribPointer(INSTANCE_MATRIX_LOCATION + column, 4, GL_FLOAT, GL_FALSE,
+            sizeof(glm::mat4), (void*)(base + sizeof(glm::vec4) * column));
+    }
+    glVertexAttribIPointer(INSTANCE_SURFACE_LOCATION, 2, GL_UNSIGNED_INT,
+        sizeof(glm::uvec2), (void*)(m_instanceSurfaceOffset + sizeof(glm::uvec2) * firstInstance));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/***********************************************************
+ *  SetInstanceSource()
+ *
+ *  This method points the instance attributes at a frame's
+ *  model matrices and surfaces, which the caller has
+ *  already written into a buffer. Nothing is uploaded here.
+ ***********************************************************/
+void PrimitiveMeshes::SetInstanceSource(GLuint buffer, GLintptr matrixOffset, GLintptr surfaceOffset) {
+    m_instanceBuffer = buffer;
+    m_instanceMatrixOffset = (size_t)matrixOffset;
+    m_instanceSurfaceOffset = (size_t)surfaceOffset;
+    SetInstanceAttributes(0);
+    FrameStats::Current().glCalls += 7;
+}
+
+/***********************************************************
+ *  SetInstanceDivisor()
+ *
+ *  This method changes the divisor of all instance
+ *  attributes, skipping the calls if it is already set.
+ ***********************************************************/
+void PrimitiveMeshes::SetInstanceDivisor(GLuint divisor) {
+    if (divisor == m_instanceDivisor) {
+        return;
+    }
+    for (GLuint column = 0; column < 4; ++column) {
+        glVertexAttribDivisor(INSTANCE_MATRIX_LOCATION + column, divisor);
+    }
+    glVertexAttribDivisor(INSTANCE_SURFACE_LOCATION, divisor);
+    m_instanceDivisor = divisor;
+    FrameStats::Current().glCalls += 5;
+}
+
+/***********************************************************
+ *  GetLocalBounds()
+ *
+ *  This method returns the bounding box of a generated mesh.
+ ***********************************************************/
+AABB PrimitiveMeshes::GetLocalBounds(MESH_ID mesh) {
+    AABB box;
+    switch (mesh) {
+    case MESH_PLANE:
+        box.minimum = glm::vec3(-1.0f, 0.0f, -1.0f);
+        box.maximum = glm::vec3(1.0f, 0.0f, 1.0f);
+        break;
+    case MESH_BOX:
+        box.minimum = glm::vec3(-0.5f);
+        box.maximum = glm::vec3(0.5f);
+        break;
+    case MESH_CYLINDER:
+    case MESH_CONE:
+        box.minimum = glm::vec3(-1.0f, 0.0f, -1.0f);
+        box.maximum = glm::vec3(1.0f, 1.0f, 1.0f);
+        break;
+    case MESH_TORUS:
+    default:
+        box.maximum = glm::vec3(TORUS_MAIN_RADIUS + TORUS_TUBE_RADIUS,
+            TORUS_MAIN_RADIUS + TORUS_TUBE_RADIUS, TORUS_TUBE_RADIUS);
+        box.minimum = -box.maximum;
+        break;
+    }
+    return box;
+}
+
+/***********************************************************
+ *  GetDrawCommand()
+ *
+ *  This method returns the indirect draw command for a range
+ *  of instances of a mesh.
+ ***********************************************************/
+DRAW_INDIRECT_COMMAND PrimitiveMeshes::GetDrawCommand(MESH_ID mesh, GLuint firstInstance, GLuint count) const {
+    DRAW_INDIRECT_COMMAND command = { 0, 0, 0, 0, 0 };
+    if (mesh >= 0 && mesh < MESH_COUNT) {
+        const MESH_RANGE& range = m_meshes[mesh];
+        command.count = (GLuint)range.indexCount;
+        command.instanceCount = count;
+        command.firstIndex = range.firstIndex;
+        command.baseVertex = range.baseVertex;
+        command.baseInstance = firstInstance;
+    }
+    return command;
+}
+
+/***********************************************************
+ *  GetMeshGeometry()
+ *
+ *  This method returns the CPU copy of a mesh's vertices
+ *  and triangle indices, for software rasterization.
+ ***********************************************************/
+MESH_GEOMETRY PrimitiveMeshes::GetMeshGeometry(MESH_ID mesh) const {
+    MESH_GEOMETRY geometry = { NULL, FLOATS_PER_VERTEX, NULL, 0, 0 };
+    if (mesh >= 0 && mesh < MESH_COUNT && m_meshes[mesh].indexCount > 0) {
+        const MESH_RANGE& range = m_meshes[mesh];
+        geometry.vertices = range.data.vertices;
+        geometry.indices = range.data.indices;
+        geometry.indexCount = (size_t)range.indexCount;
+        geometry.vertexCount = range.data.vertexCount;
+    }
+    return geometry;
+}
+
+/***********************************************************
+ *  SetDrawCommands()
+ *
+ *  This method uploads the frame's draw commands into the
+ *  draw indirect buffer, orphaning the previous ones, and
+ *  leaves the buffer bound for MultiDrawIndirect(). Without
+ *  indirect multi-draws the commands are kept in memory.
+ ***********************************************************/
+void PrimitiveMeshes::SetDrawCommands(const DRAW_INDIRECT_COMMAND* commands, size_t count) {
+    CreateBuffers();
+    if (!m_multiDrawIndirect) {
+        m_drawCommands.assign(commands, commands + count);
+        return;
+    }
+    if (count > m_indirectCapacity) {
+        m_indirectCapacity = count;
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, m_indirectCapacity * sizeof(DRAW_INDIRECT_COMMAND), NULL, GL_STREAM_DRAW);
+    if (count > 0) {
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, count * sizeof(DRAW_INDIRECT_COMMAND), commands);
+    }
+    FrameStats::Current().glCalls += (count > 0) ? 3 : 2;
+    ++FrameStats::Current().bufferUploads;
+}
+
+/***********************************************************
+ *  MultiDrawIndirect()
+ *
+ *  This method draws a range of the commands set by the last
+ *  SetDrawCommands() call with one glMultiDrawElementsIndirect
+ *  call, or one draw per command where that is unavailable.
+ ***********************************************************/
+void PrimitiveMeshes::MultiDrawIndirect(size_t firstCommand, GLsizei count) {
+    if (count <= 0) {
+        return;
+    }
+    if (m_multiDrawIndirect) {
+        GLDRAW(glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+            (const void*)(sizeof(DRAW_INDIRECT_COMMAND) * firstCommand), count, sizeof(DRAW_INDIRECT_COMMAND)));
+        FrameStats::Current().drawCommands += count;
+        return;
+    }
+    for (GLsizei i = 0; i < count; ++i) {
+        DrawCommand(m_drawCommands[firstCommand + i]);
+    }
+}
+
+/***********************************************************
+ *  DrawCommand()
+ *
+ *  This method issues a single draw command directly.
+ ***********************************************************/
+void PrimitiveMeshes::DrawCommand(const DRAW_INDIRECT_COMMAND& command) {
+    if (command.count == 0 || command.instanceCount == 0) {
+        return;
+    }
+    const void* indices = (const void*)(sizeof(GLuint) * command.firstIndex);
+#ifdef __APPLE__
+    // no base instance support in OpenGL 4.1, so the instance
+    // attributes are re-pointed at the first instance instead
+    SetInstanceAttributes(command.baseInstance);
+    FrameStats::Current().glCalls += 7;
+    GLDRAW(glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, indices,
+        command.instanceCount, command.baseVertex));
+#else
+    GLDRAW(glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES, command.count, GL_UNSIGNED_INT, indices,
+        command.instanceCount, command.baseVertex, command.baseInstance));
+#endif
+    ++FrameStats::Current().drawCommands;
+}
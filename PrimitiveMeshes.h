@@ -0,0 +1,172 @@
+///////////////////////////////////////////////////////////////////////////////
+// primitivemeshes.h
+// ============
+// Indexed basic shape meshes in shared buffers, drawn with per-instance
+// model matrices, texture array layers and material ids
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "Culling.h"
+#include "JobSystem.h"
+#include "MeshCache.h"
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <vector>
+
+// basic shape meshes that scene objects can reference
+enum MESH_ID
+{
+    MESH_PLANE = 0,
+    MESH_BOX,
+    MESH_CYLINDER,
+    MESH_CONE,
+    MESH_TORUS,
+    MESH_COUNT
+};
+
+/***********************************************************
+ *  DRAW_INDIRECT_COMMAND
+ *
+ *  One draw of glMultiDrawElementsIndirect, laid out as
+ *  OpenGL reads it from the draw indirect buffer.
+ ***********************************************************/
+struct DRAW_INDIRECT_COMMAND
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+/***********************************************************
+ *  MESH_GEOMETRY
+ *
+ *  CPU copy of a loaded mesh's triangles. Every vertex is
+ *  vertexStride floats long and starts with its position.
+ ***********************************************************/
+struct MESH_GEOMETRY
+{
+    const GLfloat* vertices;
+    size_t vertexStride;
+    const GLuint* indices;
+    size_t indexCount;
+    size_t vertexCount;
+};
+
+/***********************************************************
+ *  PrimitiveMeshes
+ *
+ *  This class generates the basic shapes with the same
+ *  vertex layout and dimensions as ShapeMeshes (position,
+ *  normal and texture coordinate at locations 0, 1 and 2),
+ *  but as indexed meshes sub-allocated from one shared
+ *  vertex and index buffer behind a single vertex array
+ *  object. Every mesh reads its model matrix (locations 3
+ *  to 6), texture array layer and material id (location 7,
+ *  a uvec2) from the
+ *  frame's instance data in one shared buffer, so the draws
+ *  of all meshes can be issued from a buffer of indirect
+ *  draw commands.
+ *
+ *  Meshes are reference counted and keyed by shape and
+ *  tessellation in a mesh cache file, so a mesh is only
+ *  generated once, ever; later runs upload it from the
+ *  mapped file.
+ ***********************************************************/
+class PrimitiveMeshes
+{
+public:
+    // constructor
+    PrimitiveMeshes();
+    // destructor
+    ~PrimitiveMeshes();
+
+    // add a reference to a mesh; LoadMeshes() loads every mesh
+    // that has references
+    void AcquireMesh(MESH_ID mesh);
+    // drop a reference to a mesh; LoadMeshes() unloads every mesh
+    // that has none left
+    void ReleaseMesh(MESH_ID mesh);
+    // make the loaded meshes match the referenced ones, taking them
+    // from the mesh cache and generating the missing ones on the
+    // job system (nothing happens if they already match)
+    void LoadMeshes(JobSystem* pJobSystem);
+    // keep the loaded meshes on the CPU only, without creating or
+    // filling the OpenGL buffers (for software rasterization)
+    void SetUploadEnabled(bool enabled) { m_uploadEnabled = enabled; }
+
+    // read the instance model matrices and surfaces (texture array
+    // layer, material id) from a buffer at the given byte offsets;
+    // the shared vertex array object must be bound
+    void SetInstanceSource(GLuint buffer, GLintptr matrixOffset, GLintptr surfaceOffset);
+    // advance the instance attributes once every divisor instances
+    // (1 by default), so consecutive instances share an object; the
+    // shared vertex array object must be bound
+    void SetInstanceDivisor(GLuint divisor);
+
+    // bounding box of a mesh in its own (object) space
+    static AABB GetLocalBounds(MESH_ID mesh);
+
+    // vertex array object shared by all meshes (0 if none loaded)
+    GLuint GetVertexArray() const { return m_vertexArray; }
+    // indirect draw command for instances of a loaded mesh; safe
+    // to call from any thread while no mesh is being loaded
+    DRAW_INDIRECT_COMMAND GetDrawCommand(MESH_ID mesh, GLuint firstInstance, GLuint count) const;
+    // triangles of a loaded mesh (no triangles if not loaded); same
+    // thread rules as GetDrawCommand()
+    MESH_GEOMETRY GetMeshGeometry(MESH_ID mesh) const;
+
+    // replace the contents of the draw indirect buffer
+    void SetDrawCommands(const DRAW_INDIRECT_COMMAND* commands, size_t count);
+    // draw a range of the commands in the draw indirect buffer;
+    // the shared vertex array object must be bound
+    void MultiDrawIndirect(size_t firstCommand, GLsizei count);
+
+private:
+    // range of a mesh inside the shared buffers, its references and
+    // its CPU copy in the mesh cache
+    struct MESH_RANGE
+    {
+        GLuint firstIndex;
+        GLsizei indexCount;
+        GLint baseVertex;
+        int references;
+        CACHED_MESH data;
+    };
+
+    MESH_RANGE m_meshes[MESH_COUNT];
+    // vertex array object and buffers shared by all meshes
+    GLuint m_vertexArray;
+    GLuint m_vertexBuffer;
+    GLuint m_indexBuffer;
+    // generated meshes, mapped from the cache file
+    MeshCache m_meshCache;
+    bool m_meshCacheOpen;
+    // false when the meshes are not uploaded to OpenGL
+    bool m_uploadEnabled;
+    // buffer holding the frame's instance data (not owned), and the
+    // byte offsets of its model matrices and surfaces
+    GLuint m_instanceBuffer;
+    size_t m_instanceMatrixOffset;
+    size_t m_instanceSurfaceOffset;
+    // current divisor of the instance attributes
+    GLuint m_instanceDivisor;
+    // buffer holding the frame's indirect draw commands
+    GLuint m_indirectBuffer;
+    // number of commands the indirect buffer can hold
+    size_t m_indirectCapacity;
+    // true when glMultiDrawElementsIndirect is available
+    bool m_multiDrawIndirect;
+    // the frame's draw commands, issued one by one without it
+    std::vector<DRAW_INDIRECT_COMMAND> m_drawCommands;
+
+    // create the shared buffers if they do not exist yet
+    void CreateBuffers();
+    // point the instance attributes of the vertex array at an offset
+    void SetInstanceAttributes(GLuint firstInstance);
+    // draw one command without the draw indirect buffer
+    void DrawCommand(const DRAW_INDIRECT_COMMAND& command);
+};
@@ -0,0 +1,396 @@
+///////////////////////////////////////////////////////////////////////////////
+// profiler.cpp
+// ============
+// Scoped CPU and GPU frame timers with Chrome trace and CSV export
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Profiler.h"
+#include "FrameStats.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+namespace {
+    // frames a query set waits before its results are read back
+    const uint32_t QUERY_RING_SIZE = 4;
+    // frames kept for export; older frames are dropped
+    const size_t MAX_RECORDED_FRAMES = 3000;
+    // trace thread id used for GPU events
+    const uint32_t GPU_THREAD = 0;
+
+    struct TRACE_EVENT
+    {
+        const char* name;
+        uint32_t frame;
+        uint32_t thread;
+        // nanoseconds since the profiler started
+        int64_t start;
+        int64_t duration;
+    };
+
+    struct GPU_SCOPE_QUERIES
+    {
+        const char* name;
+        GLuint beginQuery;
+        GLuint endQuery;
+    };
+
+    // timestamp queries issued during one frame
+    struct QUERY_SET
+    {
+        uint32_t frame;
+        // query objects owned by the set, reused every time round the ring
+        std::vector<GLuint> pool;
+        size_t used;
+        std::vector<GPU_SCOPE_QUERIES> scopes;
+        // query written last, whose result arrives last
+        GLuint lastQuery;
+        bool pending;
+    };
+
+    // per-scope totals of one frame, in milliseconds (-1 = not measured)
+    struct FRAME_RECORD
+    {
+        uint32_t frame;
+        int64_t start;
+        int64_t end;
+        std::vector<double> cpuMs;
+        std::vector<double> gpuMs;
+    };
+
+    std::atomic<bool> g_enabled(false);
+    std::atomic<uint32_t> g_frame(0);
+    std::atomic<uint32_t> g_nextThread(GPU_THREAD + 1);
+    thread_local uint32_t t_thread = GPU_THREAD;
+    const std::chrono::steady_clock::time_point g_epoch = std::chrono::steady_clock::now();
+
+    // guards the recorded events, frames and scope names
+    std::mutex g_mutex;
+    std::deque<TRACE_EVENT> g_events;
+    std::deque<FRAME_RECORD> g_frames;
+    std::vector<const char*> g_scopeNames;
+
+    // GL thread only
+    QUERY_SET g_querySets[QUERY_RING_SIZE];
+    int64_t g_gpuToCpuOffset = 0;
+    bool g_calibrated = false;
+    unsigned int g_droppedQuerySets = 0;
+
+    int64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - g_epoch).count();
+    }
+
+    uint32_t CurrentThread() {
+        if (t_thread == GPU_THREAD) {
+            t_thread = g_nextThread++;
+        }
+        return t_thread;
+    }
+
+    // column of a scope in the frame records (g_mutex must be held)
+    size_t ScopeIndex(const char* name) {
+        for (size_t i = 0; i < g_scopeNames.size(); ++i) {
+            if (g_scopeNames[i] == name || strcmp(g_scopeNames[i], name) == 0) {
+                return i;
+            }
+        }
+        g_scopeNames.push_back(name);
+        return g_scopeNames.size() - 1;
+    }
+
+    // store an event and add its time to its frame's totals
+    void Record(const char* name, uint32_t frame, uint32_t thread, int64_t start, int64_t duration) {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        TRACE_EVENT event = { name, frame, thread, start, duration };
+        g_events.push_back(event);
+
+        if (g_frames.empty() || frame < g_frames.front().frame || frame > g_frames.back().frame) {
+            return;
+        }
+        FRAME_RECORD& record = g_frames[frame - g_frames.front().frame];
+        size_t index = ScopeIndex(name);
+        std::vector<double>& totals = (thread == GPU_THREAD) ? record.gpuMs : record.cpuMs;
+        if (totals.size() <= index) {
+            totals.resize(index + 1, -1.0);
+        }
+        double ms = duration / 1000000.0;
+        totals[index] = (totals[index] < 0.0) ? ms : totals[index] + ms;
+    }
+
+    /***********************************************************
+     *  ResolveQueries()
+     *
+     *  Reads the timestamps of a finished query set. Without
+     *  wait, a set whose results have not arrived is dropped
+     *  rather than stalling the pipeline.
+     ***********************************************************/
+    void ResolveQueries(QUERY_SET& set, bool wait) {
+        set.pending = false;
+        if (set.scopes.empty()) {
+            return;
+        }
+        if (!wait) {
+            GLint available = 0;
+            glGetQueryObjectiv(set.lastQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+            ++FrameStats::Current().glCalls;
+            if (!available) {
+                ++g_droppedQuerySets;
+                return;
+            }
+        }
+        for (size_t i = 0; i < set.scopes.size(); ++i) {
+            GLuint64 begin = 0;
+            GLuint64 end = 0;
+            glGetQueryObjectui64v(set.scopes[i].beginQuery, GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(set.scopes[i].endQuery, GL_QUERY_RESULT, &end);
+            FrameStats::Current().glCalls += 2;
+            Record(set.scopes[i].name, set.frame, GPU_THREAD,
+                (int64_t)begin + g_gpuToCpuOffset, (int64_t)(end - begin));
+        }
+    }
+
+    GLuint AcquireQuery(QUERY_SET& set) {
+        if (set.used == set.pool.size()) {
+            GLuint query = 0;
+            glGenQueries(1, &query);
+            ++FrameStats::Current().glCalls;
+            set.pool.push_back(query);
+        }
+        return set.pool[set.used++];
+    }
+
+    void WriteJsonString(std::ostream& out, const char* text) {
+        out << '"';
+        for (const char* c = text; *c != '\0'; ++c) {
+            if (*c == '"' || *c == '\\') {
+                out << '\\';
+            }
+            out << *c;
+        }
+        out << '"';
+    }
+}
+
+void Profiler::SetEnabled(bool enabled) {
+    g_enabled = enabled;
+}
+
+bool Profiler::IsEnabled() {
+    return g_enabled;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This function starts a new frame record and reads back
+ *  the GPU timestamps of the frame that last used the query
+ *  set this frame is going to reuse.
+ ***********************************************************/
+void Profiler::BeginFrame() {
+    if (!g_enabled) {
+        return;
+    }
+    if (!g_calibrated) {
+        // line up the GPU clock with the CPU clock once
+        GLint64 gpuTime = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+        ++FrameStats::Current().glCalls;
+        g_gpuToCpuOffset = Now() - gpuTime;
+        g_calibrated = true;
+    }
+    CurrentThread();
+
+    uint32_t frame = ++g_frame;
+    QUERY_SET& set = g_querySets[frame % QUERY_RING_SIZE];
+    if (set.pending) {
+        ResolveQueries(set, false);
+    }
+    set.frame = frame;
+    set.used = 0;
+    set.scopes.clear();
+    set.lastQuery = 0;
+    set.pending = true;
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    FRAME_RECORD record;
+    record.frame = frame;
+    record.start = Now();
+    record.end = 0;
+    g_frames.push_back(record);
+    while (g_frames.size() > MAX_RECORDED_FRAMES) {
+        g_frames.pop_front();
+    }
+    while (!g_events.empty() && g_events.front().frame < g_frames.front().frame) {
+        g_events.pop_front();
+    }
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This function closes the current frame record.
+ ***********************************************************/
+void Profiler::EndFrame() {
+    if (!g_enabled) {
+        return;
+    }
+    int64_t end = Now();
+    int64_t start = 0;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        if (g_frames.empty() || g_frames.back().frame != g_frame) {
+            return;
+        }
+        g_frames.back().end = end;
+        start = g_frames.back().start;
+    }
+    Record("Frame", g_frame, CurrentThread(), start, end - start);
+}
+
+/***********************************************************
+ *  WriteChromeTrace()
+ *
+ *  This function waits for the outstanding GPU timestamps
+ *  and writes all recorded scopes in the Chrome trace event
+ *  format, one track per CPU thread plus one for the GPU.
+ ***********************************************************/
+bool Profiler::WriteChromeTrace(const char* filename) {
+    for (uint32_t i = 0; i < QUERY_RING_SIZE; ++i) {
+        if (g_querySets[i].pending) {
+            ResolveQueries(g_querySets[i], true);
+        }
+    }
+
+    std::ofstream out(filename);
+    if (!out) {
+        std::cout << "ERROR: could not write profile trace " << filename << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    out << std::fixed << std::setprecision(3);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << GPU_THREAD
+        << ",\"args\":{\"name\":\"GPU\"}}";
+    for (uint32_t thread = GPU_THREAD + 1; thread < g_nextThread; ++thread) {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+            << ",\"args\":{\"name\":\"CPU thread " << thread << "\"}}";
+    }
+    for (size_t i = 0; i < g_events.size(); ++i) {
+        const TRACE_EVENT& event = g_events[i];
+        out << ",\n{\"name\":";
+        WriteJsonString(out, event.name);
+        out << ",\"cat\":\"" << (event.thread == GPU_THREAD ? "gpu" : "cpu")
+            << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << event.start / 1000.0
+            << ",\"dur\":" << event.duration / 1000.0
+            << ",\"args\":{\"frame\":" << event.frame << "}}";
+    }
+    out << "\n]}\n";
+
+    std::cout << "INFO: Wrote " << g_events.size() << " profile events to " << filename << std::endl;
+    if (g_droppedQuerySets > 0) {
+        std::cout << "INFO: GPU timings of " << g_droppedQuerySets
+            << " frames were not ready in time and were dropped" << std::endl;
+    }
+    return true;
+}
+
+/***********************************************************
+ *  WriteFrameCSV()
+ *
+ *  This function writes one row per finished frame with the
+ *  frame time and the CPU and GPU time spent in each scope.
+ *  Scopes that did not run in a frame are left empty.
+ ***********************************************************/
+bool Profiler::WriteFrameCSV(const char* filename) {
+    for (uint32_t i = 0; i < QUERY_RING_SIZE; ++i) {
+        if (g_querySets[i].pending) {
+            ResolveQueries(g_querySets[i], true);
+        }
+    }
+
+    std::ofstream out(filename);
+    if (!out) {
+        std::cout << "ERROR: could not write profile frames " << filename << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(g_mutex);
+    out << std::fixed << std::setprecision(4);
+    out << "frame,frame_ms";
+    for (size_t i = 0; i < g_scopeNames.size(); ++i) {
+        out << "," << g_scopeNames[i] << " cpu_ms," << g_scopeNames[i] << " gpu_ms";
+    }
+    out << "\n";
+
+    for (size_t f = 0; f < g_frames.size(); ++f) {
+        const FRAME_RECORD& record = g_frames[f];
+        if (record.end == 0) {
+            continue;
+        }
+        out << record.frame << "," << (record.end - record.start) / 1000000.0;
+        for (size_t i = 0; i < g_scopeNames.size(); ++i) {
+            out << ",";
+            if (i < record.cpuMs.size() && record.cpuMs[i] >= 0.0) {
+                out << record.cpuMs[i];
+            }
+            out << ",";
+            if (i < record.gpuMs.size() && record.gpuMs[i] >= 0.0) {
+                out << record.gpuMs[i];
+            }
+        }
+        out << "\n";
+    }
+    return true;
+}
+
+Profiler::CpuScope::CpuScope(const char* name) {
+    m_name = name;
+    m_active = g_enabled;
+    m_start = m_active ? Now() : 0;
+}
+
+Profiler::CpuScope::~CpuScope() {
+    if (m_active) {
+        Record(m_name, g_frame, CurrentThread(), m_start, Now() - m_start);
+    }
+}
+
+/***********************************************************
+ *  GpuScope()
+ *
+ *  Writes a timestamp query before the scope's OpenGL work;
+ *  the destructor writes a second one after it.
+ ***********************************************************/
+Profiler::GpuScope::GpuScope(const char* name) {
+    m_endQuery = 0;
+    if (!g_enabled || !g_calibrated) {
+        return;
+    }
+    QUERY_SET& set = g_querySets[g_frame % QUERY_RING_SIZE];
+    GPU_SCOPE_QUERIES scope;
+    scope.name = name;
+    scope.beginQuery = AcquireQuery(set);
+    scope.endQuery = AcquireQuery(set);
+    set.scopes.push_back(scope);
+    glQueryCounter(scope.beginQuery, GL_TIMESTAMP);
+    ++FrameStats::Current().glCalls;
+    m_endQuery = scope.endQuery;
+}
+
+Profiler::GpuScope::~GpuScope() {
+    if (m_endQuery == 0) {
+        return;
+    }
+    glQueryCounter(m_endQuery, GL_TIMESTAMP);
+    ++FrameStats::Current().glCalls;
+    g_querySets[g_frame % QUERY_RING_SIZE].lastQuery = m_endQuery;
+}
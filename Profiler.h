@@ -0,0 +1,71 @@
+///////////////////////////////////////////////////////////////////////////////
+// profiler.h
+// ============
+// Scoped CPU and GPU frame timers with Chrome trace and CSV export
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+
+/***********************************************************
+ *  Profiler
+ *
+ *  CPU scopes measure wall time on any thread, including the
+ *  job system workers. GPU scopes place GL_TIMESTAMP queries
+ *  around OpenGL work on the GL thread; timestamps are used
+ *  rather than GL_TIME_ELAPSED because elapsed-time queries
+ *  cannot be nested. The queries of a frame are read back
+ *  several frames later from a ring of query sets, so the
+ *  CPU never waits for the GPU. Nothing is recorded until
+ *  the profiler is enabled.
+ ***********************************************************/
+namespace Profiler
+{
+    // start or stop recording
+    void SetEnabled(bool enabled);
+    bool IsEnabled();
+
+    // mark the start and end of a frame (GL thread)
+    void BeginFrame();
+    void EndFrame();
+
+    // write every recorded scope as a Chrome trace (chrome://tracing)
+    bool WriteChromeTrace(const char* filename);
+    // write one row per frame with the CPU and GPU time of each scope
+    bool WriteFrameCSV(const char* filename);
+
+    // times the enclosing block on the CPU; name must be a string literal
+    class CpuScope
+    {
+    public:
+        explicit CpuScope(const char* name);
+        ~CpuScope();
+
+    private:
+        const char* m_name;
+        int64_t m_start;
+        bool m_active;
+    };
+
+    // times the OpenGL work issued in the enclosing block (GL thread only)
+    class GpuScope
+    {
+    public:
+        explicit GpuScope(const char* name);
+        ~GpuScope();
+
+    private:
+        GLuint m_endQuery;
+    };
+}
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+// time the rest of the block on the CPU
+#define PROFILE_CPU_SCOPE(name) Profiler::CpuScope PROFILE_JOIN(cpuScope, __LINE__)(name)
+// time the rest of the block on the CPU and the GPU
+#define PROFILE_GPU_SCOPE(name) \
+    Profiler::CpuScope PROFILE_JOIN(cpuScope, __LINE__)(name); \
+    Profiler::GpuScope PROFILE_JOIN(gpuScope, __LINE__)(name)
@@ -0,0 +1,215 @@
+///////////////////////////////////////////////////////////////////////////////
+// programcache.cpp
+// ============
+// Disk cache of linked shader program binaries, so the GLSL sources are
+// only compiled when they, or the driver, have changed
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ProgramCache.h"
+#include "MappedFile.h"
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+    // identifies cache files, and their layout version
+    const uint32_t CACHE_MAGIC = 0x4E494250;    // "PBIN"
+    const uint32_t CACHE_VERSION = 1;
+
+    struct CACHE_HEADER
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t key;
+        uint32_t binaryFormat;
+        uint32_t binaryLength;
+    };
+
+    // read a whole file into memory
+    bool ReadFile(const std::string& path, std::vector<char>& data) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (size < 0) {
+            fclose(file);
+            return false;
+        }
+        data.resize((size_t)size);
+        size_t bytesRead = fread(data.data(), 1, data.size(), file);
+        fclose(file);
+        return bytesRead == data.size();
+    }
+
+    // add a memory block to a 64-bit FNV-1a hash
+    uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // add a string and its terminator, so "ab"+"c" differs from "a"+"bc"
+    uint64_t HashString(uint64_t hash, const char* text) {
+        if (text == NULL) {
+            text = "";
+        }
+        return HashBytes(hash, text, strlen(text) + 1);
+    }
+
+    // cache file of a shader pair: the vertex shader path with
+    // its extension replaced
+    std::string GetCachePath(const char* vertexShaderPath) {
+        std::string path = vertexShaderPath;
+        size_t separator = path.find_last_of("/\\");
+        size_t dot = path.find_last_of('.');
+        if (dot != std::string::npos && (separator == std::string::npos || dot > separator)) {
+            path.erase(dot);
+        }
+        return path + ".programbin";
+    }
+
+    // true when the driver can save and load program binaries
+    bool BinariesSupported() {
+        if (!GLEW_ARB_get_program_binary) {
+            return false;
+        }
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    double MillisecondsSince(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    /***********************************************************
+     *  LoadBinary()
+     *
+     *  This function creates a program from a cache file. It
+     *  returns 0 when the file is missing, was written for
+     *  other sources or another driver, or is rejected by the
+     *  driver.
+     ***********************************************************/
+    GLuint LoadBinary(const std::string& cachePath, uint64_t key) {
+        std::vector<char> data;
+        if (!ReadFile(cachePath, data) || data.size() < sizeof(CACHE_HEADER)) {
+            return 0;
+        }
+        CACHE_HEADER header;
+        memcpy(&header, data.data(), sizeof(header));
+        if (header.magic != CACHE_MAGIC || header.version != CACHE_VERSION || header.key != key ||
+            header.binaryLength != data.size() - sizeof(header)) {
+            std::cout << "INFO: Shader program cache " << cachePath << " is out of date" << std::endl;
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glProgramBinary(program, header.binaryFormat, data.data() + sizeof(header), (GLsizei)header.binaryLength);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (linked != GL_TRUE) {
+            // e.g. a driver update that kept the version string
+            std::cout << "INFO: Shader program cache " << cachePath << " was rejected by the driver" << std::endl;
+            glDeleteProgram(program);
+            return 0;
+        }
+        return program;
+    }
+
+    /***********************************************************
+     *  SaveBinary()
+     *
+     *  This function writes the binary of a linked program to
+     *  a cache file.
+     ***********************************************************/
+    void SaveBinary(const std::string& cachePath, uint64_t key, GLuint program) {
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0) {
+            return;
+        }
+        std::vector<char> data(sizeof(CACHE_HEADER) + (size_t)length);
+        CACHE_HEADER header;
+        header.magic = CACHE_MAGIC;
+        header.version = CACHE_VERSION;
+        header.key = key;
+        GLenum binaryFormat = 0;
+        GLsizei written = 0;
+        glGetProgramBinary(program, length, &written, &binaryFormat, data.data() + sizeof(header));
+        if (written <= 0) {
+            return;
+        }
+        header.binaryFormat = binaryFormat;
+        header.binaryLength = (uint32_t)written;
+        memcpy(data.data(), &header, sizeof(header));
+
+        // another running instance may be reading the old binary
+        if (!WriteFileAtomic(cachePath.c_str(), data.data(), sizeof(header) + (size_t)written)) {
+            std::cout << "ERROR: Could not write shader program cache " << cachePath << std::endl;
+            return;
+        }
+        std::cout << "INFO: Saved shader program cache " << cachePath << " (" << written << " bytes)" << std::endl;
+    }
+}
+
+/***********************************************************
+ *  LoadShaders()
+ *
+ *  This function loads the shader program from the cache if
+ *  it matches the sources and the driver, and otherwise
+ *  compiles the sources through the shader manager and
+ *  updates the cache.
+ ***********************************************************/
+bool ProgramCache::LoadShaders(ShaderManager* pShaderManager, const char* vertexShaderPath, const char* fragmentShaderPath) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // missing sources are reported by the shader manager
+    std::vector<char> vertexSource;
+    std::vector<char> fragmentSource;
+    bool useCache = BinariesSupported() &&
+        ReadFile(vertexShaderPath, vertexSource) && ReadFile(fragmentShaderPath, fragmentSource);
+
+    std::string cachePath = GetCachePath(vertexShaderPath);
+    uint64_t key = 14695981039346656037ull;
+    if (useCache) {
+        key = HashBytes(key, &CACHE_VERSION, sizeof(CACHE_VERSION));
+        key = HashBytes(key, vertexSource.data(), vertexSource.size());
+        key = HashString(key, "");
+        key = HashBytes(key, fragmentSource.data(), fragmentSource.size());
+        key = HashString(key, "");
+        key = HashString(key, (const char*)glGetString(GL_VENDOR));
+        key = HashString(key, (const char*)glGetString(GL_RENDERER));
+        key = HashString(key, (const char*)glGetString(GL_VERSION));
+        key = HashString(key, (const char*)glGetString(GL_SHADING_LANGUAGE_VERSION));
+
+        GLuint program = LoadBinary(cachePath, key);
+        if (program != 0) {
+            pShaderManager->m_programID = program;
+            std::cout << "INFO: Loaded shader program from cache " << cachePath << " in "
+                << MillisecondsSince(start) << " ms" << std::endl;
+            return true;
+        }
+    }
+
+    pShaderManager->LoadShaders(vertexShaderPath, fragmentShaderPath);
+    GLuint program = pShaderManager->m_programID;
+    if (program == 0) {
+        return false;
+    }
+    std::cout << "INFO: Compiled shader program in " << MillisecondsSince(start) << " ms" << std::endl;
+    if (useCache) {
+        SaveBinary(cachePath, key, program);
+    }
+    return true;
+}
@@ -0,0 +1,27 @@
+///////////////////////////////////////////////////////////////////////////////
+// programcache.h
+// ============
+// Disk cache of linked shader program binaries, so the GLSL sources are
+// only compiled when they, or the driver, have changed
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "ShaderManager.h"
+
+/***********************************************************
+ *  ProgramCache
+ *
+ *  Wraps ShaderManager::LoadShaders(). The program binary
+ *  is saved with glGetProgramBinary next to the vertex
+ *  shader, keyed by a hash of both shader sources and the
+ *  OpenGL vendor, renderer and version strings. A matching
+ *  binary is loaded with glProgramBinary; a stale, rejected
+ *  or missing one falls back to compiling the sources.
+ ***********************************************************/
+namespace ProgramCache
+{
+    // load the program into the shader manager, from the cache
+    // when possible; returns false if no program could be created
+    bool LoadShaders(ShaderManager* pShaderManager, const char* vertexShaderPath, const char* fragmentShaderPath);
+}
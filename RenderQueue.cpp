@@ -0,0 +1,166 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.cpp
+// ============
+// Sorted draw packet queue and an OpenGL state cache that filters out
+// redundant state changes while the packets are submitted
+///////////////////////////////////////////////////////////////////////////////
+
+#include "RenderQueue.h"
+#include "FrameStats.h"
+#include <algorithm>
+
+namespace {
+    // sort draw packets by ascending state key
+    bool ComparePackets(const DRAW_PACKET& a, const DRAW_PACKET& b) {
+        return a.sortKey < b.sortKey;
+    }
+
+    // value of the cached int members when the state is unknown
+    const int UNKNOWN = -1;
+}
+
+/***********************************************************
+ *  MakeSortKey()
+ *
+ *  This method packs the state of a draw packet into a key.
+ *  Fields are truncated to their bit widths, which only
+ *  affects the grouping, never the correctness of a draw.
+ ***********************************************************/
+uint64_t RenderQueue::MakeSortKey(bool blend, GLuint program, GLuint texture, MESH_ID mesh) {
+    return ((uint64_t)(blend ? 1 : 0) << 63) |
+        ((uint64_t)(program & 0xFF) << 55) |
+        ((uint64_t)(texture & 0xFFFF) << 39) |
+        ((uint64_t)(mesh & 0xFF) << 31);
+}
+
+/***********************************************************
+ *  Submit()
+ *
+ *  This method records a draw packet for the frame.
+ ***********************************************************/
+void RenderQueue::Submit(DRAW_PACKET packet) {
+    packet.sortKey = MakeSortKey(packet.blend, packet.program, packet.texture, packet.mesh);
+    m_packets.push_back(packet);
+}
+
+void RenderQueue::Set(size_t index, DRAW_PACKET packet) {
+    packet.sortKey = MakeSortKey(packet.blend, packet.program, packet.texture, packet.mesh);
+    m_packets[index] = packet;
+}
+
+/***********************************************************
+ *  Sort()
+ *
+ *  This method orders the packets by state. The sort is
+ *  stable, so packets with equal keys keep their order.
+ ***********************************************************/
+void RenderQueue::Sort() {
+    std::stable_sort(m_packets.begin(), m_packets.end(), ComparePackets);
+}
+
+/***********************************************************
+ *  GLStateCache()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+GLStateCache::GLStateCache() {
+    Invalidate();
+}
+
+/***********************************************************
+ *  Invalidate()
+ *
+ *  This method forgets the cached state, so the next change
+ *  of every kind is always issued.
+ ***********************************************************/
+void GLStateCache::Invalidate() {
+    m_program = 0;
+    m_textureArray = 0;
+    m_vertexArray = 0;
+    m_depthTest = UNKNOWN;
+    m_blend = UNKNOWN;
+    m_useTexture = UNKNOWN;
+    m_programValid = false;
+    m_textureValid = false;
+    m_vertexArrayValid = false;
+}
+
+bool GLStateCache::CountChange(bool changed) {
+    if (changed) {
+        ++FrameStats::Current().stateChanges;
+        ++FrameStats::Current().glCalls;
+    }
+    else {
+        ++FrameStats::Current().stateChangesAvoided;
+    }
+    return changed;
+}
+
+bool GLStateCache::UseProgram(GLuint program) {
+    if (m_programValid && m_program == program) {
+        return CountChange(false);
+    }
+    glUseProgram(program);
+    m_program = program;
+    m_programValid = true;
+    return CountChange(true);
+}
+
+bool GLStateCache::BindTextureArray(GLuint texture) {
+    if (m_textureValid && m_textureArray == texture) {
+        return CountChange(false);
+    }
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    m_textureArray = texture;
+    m_textureValid = true;
+    return CountChange(true);
+}
+
+bool GLStateCache::BindVertexArray(GLuint vertexArray) {
+    if (m_vertexArrayValid && m_vertexArray == vertexArray) {
+        return CountChange(false);
+    }
+    glBindVertexArray(vertexArray);
+    m_vertexArray = vertexArray;
+    m_vertexArrayValid = true;
+    return CountChange(true);
+}
+
+bool GLStateCache::SetDepthTest(bool enabled) {
+    if (m_depthTest == (enabled ? 1 : 0)) {
+        return CountChange(false);
+    }
+    if (enabled) {
+        glEnable(GL_DEPTH_TEST);
+    }
+    else {
+        glDisable(GL_DEPTH_TEST);
+    }
+    m_depthTest = enabled ? 1 : 0;
+    return CountChange(true);
+}
+
+bool GLStateCache::SetBlend(bool enabled) {
+    if (m_blend == (enabled ? 1 : 0)) {
+        return CountChange(false);
+    }
+    if (enabled) {
+        glEnable(GL_BLEND);
+    }
+    else {
+        glDisable(GL_BLEND);
+    }
+    m_blend = enabled ? 1 : 0;
+    return CountChange(true);
+}
+
+bool GLStateCache::SetUseTexture(const Uniform<int>& handle, int value) {
+    if (m_useTexture == value) {
+        return CountChange(false);
+    }
+    // the uniform upload is counted by the handle itself
+    handle.Set(value);
+    m_useTexture = value;
+    ++FrameStats::Current().stateChanges;
+    return true;
+}
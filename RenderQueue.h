@@ -0,0 +1,113 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.h
+// ============
+// Sorted draw packet queue and an OpenGL state cache that filters out
+// redundant state changes while the packets are submitted
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PrimitiveMeshes.h"
+#include "ShaderUniforms.h"
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  DRAW_PACKET
+ *
+ *  Everything needed to issue one instanced draw. The sort
+ *  key orders packets so that draws sharing state end up
+ *  next to each other.
+ ***********************************************************/
+struct DRAW_PACKET
+{
+    uint64_t sortKey;
+    GLuint program;
+    GLuint texture;         // texture array, 0 for untextured draws
+    MESH_ID mesh;
+    bool blend;
+    GLuint firstInstance;
+    GLsizei instanceCount;
+};
+
+/***********************************************************
+ *  RenderQueue
+ *
+ *  This class records the draw packets of a frame and sorts
+ *  them by their 64-bit state key:
+ *
+ *    bit  63      blend (opaque packets are drawn first)
+ *    bits 55-62   shader program
+ *    bits 39-54   texture array
+ *    bits 31-38   mesh
+ *
+ *  The mesh comes last: packets that differ only in their
+ *  mesh share all state and are drawn by one multi-draw.
+ *  Materials are no draw state; every instance reads its
+ *  own from the material table.
+ ***********************************************************/
+class RenderQueue
+{
+public:
+    // build the state sort key for a packet
+    static uint64_t MakeSortKey(bool blend, GLuint program, GLuint texture, MESH_ID mesh);
+
+    // remove all recorded packets
+    void Clear() { m_packets.clear(); }
+    // record a packet, filling in its sort key
+    void Submit(DRAW_PACKET packet);
+    // make room for count packets to be filled in with Set()
+    void Resize(size_t count) { m_packets.resize(count); }
+    // fill in a packet and its sort key; several threads may set
+    // different packets at the same time
+    void Set(size_t index, DRAW_PACKET packet);
+    // order the recorded packets by sort key
+    void Sort();
+
+    const std::vector<DRAW_PACKET>& GetPackets() const { return m_packets; }
+
+private:
+    std::vector<DRAW_PACKET> m_packets;
+};
+
+/***********************************************************
+ *  GLStateCache
+ *
+ *  This class remembers the OpenGL state it has set and only
+ *  forwards a change to OpenGL when the value differs. Code
+ *  that changes the same state directly must call
+ *  Invalidate() afterwards.
+ ***********************************************************/
+class GLStateCache
+{
+public:
+    // constructor
+    GLStateCache();
+
+    // forget all cached state
+    void Invalidate();
+
+    // each method returns true when the change was issued
+    bool UseProgram(GLuint program);
+    bool BindTextureArray(GLuint texture);
+    bool BindVertexArray(GLuint vertexArray);
+    bool SetDepthTest(bool enabled);
+    bool SetBlend(bool enabled);
+    bool SetUseTexture(const Uniform<int>& handle, int value);
+
+private:
+    GLuint m_program;
+    GLuint m_textureArray;
+    GLuint m_vertexArray;
+    int m_depthTest;
+    int m_blend;
+    int m_useTexture;
+    // false while the matching member holds no known value
+    bool m_programValid;
+    bool m_textureValid;
+    bool m_vertexArrayValid;
+
+    // count an issued or avoided change in the frame statistics
+    bool CountChange(bool changed);
+};
@@ -0,0 +1,127 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenegenerator.cpp
+// ============
+// Seeded generator for large synthetic scenes built from copies of a
+// template scene, used to measure how the renderer scales
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneGenerator.h"
+#include <cmath>
+#include <iostream>
+#include <random>
+
+namespace {
+    // free space left around each copy of the template
+    const float CELL_MARGIN = 2.0f;
+    // height range and reach of the generated point lights
+    const float LIGHT_MIN_HEIGHT = 0.5f;
+    const float LIGHT_MAX_HEIGHT = 3.0f;
+    const float LIGHT_MIN_RADIUS = 2.0f;
+    const float LIGHT_MAX_RADIUS = 6.0f;
+
+    // uniform float in [minimum, maximum); mt19937 itself is fully
+    // specified, unlike the standard distributions, so the values
+    // are the same with every standard library
+    float RandomRange(std::mt19937& random, float minimum, float maximum) {
+        float unit = (random() >> 8) * (1.0f / 16777216.0f);
+        return minimum + unit * (maximum - minimum);
+    }
+}
+
+bool GenerateScene(
+    const SCENE_DESCRIPTION& sceneTemplate,
+    size_t objectCount,
+    size_t lightCount,
+    uint32_t seed,
+    SCENE_DESCRIPTION& scene) {
+    const SCENE_OBJECTS& source = sceneTemplate.objects;
+
+    // split the template into the ground and the objects to copy
+    int ground = -1;
+    std::vector<size_t> copied;
+    glm::vec2 minimum(1e30f);
+    glm::vec2 maximum(-1e30f);
+    for (size_t i = 0; i < source.Count(); ++i) {
+        if (ground < 0 && source.meshID[i] == MESH_PLANE) {
+            ground = (int)i;
+            continue;
+        }
+        copied.push_back(i);
+        glm::vec2 position(source.position[i].x, source.position[i].z);
+        glm::vec2 reach(glm::max(source.scale[i].x, source.scale[i].z));
+        minimum = glm::min(minimum, position - reach);
+        maximum = glm::max(maximum, position + reach);
+    }
+    if (copied.empty() || objectCount < 2) {
+        std::cout << "ERROR: scene template has nothing to replicate" << std::endl;
+        return false;
+    }
+
+    scene.textureTags = sceneTemplate.textureTags;
+    scene.texturePaths = sceneTemplate.texturePaths;
+    scene.materials = sceneTemplate.materials;
+    scene.lightDirection = sceneTemplate.lightDirection;
+    scene.lightColor = sceneTemplate.lightColor;
+    scene.pointLights = sceneTemplate.pointLights;
+    scene.objects.Clear();
+    scene.objects.Reserve(objectCount);
+
+    size_t copyCount = (objectCount - 1 + copied.size() - 1) / copied.size();
+    size_t gridSize = (size_t)ceil(sqrt((double)copyCount));
+    glm::vec2 footprint = maximum - minimum;
+    float cellSize = glm::max(footprint.x, footprint.y) + CELL_MARGIN;
+    float layoutSize = cellSize * gridSize;
+    glm::vec2 templateCenter = (minimum + maximum) * 0.5f;
+    // largest offset that keeps a copy inside its cell
+    glm::vec2 jitter = glm::max(glm::vec2(cellSize) - footprint, glm::vec2(0.0f)) * 0.5f;
+
+    // one ground plane under the whole grid (the plane mesh spans -1..1)
+    glm::vec3 groundScale(layoutSize * 0.5f, 1.0f, layoutSize * 0.5f);
+    glm::vec3 groundPosition(0.0f);
+    uint16_t groundMaterial = 0;
+    int groundTexture = -1;
+    if (ground >= 0) {
+        groundScale.y = source.scale[ground].y;
+        groundPosition.y = source.position[ground].y;
+        groundMaterial = source.materialID[ground];
+        groundTexture = source.textureID[ground];
+    }
+    scene.objects.Add(MESH_PLANE, groundTexture, groundMaterial,
+        groundScale, glm::vec3(0.0f), groundPosition, false);
+
+    std::mt19937 random(seed);
+    for (size_t copy = 0; copy < copyCount && scene.objects.Count() < objectCount; ++copy) {
+        glm::vec2 cell((float)(copy % gridSize), (float)(copy / gridSize));
+        glm::vec2 center = (cell + 0.5f) * cellSize - layoutSize * 0.5f;
+        center.x += RandomRange(random, -jitter.x, jitter.x);
+        center.y += RandomRange(random, -jitter.y, jitter.y);
+        glm::vec3 offset(center.x - templateCenter.x, 0.0f, center.y - templateCenter.y);
+
+        for (size_t c = 0; c < copied.size() && scene.objects.Count() < objectCount; ++c) {
+            size_t i = copied[c];
+            scene.objects.Add((MESH_ID)source.meshID[i], source.textureID[i], source.materialID[i],
+                source.scale[i], source.rotation[i], source.position[i] + offset, source.isDynamic[i] != 0);
+        }
+    }
+
+    // small colored lights scattered over the whole layout, drawn
+    // after the objects so the object layout does not depend on them
+    scene.pointLights.reserve(scene.pointLights.size() + lightCount);
+    for (size_t i = 0; i < lightCount; ++i) {
+        SCENE_POINT_LIGHT light;
+        light.position.x = RandomRange(random, -0.5f, 0.5f) * layoutSize;
+        light.position.y = groundPosition.y + RandomRange(random, LIGHT_MIN_HEIGHT, LIGHT_MAX_HEIGHT);
+        light.position.z = RandomRange(random, -0.5f, 0.5f) * layoutSize;
+        light.color.x = RandomRange(random, 0.2f, 1.0f);
+        light.color.y = RandomRange(random, 0.2f, 1.0f);
+        light.color.z = RandomRange(random, 0.2f, 1.0f);
+        light.intensity = 1.0f;
+        light.radius = RandomRange(random, LIGHT_MIN_RADIUS, LIGHT_MAX_RADIUS);
+        scene.pointLights.push_back(light);
+    }
+
+    std::cout << "INFO: Generated " << scene.objects.Count() << " objects (" << copyCount
+        << " copies of the template, seed " << seed << ") and " << scene.pointLights.size()
+        << " point lights" << std::endl;
+    return true;
+}
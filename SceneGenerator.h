@@ -0,0 +1,33 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenegenerator.h
+// ============
+// Seeded generator for large synthetic scenes built from copies of a
+// template scene, used to measure how the renderer scales
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "SceneLoader.h"
+#include <cstddef>
+#include <cstdint>
+
+/***********************************************************
+ *  GenerateScene()
+ *
+ *  Fills scene with objectCount objects: one ground plane
+ *  sized to the whole layout, plus copies of the template's
+ *  other objects (the desk, cup, lamp, glasses and pencils)
+ *  laid out on a square grid. Each copy is moved by a
+ *  random offset inside its grid cell. The same seed always
+ *  gives the same scene on every platform. The template's
+ *  textures, materials and lights are kept; its first plane
+ *  object is taken as the ground. lightCount point lights
+ *  with random colors and short reach are added at random
+ *  spots above the ground.
+ ***********************************************************/
+bool GenerateScene(
+    const SCENE_DESCRIPTION& sceneTemplate,
+    size_t objectCount,
+    size_t lightCount,
+    uint32_t seed,
+    SCENE_DESCRIPTION& scene);
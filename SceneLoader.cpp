@@ -0,0 +1,267 @@
+///////////////////////////////////////////////////////////////////////////////
+// sceneloader.cpp
+// ============
+// Load 3D scene descriptions from text files into flat
+// structure-of-arrays object storage
+//
+// Scene file format - one entry per line, '#' starts a comment:
+//
+//   texture     <tag> <image path>
+//   material    <tag> <r g b a> <specular strength>
+//   directional <direction x y z> <color r g b>
+//   pointlight  <position x y z> <color r g b> <intensity> [radius]
+//   object      <mesh> <texture tag | -> <material tag>
+//               <scale x y z> <rotation x y z (degrees)> <position x y z>
+//               [dynamic]
+//
+// Meshes are plane, box, cylinder, cone and torus. A scene may hold any
+// number of point lights; a light without a radius reaches as far as
+// GetPointLightRange() says its light is still visible.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneLoader.h"
+#include "TransformKernel.h"
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+    // scene file names of the MESH_ID values
+    const char* const MESH_NAMES[MESH_COUNT] = { "plane", "box", "cylinder", "cone", "torus" };
+
+    bool ReadVec3(std::istringstream& stream, glm::vec3& value) {
+        return static_cast<bool>(stream >> value.x >> value.y >> value.z);
+    }
+
+    // true when nothing but white space is left on the line
+    bool AtLineEnd(std::istringstream& stream) {
+        return (stream >> std::ws).eof();
+    }
+
+    int FindMesh(const std::string& name) {
+        int mesh = -1;
+        switch (HashTag(name.c_str())) {
+        case HashTag("plane"):    mesh = MESH_PLANE; break;
+        case HashTag("box"):      mesh = MESH_BOX; break;
+        case HashTag("cylinder"): mesh = MESH_CYLINDER; break;
+        case HashTag("cone"):     mesh = MESH_CONE; break;
+        case HashTag("torus"):    mesh = MESH_TORUS; break;
+        default: break;
+        }
+        // one comparison rules out an unknown name with a colliding hash
+        return (mesh >= 0 && name == MESH_NAMES[mesh]) ? mesh : -1;
+    }
+}
+
+void SCENE_OBJECTS::Reserve(size_t count) {
+    meshID.reserve(count);
+    textureID.reserve(count);
+    materialID.reserve(count);
+    modelMatrix.reserve(count);
+    isDynamic.reserve(count);
+    scale.reserve(count);
+    rotation.reserve(count);
+    position.reserve(count);
+}
+
+void SCENE_OBJECTS::Clear() {
+    meshID.clear();
+    textureID.clear();
+    materialID.clear();
+    modelMatrix.clear();
+    isDynamic.clear();
+    scale.clear();
+    rotation.clear();
+    position.clear();
+}
+
+void SCENE_OBJECTS::Add(MESH_ID mesh, int texture, uint16_t material,
+    const glm::vec3& scaleXYZ, const glm::vec3& rotationXYZ, const glm::vec3& positionXYZ, bool dynamic) {
+    meshID.push_back((uint8_t)mesh);
+    textureID.push_back(texture);
+    materialID.push_back(material);
+    modelMatrix.push_back(BuildModelMatrix(scaleXYZ, rotationXYZ, positionXYZ));
+    isDynamic.push_back(dynamic ? 1 : 0);
+    scale.push_back(scaleXYZ);
+    rotation.push_back(rotationXYZ);
+    position.push_back(positionXYZ);
+}
+
+/***********************************************************
+ *  BuildModelMatrix()
+ *
+ *  This function builds a model matrix from the scale,
+ *  the X/Y/Z rotations in degrees and the position, with
+ *  the same kernel that builds them in batches.
+ ***********************************************************/
+glm::mat4 BuildModelMatrix(const glm::vec3& scaleXYZ, const glm::vec3& rotationDegreesXYZ, const glm::vec3& positionXYZ) {
+    glm::mat4 modelMatrix;
+    TransformKernel::BuildModelMatrices(&scaleXYZ, &rotationDegreesXYZ, &positionXYZ, 1, &modelMatrix);
+    return modelMatrix;
+}
+
+/***********************************************************
+ *  GetPointLightRange()
+ *
+ *  This function returns the distance at which the light's
+ *  attenuated brightness, intensity / (1 + 0.09 d +
+ *  0.032 d^2) times its brightest color channel, drops
+ *  below one 8-bit color step.
+ ***********************************************************/
+float GetPointLightRange(const glm::vec3& color, float intensity) {
+    const float LINEAR = 0.09f;
+    const float QUADRATIC = 0.032f;
+    float brightness = intensity * glm::max(color.x, glm::max(color.y, color.z)) * 256.0f;
+    if (brightness <= 1.0f) {
+        return 0.0f;
+    }
+    // positive root of QUADRATIC d^2 + LINEAR d + 1 - brightness = 0
+    return (-LINEAR + sqrtf(LINEAR * LINEAR + 4.0f * QUADRATIC * (brightness - 1.0f))) / (2.0f * QUADRATIC);
+}
+
+/***********************************************************
+ *  LoadSceneFile()
+ *
+ *  This function reads a scene file into a scene description.
+ *  Object model matrices are computed once here, so static
+ *  objects never need them rebuilt while rendering.
+ ***********************************************************/
+bool LoadSceneFile(const char* filename, SCENE_DESCRIPTION& scene) {
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        std::cout << "ERROR: could not open scene file: " << filename << std::endl;
+        return false;
+    }
+
+    scene.textureTags.clear();
+    scene.texturePaths.clear();
+    scene.materials.clear();
+    scene.objects.Clear();
+    scene.lightDirection = glm::vec3(-0.2f, -1.0f, -0.3f);
+    scene.lightColor = glm::vec3(1.0f);
+    scene.pointLights.clear();
+
+    std::unordered_map<std::string, int> textureLookup;
+    std::unordered_map<std::string, int> materialLookup;
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        ++lineNumber;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+
+        std::istringstream stream(line);
+        std::string keyword;
+        if (!(stream >> keyword)) {
+            continue;
+        }
+
+        bool valid = true;
+        const char* error = "invalid scene entry";
+        if (keyword == "texture") {
+            std::string tag, path;
+            valid = static_cast<bool>(stream >> tag >> path);
+            if (valid && textureLookup.count(tag) > 0) {
+                valid = false;
+                error = "duplicate texture tag";
+            }
+            if (valid) {
+                textureLookup[tag] = (int)scene.textureTags.size();
+                scene.textureTags.push_back(tag);
+                scene.texturePaths.push_back(path);
+            }
+        }
+        else if (keyword == "material") {
+            SCENE_MATERIAL material;
+            valid = static_cast<bool>(stream >> material.tag >> material.color.x >> material.color.y >>
+                material.color.z >> material.color.w >> material.specularStrength);
+            if (valid && materialLookup.count(material.tag) > 0) {
+                valid = false;
+                error = "duplicate material tag";
+            }
+            // objects keep 16-bit material ids
+            if (valid && scene.materials.size() >= UINT16_MAX) {
+                valid = false;
+                error = "too many materials";
+            }
+            if (valid) {
+                materialLookup[material.tag] = (int)scene.materials.size();
+                scene.materials.push_back(material);
+            }
+        }
+        else if (keyword == "directional") {
+            valid = ReadVec3(stream, scene.lightDirection) && ReadVec3(stream, scene.lightColor);
+        }
+        else if (keyword == "pointlight") {
+            SCENE_POINT_LIGHT light;
+            valid = ReadVec3(stream, light.position) && ReadVec3(stream, light.color) &&
+                static_cast<bool>(stream >> light.intensity);
+            if (valid) {
+                if (AtLineEnd(stream)) {
+                    light.radius = GetPointLightRange(light.color, light.intensity);
+                }
+                else {
+                    valid = static_cast<bool>(stream >> light.radius) && light.radius >= 0.0f;
+                }
+            }
+            // a light too dark to see is left out
+            if (valid && light.radius > 0.0f) {
+                scene.pointLights.push_back(light);
+            }
+        }
+        else if (keyword == "object") {
+            std::string meshName, textureTag, materialTag, flag;
+            glm::vec3 scaleXYZ, rotationXYZ, positionXYZ;
+            valid = static_cast<bool>(stream >> meshName >> textureTag >> materialTag) &&
+                ReadVec3(stream, scaleXYZ) && ReadVec3(stream, rotationXYZ) && ReadVec3(stream, positionXYZ);
+
+            int mesh = FindMesh(meshName);
+            int texture = -1;
+            int material = -1;
+            if (valid) {
+                if (textureTag != "-") {
+                    std::unordered_map<std::string, int>::iterator found = textureLookup.find(textureTag);
+                    texture = (found != textureLookup.end()) ? found->second : -2;
+                }
+                std::unordered_map<std::string, int>::iterator found = materialLookup.find(materialTag);
+                material = (found != materialLookup.end()) ? found->second : -1;
+                valid = mesh >= 0 && texture != -2 && material >= 0;
+            }
+            // the only flag is "dynamic"; anything else is likely a typo
+            if (valid && !AtLineEnd(stream)) {
+                stream >> flag;
+                if (flag != "dynamic") {
+                    valid = false;
+                    error = "unknown object flag";
+                }
+            }
+            if (valid) {
+                scene.objects.Add((MESH_ID)mesh, texture, (uint16_t)material,
+                    scaleXYZ, rotationXYZ, positionXYZ, flag == "dynamic");
+            }
+        }
+        else {
+            valid = false;
+        }
+
+        // every entry must end after its values
+        if (valid && !AtLineEnd(stream)) {
+            valid = false;
+            error = "unexpected value at the end of the line";
+        }
+        if (!valid) {
+            std::cout << "ERROR: " << filename << "(" << lineNumber << "): " << error << ": "
+                << line << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "INFO: Loaded scene " << filename << " with " << scene.objects.Count()
+        << " objects" << std::endl;
+    return true;
+}
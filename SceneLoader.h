@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+// sceneloader.h
+// ============
+// Load 3D scene descriptions from text files into flat
+// structure-of-arrays object storage
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PrimitiveMeshes.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  SCENE_MATERIAL
+ *
+ *  Surface values written to the shader for an object.
+ ***********************************************************/
+struct SCENE_MATERIAL
+{
+    std::string tag;
+    glm::vec4 color;
+    float specularStrength;
+};
+
+/***********************************************************
+ *  SCENE_POINT_LIGHT
+ *
+ *  Local light. Its light falls off with distance and ends
+ *  at the radius, so it only has to be shaded by the pixels
+ *  inside that sphere.
+ ***********************************************************/
+struct SCENE_POINT_LIGHT
+{
+    glm::vec3 position;
+    glm::vec3 color;
+    float intensity;
+    float radius;
+};
+
+/***********************************************************
+ *  SCENE_OBJECTS
+ *
+ *  Structure-of-arrays storage for every object in the
+ *  scene. Index i in each array describes the same object,
+ *  so the render loop walks the arrays linearly.
+ ***********************************************************/
+struct SCENE_OBJECTS
+{
+    // MESH_ID of the object
+    std::vector<uint8_t> meshID;
+    // index into the scene texture table, -1 for untextured
+    std::vector<int> textureID;
+    // index into the scene material table
+    std::vector<uint16_t> materialID;
+    // model matrix, precomputed when the scene is loaded
+    std::vector<glm::mat4> modelMatrix;
+    // non-zero for objects that may move after loading
+    std::vector<uint8_t> isDynamic;
+
+    // transform values the model matrices were built from
+    std::vector<glm::vec3> scale;
+    std::vector<glm::vec3> rotation;
+    std::vector<glm::vec3> position;
+
+    size_t Count() const { return meshID.size(); }
+    void Reserve(size_t count);
+    void Clear();
+    // append an object, building its model matrix
+    void Add(MESH_ID mesh, int texture, uint16_t material,
+        const glm::vec3& scaleXYZ, const glm::vec3& rotationXYZ, const glm::vec3& positionXYZ, bool dynamic);
+};
+
+/***********************************************************
+ *  SCENE_DESCRIPTION
+ *
+ *  Everything read from a scene file.
+ ***********************************************************/
+struct SCENE_DESCRIPTION
+{
+    // texture table - tags and image file paths
+    std::vector<std::string> textureTags;
+    std::vector<std::string> texturePaths;
+    // material table
+    std::vector<SCENE_MATERIAL> materials;
+    // directional light
+    glm::vec3 lightDirection;
+    glm::vec3 lightColor;
+    // local point lights
+    std::vector<SCENE_POINT_LIGHT> pointLights;
+    // scene objects
+    SCENE_OBJECTS objects;
+};
+
+// 32-bit FNV-1a hash of a tag; built-in names are hashed at compile
+// time, so matching one against a tag read at runtime is an integer
+// comparison (or a switch) instead of string comparisons
+constexpr uint32_t HashTag(const char* tag, uint32_t hash = 2166136261u) {
+    return (*tag != '\0') ? HashTag(tag + 1, (hash ^ (uint8_t)*tag) * 16777619u) : hash;
+}
+
+// build a model matrix from scale, rotation (degrees) and position
+glm::mat4 BuildModelMatrix(
+    const glm::vec3& scaleXYZ,
+    const glm::vec3& rotationDegreesXYZ,
+    const glm::vec3& positionXYZ);
+
+// distance at which a point light no longer visibly adds to the scene
+float GetPointLightRange(const glm::vec3& color, float intensity);
+
+// load a scene description from a text file
+bool LoadSceneFile(const char* filename, SCENE_DESCRIPTION& scene);
@@ -7,77 +7,107 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "SceneManager.h"
-#ifndef STB_IMAGE_IMPLEMENTATION
-#define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.h"
-#endif
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "FrameScheduler.h"
+#include "TransformKernel.h"
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
-// Load texture function
-unsigned int loadTexture(const char* path) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrChannels;
-    unsigned char* data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (data) {
-        GLenum format;
-        if (nrChannels == 1)
-            format = GL_RED;
-        else if (nrChannels == 3)
-            format = GL_RGB;
-        else if (nrChannels == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-        std::cout << "Texture loaded successfully from: " << path << std::endl;
-    }
-    else {
-        std::cout << "Failed to load texture from: " << path << std::endl;
-        stbi_image_free(data);
+namespace {
+    // scene file loaded by PrepareScene()
+    const char* const DEFAULT_SCENE_FILE = "Scenes/desk.scene";
+    // smallest number of elements handed to one job
+    const size_t TRANSFORM_GRAIN_SIZE = 64;
+    // moved objects whose matrices are built by one kernel call
+    const size_t TRANSFORM_BATCH_SIZE = 64;
+    const size_t GATHER_GRAIN_SIZE = 1024;
+    const size_t PACKET_GRAIN_SIZE = 64;
+    const size_t OCCLUSION_GRAIN_SIZE = 256;
+    // alignment of the instance data in the upload ring
+    const size_t INSTANCE_ALIGNMENT = 16;
+    // objects covering less of the screen are never occluders, and
+    // at most this many of the largest ones are rasterized
+    const float MIN_OCCLUDER_AREA = 0.02f;
+    const size_t MAX_OCCLUDERS = 16;
+
+    // viewport of one view of a multi-view frame: the views fill
+    // the quarters of the frame, left to right and top to bottom
+    void GetViewRect(int view, int width, int height, int rect[4]) {
+        int halfWidth = width / 2;
+        int halfHeight = height / 2;
+        bool right = (view % 2) != 0;
+        bool top = (view / 2) == 0;
+        rect[0] = right ? halfWidth : 0;
+        rect[1] = top ? halfHeight : 0;
+        rect[2] = right ? width - halfWidth : halfWidth;
+        rect[3] = top ? height - halfHeight : halfHeight;
     }
 
-    return textureID;
+    // true when two sorted packets can share one multi-draw
+    bool SameDrawState(const DRAW_PACKET& a, const DRAW_PACKET& b) {
+        return a.program == b.program && a.blend == b.blend &&
+            a.texture == b.texture;
+    }
 }
 
-// Shader uniform variable names
-const char* g_ModelName = "model";
-const char* g_ColorValueName = "objectColor";
-const char* g_TextureValueName = "objectTexture";
-const char* g_UseTextureName = "bUseTexture";
-const char* g_ViewName = "viewMatrix";
-const char* g_ProjectionName = "projectionMatrix";
-const char* g_LightDirection = "lightDirection";
-const char* g_LightColor = "lightColor";
-const char* g_CameraPosition = "cameraPos";
-const char* g_SpecularStrength = "specularStrength";
-
-// Secondary point light (to avoid shadows)
-const char* g_PointLightPosition = "pointLight.position";
-const char* g_PointLightColor = "pointLight.color";
-const char* g_PointLightIntensity = "pointLight.intensity";
-
-unsigned int cupTexture, handleTexture, lampPostTexture, lampShadeTexture, lensTexture, notebookTexture, armTexture, pencilTexture, pencilHolderTexture, lampBaseTexture, bridgeTexture;
-
 SceneManager::SceneManager(ShaderManager* pShaderManager) {
     m_pShaderManager = pShaderManager;  // Ensure this is properly initialized
-    m_basicMeshes = new ShapeMeshes();
+    m_pShaderUniforms = NULL;
+    m_pJobSystem = NULL;
+    m_occlusionCulling = true;
+    m_lateLatching = false;
+    m_buildIndex = 0;
+    m_buildPending = false;
+    m_drawListReady = false;
+    m_viewportWidth = 0;
+    m_viewportHeight = 0;
+#ifdef __APPLE__
+    // OpenGL 4.1 cannot select the viewport in the vertex shader
+    m_singlePassViews = false;
+#else
+    m_singlePassViews = GLEW_ARB_viewport_array &&
+        (GLEW_ARB_shader_viewport_layer_array || GLEW_AMD_vertex_shader_viewport_index);
+#endif
+    m_basicMeshes = new PrimitiveMeshes();
+    m_textureCache = new TextureCache();
+    m_lightClusters = new LightClusters();
+    m_uploadRing = new UploadRing();
+    m_materialTable = new MaterialTable();
+    m_pSoftwareRasterizer = NULL;
 }
 
 SceneManager::~SceneManager() {
+    // the background job still references the scene
+    WaitForDrawList();
     delete m_pShaderManager;
     delete m_basicMeshes;
+    delete m_textureCache;
+    delete m_lightClusters;
+    delete m_uploadRing;
+    delete m_materialTable;
+}
+
+/***********************************************************
+ *  SetSoftwareRasterizer()
+ *
+ *  This function makes the scene manager draw with a
+ *  software rasterizer: meshes, light lists and textures
+ *  stay in CPU memory, and every view is drawn in its own
+ *  pass.
+ ***********************************************************/
+void SceneManager::SetSoftwareRasterizer(SoftwareRasterizer* pRasterizer) {
+    WaitForDrawList();
+    m_pSoftwareRasterizer = pRasterizer;
+    m_basicMeshes->SetUploadEnabled(pRasterizer == NULL);
+    m_lightClusters->SetUploadEnabled(pRasterizer == NULL);
+    if (pRasterizer != NULL) {
+        m_singlePassViews = false;
+    }
+    m_drawListReady = false;
 }
 
 /***********************************************************
@@ -87,207 +117,691 @@ SceneManager::~SceneManager() {
  *  including the coffee cup, notebook, and pencils.
  ***********************************************************/
 void SceneManager::PrepareScene() {
-    // Load the plane (ground) mesh
-    m_basicMeshes->LoadPlaneMesh();
+    LoadScene(DEFAULT_SCENE_FILE);
+}
 
-    // Load the coffee cup body (cylinder) and handle (torus)
-    m_basicMeshes->LoadCylinderMesh();
-    m_basicMeshes->LoadTorusMesh();
+/***********************************************************
+ *  LoadScene()
+ *
+ *  This function loads a scene file, the meshes and textures
+ *  it references, and its lights.
+ ***********************************************************/
+bool SceneManager::LoadScene(const char* filename) {
+    SCENE_DESCRIPTION scene;
+    if (!LoadSceneFile(filename, scene)) {
+        return false;
+    }
+    LoadScene(scene);
+    return true;
+}
 
-    // Load the notebook (box)
-    m_basicMeshes->LoadBoxMesh();
+/***********************************************************
+ *  LoadScene()
+ *
+ *  This function replaces the current scene objects with an
+ *  already loaded or generated scene description and loads
+ *  the meshes and textures it references.
+ ***********************************************************/
+void SceneManager::LoadScene(const SCENE_DESCRIPTION& scene) {
+    WaitForDrawList();
+    m_drawListReady = false;
+
+    // Every object holds a reference to its mesh: meshes only the
+    // old scene used are unloaded, ones both use stay loaded
+    for (size_t i = 0; i < m_scene.objects.Count(); ++i) {
+        m_basicMeshes->ReleaseMesh((MESH_ID)m_scene.objects.meshID[i]);
+    }
+    m_scene = scene;
+    const SCENE_OBJECTS& objects = m_scene.objects;
+    for (size_t i = 0; i < objects.Count(); ++i) {
+        m_basicMeshes->AcquireMesh((MESH_ID)objects.meshID[i]);
+    }
+    m_basicMeshes->LoadMeshes(m_pJobSystem);
+    // loading rebinds the vertex array behind the state cache
+    m_stateCache.Invalidate();
+
+    // World space bounds for frustum culling
+    m_objectBounds.resize(objects.Count());
+    for (size_t i = 0; i < objects.Count(); ++i) {
+        m_objectBounds[i] = PrimitiveMeshes::GetLocalBounds((MESH_ID)objects.meshID[i])
+            .Transformed(objects.modelMatrix[i]);
+    }
+    m_objectTree.Build(m_objectBounds);
 
-    // Load the pencils (cylinders)
-    m_basicMeshes->LoadCylinderMesh();
+    if (m_pSoftwareRasterizer != NULL) {
+        // the rasterizer samples the decoded images directly
+        m_pSoftwareRasterizer->LoadTextures(m_scene.texturePaths, m_sceneTextures);
+    }
+    else {
+        // Queue the scene textures - files shared by several
+        // objects are only decoded once - and upload them
+        std::vector<int> textureHandles;
+        for (size_t i = 0; i < m_scene.texturePaths.size(); ++i) {
+            textureHandles.push_back(m_textureCache->Request(m_scene.texturePaths[i].c_str()));
+        }
+        m_textureCache->LoadPending();
+
+        // Pack the textures into texture arrays; objects pick their
+        // layer through the instance data, so objects with different
+        // textures of the same size share one texture binding
+        m_textureCache->ReleaseTextureArrays();
+        m_textureCache->BuildTextureArrays(textureHandles, m_sceneTextures);
+    }
+    for (size_t i = 0; i < m_sceneTextures.size(); ++i) {
+        // Debug: Check if the textures were loaded successfully
+        if (m_sceneTextures[i].arrayTexture == 0) {
+            std::cout << "Error loading " << m_scene.textureTags[i] << " texture!" << std::endl;
+        }
+    }
+    m_objectSurfaces.resize(objects.Count());
+    for (size_t i = 0; i < objects.Count(); ++i) {
+        m_objectSurfaces[i].x = (objects.textureID[i] >= 0) ? (GLuint)m_sceneTextures[objects.textureID[i]].layer : 0;
+        m_objectSurfaces[i].y = objects.materialID[i];
+    }
+    BuildInstanceBatches();
+    if (m_pSoftwareRasterizer != NULL) {
+        m_pSoftwareRasterizer->SetMaterials(m_scene.materials);
+    }
+    else {
+        // every object may be visible, so a ring frame must hold
+        // instance data for all of them
+        m_uploadRing->Reserve(objects.Count() * (sizeof(glm::mat4) + sizeof(glm::uvec2)) + 2 * INSTANCE_ALIGNMENT);
 
-    // Load the cone mesh for the lamp shade
-    m_basicMeshes->LoadConeMesh();
+        // Objects pick their material from the table by the id in their
+        // instance data, so drawing never uploads material values
+        m_materialTable->SetMaterials(m_scene.materials);
+    }
+
+    // Set up the directional light, which only reaches the GPU with the
+    // next per-frame uniform buffer upload, and the point lights (to
+    // avoid shadows), which are assigned to light clusters every frame
+    m_pShaderUniforms->SetLights(m_scene.lightDirection, m_scene.lightColor);
+    m_lightClusters->SetLights(m_scene.pointLights);
+    if (m_pSoftwareRasterizer != NULL) {
+        m_pSoftwareRasterizer->SetLights(m_scene.pointLights);
+    }
 
-    // Load textures for the cup and handle (these remain the same)
-    cupTexture = loadTexture("Textures/TCom_RoughCeramic_header.jpg");
-    handleTexture = loadTexture("Textures/TCom_Plastic_Scratched_header.jpg");
+    m_dirtyObjects.clear();
 
-    // Load textures for the new elements
-    lampPostTexture = loadTexture("Textures/TCom_BrushedStainlessSteel_header.jpg");
-    lampShadeTexture = loadTexture("Textures/TCom_Various_ReflectiveTape_header4.jpg");
-    lensTexture = loadTexture("Textures/TCom_RetroStainlessSheet_header.jpg");
-    notebookTexture = loadTexture("Textures/TCom_Leather_Plain08_header.jpg");
-    armTexture = loadTexture("Textures/TCom_BrushedStainlessSteel_header.jpg");
-    pencilTexture = loadTexture("Textures/TCom_Leather_Italian_header.jpg");
-    pencilHolderTexture = loadTexture("Textures/TCom_Leather_Italian_header.jpg");
-    lampBaseTexture = loadTexture("Textures/TCom_BrushedStainlessSteel_header.jpg");
-    bridgeTexture = loadTexture("Textures/TCom_RetroStainlessSheet_header.jpg");
+    // loading bound textures and vertex arrays directly
+    m_stateCache.Invalidate();
+    FrameScheduler::RequestRedraw();
+}
 
-    // Debug: Check if the textures were loaded successfully
-    if (cupTexture == 0) {
-        std::cout << "Error loading cup texture!" << std::endl;
+/***********************************************************
+ *  SetObjectTransform()
+ *
+ *  This function moves a dynamic scene object. Its model
+ *  matrix is rebuilt before the next frame is rendered.
+ ***********************************************************/
+void SceneManager::SetObjectTransform(size_t index, glm::vec3 scaleXYZ, glm::vec3 rotationXYZ, glm::vec3 positionXYZ) {
+    SCENE_OBJECTS& objects = m_scene.objects;
+    if (index >= objects.Count() || !objects.isDynamic[index]) {
+        return;
     }
-    if (handleTexture == 0) {
-        std::cout << "Error loading handle texture!" << std::endl;
+    objects.scale[index] = scaleXYZ;
+    objects.rotation[index] = rotationXYZ;
+    objects.position[index] = positionXYZ;
+    m_dirtyObjects.push_back(index);
+    FrameScheduler::RequestRedraw();
+}
+
+/***********************************************************
+ *  UpdateDynamicTransforms()
+ *
+ *  This function rebuilds the model matrices and bounds of
+ *  the dynamic objects that were moved since the last frame
+ *  and refits the culling tree around the new bounds. No
+ *  draw list may be building while the scene changes.
+ ***********************************************************/
+void SceneManager::UpdateDynamicTransforms() {
+    if (m_dirtyObjects.empty()) {
+        return;
     }
+    PROFILE_CPU_SCOPE("UpdateDynamicTransforms");
+    // an object moved twice is only rebuilt once
+    std::sort(m_dirtyObjects.begin(), m_dirtyObjects.end());
+    m_dirtyObjects.erase(std::unique(m_dirtyObjects.begin(), m_dirtyObjects.end()), m_dirtyObjects.end());
+
+    m_pJobSystem->ParallelFor(m_dirtyObjects.size(), TRANSFORM_GRAIN_SIZE, [this](size_t begin, size_t end) {
+        SCENE_OBJECTS& objects = m_scene.objects;
+        // the dirty objects are scattered, so each batch is gathered
+        // into packed arrays for the kernel and scattered back
+        glm::vec3 scale[TRANSFORM_BATCH_SIZE];
+        glm::vec3 rotation[TRANSFORM_BATCH_SIZE];
+        glm::vec3 position[TRANSFORM_BATCH_SIZE];
+        alignas(32) glm::mat4 matrices[TRANSFORM_BATCH_SIZE];
+        for (size_t first = begin; first < end; first += TRANSFORM_BATCH_SIZE) {
+            size_t count = std::min(end - first, TRANSFORM_BATCH_SIZE);
+            for (size_t i = 0; i < count; ++i) {
+                size_t index = m_dirtyObjects[first + i];
+                scale[i] = objects.scale[index];
+                rotation[i] = objects.rotation[index];
+                position[i] = objects.position[index];
+            }
+            TransformKernel::BuildModelMatrices(scale, rotation, position, count, matrices);
+            for (size_t i = 0; i < count; ++i) {
+                size_t index = m_dirtyObjects[first + i];
+                objects.modelMatrix[index] = matrices[i];
+                m_objectBounds[index] = PrimitiveMeshes::GetLocalBounds((MESH_ID)objects.meshID[index])
+                    .Transformed(matrices[i]);
+            }
+        }
+    });
+    m_objectTree.Refit(m_objectBounds);
+    m_dirtyObjects.clear();
 }
 
 /***********************************************************
- *  RenderScene()
+ *  BeginDrawList()
  *
- *  This function renders the loaded 3D objects in the scene,
- *  including the coffee cup, notebook, pencils, pencil holder, and plane.
+ *  This function takes the current camera and light data
+ *  into a draw list and, when drawing with OpenGL, the next
+ *  upload ring frame for its instance data.
  ***********************************************************/
-void SceneManager::RenderScene() {
-    // Enable depth testing for 3D rendering
-    glEnable(GL_DEPTH_TEST);
-    // Set the background color and clear buffers
-    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    // Set up the camera view and projection matrices
-    glm::vec3 cameraPos = glm::vec3(0.0f, 2.0f, 10.0f);
-    glm::mat4 view = glm::lookAt(cameraPos, glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
-
-    // Pass the view and projection matrices to the shader
-    m_pShaderManager->setMat4Value(g_ViewName, view);
-    m_pShaderManager->setMat4Value(g_ProjectionName, projection);
-
-    // Set up the lighting directly here
-    glm::vec3 lightDirection = glm::vec3(-0.2f, -1.0f, -0.3f);  // Light direction
-    glm::vec3 lightColor = glm::vec3(1.0f, 1.0f, 1.0f);         // White light
-    m_pShaderManager->setVec3Value(g_LightDirection, lightDirection);
-    m_pShaderManager->setVec3Value(g_LightColor, lightColor);
-
-    // Set up secondary point light
-    glm::vec3 pointLightPosition = glm::vec3(2.0f, 2.0f, 2.0f);  // Point light position
-    glm::vec3 pointLightColor = glm::vec3(0.8f, 0.8f, 0.8f);     // Slightly dimmer white light
-    m_pShaderManager->setVec3Value(g_PointLightPosition, pointLightPosition);
-    m_pShaderManager->setVec3Value(g_PointLightColor, pointLightColor);
-    m_pShaderManager->setFloatValue(g_PointLightIntensity, 1.0f);
-
-    // Draw the plane (ground) with reflection
-    glm::vec3 planeScale = glm::vec3(10.0f, 1.0f, 10.0f);  // Scale the plane to cover a large area
-    glm::vec3 planePosition = glm::vec3(0.0f, 0.0f, 0.0f); // Position it at the origin
-    SetTransformations(planeScale, 0, 0, 0, planePosition);
-    SetShaderColor(0.5f, 0.5f, 0.5f, 1.0f);  // Set the plane color to grey
-    m_pShaderManager->setFloatValue(g_SpecularStrength, 0.6f);  // Add specular reflection for Phong lighting
-    m_basicMeshes->DrawPlaneMesh();  // Render the plane
-
-    // Draw the coffee cup body (cylinder) with texture (unchanged)
-    glm::vec3 cupScale = glm::vec3(1.0f, 1.5f, 1.0f);
-    glm::vec3 cupPosition = glm::vec3(0.0f, 0.0f, 0.0f);  // Lowered to rest directly on the platform
-    SetTransformations(cupScale, 0, 0, 0, cupPosition);
-    glBindTexture(GL_TEXTURE_2D, cupTexture);  // Bind the cup texture
-    m_pShaderManager->setIntValue(g_UseTextureName, 1); // Enable texture for the cup
-    m_basicMeshes->DrawCylinderMesh();
-
-    // Draw the coffee cup handle (torus) with texture (unchanged)
-    glm::vec3 handleScale = glm::vec3(0.3f, 0.3f, 0.3f);  // Proper scale for the handle
-    glm::vec3 handlePosition = glm::vec3(1.0f, 0.375f, 0.0f);  // Closer to the cup
-    SetTransformations(handleScale, 0, 0, 90, handlePosition);  // Rotated to ensure it sits vertically and arches out
-    glBindTexture(GL_TEXTURE_2D, handleTexture);  // Bind the handle texture
-    m_pShaderManager->setIntValue(g_UseTextureName, 1);  // Enable texture for the handle
-    m_basicMeshes->DrawTorusMesh();  // Render the handle
-
-    // Draw the notebook with leather texture
-    glm::vec3 notebookScale = glm::vec3(2.0f, 0.1f, 3.0f);  // Thin box for the notebook
-    glm::vec3 notebookPosition = glm::vec3(-2.0f, 0.05f, 1.5f);  // Position it near the cup
-    SetTransformations(notebookScale, 0, 0, 0, notebookPosition);
-    glBindTexture(GL_TEXTURE_2D, notebookTexture);  // Bind the notebook leather texture
-    m_pShaderManager->setIntValue(g_UseTextureName, 1);  // Enable texture for the notebook
-    m_basicMeshes->DrawBoxMesh();  // Render the notebook
-
-    // Draw the lamp post with stainless steel texture
-    glm::vec3 lampPostScale = glm::vec3(0.15f, 4.0f, 0.15f);  // Taller and thicker cylinder for the lamp post
-    glm::vec3 lampPostPosition = glm::vec3(2.5f, 0.0f, -2.0f);  // Keep the same position on the table
-    SetTransformations(lampPostScale, 0, 0, 0, lampPostPosition);
-    glBindTexture(GL_TEXTURE_2D, lampPostTexture);  // Bind the lamp post texture
-    m_pShaderManager->setIntValue(g_UseTextureName, 1);  // Enable texture for the lamp post
-    m_basicMeshes->DrawCylinderMesh();  // Render the lamp post
-
-    // Draw the lamp shade with reflective tape texture
-    glm::vec3 lampShadeScale = glm::vec3(1.0f, 1.0f, 1.0f);  // Larger cone for the lamp shade
-    glm::vec3 lampShadePosition = glm::vec3(2.5f, 4.0f, -2.0f);  // Adjust position to sit right on top of the taller post
-    SetTransformations(lampShadeScale, 0, 0, 0, lampShadePosition);
-    glBindTexture(GL_TEXTURE_2D, lampShadeTexture);  // Bind the lamp shade texture
-    m_pShaderManager->setIntValue(g_UseTextureName, 1);  // Enable texture for the lamp shade
-    m_basicMeshes->DrawConeMesh();  // Render the lamp shade
-
-    // Draw the lamp base with stainless steel texture
-    glm::vec3 lampBaseScale = glm::vec3(1.0f, 0.1f, 1.0f);  // Wider and flat cylinder for the base
-    glm::vec3 lampBasePosition = glm::vec3(2.5f, -0.05f, -2.0f);  // Positioned slightly below the table surface
-    SetTransformations(lampBaseScale, 0, 0, 0, lampBasePosition);
-    glBindTexture(GL_TEXTURE_2D, lampBaseTexture);  // Bind the lamp base texture
-    m_basicMeshes->DrawCylinderMesh();  // Render the lamp base
-
-    // Draw the lenses with retro stainless steel texture
-    glm::vec3 lensScale = glm::vec3(0.5f, 0.05f, 0.5f); // Scale for the lenses, keeping them thin and wide
-    glm::vec3 lens1Position = glm::vec3(2.5f, 0.5f, 0.0f); // Increased y-value to fully lift it off the table
-    SetTransformations(lensScale, 90, 0, 0, lens1Position); // Rotate 90 degrees to stand the lens vertically
-    glBindTexture(GL_TEXTURE_2D, lensTexture);  // Bind the lens texture
-    m_pShaderManager->setIntValue(g_UseTextureName, 1);  // Enable texture for the lenses
-    m_basicMeshes->DrawCylinderMesh(); // Draw the first lens
-
-    glm::vec3 lens2Position = glm::vec3(3.6f, 0.5f, 0.0f); // Same height adjustment for the second lens
-    SetTransformations(lensScale, 90, 0, 0, lens2Position); // Same rotation and scale as the first lens
-    glBindTexture(GL_TEXTURE_2D, lensTexture);  // Bind the lens texture again
-    m_basicMeshes->DrawCylinderMesh(); // Draw the second lens
-
-    // Draw the bridge between lenses with retro stainless steel texture
-    glm::vec3 bridgeScale = glm::vec3(0.1f, 0.05f, 0.3f); // Make the bridge thinner and shorter
-    glm::vec3 bridgePosition = glm::vec3(3.05f, 0.52f, 0.0f); // Slightly raise the position and align between lenses
-    SetTransformations(bridgeScale, 0, 90, 0, bridgePosition); // Rotate to align horizontally
-    glBindTexture(GL_TEXTURE_2D, bridgeTexture);  // Bind the bridge texture
-    m_pShaderManager->setIntValue(g_UseTextureName, 1);  // Enable texture for the bridge
-    m_basicMeshes->DrawCylinderMesh(); // Draw the bridge
-
-    // Draw the arms for the lenses with stainless steel texture
-    glm::vec3 arm1Scale = glm::vec3(0.05f, 0.05f, 0.7f); // Same size for the arm
-    glm::vec3 arm1Position = glm::vec3(2.05f, 0.3f, -0.6f); // Moved backward slightly more
-    SetTransformations(arm1Scale, 0, 0, 10, arm1Position); // Rotate slightly backward
-    glBindTexture(GL_TEXTURE_2D, armTexture);  // Bind the arm texture
-    m_basicMeshes->DrawCylinderMesh(); // Draw left arm
-
-    glm::vec3 arm2Position = glm::vec3(4.1f, 0.3f, -0.6f); // Slightly further to the right
-    SetTransformations(arm1Scale, 0, 0, -10, arm2Position); // Keep the same slight backward tilt
-    m_basicMeshes->DrawCylinderMesh(); // Draw the right arm
-
-    // Draw the pencil holder with leather texture
-    glm::vec3 holderScale = glm::vec3(0.2f, 0.6f, 0.2f);  // Small cylinder for the pencil holder
-    glm::vec3 holderPosition = glm::vec3(-2.5f, 0.0f, 2.0f);  // Adjusted to sit on the platform
-    SetTransformations(holderScale, 0, 0, 0, holderPosition);
-    glBindTexture(GL_TEXTURE_2D, pencilHolderTexture);  // Bind the pencil holder texture
-    m_pShaderManager->setIntValue(g_UseTextureName, 1);  // Enable texture for the pencil holder
-    m_basicMeshes->DrawCylinderMesh();  // Render the pencil holder
-
-    // Draw the first pencil inside the holder
-    glm::vec3 pencilScale = glm::vec3(0.05f, 0.8f, 0.05f);  // Shorter to fit inside the holder
-    glm::vec3 pencilPosition = glm::vec3(-2.5f, 0.6f, 2.0f);  // Lowered position inside the holder
-    SetTransformations(pencilScale, 0, 0, 0, pencilPosition);
-    glBindTexture(GL_TEXTURE_2D, pencilTexture);  // Bind the pencil texture
-    m_basicMeshes->DrawCylinderMesh();  // Render the first pencil
-
-    // Draw the second pencil inside the holder
-    glm::vec3 pencil2Position = glm::vec3(-2.45f, 0.6f, 2.05f);  // Slightly offset position, lowered
-    SetTransformations(pencilScale, 0, 0, 0, pencil2Position);
-    m_basicMeshes->DrawCylinderMesh();  // Render the second pencil
+void SceneManager::BeginDrawList(DRAW_LIST& list) {
+    list.frame = m_pShaderUniforms->GetFrame();
+    list.uploadFrame = (m_pSoftwareRasterizer != NULL) ? -1 : m_uploadRing->BeginFrame();
+}
+
+/***********************************************************
+ *  BuildDrawList()
+ *
+ *  This function does the CPU work for a frame: it finds the
+ *  visible objects, gathers their instance matrices,
+ *  records the sorted draw packets and builds the light
+ *  clusters. It runs as a job and makes no OpenGL calls.
+ ***********************************************************/
+void SceneManager::BuildDrawList(DRAW_LIST& list) {
+    PROFILE_CPU_SCOPE("BuildDrawList");
+    CullObjects(list);
+    BuildDrawPackets(list);
+    AssignLights(list);
 }
 
 /***********************************************************
- *  SetTransformations()
+ *  CullObjects()
  *
- *  This function applies transformations (translation, rotation,
- *  scaling) to the 3D objects in the scene.
+ *  This function queries disjoint subtrees of the object
+ *  tree against the frustums of all views in parallel,
+ *  keeping the objects inside any of them, drops the objects
+ *  hidden behind occluders, then groups the model matrices
+ *  of the visible objects by draw batch.
+ *  Batches without visible objects are left with an
+ *  instance count of 0.
  ***********************************************************/
-void SceneManager::SetTransformations(glm::vec3 scale, float rotX, float rotY, float rotZ, glm::vec3 pos) {
-    glm::mat4 model = glm::translate(pos) * glm::rotate(glm::radians(rotX), glm::vec3(1, 0, 0)) *
-        glm::rotate(glm::radians(rotY), glm::vec3(0, 1, 0)) *
-        glm::rotate(glm::radians(rotZ), glm::vec3(0, 0, 1)) * glm::scale(scale);
-    m_pShaderManager->setMat4Value(g_ModelName, model);
+void SceneManager::CullObjects(DRAW_LIST& list) {
+    PROFILE_CPU_SCOPE("CullObjects");
+    Frustum frustums[MAX_VIEWS];
+    size_t viewCount = (size_t)list.frame.viewCount.x;
+    for (size_t v = 0; v < viewCount; ++v) {
+        frustums[v].Extract(list.frame.projectionMatrices[v] * list.frame.viewMatrices[v]);
+    }
+
+    m_objectTree.GetSubtreeRoots(m_pJobSystem->GetWorkerCount() + 1, m_subtreeRoots);
+    m_subtreeVisible.resize(m_subtreeRoots.size());
+    m_pJobSystem->ParallelFor(m_subtreeRoots.size(), 1, [this, &frustums, viewCount](size_t begin, size_t end) {
+        PROFILE_CPU_SCOPE("QueryObjectTree");
+        for (size_t r = begin; r < end; ++r) {
+            m_subtreeVisible[r].clear();
+            m_objectTree.Query(frustums, viewCount, m_objectBounds, m_subtreeVisible[r], m_subtreeRoots[r]);
+        }
+    });
+
+    m_visibleObjects.clear();
+    for (size_t r = 0; r < m_subtreeRoots.size(); ++r) {
+        m_visibleObjects.insert(m_visibleObjects.end(), m_subtreeVisible[r].begin(), m_subtreeVisible[r].end());
+    }
+    // keep the scene file order inside each batch
+    std::sort(m_visibleObjects.begin(), m_visibleObjects.end());
+    CullOccludedObjects(list);
+
+    // count the visible instances of each batch, then turn the
+    // counts into the first instance of each batch
+    for (size_t b = 0; b < m_instanceBatches.size(); ++b) {
+        m_instanceBatches[b].instanceCount = 0;
+    }
+    for (size_t i = 0; i < m_visibleObjects.size(); ++i) {
+        ++m_instanceBatches[m_objectBatch[m_visibleObjects[i]]].instanceCount;
+    }
+    m_batchCursors.resize(m_instanceBatches.size());
+    GLuint firstInstance = 0;
+    for (size_t b = 0; b < m_instanceBatches.size(); ++b) {
+        m_instanceBatches[b].firstInstance = firstInstance;
+        m_batchCursors[b] = firstInstance;
+        firstInstance += (GLuint)m_instanceBatches[b].instanceCount;
+    }
+    m_instanceSlots.resize(m_visibleObjects.size());
+    for (size_t i = 0; i < m_visibleObjects.size(); ++i) {
+        m_instanceSlots[i] = m_batchCursors[m_objectBatch[m_visibleObjects[i]]]++;
+    }
+
+    // the instance data goes straight into the list's upload ring
+    // frame (or its own arrays when software rasterized); every
+    // visible object owns one slot, so the copies can run in parallel
+    glm::mat4* instanceMatrices = NULL;
+    glm::uvec2* instanceSurfaces = NULL;
+    if (m_pSoftwareRasterizer != NULL) {
+        list.instanceMatrices.resize(m_visibleObjects.size());
+        list.instanceSurfaces.resize(m_visibleObjects.size());
+        instanceMatrices = list.instanceMatrices.data();
+        instanceSurfaces = list.instanceSurfaces.data();
+    }
+    else {
+        UPLOAD_ALLOCATION matrices = m_uploadRing->Allocate(list.uploadFrame,
+            m_visibleObjects.size() * sizeof(glm::mat4), INSTANCE_ALIGNMENT);
+        UPLOAD_ALLOCATION surfaces = m_uploadRing->Allocate(list.uploadFrame,
+            m_visibleObjects.size() * sizeof(glm::uvec2), INSTANCE_ALIGNMENT);
+        list.instanceMatrixOffset = matrices.offset;
+        list.instanceSurfaceOffset = surfaces.offset;
+        if (matrices.data == NULL || surfaces.data == NULL) {
+            // LoadScene() reserves room for every object, so this
+            // only happens when the scene was changed without it
+            std::cout << "ERROR: upload ring frame too small for " << m_visibleObjects.size() << " instances" << std::endl;
+            for (size_t b = 0; b < m_instanceBatches.size(); ++b) {
+                m_instanceBatches[b].instanceCount = 0;
+            }
+            m_visibleObjects.clear();
+        }
+        instanceMatrices = (glm::mat4*)matrices.data;
+        instanceSurfaces = (glm::uvec2*)surfaces.data;
+    }
+    m_pJobSystem->ParallelFor(m_visibleObjects.size(), GATHER_GRAIN_SIZE,
+        [this, instanceMatrices, instanceSurfaces](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            instanceMatrices[m_instanceSlots[i]] = m_scene.objects.modelMatrix[m_visibleObjects[i]];
+            instanceSurfaces[m_instanceSlots[i]] = m_objectSurfaces[m_visibleObjects[i]];
+        }
+    });
+
+    list.objectsVisible = (unsigned int)m_visibleObjects.size();
+    list.objectsCulled = (unsigned int)(m_objectBounds.size() - m_visibleObjects.size() - list.objectsOccluded);
 }
 
 /***********************************************************
- *  SetShaderColor()
+ *  CullOccludedObjects()
  *
- *  This function sets the color values into the shader.
+ *  This function rasterizes the opaque visible objects
+ *  covering the most screen area into the occlusion
+ *  buffer, tests every visible object's bounds against its
+ *  depth pyramid in parallel and removes the hidden objects
+ *  from the visible list, keeping its order. Occluders only hide
+ *  objects from the camera, so multi-view frames skip this.
  ***********************************************************/
-void SceneManager::SetShaderColor(float r, float g, float b, float a) {
-    m_pShaderManager->setVec4Value(g_ColorValueName, glm::vec4(r, g, b, a));
+void SceneManager::CullOccludedObjects(DRAW_LIST& list) {
+    list.objectsOccluded = 0;
+    if (!m_occlusionCulling || m_visibleObjects.empty() || list.frame.viewCount.x > 1) {
+        return;
+    }
+    PROFILE_CPU_SCOPE("CullOccludedObjects");
+    m_occlusionBuffer.Begin(list.frame.projection * list.frame.view);
+
+    // the largest opaque objects on screen are the occluders; blended
+    // objects let the ones behind them show through
+    m_screenAreas.resize(m_visibleObjects.size());
+    m_pJobSystem->ParallelFor(m_visibleObjects.size(), OCCLUSION_GRAIN_SIZE, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            m_screenAreas[i] = m_occlusionBuffer.GetScreenArea(m_objectBounds[m_visibleObjects[i]]);
+        }
+    });
+    m_occluders.clear();
+    for (size_t i = 0; i < m_visibleObjects.size(); ++i) {
+        if (m_screenAreas[i] >= MIN_OCCLUDER_AREA && !m_instanceBatches[m_objectBatch[m_visibleObjects[i]]].blend) {
+            m_occluders.push_back((uint32_t)i);
+        }
+    }
+    if (m_occluders.size() > MAX_OCCLUDERS) {
+        std::partial_sort(m_occluders.begin(), m_occluders.begin() + MAX_OCCLUDERS, m_occluders.end(),
+            [this](uint32_t a, uint32_t b) { return m_screenAreas[a] > m_screenAreas[b]; });
+        m_occluders.resize(MAX_OCCLUDERS);
+    }
+    if (m_occluders.empty()) {
+        return;
+    }
+    for (size_t o = 0; o < m_occluders.size(); ++o) {
+        uint32_t object = m_visibleObjects[m_occluders[o]];
+        m_occlusionBuffer.AddOccluder(m_basicMeshes->GetMeshGeometry((MESH_ID)m_scene.objects.meshID[object]),
+            m_scene.objects.modelMatrix[object]);
+    }
+    m_occlusionBuffer.Finish(m_pJobSystem);
+
+    m_occluded.resize(m_visibleObjects.size());
+    m_pJobSystem->ParallelFor(m_visibleObjects.size(), OCCLUSION_GRAIN_SIZE, [this](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            m_occluded[i] = m_occlusionBuffer.IsOccluded(m_objectBounds[m_visibleObjects[i]]) ? 1 : 0;
+        }
+    });
+    size_t kept = 0;
+    for (size_t i = 0; i < m_visibleObjects.size(); ++i) {
+        if (!m_occluded[i]) {
+            m_visibleObjects[kept++] = m_visibleObjects[i];
+        }
+    }
+    list.objectsOccluded = (unsigned int)(m_visibleObjects.size() - kept);
+    m_visibleObjects.resize(kept);
 }
+
+/***********************************************************
+ *  BuildDrawPackets()
+ *
+ *  This function records one draw packet per batch with
+ *  visible objects, generating the sort keys in parallel,
+ *  sorts the packets by state and builds the indirect draw
+ *  command of every packet in the sorted order. When all
+ *  views are drawn in one pass, every command draws each
+ *  instance once per view.
+ ***********************************************************/
+void SceneManager::BuildDrawPackets(DRAW_LIST& list) {
+    PROFILE_CPU_SCOPE("BuildDrawPackets");
+    m_visibleBatches.clear();
+    for (size_t b = 0; b < m_instanceBatches.size(); ++b) {
+        if (m_instanceBatches[b].instanceCount > 0) {
+            m_visibleBatches.push_back((uint32_t)b);
+        }
+    }
+
+    // the software rasterizer runs without shader programs
+    GLuint program = (m_pShaderManager != NULL) ? m_pShaderManager->m_programID : 0;
+    list.queue.Resize(m_visibleBatches.size());
+    m_pJobSystem->ParallelFor(m_visibleBatches.size(), PACKET_GRAIN_SIZE, [this, &list, program](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const INSTANCE_BATCH& batch = m_instanceBatches[m_visibleBatches[i]];
+            DRAW_PACKET packet;
+            packet.program = program;
+            packet.texture = batch.textureArray;
+            packet.mesh = batch.mesh;
+            packet.blend = batch.blend;
+            packet.firstInstance = batch.firstInstance;
+            packet.instanceCount = batch.instanceCount;
+            list.queue.Set(i, packet);
+        }
+    });
+    list.queue.Sort();
+
+    list.instanceViews = m_singlePassViews ? (GLuint)list.frame.viewCount.x : 1;
+    const std::vector<DRAW_PACKET>& packets = list.queue.GetPackets();
+    list.drawCommands.resize(packets.size());
+    for (size_t p = 0; p < packets.size(); ++p) {
+        list.drawCommands[p] = m_basicMeshes->GetDrawCommand(packets[p].mesh,
+            packets[p].firstInstance, (GLuint)packets[p].instanceCount * list.instanceViews);
+    }
+}
+
+/***********************************************************
+ *  AssignLights()
+ *
+ *  This function builds the per-cluster point light lists
+ *  for the camera the draw list was built with, so the
+ *  lists always match the frame data they are drawn with.
+ ***********************************************************/
+void SceneManager::AssignLights(DRAW_LIST& list) {
+    m_lightClusters->Assign(list.frame.view, list.frame.projection, m_pJobSystem, list.lightClusters);
+}
+
+/***********************************************************
+ *  SubmitDrawList()
+ *
+ *  This function uploads a finished draw list and issues
+ *  its draws, skipping state that is already set.
+ *
+ *  A multi-view list is drawn into one viewport per view.
+ *  Where the vertex shader selects the viewport, the draws
+ *  are issued once with every instance repeated for each
+ *  view; otherwise the same uploaded draws are issued once
+ *  per view, each pass into that view's viewport. With a
+ *  software rasterizer the list is rasterized instead.
+ ***********************************************************/
+void SceneManager::SubmitDrawList(const DRAW_LIST& list) {
+    PROFILE_CPU_SCOPE("SubmitDrawList");
+    if (m_pSoftwareRasterizer != NULL) {
+        FrameStats::Current().objectsVisible += list.objectsVisible;
+        FrameStats::Current().objectsCulled += list.objectsCulled;
+        FrameStats::Current().objectsOccluded += list.objectsOccluded;
+        FrameStats::Current().lightsVisible += list.lightClusters.lightsVisible;
+        FrameStats::Current().clusterLightEntries += (unsigned int)list.lightClusters.lightIndices.size();
+        RasterizeDrawList(list);
+        return;
+    }
+    // Depth testing and clearing are done by the main loop, and all
+    // other state changes go through the state cache below
+
+    // Upload the camera and light data the list was built with in
+    // one buffer update and its light clusters; the visible objects'
+    // instance data was written into the upload ring while building
+    m_pShaderUniforms->UploadFrame(list.frame);
+    m_lightClusters->Upload(list.lightClusters);
+    m_uploadRing->Flush(list.uploadFrame);
+    FrameStats::Current().objectsVisible += list.objectsVisible;
+    FrameStats::Current().objectsCulled += list.objectsCulled;
+    FrameStats::Current().objectsOccluded += list.objectsOccluded;
+
+    m_basicMeshes->SetDrawCommands(list.drawCommands.data(), list.drawCommands.size());
+
+    m_stateCache.SetDepthTest(true);
+    m_stateCache.BindVertexArray(m_basicMeshes->GetVertexArray());
+    m_basicMeshes->SetInstanceSource(m_uploadRing->GetBuffer(), list.instanceMatrixOffset, list.instanceSurfaceOffset);
+    PROFILE_GPU_SCOPE("Draw");
+    int viewCount = list.frame.viewCount.x;
+    if (viewCount > 1) {
+        // the view selection uniforms belong to the scene program
+        m_stateCache.UseProgram(m_pShaderManager->m_programID);
+    }
+    if (viewCount <= 1) {
+        DrawPackets(list);
+    }
+    else if (list.instanceViews > 1) {
+        for (int v = 0; v < viewCount; ++v) {
+            int rect[4];
+            GetViewRect(v, m_viewportWidth, m_viewportHeight, rect);
+            glViewportIndexedf((GLuint)v, (GLfloat)rect[0], (GLfloat)rect[1], (GLfloat)rect[2], (GLfloat)rect[3]);
+        }
+        m_basicMeshes->SetInstanceDivisor(list.instanceViews);
+        m_pShaderUniforms->instanceViews.Set((int)list.instanceViews);
+        DrawPackets(list);
+        m_pShaderUniforms->instanceViews.Set(1);
+        m_basicMeshes->SetInstanceDivisor(1);
+        FrameStats::Current().glCalls += viewCount;
+    }
+    else {
+        for (int v = 0; v < viewCount; ++v) {
+            int rect[4];
+            GetViewRect(v, m_viewportWidth, m_viewportHeight, rect);
+            GLCOUNT(glViewport(rect[0], rect[1], rect[2], rect[3]));
+            m_pShaderUniforms->firstView.Set(v);
+            DrawPackets(list);
+        }
+        m_pShaderUniforms->firstView.Set(0);
+    }
+    if (viewCount > 1) {
+        GLCOUNT(glViewport(0, 0, m_viewportWidth, m_viewportHeight));
+    }
+    // the ring frame is handed out again once these draws are done
+    m_uploadRing->EndFrame(list.uploadFrame);
+}
+
+/***********************************************************
+ *  DrawPackets()
+ *
+ *  This function issues the draws of a submitted draw list.
+ *  All meshes share one vertex array, and each run of
+ *  packets that differ only in their mesh is one indirect
+ *  multi-draw.
+ ***********************************************************/
+void SceneManager::DrawPackets(const DRAW_LIST& list) {
+    const std::vector<DRAW_PACKET>& packets = list.queue.GetPackets();
+    size_t runStart = 0;
+    while (runStart < packets.size()) {
+        const DRAW_PACKET& packet = packets[runStart];
+        size_t runEnd = runStart + 1;
+        while (runEnd < packets.size() && SameDrawState(packet, packets[runEnd])) {
+            ++runEnd;
+        }
+
+        m_stateCache.UseProgram(packet.program);
+        m_stateCache.SetBlend(packet.blend);
+        // untextured draws keep whatever texture is bound
+        if (packet.texture != 0) {
+            m_stateCache.BindTextureArray(packet.texture);
+        }
+        m_stateCache.SetUseTexture(m_pShaderUniforms->bUseTexture, packet.texture != 0 ? 1 : 0);
+        m_basicMeshes->MultiDrawIndirect(runStart, (GLsizei)(runEnd - runStart));
+        runStart = runEnd;
+    }
+}
+
+/***********************************************************
+ *  RasterizeDrawList()
+ *
+ *  This function draws a draw list's packets, in their
+ *  sorted order, with the software rasterizer, one pass per
+ *  view into that view's part of the framebuffer.
+ ***********************************************************/
+void SceneManager::RasterizeDrawList(const DRAW_LIST& list) {
+    const std::vector<DRAW_PACKET>& packets = list.queue.GetPackets();
+    m_softwareDraws.resize(packets.size());
+    for (size_t p = 0; p < packets.size(); ++p) {
+        SOFTWARE_DRAW& draw = m_softwareDraws[p];
+        draw.geometry = m_basicMeshes->GetMeshGeometry(packets[p].mesh);
+        draw.texture = packets[p].texture;
+        draw.blend = packets[p].blend;
+        draw.firstInstance = packets[p].firstInstance;
+        draw.instanceCount = (uint32_t)packets[p].instanceCount;
+    }
+
+    int viewCount = list.frame.viewCount.x;
+    for (int v = 0; v < viewCount; ++v) {
+        int rect[4] = { 0, 0, m_viewportWidth, m_viewportHeight };
+        if (viewCount > 1) {
+            GetViewRect(v, m_viewportWidth, m_viewportHeight, rect);
+        }
+        m_pSoftwareRasterizer->Draw(list.frame, v, rect, list.lightClusters, m_softwareDraws.data(),
+            m_softwareDraws.size(), list.instanceMatrices.data(), list.instanceSurfaces.data());
+    }
+}
+
+/***********************************************************
+ *  WaitForDrawList()
+ *
+ *  This function waits until the draw list being built in
+ *  the background is finished. Afterwards no job reads the
+ *  scene, so it may be changed.
+ ***********************************************************/
+void SceneManager::WaitForDrawList() {
+    if (m_buildPending) {
+        PROFILE_CPU_SCOPE("WaitForDrawList");
+        m_pJobSystem->Wait(m_buildCounter);
+        m_buildPending = false;
+    }
+}
+
+/***********************************************************
+ *  RenderScene()
+ *
+ *  This function renders the loaded 3D objects in the scene.
+ *  The draw lists are double buffered: while the list built
+ *  during the previous frame is submitted, a job builds the
+ *  list for the next frame from the current camera, so the
+ *  CPU work of one frame overlaps the OpenGL submission of
+ *  the one before it. Each list writes its instance data
+ *  into its own upload ring frame; with the frame the GPU
+ *  may still be drawing, that makes three.
+ *
+ *  With late latching the list is built from the current
+ *  camera right before it is submitted instead, so what is
+ *  drawn is a frame more recent, at the cost of the overlap.
+ ***********************************************************/
+void SceneManager::RenderScene() {
+    WaitForDrawList();
+
+    // Only moved dynamic objects need their matrices rebuilt
+    bool movedObjects = !m_dirtyObjects.empty();
+    UpdateDynamicTransforms();
+
+    if (m_lateLatching) {
+        DRAW_LIST& list = m_drawLists[m_buildIndex];
+        BeginDrawList(list);
+        BuildDrawList(list);
+        SubmitDrawList(list);
+        // a later switch back starts the double buffering over
+        m_drawListReady = false;
+        return;
+    }
+
+    int submitIndex = m_buildIndex;
+    if (!m_drawListReady) {
+        // nothing was built ahead (first frame after loading)
+        BeginDrawList(m_drawLists[submitIndex]);
+        BuildDrawList(m_drawLists[submitIndex]);
+        m_drawListReady = true;
+    }
+
+    // Start on the next frame's draw list
+    m_buildIndex = 1 - submitIndex;
+    BeginDrawList(m_drawLists[m_buildIndex]);
+    m_buildPending = true;
+    m_pJobSystem->Run([this]() { BuildDrawList(m_drawLists[m_buildIndex]); }, &m_buildCounter);
+
+    SubmitDrawList(m_drawLists[submitIndex]);
+
+    // The submitted list lags one frame behind; if the next one differs,
+    // make sure it is drawn even when nothing else changes
+    if (movedObjects || memcmp(&m_drawLists[submitIndex].frame, &m_drawLists[m_buildIndex].frame,
+        sizeof(FRAME_UNIFORMS)) != 0) {
+        FrameScheduler::RequestRedraw();
+    }
+}
+
+/***********************************************************
+ *  BuildInstanceBatches()
+ *
+ *  This function records one instanced draw batch for every
+ *  mesh, texture array and blending combination in the
+ *  scene, in that sort order, and remembers each object's
+ *  batch. Materials do not split batches; every instance
+ *  reads its own from the material table. Objects whose textures are layers of the same
+ *  array share a batch. The scene textures must be loaded.
+ ***********************************************************/
+void SceneManager::BuildInstanceBatches() {
+    const SCENE_OBJECTS& objects = m_scene.objects;
+
+    std::vector<GLuint> objectArrays(objects.Count());
+    std::vector<uint8_t> objectBlend(objects.Count());
+    std::vector<size_t> order(objects.Count());
+    for (size_t i = 0; i < order.size(); ++i) {
+        objectArrays[i] = (objects.textureID[i] >= 0) ? m_sceneTextures[objects.textureID[i]].arrayTexture : 0;
+        objectBlend[i] = (m_scene.materials[objects.materialID[i]].color.w < 1.0f) ? 1 : 0;
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&objects, &objectArrays, &objectBlend](size_t a, size_t b) {
+        if (objects.meshID[a] != objects.meshID[b]) {
+            return objects.meshID[a] < objects.meshID[b];
+        }
+        if (objectArrays[a] != objectArrays[b]) {
+            return objectArrays[a] < objectArrays[b];
+        }
+        return objectBlend[a] < objectBlend[b];
+    });
+
+    m_objectBatch.assign(order.size(), 0);
+    m_instanceBatches.clear();
+    for (size_t slot = 0; slot < order.size(); ++slot) {
+        size_t i = order[slot];
+        if (m_instanceBatches.empty() ||
+            m_instanceBatches.back().mesh != objects.meshID[i] ||
+            m_instanceBatches.back().textureArray != objectArrays[i] ||
+            m_instanceBatches.back().blend != (objectBlend[i] != 0)) {
+            INSTANCE_BATCH batch;
+            batch.mesh = (MESH_ID)objects.meshID[i];
+            batch.textureArray = objectArrays[i];
+            batch.blend = objectBlend[i] != 0;
+            batch.firstInstance = 0;
+            batch.instanceCount = 0;
+            m_instanceBatches.push_back(batch);
+        }
+        m_objectBatch[i] = (uint32_t)(m_instanceBatches.size() - 1);
+    }
+
+    std::cout << "INFO: " << objects.Count() << " objects in " << m_instanceBatches.size()
+        << " instanced draw batches" << std::endl;
+}
+
@@ -10,7 +10,18 @@
 #pragma once
 
 #include "ShaderManager.h"
-#include "ShapeMeshes.h"
+#include "ShaderUniforms.h"
+#include "PrimitiveMeshes.h"
+#include "TextureCache.h"
+#include "SceneLoader.h"
+#include "RenderQueue.h"
+#include "Culling.h"
+#include "LightClusters.h"
+#include "MaterialTable.h"
+#include "OcclusionBuffer.h"
+#include "UploadRing.h"
+#include "JobSystem.h"
+#include "SoftwareRasterizer.h"
 #include <GLFW/glfw3.h> // GLFW for input handling
 #include <string>
 #include <vector>
@@ -30,33 +41,127 @@ public:
     // destructor
     ~SceneManager();
 
-    struct TEXTURE_INFO
+    // range of instances drawn with one instanced draw call;
+    // the range is rebuilt every frame from the visible objects
+    struct INSTANCE_BATCH
     {
-        std::string tag;
-        uint32_t ID;
+        MESH_ID mesh;
+        GLuint textureArray;    // 0 for untextured objects
+        bool blend;             // materials with alpha below 1
+        GLuint firstInstance;
+        GLsizei instanceCount;
     };
 
-    struct OBJECT_MATERIAL
+    // CPU output of one frame, consumed by the OpenGL thread
+    struct DRAW_LIST
     {
-        float ambientStrength;
-        glm::vec3 ambientColor;
-        glm::vec3 diffuseColor;
-        glm::vec3 specularColor;
-        float shininess;
-        std::string tag;
+        // camera and light data the list was built with
+        FRAME_UNIFORMS frame;
+        // upload ring frame holding the list's instance data, and the
+        // offsets of the visible objects' model matrices and surfaces
+        // (texture array layer, material id) in it, grouped by batch
+        int uploadFrame;
+        GLintptr instanceMatrixOffset;
+        GLintptr instanceSurfaceOffset;
+        // the same instance data of a list drawn by the software
+        // rasterizer, which has no upload ring
+        std::vector<glm::mat4> instanceMatrices;
+        std::vector<glm::uvec2> instanceSurfaces;
+        // views every instance of a draw command is drawn into by
+        // one draw (1 when the views are drawn in separate passes)
+        GLuint instanceViews;
+        // sorted draw packets and their indirect draw commands
+        RenderQueue queue;
+        std::vector<DRAW_INDIRECT_COMMAND> drawCommands;
+        // point lights of each light cluster of the view
+        LIGHT_CLUSTER_LIST lightClusters;
+        unsigned int objectsVisible;
+        unsigned int objectsCulled;
+        // objects inside the frustum but hidden behind occluders
+        unsigned int objectsOccluded;
     };
 
 private:
     // pointer to shader manager object
     ShaderManager* m_pShaderManager;
-    // pointer to basic shapes object
-    ShapeMeshes* m_basicMeshes;
-    // total number of loaded textures
-    int m_loadedTextures;
-    // loaded textures info
-    TEXTURE_INFO m_textureIDs[16];
-    // defined object materials
-    std::vector<OBJECT_MATERIAL> m_objectMaterials;
+    // pointer to the resolved shader uniform handles
+    ShaderUniforms* m_pShaderUniforms;
+    // pointer to the job system running the per-frame CPU work
+    JobSystem* m_pJobSystem;
+    // pointer to the instanced basic shapes object
+    PrimitiveMeshes* m_basicMeshes;
+    // pointer to the texture cache object
+    TextureCache* m_textureCache;
+    // pointer to the point light clusters object
+    LightClusters* m_lightClusters;
+    // pointer to the ring the draw lists write their instance data into
+    UploadRing* m_uploadRing;
+    // pointer to the GPU table of the scene materials
+    MaterialTable* m_materialTable;
+    // pointer to the rasterizer drawing the scene on the CPU, NULL
+    // when it is drawn with OpenGL
+    SoftwareRasterizer* m_pSoftwareRasterizer;
+    // draws of the draw list being rasterized
+    std::vector<SOFTWARE_DRAW> m_softwareDraws;
+
+    // loaded scene description and object arrays
+    SCENE_DESCRIPTION m_scene;
+    // texture array and layer of each scene texture table entry
+    std::vector<TEXTURE_LAYER> m_sceneTextures;
+    // texture array layer and material id of each scene object
+    std::vector<glm::uvec2> m_objectSurfaces;
+    // dynamic objects moved since the last frame
+    std::vector<size_t> m_dirtyObjects;
+    // instanced draw batches, one per mesh/texture/blending
+    std::vector<INSTANCE_BATCH> m_instanceBatches;
+    // instanced draw batch of each scene object
+    std::vector<uint32_t> m_objectBatch;
+    // world space bounding box of each scene object
+    std::vector<AABB> m_objectBounds;
+    // bounding volume hierarchy over the object bounds
+    BoundingVolumeHierarchy m_objectTree;
+    // objects inside the view frustum this frame
+    std::vector<uint32_t> m_visibleObjects;
+    // instance slot of each visible object
+    std::vector<GLuint> m_instanceSlots;
+    // next free instance slot of each batch while gathering
+    std::vector<GLuint> m_batchCursors;
+    // batches with visible objects this frame
+    std::vector<uint32_t> m_visibleBatches;
+    // object tree subtrees culled by separate jobs, and their results
+    std::vector<uint32_t> m_subtreeRoots;
+    std::vector<std::vector<uint32_t>> m_subtreeVisible;
+    // true when objects hidden behind occluders are skipped
+    bool m_occlusionCulling;
+    // true when each frame's draw list is built right before it is
+    // submitted rather than during the frame before
+    bool m_lateLatching;
+    // true when the vertex shader can select the viewport, so all
+    // views of a frame are drawn by one set of draws
+    bool m_singlePassViews;
+    // size of the viewport the scene is drawn into
+    int m_viewportWidth;
+    int m_viewportHeight;
+    // depth of the largest visible objects, for occlusion tests
+    OcclusionBuffer m_occlusionBuffer;
+    // screen area of each object in the frustum, for choosing occluders
+    std::vector<float> m_screenAreas;
+    // visible objects chosen as occluders
+    std::vector<uint32_t> m_occluders;
+    // non-zero for each object in the frustum found to be hidden
+    std::vector<uint8_t> m_occluded;
+    // double-buffered draw lists: one is built while the other is submitted
+    DRAW_LIST m_drawLists[2];
+    // draw list being built (or last built)
+    int m_buildIndex;
+    // counts the draw list build job in flight
+    JobCounter m_buildCounter;
+    // true while a draw list build job may be running
+    bool m_buildPending;
+    // false until a draw list for the loaded scene exists
+    bool m_drawListReady;
+    // OpenGL state set while submitting draw packets
+    GLStateCache m_stateCache;
 
     // Camera properties
     glm::vec3 m_cameraPos;
@@ -67,57 +172,87 @@ private:
     glm::mat4 m_projectionMatrix;
     GLFWwindow* m_window; // Store pointer to GLFW window
 
-    // load texture images and convert to OpenGL texture data
-    bool CreateGLTexture(const char* filename, std::string tag);
-    // bind loaded OpenGL textures to slots in memory
-    void BindGLTextures();
-    // free the loaded OpenGL textures
-    void DestroyGLTextures();
-    // find a loaded texture by tag
-    int FindTextureID(std::string tag);
-    int FindTextureSlot(std::string tag);
-    // find a defined material by tag
-    bool FindMaterial(std::string tag, OBJECT_MATERIAL& material);
-
-    // set the transformation values 
-    // into the transform buffer
-    void SetTransformations(
-        glm::vec3 scaleXYZ,
-        float XrotationDegrees,
-        float YrotationDegrees,
-        float ZrotationDegrees,
-        glm::vec3 positionXYZ);
-
-    // set the color values into the shader
-    void SetShaderColor(
-        float redColorValue,
-        float greenColorValue,
-        float blueColorValue,
-        float alphaValue);
-
-    // set the texture data into the shader
-    void SetShaderTexture(
-        std::string textureTag);
-
-    // set the UV scale for the texture mapping
-    void SetTextureUVScale(
-        float u, float v);
-
-    // set the object material into the shader
-    void SetShaderMaterial(
-        std::string materialTag);
-
     // Handle camera movement and input
     void UpdateCamera();
 
+    // group the scene objects into instanced draw batches
+    void BuildInstanceBatches();
+    // rebuild the model matrices and bounds of moved dynamic objects
+    void UpdateDynamicTransforms();
+    // start a draw list for the current frame data
+    void BeginDrawList(DRAW_LIST& list);
+    // build a frame's draw list (runs as a job, no OpenGL calls)
+    void BuildDrawList(DRAW_LIST& list);
+    // find the visible objects and gather their instance matrices
+    void CullObjects(DRAW_LIST& list);
+    // remove the objects hidden behind the largest visible objects
+    void CullOccludedObjects(DRAW_LIST& list);
+    // record and sort the draw packets of the visible batches
+    void BuildDrawPackets(DRAW_LIST& list);
+    // assign the point lights to the light clusters of the view
+    void AssignLights(DRAW_LIST& list);
+    // upload a draw list and issue its draws
+    void SubmitDrawList(const DRAW_LIST& list);
+    // issue the draws of a draw list's packets
+    void DrawPackets(const DRAW_LIST& list);
+    // draw a draw list's packets with the software rasterizer
+    void RasterizeDrawList(const DRAW_LIST& list);
+    // wait for the draw list build job in flight, if any
+    void WaitForDrawList();
+
 public:
     // The following methods are for the students to 
     // customize for their own 3D scene
     void PrepareScene();
     void RenderScene();
 
+    // load a scene file, replacing the current scene objects
+    bool LoadScene(const char* filename);
+    // replace the current scene objects with a scene description
+    void LoadScene(const SCENE_DESCRIPTION& scene);
+    // move a dynamic scene object
+    void SetObjectTransform(size_t index, glm::vec3 scaleXYZ, glm::vec3 rotationXYZ, glm::vec3 positionXYZ);
+
     // Pass the GLFW window to the scene manager for input handling
     void SetWindow(GLFWwindow* window) {
         m_window = window;
     }
+
+    // Pass the job system for the per-frame CPU work (must be set before PrepareScene)
+    void SetJobSystem(JobSystem* pJobSystem) {
+        m_pJobSystem = pJobSystem;
+    }
+
+    // Skip objects hidden behind other objects (on by default)
+    void SetOcclusionCulling(bool enabled) {
+        m_occlusionCulling = enabled;
+    }
+
+    // Build each frame's draw list from the latest camera right before
+    // drawing it, trading the CPU/GPU overlap for a frame less latency
+    void SetLateLatching(bool enabled) {
+        WaitForDrawList();
+        m_lateLatching = enabled;
+    }
+
+    // Size of the viewport the scene is drawn into, which multi-view
+    // frames split between their views (set it whenever it changes)
+    void SetViewportSize(int width, int height) {
+        m_viewportWidth = width;
+        m_viewportHeight = height;
+    }
+
+    // Draw with a software rasterizer instead of OpenGL, which then
+    // is never called (must be set before a scene is loaded)
+    void SetSoftwareRasterizer(SoftwareRasterizer* pRasterizer);
+
+    // Forget the cached OpenGL state after other code changed it
+    void InvalidateState() {
+        m_stateCache.Invalidate();
+    }
+
+    // Pass the resolved uniform handles (must be set before PrepareScene)
+    void SetShaderUniforms(ShaderUniforms* pShaderUniforms) {
+        m_pShaderUniforms = pShaderUniforms;
+    }
 };
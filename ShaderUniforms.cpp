@@ -0,0 +1,193 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderuniforms.cpp
+// ============
+// Uniform locations resolved once at program link, and the per-frame
+// uniform buffer holding the camera and lighting data
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderUniforms.h"
+#include "FrameStats.h"
+#include "LightClusters.h"
+#include "MaterialTable.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    // count one uniform upload in the frame statistics
+    void CountUniformCall() {
+        ++FrameStats::Current().uniformCalls;
+        ++FrameStats::Current().glCalls;
+    }
+}
+
+template <>
+void Uniform<glm::mat4>::Set(const glm::mat4& value) const {
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    CountUniformCall();
+}
+
+template <>
+void Uniform<glm::vec4>::Set(const glm::vec4& value) const {
+    glUniform4fv(location, 1, glm::value_ptr(value));
+    CountUniformCall();
+}
+
+template <>
+void Uniform<glm::vec3>::Set(const glm::vec3& value) const {
+    glUniform3fv(location, 1, glm::value_ptr(value));
+    CountUniformCall();
+}
+
+template <>
+void Uniform<int>::Set(const int& value) const {
+    glUniform1i(location, value);
+    CountUniformCall();
+}
+
+template <>
+void Uniform<float>::Set(const float& value) const {
+    glUniform1f(location, value);
+    CountUniformCall();
+}
+
+/***********************************************************
+ *  ShaderUniforms()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderUniforms::ShaderUniforms() {
+    m_frameBuffer = 0;
+    m_frame = FRAME_UNIFORMS();
+    m_uploadedFrame = FRAME_UNIFORMS();
+    m_frameUploaded = false;
+}
+
+/***********************************************************
+ *  ~ShaderUniforms()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ShaderUniforms::~ShaderUniforms() {
+    if (m_frameBuffer != 0) {
+        glDeleteBuffers(1, &m_frameBuffer);
+        m_frameBuffer = 0;
+    }
+}
+
+/***********************************************************
+ *  Resolve()
+ *
+ *  This method looks up every uniform location of the
+ *  linked program once, binds the FrameData block to its
+ *  binding point and creates the uniform buffer behind it.
+ *  The program must be in use.
+ ***********************************************************/
+void ShaderUniforms::Resolve(GLuint programID) {
+    objectTexture.location = glGetUniformLocation(programID, "objectTexture");
+    bUseTexture.location = glGetUniformLocation(programID, "bUseTexture");
+    firstView.location = glGetUniformLocation(programID, "firstView");
+    instanceViews.location = glGetUniformLocation(programID, "instanceViews");
+    materialData.location = glGetUniformLocation(programID, "materialData");
+    lightData.location = glGetUniformLocation(programID, "lightData");
+    clusterLights.location = glGetUniformLocation(programID, "clusterLights");
+    lightIndices.location = glGetUniformLocation(programID, "lightIndices");
+
+    GLuint blockIndex = glGetUniformBlockIndex(programID, "FrameData");
+    if (blockIndex == GL_INVALID_INDEX) {
+        std::cout << "ERROR: FrameData uniform block not found in shader program" << std::endl;
+    }
+    else {
+        glUniformBlockBinding(programID, blockIndex, FRAME_DATA_BINDING);
+    }
+
+    if (m_frameBuffer == 0) {
+        glGenBuffers(1, &m_frameBuffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, m_frameBuffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FRAME_UNIFORMS), NULL, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, m_frameBuffer);
+    }
+    m_frameUploaded = false;
+
+    // the scene textures are always sampled from texture unit 0, and
+    // the material table and light cluster buffers from the units
+    // MaterialTable and LightClusters bind
+    objectTexture.Set(0);
+    materialData.Set(MaterialTable::MATERIAL_DATA_UNIT);
+    lightData.Set(LightClusters::LIGHT_DATA_UNIT);
+    clusterLights.Set(LightClusters::CLUSTER_LIGHTS_UNIT);
+    lightIndices.Set(LightClusters::LIGHT_INDICES_UNIT);
+    // every instance is drawn into the camera view until a
+    // multi-view pass selects others
+    firstView.Set(0);
+    instanceViews.Set(1);
+}
+
+/***********************************************************
+ *  SetCamera()
+ *
+ *  This method stores the camera values for the frame,
+ *  along with the light cluster depth slicing that follows
+ *  from the projection. The camera is the only view.
+ ***********************************************************/
+void ShaderUniforms::SetCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& position) {
+    CAMERA_VIEW camera = { view, projection, position };
+    SetViews(&camera, 1);
+}
+
+/***********************************************************
+ *  SetViews()
+ *
+ *  This method stores the views drawn in the frame. Unused
+ *  view slots are cleared, so frames with the same views
+ *  compare equal.
+ ***********************************************************/
+void ShaderUniforms::SetViews(const CAMERA_VIEW* views, int count) {
+    count = std::min(std::max(count, 1), (int)MAX_VIEWS);
+    const CAMERA_VIEW& camera = views[0];
+    m_frame.view = camera.view;
+    m_frame.projection = camera.projection;
+    m_frame.viewPosition = glm::vec4(camera.position, 1.0f);
+    m_frame.clusterSlicing = LightClusters::GetDepthSlicing(camera.projection);
+    m_frame.clusterGrid = glm::ivec4(LightClusters::GRID_X, LightClusters::GRID_Y, LightClusters::GRID_Z, 0);
+    for (int i = 0; i < MAX_VIEWS; ++i) {
+        m_frame.viewMatrices[i] = (i < count) ? views[i].view : glm::mat4(0.0f);
+        m_frame.projectionMatrices[i] = (i < count) ? views[i].projection : glm::mat4(0.0f);
+        m_frame.viewPositions[i] = (i < count) ? glm::vec4(views[i].position, 1.0f) : glm::vec4(0.0f);
+    }
+    m_frame.viewCount = glm::ivec4(count, 0, 0, 0);
+}
+
+/***********************************************************
+ *  SetLights()
+ *
+ *  This method stores the light values for the frame.
+ ***********************************************************/
+void ShaderUniforms::SetLights(const glm::vec3& lightDirection, const glm::vec3& lightColor) {
+    m_frame.lightDirection = glm::vec4(lightDirection, 0.0f);
+    m_frame.lightColor = glm::vec4(lightColor, 1.0f);
+}
+
+/***********************************************************
+ *  UploadFrame()
+ *
+ *  This method uploads the whole FrameData block with one
+ *  buffer update, skipping the upload when the buffer
+ *  already holds the same values (a camera that has not
+ *  moved needs no upload).
+ ***********************************************************/
+void ShaderUniforms::UploadFrame(const FRAME_UNIFORMS& frame) {
+    if (m_frameBuffer == 0) {
+        return;
+    }
+    if (m_frameUploaded && memcmp(&m_uploadedFrame, &frame, sizeof(FRAME_UNIFORMS)) == 0) {
+        return;
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, m_frameBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FRAME_UNIFORMS), &frame);
+    FrameStats::Current().glCalls += 2;
+    ++FrameStats::Current().bufferUploads;
+    m_uploadedFrame = frame;
+    m_frameUploaded = true;
+}
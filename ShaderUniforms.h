@@ -0,0 +1,128 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderuniforms.h
+// ============
+// Uniform locations resolved once at program link, and the per-frame
+// uniform buffer holding the camera and lighting data
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  Uniform
+ *
+ *  Typed handle for a uniform location. Setting a value is
+ *  a single glUniform* call with no name lookup.
+ ***********************************************************/
+template <typename T>
+struct Uniform
+{
+    GLint location;
+
+    Uniform() : location(-1) {}
+    void Set(const T& value) const;
+};
+
+// most views drawn together in multi-view mode
+enum { MAX_VIEWS = 4 };
+
+/***********************************************************
+ *  CAMERA_VIEW
+ *
+ *  One view of the scene drawn in multi-view mode.
+ ***********************************************************/
+struct CAMERA_VIEW
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 position;
+};
+
+/***********************************************************
+ *  FRAME_UNIFORMS
+ *
+ *  CPU copy of the FrameData uniform block, laid out with
+ *  std140 rules (every member is 16 byte aligned). The
+ *  camera (view, projection, viewPosition) is also view 0
+ *  of the view arrays; culling, occlusion and the light
+ *  clusters work with the camera.
+ ***********************************************************/
+struct FRAME_UNIFORMS
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec4 viewPosition;
+    glm::vec4 lightDirection;
+    glm::vec4 lightColor;
+    // depth slicing of the light clusters (LightClusters::GetDepthSlicing)
+    glm::vec4 clusterSlicing;
+    // light clusters along x, y and z
+    glm::ivec4 clusterGrid;
+    // every view drawn this frame, each into its own viewport
+    glm::mat4 viewMatrices[MAX_VIEWS];
+    glm::mat4 projectionMatrices[MAX_VIEWS];
+    glm::vec4 viewPositions[MAX_VIEWS];
+    // x: number of views (1 outside multi-view mode)
+    glm::ivec4 viewCount;
+};
+
+/***********************************************************
+ *  ShaderUniforms
+ *
+ *  This class holds the resolved uniform handles of the
+ *  scene shader program and the per-frame uniform buffer.
+ ***********************************************************/
+class ShaderUniforms
+{
+public:
+    // constructor
+    ShaderUniforms();
+    // destructor
+    ~ShaderUniforms();
+
+    // resolve the uniform locations of a linked program
+    void Resolve(GLuint programID);
+
+    // set the camera values for the current frame, the only view drawn
+    void SetCamera(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& position);
+    // set several views to draw in one pass (at most MAX_VIEWS); the
+    // first one is the camera
+    void SetViews(const CAMERA_VIEW* views, int count);
+    // set the directional light values for the current frame; the point
+    // lights are read from the light cluster buffers
+    void SetLights(const glm::vec3& lightDirection, const glm::vec3& lightColor);
+    // upload frame data if it differs from the last upload; draw lists
+    // built ahead of time pass the frame data they were built with
+    void UploadFrame(const FRAME_UNIFORMS& frame);
+    // CPU copy of the current frame data
+    const FRAME_UNIFORMS& GetFrame() const { return m_frame; }
+
+    // per-draw uniform handles
+    Uniform<int> objectTexture;
+    Uniform<int> bUseTexture;
+    // per-pass view selection: instance i of a draw is drawn into
+    // view firstView + i % instanceViews
+    Uniform<int> firstView;
+    Uniform<int> instanceViews;
+    // material table buffer texture sampler
+    Uniform<int> materialData;
+    // light cluster buffer texture samplers
+    Uniform<int> lightData;
+    Uniform<int> clusterLights;
+    Uniform<int> lightIndices;
+
+private:
+    // binding point of the FrameData uniform block
+    static const GLuint FRAME_DATA_BINDING = 0;
+
+    // uniform buffer object for the FrameData block
+    GLuint m_frameBuffer;
+    // CPU copy of the FrameData block
+    FRAME_UNIFORMS m_frame;
+    // contents of the uniform buffer
+    FRAME_UNIFORMS m_uploadedFrame;
+    // false until the uniform buffer holds frame data
+    bool m_frameUploaded;
+};
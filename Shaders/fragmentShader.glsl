@@ -0,0 +1,99 @@
+#version 330 core
+
+in vec3 fragmentPosition;
+in vec3 fragmentVertexNormal;
+in vec2 fragmentTextureCoordinate;
+flat in uint fragmentTextureLayer;
+flat in uint fragmentMaterial;
+flat in int fragmentView;
+
+out vec4 outFragmentColor;
+
+// per-frame camera and lighting data, uploaded once per frame
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPosition;
+    vec4 lightDirection;
+    vec4 lightColor;
+    vec4 clusterSlicing;        // x, y: depth slice scale and bias
+    ivec4 clusterGrid;          // light clusters along x, y and z
+    // every view drawn this frame; view 0 is the camera above
+    mat4 viewMatrices[4];
+    mat4 projectionMatrices[4];
+    vec4 viewPositions[4];
+    ivec4 viewCount;            // x: number of views
+};
+
+uniform sampler2DArray objectTexture;
+uniform bool bUseTexture;
+
+// scene materials, two texels each: color, specular strength
+uniform samplerBuffer materialData;
+
+// point lights, two texels each: position and radius, color and intensity
+uniform samplerBuffer lightData;
+// first light index and light count of each light cluster
+uniform usamplerBuffer clusterLights;
+// point light indices of all clusters
+uniform usamplerBuffer lightIndices;
+
+// Phong shading for one light arriving from lightVector
+vec3 CalculateLight(vec3 lightVector, vec3 color, vec3 normal, vec3 viewVector, float specularStrength)
+{
+    float diffuse = max(dot(normal, lightVector), 0.0);
+    vec3 reflectVector = reflect(-lightVector, normal);
+    float specular = pow(max(dot(viewVector, reflectVector), 0.0), 32.0);
+    return (diffuse + specularStrength * specular) * color;
+}
+
+void main()
+{
+    vec3 normal = normalize(fragmentVertexNormal);
+    vec3 viewVector = normalize(viewPositions[fragmentView].xyz - fragmentPosition);
+    vec4 objectColor = texelFetch(materialData, int(fragmentMaterial) * 2);
+    float specularStrength = texelFetch(materialData, int(fragmentMaterial) * 2 + 1).x;
+
+    // ambient term plus the directional light
+    vec3 lighting = 0.2 * lightColor.rgb;
+    lighting += CalculateLight(normalize(-lightDirection.xyz), lightColor.rgb, normal, viewVector, specularStrength);
+
+    // light cluster of the fragment: its screen tile and depth slice
+    vec4 viewSpacePosition = view * vec4(fragmentPosition, 1.0);
+    vec4 clipPosition = projection * viewSpacePosition;
+    ivec2 tile = ivec2((clipPosition.xy / clipPosition.w * 0.5 + 0.5) * vec2(clusterGrid.xy));
+    tile = clamp(tile, ivec2(0), clusterGrid.xy - 1);
+    float depth = max(-viewSpacePosition.z, 1e-4);
+    int slice = clamp(int(floor(log(depth) * clusterSlicing.x + clusterSlicing.y)), 0, clusterGrid.z - 1);
+    uvec2 cluster = texelFetch(clusterLights, (slice * clusterGrid.y + tile.y) * clusterGrid.x + tile.x).xy;
+    // the clusters cover the camera view only; in the other views,
+    // fragments outside it get no point lights
+    if (fragmentView != 0 && (any(greaterThan(abs(clipPosition.xyz), vec3(clipPosition.w))) || clipPosition.w <= 0.0))
+    {
+        cluster.y = 0u;
+    }
+
+    // the cluster's point lights, with distance attenuation that
+    // fades to zero at each light's radius
+    for (uint i = 0u; i < cluster.y; ++i)
+    {
+        int light = int(texelFetch(lightIndices, int(cluster.x + i)).x);
+        vec4 positionRadius = texelFetch(lightData, light * 2);
+        vec4 colorIntensity = texelFetch(lightData, light * 2 + 1);
+
+        vec3 toPointLight = positionRadius.xyz - fragmentPosition;
+        float distance = length(toPointLight);
+        float fade = clamp(1.0 - pow(distance / positionRadius.w, 4.0), 0.0, 1.0);
+        float attenuation = colorIntensity.w * fade * fade / (1.0 + 0.09 * distance + 0.032 * distance * distance);
+        lighting += attenuation * CalculateLight(toPointLight / max(distance, 1e-4), colorIntensity.rgb,
+            normal, viewVector, specularStrength);
+    }
+
+    vec4 baseColor = objectColor;
+    if (bUseTexture)
+    {
+        baseColor = texture(objectTexture, vec3(fragmentTextureCoordinate, float(fragmentTextureLayer)));
+    }
+    outFragmentColor = vec4(lighting * baseColor.rgb, baseColor.a);
+}
@@ -0,0 +1,43 @@
+#version 330 core
+
+in vec2 outputCoordinate;
+
+out vec4 outFragmentColor;
+
+// offscreen scene image, drawn at a fraction of its size
+uniform sampler2D sourceImage;
+// xy: drawn part of the image in texture coordinates,
+// zw: size of one texel in texture coordinates
+uniform vec4 sourceRegion;
+// strength of the sharpen filter, 0 for plain bilinear upscaling
+uniform float sharpness;
+
+// bilinear sample that never reads outside the drawn part
+vec3 SampleSource(vec2 coordinate)
+{
+    vec2 halfTexel = sourceRegion.zw * 0.5;
+    return texture(sourceImage, clamp(coordinate, halfTexel, sourceRegion.xy - halfTexel)).rgb;
+}
+
+void main()
+{
+    vec2 coordinate = outputCoordinate * sourceRegion.xy;
+    vec3 center = SampleSource(coordinate);
+    if (sharpness <= 0.0)
+    {
+        outFragmentColor = vec4(center, 1.0);
+        return;
+    }
+
+    // unsharp mask over the four neighbouring source texels, limited
+    // to their range so edges do not ring
+    vec3 north = SampleSource(coordinate + vec2(0.0, sourceRegion.w));
+    vec3 south = SampleSource(coordinate - vec2(0.0, sourceRegion.w));
+    vec3 east = SampleSource(coordinate + vec2(sourceRegion.z, 0.0));
+    vec3 west = SampleSource(coordinate - vec2(sourceRegion.z, 0.0));
+    vec3 minimum = min(center, min(min(north, south), min(east, west)));
+    vec3 maximum = max(center, max(max(north, south), max(east, west)));
+    vec3 blurred = (north + south + east + west) * 0.25;
+    vec3 sharpened = center + (center - blurred) * sharpness;
+    outFragmentColor = vec4(clamp(sharpened, minimum, maximum), 1.0);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+
+// texture coordinate across the output, 0 to 1
+out vec2 outputCoordinate;
+
+// one triangle covering the whole output, with no vertex data:
+// vertices 0, 1 and 2 become (0, 0), (2, 0) and (0, 2)
+void main()
+{
+    vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    outputCoordinate = corner;
+    gl_Position = vec4(corner * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,59 @@
+#version 330 core
+// selecting the viewport in the vertex shader draws several views
+// in one pass; without either extension each view is its own pass
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_viewport_index : enable
+
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 1) in vec3 inVertexNormal;
+layout (location = 2) in vec2 inTextureCoordinate;
+// per-instance model matrix (occupies locations 3 to 6)
+layout (location = 3) in mat4 instanceModel;
+// per-instance layer of the texture array holding the object's texture
+// (x) and material table index (y)
+layout (location = 7) in uvec2 instanceSurface;
+
+// per-frame camera and lighting data, uploaded once per frame
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    vec4 viewPosition;
+    vec4 lightDirection;
+    vec4 lightColor;
+    vec4 clusterSlicing;        // x, y: depth slice scale and bias
+    ivec4 clusterGrid;          // light clusters along x, y and z
+    // every view drawn this frame; view 0 is the camera above
+    mat4 viewMatrices[4];
+    mat4 projectionMatrices[4];
+    vec4 viewPositions[4];
+    ivec4 viewCount;            // x: number of views
+};
+
+// instance i of a draw is drawn into view firstView + i % instanceViews;
+// the instance attributes advance once every instanceViews instances
+uniform int firstView;
+uniform int instanceViews;
+
+out vec3 fragmentPosition;
+out vec3 fragmentVertexNormal;
+out vec2 fragmentTextureCoordinate;
+flat out uint fragmentTextureLayer;
+flat out uint fragmentMaterial;
+flat out int fragmentView;
+
+void main()
+{
+    fragmentPosition = vec3(instanceModel * vec4(inVertexPosition, 1.0));
+    fragmentVertexNormal = mat3(transpose(inverse(instanceModel))) * inVertexNormal;
+    fragmentTextureCoordinate = inTextureCoordinate;
+    fragmentTextureLayer = instanceSurface.x;
+    fragmentMaterial = instanceSurface.y;
+
+    int viewIndex = firstView + gl_InstanceID % instanceViews;
+    fragmentView = viewIndex;
+    gl_Position = projectionMatrices[viewIndex] * viewMatrices[viewIndex] * vec4(fragmentPosition, 1.0);
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_viewport_index)
+    gl_ViewportIndex = viewIndex;
+#endif
+}
@@ -0,0 +1,1050 @@
+///////////////////////////////////////////////////////////////////////////////
+// softwarerasterizer.cpp
+// ============
+// Multi-threaded tile-binned CPU rasterizer that draws the scene manager's
+// draw lists with the same lighting and texturing as the scene shaders,
+// for machines without a GPU
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SoftwareRasterizer.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include "TransformKernel.h"
+#include "stb_image.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define SOFTWARE_RASTERIZER_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+// MSVC compiles intrinsics of any instruction set without flags
+#define TARGET_SSE4
+#define TARGET_AVX2
+#else
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+    typedef SoftwareRasterizer::CLIP_VERTEX CLIP_VERTEX;
+    typedef SoftwareRasterizer::TRIANGLE TRIANGLE;
+    typedef SoftwareRasterizer::PLANE PLANE;
+
+    // vertices are snapped to 1/16 pixel, and pixels are sampled
+    // at their centers, half a pixel in
+    const int SUBPIXEL_BITS = 4;
+    const int SUBPIXEL_SCALE = 1 << SUBPIXEL_BITS;
+    const int PIXEL_CENTER = SUBPIXEL_SCALE / 2;
+    // pixels the clipped triangles may reach past each viewport
+    // edge; keeps the edge functions of a tile inside 32 bits
+    const float GUARD_BAND = 2048.0f;
+    // pixel that no opaque triangle covers
+    const uint32_t NO_TRIANGLE = 0xFFFFFFFFu;
+    // instance chunks per thread; every chunk is a job of its own,
+    // so threads done with light chunks steal the remaining ones
+    const size_t CHUNKS_PER_THREAD = 4;
+    // framebuffer rows cleared by one job
+    const size_t CLEAR_GRAIN_SIZE = 16;
+    // most vertices of a triangle clipped by the six planes
+    const int MAX_CLIPPED_VERTICES = 9;
+    // terms of the scene shaders' lighting
+    const float AMBIENT_STRENGTH = 0.2f;
+    const float SHININESS = 32.0f;
+
+    // clip planes: inside when the plane value of a clip position is
+    // at least 0; x and y are clipped to the guard band
+    enum CLIP_PLANE
+    {
+        CLIP_NEAR = 0,
+        CLIP_FAR,
+        CLIP_LEFT,
+        CLIP_RIGHT,
+        CLIP_BOTTOM,
+        CLIP_TOP,
+        CLIP_PLANE_COUNT
+    };
+
+    float PlaneValue(int plane, const glm::vec4& p, const glm::vec2& guard) {
+        switch (plane) {
+        case CLIP_NEAR: return p.z + p.w;
+        case CLIP_FAR: return p.w - p.z;
+        case CLIP_LEFT: return guard.x * p.w + p.x;
+        case CLIP_RIGHT: return guard.x * p.w - p.x;
+        case CLIP_BOTTOM: return guard.y * p.w + p.y;
+        default: return guard.y * p.w - p.y;
+        }
+    }
+
+    // one bit per clip plane the position is outside of
+    int ClipCodes(const glm::vec4& p, const glm::vec2& guard) {
+        int codes = 0;
+        for (int plane = 0; plane < CLIP_PLANE_COUNT; ++plane) {
+            if (PlaneValue(plane, p, guard) < 0.0f) {
+                codes |= 1 << plane;
+            }
+        }
+        return codes;
+    }
+
+    CLIP_VERTEX Interpolate(const CLIP_VERTEX& a, const CLIP_VERTEX& b, float t) {
+        CLIP_VERTEX result;
+        result.position = a.position + (b.position - a.position) * t;
+        for (int i = 0; i < SoftwareRasterizer::ATTRIBUTE_COUNT; ++i) {
+            result.attributes[i] = a.attributes[i] + (b.attributes[i] - a.attributes[i]) * t;
+        }
+        return result;
+    }
+
+    /***********************************************************
+     *  ClipPolygon()
+     *
+     *  Sutherland-Hodgman clipping of a convex polygon against
+     *  the planes in codes; the attributes are interpolated in
+     *  clip space, which keeps them perspective correct.
+     *  Returns the new vertex count.
+     ***********************************************************/
+    int ClipPolygon(CLIP_VERTEX* polygon, int count, int codes, const glm::vec2& guard) {
+        CLIP_VERTEX clipped[MAX_CLIPPED_VERTICES];
+        for (int plane = 0; plane < CLIP_PLANE_COUNT && count >= 3; ++plane) {
+            if ((codes & (1 << plane)) == 0) {
+                continue;
+            }
+            int clippedCount = 0;
+            for (int i = 0; i < count; ++i) {
+                const CLIP_VERTEX& a = polygon[i];
+                const CLIP_VERTEX& b = polygon[(i + 1) % count];
+                float valueA = PlaneValue(plane, a.position, guard);
+                float valueB = PlaneValue(plane, b.position, guard);
+                if (valueA >= 0.0f) {
+                    clipped[clippedCount++] = a;
+                }
+                if ((valueA >= 0.0f) != (valueB >= 0.0f)) {
+                    clipped[clippedCount++] = Interpolate(a, b, valueA / (valueA - valueB));
+                }
+            }
+            count = clippedCount;
+            std::copy(clipped, clipped + count, polygon);
+        }
+        return count;
+    }
+
+    // plane through three values at three screen positions, relative
+    // to the first; the positions are in pixels from the first vertex
+    PLANE MakePlane(float q0, float q1, float q2, float x1, float y1, float x2, float y2, float inverseArea) {
+        PLANE plane;
+        plane.origin = q0;
+        plane.stepX = ((q1 - q0) * y2 - (q2 - q0) * y1) * inverseArea;
+        plane.stepY = ((q2 - q0) * x1 - (q1 - q0) * x2) * inverseArea;
+        return plane;
+    }
+
+    float Evaluate(const PLANE& plane, float dx, float dy) {
+        return plane.origin + plane.stepX * dx + plane.stepY * dy;
+    }
+
+    uint32_t PackColor(const glm::vec4& color) {
+        glm::vec4 c = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+        return (uint32_t)c.x | ((uint32_t)c.y << 8) | ((uint32_t)c.z << 16) | ((uint32_t)c.w << 24);
+    }
+
+    glm::vec4 UnpackColor(uint32_t color) {
+        return glm::vec4((float)(color & 0xFF), (float)((color >> 8) & 0xFF),
+            (float)((color >> 16) & 0xFF), (float)(color >> 24)) * (1.0f / 255.0f);
+    }
+
+    // Phong shading for one light arriving from lightVector, as in
+    // the fragment shader
+    glm::vec3 CalculateLight(const glm::vec3& lightVector, const glm::vec3& color, const glm::vec3& normal,
+        const glm::vec3& viewVector, float specularStrength) {
+        float diffuse = std::max(glm::dot(normal, lightVector), 0.0f);
+        glm::vec3 reflectVector = glm::reflect(-lightVector, normal);
+        float specular = powf(std::max(glm::dot(viewVector, reflectVector), 0.0f), SHININESS);
+        return (diffuse + specularStrength * specular) * color;
+    }
+
+    /***********************************************************
+     *  TILE_SETUP
+     *
+     *  Edge functions and depth of a triangle over the pixel
+     *  rectangle it covers in one tile, at the first pixel of
+     *  the first row. Every row starts at firstX, rounded down
+     *  to the SIMD width, so vector loads and stores stay
+     *  aligned to the tile; the pixels left of minX are masked.
+     *  An edge the whole rectangle is inside of has all values
+     *  0 and is never failed. Depth starts from the tile's
+     *  first column instead, so every kernel computes exactly
+     *  the same depths.
+     ***********************************************************/
+    struct TILE_SETUP
+    {
+        int minX;
+        int minY;
+        int endX;
+        int endY;
+        int firstX;
+        int depthX;
+        int32_t edge[3];
+        int32_t edgeStepX[3];
+        int32_t edgeStepY[3];
+        float depth;
+        float depthStepX;
+        float depthStepY;
+    };
+
+    /***********************************************************
+     *  SetupTile()
+     *
+     *  This function sets a triangle up for the rectangle
+     *  [minX, endX) x [minY, endY) of a tile. Edge values are
+     *  twice the signed area in 1/256 pixels, biased by -1 on
+     *  edges that are neither top nor left edges, so a pixel
+     *  is covered when all three are at least 0 (top-left fill
+     *  rule). The corners of the rectangle are tested in 64
+     *  bits first: an edge with every corner outside rejects
+     *  the triangle; an edge crossing the rectangle has values
+     *  inside it that fit in 32 bits.
+     ***********************************************************/
+    bool SetupTile(const TRIANGLE& triangle, int minX, int minY, int endX, int endY, int simdWidth, TILE_SETUP& setup) {
+        setup.minX = std::max(triangle.minX, minX);
+        setup.minY = std::max(triangle.minY, minY);
+        setup.endX = std::min(triangle.endX, endX);
+        setup.endY = std::min(triangle.endY, endY);
+        if (setup.minX >= setup.endX || setup.minY >= setup.endY) {
+            return false;
+        }
+        setup.firstX = setup.minX & ~(simdWidth - 1);
+        setup.depthX = setup.minX & ~(SoftwareRasterizer::TILE_SIZE - 1);
+
+        int64_t cornerX[2] = {
+            (int64_t)setup.minX * SUBPIXEL_SCALE + PIXEL_CENTER, (int64_t)(setup.endX - 1) * SUBPIXEL_SCALE + PIXEL_CENTER };
+        int64_t cornerY[2] = {
+            (int64_t)setup.minY * SUBPIXEL_SCALE + PIXEL_CENTER, (int64_t)(setup.endY - 1) * SUBPIXEL_SCALE + PIXEL_CENTER };
+        for (int k = 0; k < 3; ++k) {
+            int next = (k + 1) % 3;
+            int64_t a = (int64_t)triangle.y[k] - triangle.y[next];
+            int64_t b = (int64_t)triangle.x[next] - triangle.x[k];
+            int64_t bias = (a > 0 || (a == 0 && b < 0)) ? 0 : -1;
+            int inside = 0;
+            for (int corner = 0; corner < 4; ++corner) {
+                int64_t value = a * (cornerX[corner & 1] - triangle.x[k]) + b * (cornerY[corner >> 1] - triangle.y[k]) + bias;
+                inside += (value >= 0) ? 1 : 0;
+            }
+            if (inside == 0) {
+                return false;
+            }
+            if (inside == 4) {
+                setup.edge[k] = 0;
+                setup.edgeStepX[k] = 0;
+                setup.edgeStepY[k] = 0;
+                continue;
+            }
+            int64_t firstX = (int64_t)setup.firstX * SUBPIXEL_SCALE + PIXEL_CENTER;
+            setup.edge[k] = (int32_t)(a * (firstX - triangle.x[k]) + b * (cornerY[0] - triangle.y[k]) + bias);
+            setup.edgeStepX[k] = (int32_t)(a * SUBPIXEL_SCALE);
+            setup.edgeStepY[k] = (int32_t)(b * SUBPIXEL_SCALE);
+        }
+
+        float dx = setup.depthX + 0.5f - triangle.x[0] * (1.0f / SUBPIXEL_SCALE);
+        float dy = setup.minY + 0.5f - triangle.y[0] * (1.0f / SUBPIXEL_SCALE);
+        setup.depth = Evaluate(triangle.depth, dx, dy);
+        setup.depthStepX = triangle.depth.stepX;
+        setup.depthStepY = triangle.depth.stepY;
+        return true;
+    }
+
+    // covers the pixels of a tile setup that pass the depth test
+    // (less than), writing their depths; writes the triangle id of
+    // each such pixel when ids is not NULL and otherwise appends the
+    // pixel offsets to fragments. Returns the number of fragments
+    typedef uint32_t (*RASTERIZE_FUNCTION)(const TILE_SETUP& setup, float* depth, uint32_t* ids,
+        size_t pitch, uint32_t id, uint32_t* fragments);
+
+    /***********************************************************
+     *  RasterizeScalar()
+     *
+     *  One pixel at a time, with the same arithmetic as the
+     *  SIMD versions below.
+     ***********************************************************/
+    uint32_t RasterizeScalar(const TILE_SETUP& setup, float* depth, uint32_t* ids,
+        size_t pitch, uint32_t id, uint32_t* fragments) {
+        uint32_t count = 0;
+        for (int y = setup.minY; y < setup.endY; ++y) {
+            int dy = y - setup.minY;
+            float rowDepth = setup.depth + setup.depthStepY * (float)dy;
+            size_t row = (size_t)y * pitch;
+            for (int x = setup.minX; x < setup.endX; ++x) {
+                int dx = x - setup.firstX;
+                int32_t e0 = setup.edge[0] + setup.edgeStepY[0] * dy + setup.edgeStepX[0] * dx;
+                int32_t e1 = setup.edge[1] + setup.edgeStepY[1] * dy + setup.edgeStepX[1] * dx;
+                int32_t e2 = setup.edge[2] + setup.edgeStepY[2] * dy + setup.edgeStepX[2] * dx;
+                if ((e0 | e1 | e2) < 0) {
+                    continue;
+                }
+                float z = rowDepth + setup.depthStepX * (float)(x - setup.depthX);
+                size_t pixel = row + x;
+                if (z < depth[pixel]) {
+                    depth[pixel] = z;
+                    if (ids != NULL) {
+                        ids[pixel] = id;
+                    }
+                    else {
+                        fragments[count++] = (uint32_t)pixel;
+                    }
+                }
+            }
+        }
+        return count;
+    }
+
+#ifdef SOFTWARE_RASTERIZER_X86
+    /***********************************************************
+     *  SSE4.1 kernel - 4 pixels per iteration
+     ***********************************************************/
+    TARGET_SSE4 uint32_t RasterizeSSE4(const TILE_SETUP& setup, float* depth, uint32_t* ids,
+        size_t pitch, uint32_t id, uint32_t* fragments) {
+        const __m128i lanes = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i minX = _mm_set1_epi32(setup.minX - 1);
+        const __m128i endX = _mm_set1_epi32(setup.endX);
+        const __m128i allInside = _mm_set1_epi32(-1);
+        const __m128i idValue = _mm_set1_epi32((int)id);
+        const __m128 depthStepX = _mm_set1_ps(setup.depthStepX);
+        __m128i stepX[3];
+        __m128i edgeStep4[3];
+        for (int k = 0; k < 3; ++k) {
+            stepX[k] = _mm_mullo_epi32(_mm_set1_epi32(setup.edgeStepX[k]), lanes);
+            edgeStep4[k] = _mm_set1_epi32(setup.edgeStepX[k] * 4);
+        }
+        uint32_t count = 0;
+        for (int y = setup.minY; y < setup.endY; ++y) {
+            int dy = y - setup.minY;
+            __m128 rowDepth = _mm_set1_ps(setup.depth + setup.depthStepY * (float)dy);
+            __m128i e[3];
+            for (int k = 0; k < 3; ++k) {
+                e[k] = _mm_add_epi32(_mm_set1_epi32(setup.edge[k] + setup.edgeStepY[k] * dy), stepX[k]);
+            }
+            size_t row = (size_t)y * pitch;
+            for (int x = setup.firstX; x < setup.endX; x += 4) {
+                __m128i columns = _mm_add_epi32(_mm_set1_epi32(x), lanes);
+                __m128i mask = _mm_and_si128(_mm_cmpgt_epi32(columns, minX), _mm_cmpgt_epi32(endX, columns));
+                __m128i edges = _mm_or_si128(_mm_or_si128(e[0], e[1]), e[2]);
+                mask = _mm_and_si128(mask, _mm_cmpgt_epi32(edges, allInside));
+                for (int k = 0; k < 3; ++k) {
+                    e[k] = _mm_add_epi32(e[k], edgeStep4[k]);
+                }
+                if (_mm_testz_si128(mask, mask)) {
+                    continue;
+                }
+                __m128 offsets = _mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(x - setup.depthX), lanes));
+                __m128 z = _mm_add_ps(rowDepth, _mm_mul_ps(depthStepX, offsets));
+                float* depthRow = depth + row + x;
+                __m128 current = _mm_loadu_ps(depthRow);
+                __m128 pass = _mm_and_ps(_mm_castsi128_ps(mask), _mm_cmplt_ps(z, current));
+                int bits = _mm_movemask_ps(pass);
+                if (bits == 0) {
+                    continue;
+                }
+                _mm_storeu_ps(depthRow, _mm_blendv_ps(current, z, pass));
+                if (ids != NULL) {
+                    __m128i* idRow = (__m128i*)(ids + row + x);
+                    _mm_storeu_si128(idRow, _mm_castps_si128(_mm_blendv_ps(
+                        _mm_castsi128_ps(_mm_loadu_si128(idRow)), _mm_castsi128_ps(idValue), pass)));
+                }
+                else {
+                    for (int lane = 0; lane < 4; ++lane) {
+                        if (bits & (1 << lane)) {
+                            fragments[count++] = (uint32_t)(row + x + lane);
+                        }
+                    }
+                }
+            }
+        }
+        return count;
+    }
+
+    /***********************************************************
+     *  AVX2 kernel - 8 pixels per iteration
+     ***********************************************************/
+    TARGET_AVX2 uint32_t RasterizeAVX2(const TILE_SETUP& setup, float* depth, uint32_t* ids,
+        size_t pitch, uint32_t id, uint32_t* fragments) {
+        const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i minX = _mm256_set1_epi32(setup.minX - 1);
+        const __m256i endX = _mm256_set1_epi32(setup.endX);
+        const __m256i allInside = _mm256_set1_epi32(-1);
+        const __m256i idValue = _mm256_set1_epi32((int)id);
+        const __m256 depthStepX = _mm256_set1_ps(setup.depthStepX);
+        __m256i stepX[3];
+        __m256i edgeStep8[3];
+        for (int k = 0; k < 3; ++k) {
+            stepX[k] = _mm256_mullo_epi32(_mm256_set1_epi32(setup.edgeStepX[k]), lanes);
+            edgeStep8[k] = _mm256_set1_epi32(setup.edgeStepX[k] * 8);
+        }
+        uint32_t count = 0;
+        for (int y = setup.minY; y < setup.endY; ++y) {
+            int dy = y - setup.minY;
+            __m256 rowDepth = _mm256_set1_ps(setup.depth + setup.depthStepY * (float)dy);
+            __m256i e[3];
+            for (int k = 0; k < 3; ++k) {
+                e[k] = _mm256_add_epi32(_mm256_set1_epi32(setup.edge[k] + setup.edgeStepY[k] * dy), stepX[k]);
+            }
+            size_t row = (size_t)y * pitch;
+            for (int x = setup.firstX; x < setup.endX; x += 8) {
+                __m256i columns = _mm256_add_epi32(_mm256_set1_epi32(x), lanes);
+                __m256i mask = _mm256_and_si256(_mm256_cmpgt_epi32(columns, minX), _mm256_cmpgt_epi32(endX, columns));
+                __m256i edges = _mm256_or_si256(_mm256_or_si256(e[0], e[1]), e[2]);
+                mask = _mm256_and_si256(mask, _mm256_cmpgt_epi32(edges, allInside));
+                for (int k = 0; k < 3; ++k) {
+                    e[k] = _mm256_add_epi32(e[k], edgeStep8[k]);
+                }
+                if (_mm256_testz_si256(mask, mask)) {
+                    continue;
+                }
+                __m256 offsets = _mm256_cvtepi32_ps(_mm256_add_epi32(_mm256_set1_epi32(x - setup.depthX), lanes));
+                __m256 z = _mm256_add_ps(rowDepth, _mm256_mul_ps(depthStepX, offsets));
+                float* depthRow = depth + row + x;
+                __m256 current = _mm256_loadu_ps(depthRow);
+                __m256 pass = _mm256_and_ps(_mm256_castsi256_ps(mask), _mm256_cmp_ps(z, current, _CMP_LT_OQ));
+                int bits = _mm256_movemask_ps(pass);
+                if (bits == 0) {
+                    continue;
+                }
+                _mm256_storeu_ps(depthRow, _mm256_blendv_ps(current, z, pass));
+                if (ids != NULL) {
+                    __m256i* idRow = (__m256i*)(ids + row + x);
+                    _mm256_storeu_si256(idRow, _mm256_blendv_epi8(_mm256_loadu_si256(idRow), idValue,
+                        _mm256_castps_si256(pass)));
+                }
+                else {
+                    for (int lane = 0; lane < 8; ++lane) {
+                        if (bits & (1 << lane)) {
+                            fragments[count++] = (uint32_t)(row + x + lane);
+                        }
+                    }
+                }
+            }
+        }
+        return count;
+    }
+#endif
+
+    // a kernel and the number of pixels it tests at once
+    struct RASTERIZE_KERNEL
+    {
+        RASTERIZE_FUNCTION function;
+        int simdWidth;
+    };
+
+    // kernel for the best instruction set the CPU supports
+    RASTERIZE_KERNEL SelectKernel() {
+        RASTERIZE_KERNEL kernel = { RasterizeScalar, 1 };
+#ifdef SOFTWARE_RASTERIZER_X86
+        switch (TransformKernel::GetSupportedInstructionSet()) {
+        case TransformKernel::INSTRUCTIONS_AVX2:
+            kernel.function = RasterizeAVX2;
+            kernel.simdWidth = 8;
+            break;
+        case TransformKernel::INSTRUCTIONS_SSE4:
+            kernel.function = RasterizeSSE4;
+            kernel.simdWidth = 4;
+            break;
+        default:
+            break;
+        }
+#endif
+        return kernel;
+    }
+
+    // bilinear filtered texel of one mip level, repeating at the edges
+    glm::vec4 SampleLevel(const std::vector<uint32_t>& texels, int width, int height, const glm::vec2& coordinate) {
+        float s = coordinate.x * width - 0.5f;
+        float t = coordinate.y * height - 0.5f;
+        float s0 = floorf(s);
+        float t0 = floorf(t);
+        float fractionS = s - s0;
+        float fractionT = t - t0;
+        int x0 = ((int)fmodf(s0, (float)width) + width) % width;
+        int y0 = ((int)fmodf(t0, (float)height) + height) % height;
+        int x1 = (x0 + 1) % width;
+        int y1 = (y0 + 1) % height;
+        glm::vec4 bottom = glm::mix(UnpackColor(texels[(size_t)y0 * width + x0]),
+            UnpackColor(texels[(size_t)y0 * width + x1]), fractionS);
+        glm::vec4 top = glm::mix(UnpackColor(texels[(size_t)y1 * width + x0]),
+            UnpackColor(texels[(size_t)y1 * width + x1]), fractionS);
+        return glm::mix(bottom, top, fractionT);
+    }
+}
+
+/***********************************************************
+ *  SoftwareRasterizer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+SoftwareRasterizer::SoftwareRasterizer() {
+    m_pJobSystem = NULL;
+    m_width = 0;
+    m_height = 0;
+    m_pitch = 0;
+    m_tilesX = 0;
+    m_tilesY = 0;
+}
+
+/***********************************************************
+ *  SetSize()
+ *
+ *  This method resizes the framebuffer. The depth and
+ *  triangle buffers cover whole tiles.
+ ***********************************************************/
+void SoftwareRasterizer::SetSize(int width, int height) {
+    m_width = std::min(std::max(width, 1), (int)MAX_SIZE);
+    m_height = std::min(std::max(height, 1), (int)MAX_SIZE);
+    m_tilesX = (m_width + TILE_SIZE - 1) / TILE_SIZE;
+    m_tilesY = (m_height + TILE_SIZE - 1) / TILE_SIZE;
+    m_pitch = m_tilesX * TILE_SIZE;
+    size_t bufferSize = (size_t)m_pitch * m_tilesY * TILE_SIZE;
+    m_color.assign((size_t)m_width * m_height, 0);
+    m_depth.assign(bufferSize, 1.0f);
+    m_triangleIDs.assign(bufferSize, NO_TRIANGLE);
+    m_chunks.clear();
+}
+
+/***********************************************************
+ *  LoadTextures()
+ *
+ *  This method decodes every texture file not decoded yet
+ *  and builds its mip levels with a 2x2 box filter, like
+ *  glGenerateMipmap. Textures with fewer than 4 channels
+ *  are expanded the way OpenGL samples them: missing color
+ *  channels are 0 and missing alpha is 1.
+ ***********************************************************/
+void SoftwareRasterizer::LoadTextures(const std::vector<std::string>& paths, std::vector<TEXTURE_LAYER>& layers) {
+    layers.resize(paths.size());
+    int decoded = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        layers[i].arrayTexture = 0;
+        layers[i].layer = 0;
+        std::unordered_map<std::string, GLuint>::const_iterator found = m_textureLookup.find(paths[i]);
+        if (found != m_textureLookup.end()) {
+            layers[i].arrayTexture = found->second;
+            continue;
+        }
+
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        unsigned char* pixels = stbi_load(paths[i].c_str(), &width, &height, &channels, 0);
+        if (pixels == NULL) {
+            std::cout << "Failed to load texture from: " << paths[i] << std::endl;
+            continue;
+        }
+        SOFTWARE_TEXTURE texture;
+        std::vector<uint32_t> texels((size_t)width * height);
+        for (size_t p = 0; p < texels.size(); ++p) {
+            const unsigned char* source = pixels + p * channels;
+            uint32_t red = source[0];
+            uint32_t green = (channels >= 2) ? source[1] : 0;
+            uint32_t blue = (channels >= 3) ? source[2] : 0;
+            uint32_t alpha = (channels == 4) ? source[3] : 255;
+            texels[p] = red | (green << 8) | (blue << 16) | (alpha << 24);
+        }
+        stbi_image_free(pixels);
+
+        texture.levels.push_back(texels);
+        texture.widths.push_back(width);
+        texture.heights.push_back(height);
+        while (width > 1 || height > 1) {
+            const std::vector<uint32_t>& source = texture.levels.back();
+            int levelWidth = std::max(1, width / 2);
+            int levelHeight = std::max(1, height / 2);
+            std::vector<uint32_t> level((size_t)levelWidth * levelHeight);
+            for (int y = 0; y < levelHeight; ++y) {
+                int y0 = std::min(y * 2, height - 1);
+                int y1 = std::min(y * 2 + 1, height - 1);
+                for (int x = 0; x < levelWidth; ++x) {
+                    int x0 = std::min(x * 2, width - 1);
+                    int x1 = std::min(x * 2 + 1, width - 1);
+                    glm::vec4 sum = UnpackColor(source[(size_t)y0 * width + x0]) + UnpackColor(source[(size_t)y0 * width + x1]) +
+                        UnpackColor(source[(size_t)y1 * width + x0]) + UnpackColor(source[(size_t)y1 * width + x1]);
+                    level[(size_t)y * levelWidth + x] = PackColor(sum * 0.25f);
+                }
+            }
+            texture.levels.push_back(level);
+            texture.widths.push_back(levelWidth);
+            texture.heights.push_back(levelHeight);
+            width = levelWidth;
+            height = levelHeight;
+        }
+
+        m_textures.push_back(texture);
+        GLuint handle = (GLuint)m_textures.size();
+        m_textureLookup[paths[i]] = handle;
+        layers[i].arrayTexture = handle;
+        ++decoded;
+    }
+    std::cout << "INFO: Decoded " << decoded << " textures for software rasterization" << std::endl;
+}
+
+/***********************************************************
+ *  SetMaterials()
+ *
+ *  This method keeps the scene materials.
+ ***********************************************************/
+void SoftwareRasterizer::SetMaterials(const std::vector<SCENE_MATERIAL>& materials) {
+    m_materials = materials;
+}
+
+/***********************************************************
+ *  SetLights()
+ *
+ *  This method keeps the scene point lights; the light
+ *  clusters passed to Draw() index them.
+ ***********************************************************/
+void SoftwareRasterizer::SetLights(const std::vector<SCENE_POINT_LIGHT>& lights) {
+    m_lights = lights;
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method clears the color and depth buffers, a band
+ *  of rows per job.
+ ***********************************************************/
+void SoftwareRasterizer::Clear(const glm::vec4& color) {
+    PROFILE_CPU_SCOPE("ClearSoftware");
+    uint32_t packed = PackColor(color);
+    m_pJobSystem->ParallelFor((size_t)m_height, CLEAR_GRAIN_SIZE, [this, packed](size_t begin, size_t end) {
+        std::fill(m_color.begin() + begin * m_width, m_color.begin() + end * m_width, packed);
+        std::fill(m_depth.begin() + begin * m_pitch, m_depth.begin() + end * m_pitch, 1.0f);
+    });
+}
+
+/***********************************************************
+ *  Draw()
+ *
+ *  This method draws one view: the instances are split
+ *  into chunks that are transformed and binned as separate
+ *  jobs, then every tile the viewport touches is rasterized
+ *  and shaded by a job of its own.
+ ***********************************************************/
+void SoftwareRasterizer::Draw(const FRAME_UNIFORMS& frame, int view, const int viewport[4],
+    const LIGHT_CLUSTER_LIST& lightClusters, const SOFTWARE_DRAW* draws, size_t drawCount,
+    const glm::mat4* instanceMatrices, const glm::uvec2* instanceSurfaces) {
+    PROFILE_CPU_SCOPE("RasterizeView");
+    // pixels of the viewport inside the framebuffer
+    int bounds[4] = {
+        std::max(viewport[0], 0), std::max(viewport[1], 0),
+        std::min(viewport[0] + viewport[2], m_width), std::min(viewport[1] + viewport[3], m_height) };
+    if (bounds[0] >= bounds[2] || bounds[1] >= bounds[3]) {
+        return;
+    }
+
+    m_instances.clear();
+    for (size_t d = 0; d < drawCount; ++d) {
+        if (draws[d].geometry.indexCount == 0) {
+            continue;
+        }
+        for (uint32_t i = 0; i < draws[d].instanceCount; ++i) {
+            m_instances.push_back(glm::uvec2((unsigned int)d, i));
+        }
+    }
+    FrameStats::Current().drawCalls += (unsigned int)drawCount;
+    if (m_instances.empty()) {
+        return;
+    }
+
+    size_t chunkCount = std::min(m_instances.size(), (m_pJobSystem->GetWorkerCount() + 1) * CHUNKS_PER_THREAD);
+    if (m_chunks.size() < chunkCount) {
+        m_chunks.resize(chunkCount);
+    }
+    for (size_t c = 0; c < chunkCount; ++c) {
+        m_chunks[c].firstInstance = m_instances.size() * c / chunkCount;
+        m_chunks[c].endInstance = m_instances.size() * (c + 1) / chunkCount;
+    }
+    {
+        PROFILE_CPU_SCOPE("TransformAndBin");
+        JobCounter counter;
+        for (size_t c = 0; c < chunkCount; ++c) {
+            GEOMETRY_CHUNK* pChunk = &m_chunks[c];
+            m_pJobSystem->Run([this, pChunk, &frame, view, viewport, &bounds, draws, instanceMatrices, instanceSurfaces]() {
+                ProcessChunk(*pChunk, frame, view, viewport, bounds, draws, instanceMatrices, instanceSurfaces);
+            }, &counter);
+        }
+        m_pJobSystem->Wait(counter);
+    }
+    m_chunkBases.resize(chunkCount);
+    uint32_t triangleCount = 0;
+    for (size_t c = 0; c < chunkCount; ++c) {
+        m_chunkBases[c] = triangleCount;
+        triangleCount += (uint32_t)m_chunks[c].triangles.size();
+    }
+
+    // the tiles are queued one job each, those with the most
+    // triangles first: the workers steal the oldest jobs, so the
+    // expensive tiles start early and the cheap ones fill the gaps
+    m_viewTiles.clear();
+    for (int y = bounds[1] / TILE_SIZE; y <= (bounds[3] - 1) / TILE_SIZE; ++y) {
+        for (int x = bounds[0] / TILE_SIZE; x <= (bounds[2] - 1) / TILE_SIZE; ++x) {
+            uint32_t tile = (uint32_t)(y * m_tilesX + x);
+            uint32_t binned = 0;
+            for (size_t c = 0; c < chunkCount; ++c) {
+                binned += (uint32_t)m_chunks[c].bins[tile].size();
+            }
+            m_viewTiles.push_back(glm::uvec2(tile, binned));
+        }
+    }
+    std::stable_sort(m_viewTiles.begin(), m_viewTiles.end(),
+        [](const glm::uvec2& a, const glm::uvec2& b) { return a.y > b.y; });
+    PROFILE_CPU_SCOPE("RasterizeTiles");
+    JobCounter counter;
+    for (size_t t = 0; t < m_viewTiles.size(); ++t) {
+        int tile = (int)m_viewTiles[t].x;
+        m_pJobSystem->Run([this, tile, &frame, view, &bounds, &lightClusters]() {
+            DrawTile(tile, frame, view, bounds, lightClusters);
+        }, &counter);
+    }
+    m_pJobSystem->Wait(counter);
+}
+
+/***********************************************************
+ *  ProcessChunk()
+ *
+ *  This method transforms the vertices of every instance in
+ *  a chunk once, like the vertex shader, then clips the
+ *  triangles that cross a clip plane and bins the rest.
+ *  Triangles entirely outside one plane are dropped.
+ ***********************************************************/
+void SoftwareRasterizer::ProcessChunk(GEOMETRY_CHUNK& chunk, const FRAME_UNIFORMS& frame, int view,
+    const int viewport[4], const int bounds[4], const SOFTWARE_DRAW* draws,
+    const glm::mat4* instanceMatrices, const glm::uvec2* instanceSurfaces) {
+    chunk.triangles.clear();
+    chunk.bins.resize((size_t)m_tilesX * m_tilesY);
+    for (size_t t = 0; t < chunk.bins.size(); ++t) {
+        chunk.bins[t].clear();
+    }
+
+    glm::mat4 viewProjection = frame.projectionMatrices[view] * frame.viewMatrices[view];
+    // the guard band in NDC units, reaching GUARD_BAND pixels past the viewport
+    glm::vec2 guard(1.0f + 2.0f * GUARD_BAND / viewport[2], 1.0f + 2.0f * GUARD_BAND / viewport[3]);
+    for (size_t i = chunk.firstInstance; i < chunk.endInstance; ++i) {
+        const SOFTWARE_DRAW& draw = draws[m_instances[i].x];
+        const MESH_GEOMETRY& mesh = draw.geometry;
+        uint32_t instance = draw.firstInstance + m_instances[i].y;
+        const glm::mat4& model = instanceMatrices[instance];
+        glm::mat3 normalMatrix = glm::transpose(glm::inverse(glm::mat3(model)));
+        uint32_t material = instanceSurfaces[instance].y;
+
+        chunk.vertices.resize(mesh.vertexCount);
+        chunk.clipCodes.resize(mesh.vertexCount);
+        int* codes = chunk.clipCodes.data();
+        for (size_t v = 0; v < mesh.vertexCount; ++v) {
+            const GLfloat* source = mesh.vertices + v * mesh.vertexStride;
+            CLIP_VERTEX& vertex = chunk.vertices[v];
+            glm::vec3 position = glm::vec3(model * glm::vec4(source[0], source[1], source[2], 1.0f));
+            glm::vec3 normal = normalMatrix * glm::vec3(source[3], source[4], source[5]);
+            vertex.position = viewProjection * glm::vec4(position, 1.0f);
+            vertex.attributes[0] = position.x;
+            vertex.attributes[1] = position.y;
+            vertex.attributes[2] = position.z;
+            vertex.attributes[3] = normal.x;
+            vertex.attributes[4] = normal.y;
+            vertex.attributes[5] = normal.z;
+            vertex.attributes[6] = source[6];
+            vertex.attributes[7] = source[7];
+            codes[v] = ClipCodes(vertex.position, guard);
+        }
+
+        for (size_t t = 0; t + 2 < mesh.indexCount; t += 3) {
+            GLuint i0 = mesh.indices[t];
+            GLuint i1 = mesh.indices[t + 1];
+            GLuint i2 = mesh.indices[t + 2];
+            if ((codes[i0] & codes[i1] & codes[i2]) != 0) {
+                continue;
+            }
+            if ((codes[i0] | codes[i1] | codes[i2]) == 0) {
+                AddTriangle(chunk, chunk.vertices[i0], chunk.vertices[i1], chunk.vertices[i2],
+                    viewport, bounds, draw, material);
+                continue;
+            }
+            CLIP_VERTEX polygon[MAX_CLIPPED_VERTICES] = {
+                chunk.vertices[i0], chunk.vertices[i1], chunk.vertices[i2] };
+            int count = ClipPolygon(polygon, 3, codes[i0] | codes[i1] | codes[i2], guard);
+            for (int v = 2; v < count; ++v) {
+                AddTriangle(chunk, polygon[0], polygon[v - 1], polygon[v], viewport, bounds, draw, material);
+            }
+        }
+    }
+}
+
+/***********************************************************
+ *  AddTriangle()
+ *
+ *  This method maps a clipped triangle to the viewport,
+ *  snaps it to 1/16 pixel and makes it counter-clockwise
+ *  (nothing is back face culled, like in the OpenGL path).
+ *  Its depth, 1/w and attributes divided by w vary
+ *  linearly over the screen and are kept as planes. The
+ *  triangle is appended to the bin of every tile its
+ *  bounding rectangle touches.
+ ***********************************************************/
+bool SoftwareRasterizer::AddTriangle(GEOMETRY_CHUNK& chunk, const CLIP_VERTEX& a, const CLIP_VERTEX& b,
+    const CLIP_VERTEX& c, const int viewport[4], const int bounds[4], const SOFTWARE_DRAW& draw, uint32_t material) {
+    const CLIP_VERTEX* vertices[3] = { &a, &b, &c };
+    TRIANGLE triangle;
+    float inverseW[3];
+    float depth[3];
+    for (int i = 0; i < 3; ++i) {
+        const glm::vec4& clip = vertices[i]->position;
+        inverseW[i] = 1.0f / clip.w;
+        float x = viewport[0] + (clip.x * inverseW[i] + 1.0f) * 0.5f * viewport[2];
+        float y = viewport[1] + (clip.y * inverseW[i] + 1.0f) * 0.5f * viewport[3];
+        triangle.x[i] = (int32_t)lrintf(x * SUBPIXEL_SCALE);
+        triangle.y[i] = (int32_t)lrintf(y * SUBPIXEL_SCALE);
+        depth[i] = clip.z * inverseW[i] * 0.5f + 0.5f;
+    }
+    int64_t area = ((int64_t)triangle.x[1] - triangle.x[0]) * ((int64_t)triangle.y[2] - triangle.y[0]) -
+        ((int64_t)triangle.y[1] - triangle.y[0]) * ((int64_t)triangle.x[2] - triangle.x[0]);
+    if (area == 0) {
+        return false;
+    }
+    if (area < 0) {
+        std::swap(triangle.x[1], triangle.x[2]);
+        std::swap(triangle.y[1], triangle.y[2]);
+        std::swap(vertices[1], vertices[2]);
+        std::swap(inverseW[1], inverseW[2]);
+        std::swap(depth[1], depth[2]);
+        area = -area;
+    }
+
+    // pixels whose centers lie inside the snapped bounds
+    int32_t minX = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+    int32_t maxX = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+    int32_t minY = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+    int32_t maxY = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+    triangle.minX = std::max((minX - PIXEL_CENTER + SUBPIXEL_SCALE - 1) >> SUBPIXEL_BITS, bounds[0]);
+    triangle.minY = std::max((minY - PIXEL_CENTER + SUBPIXEL_SCALE - 1) >> SUBPIXEL_BITS, bounds[1]);
+    triangle.endX = std::min(((maxX - PIXEL_CENTER) >> SUBPIXEL_BITS) + 1, bounds[2]);
+    triangle.endY = std::min(((maxY - PIXEL_CENTER) >> SUBPIXEL_BITS) + 1, bounds[3]);
+    if (triangle.minX >= triangle.endX || triangle.minY >= triangle.endY) {
+        return false;
+    }
+
+    float x1 = (triangle.x[1] - triangle.x[0]) * (1.0f / SUBPIXEL_SCALE);
+    float y1 = (triangle.y[1] - triangle.y[0]) * (1.0f / SUBPIXEL_SCALE);
+    float x2 = (triangle.x[2] - triangle.x[0]) * (1.0f / SUBPIXEL_SCALE);
+    float y2 = (triangle.y[2] - triangle.y[0]) * (1.0f / SUBPIXEL_SCALE);
+    float inverseArea = (float)(SUBPIXEL_SCALE * SUBPIXEL_SCALE) / (float)area;
+    triangle.depth = MakePlane(depth[0], depth[1], depth[2], x1, y1, x2, y2, inverseArea);
+    triangle.inverseW = MakePlane(inverseW[0], inverseW[1], inverseW[2], x1, y1, x2, y2, inverseArea);
+    for (int i = 0; i < ATTRIBUTE_COUNT; ++i) {
+        triangle.attributes[i] = MakePlane(
+            vertices[0]->attributes[i] * inverseW[0], vertices[1]->attributes[i] * inverseW[1],
+            vertices[2]->attributes[i] * inverseW[2], x1, y1, x2, y2, inverseArea);
+    }
+    triangle.texture = draw.texture;
+    triangle.material = material;
+    triangle.blend = draw.blend;
+
+    uint32_t index = (uint32_t)chunk.triangles.size();
+    chunk.triangles.push_back(triangle);
+    for (int y = triangle.minY / TILE_SIZE; y <= (triangle.endY - 1) / TILE_SIZE; ++y) {
+        for (int x = triangle.minX / TILE_SIZE; x <= (triangle.endX - 1) / TILE_SIZE; ++x) {
+            chunk.bins[(size_t)y * m_tilesX + x].push_back(index);
+        }
+    }
+    return true;
+}
+
+/***********************************************************
+ *  DrawTile()
+ *
+ *  This method finishes one tile of the view: it rasterizes
+ *  the tile's opaque triangles in draw order, keeping the
+ *  nearest triangle of every pixel, shades each covered
+ *  pixel once and then draws the blended triangles over it
+ *  in draw order, shading every pixel that passes the depth
+ *  test and blending it by its alpha.
+ ***********************************************************/
+void SoftwareRasterizer::DrawTile(int tile, const FRAME_UNIFORMS& frame, int view, const int bounds[4],
+    const LIGHT_CLUSTER_LIST& lightClusters) {
+    static const RASTERIZE_KERNEL kernel = SelectKernel();
+    int tileX = tile % m_tilesX;
+    int tileY = tile / m_tilesX;
+    int minX = std::max(tileX * TILE_SIZE, bounds[0]);
+    int minY = std::max(tileY * TILE_SIZE, bounds[1]);
+    int endX = std::min((tileX + 1) * TILE_SIZE, bounds[2]);
+    int endY = std::min((tileY + 1) * TILE_SIZE, bounds[3]);
+    size_t chunkCount = m_chunkBases.size();
+
+    bool blended = false;
+    for (size_t c = 0; c < chunkCount; ++c) {
+        const GEOMETRY_CHUNK& chunk = m_chunks[c];
+        const std::vector<uint32_t>& bin = chunk.bins[tile];
+        for (size_t i = 0; i < bin.size(); ++i) {
+            const TRIANGLE& triangle = chunk.triangles[bin[i]];
+            TILE_SETUP setup;
+            if (triangle.blend) {
+                blended = true;
+            }
+            else if (SetupTile(triangle, minX, minY, endX, endY, kernel.simdWidth, setup)) {
+                kernel.function(setup, m_depth.data(), m_triangleIDs.data(), (size_t)m_pitch, m_chunkBases[c] + bin[i], NULL);
+            }
+        }
+    }
+
+    for (int y = minY; y < endY; ++y) {
+        for (int x = minX; x < endX; ++x) {
+            uint32_t& id = m_triangleIDs[(size_t)y * m_pitch + x];
+            if (id != NO_TRIANGLE) {
+                glm::vec4 color = Shade(GetTriangle(id), x + 0.5f, y + 0.5f, frame, view, lightClusters);
+                m_color[(size_t)y * m_width + x] = PackColor(color);
+                id = NO_TRIANGLE;
+            }
+        }
+    }
+    if (!blended) {
+        return;
+    }
+
+    uint32_t fragments[TILE_SIZE * TILE_SIZE];
+    for (size_t c = 0; c < chunkCount; ++c) {
+        const GEOMETRY_CHUNK& chunk = m_chunks[c];
+        const std::vector<uint32_t>& bin = chunk.bins[tile];
+        for (size_t i = 0; i < bin.size(); ++i) {
+            const TRIANGLE& triangle = chunk.triangles[bin[i]];
+            TILE_SETUP setup;
+            if (!triangle.blend || !SetupTile(triangle, minX, minY, endX, endY, kernel.simdWidth, setup)) {
+                continue;
+            }
+            uint32_t count = kernel.function(setup, m_depth.data(), NULL, (size_t)m_pitch, 0, fragments);
+            for (uint32_t f = 0; f < count; ++f) {
+                int x = (int)(fragments[f] % m_pitch);
+                int y = (int)(fragments[f] / m_pitch);
+                glm::vec4 source = Shade(triangle, x + 0.5f, y + 0.5f, frame, view, lightClusters);
+                uint32_t& target = m_color[(size_t)y * m_width + x];
+                // glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+                target = PackColor(source * source.w + UnpackColor(target) * (1.0f - source.w));
+            }
+        }
+    }
+}
+
+/***********************************************************
+ *  GetTriangle()
+ *
+ *  This method finds the chunk holding a triangle from the
+ *  chunks' first triangle indices.
+ ***********************************************************/
+const SoftwareRasterizer::TRIANGLE& SoftwareRasterizer::GetTriangle(uint32_t id) const {
+    size_t chunk = std::upper_bound(m_chunkBases.begin(), m_chunkBases.end(), id) - m_chunkBases.begin() - 1;
+    return m_chunks[chunk].triangles[id - m_chunkBases[chunk]];
+}
+
+/***********************************************************
+ *  Shade()
+ *
+ *  This method does the work of the fragment shader for
+ *  one pixel: the attributes are interpolated perspective
+ *  correctly, lit by the ambient term, the directional
+ *  light and the point lights of the pixel's light cluster,
+ *  and multiplied with the material color or the texture.
+ *  The texture level of detail comes from the exact screen
+ *  space derivatives of the texture coordinate.
+ ***********************************************************/
+glm::vec4 SoftwareRasterizer::Shade(const TRIANGLE& triangle, float x, float y, const FRAME_UNIFORMS& frame,
+    int view, const LIGHT_CLUSTER_LIST& lightClusters) const {
+    float dx = x - triangle.x[0] * (1.0f / SUBPIXEL_SCALE);
+    float dy = y - triangle.y[0] * (1.0f / SUBPIXEL_SCALE);
+    float w = 1.0f / Evaluate(triangle.inverseW, dx, dy);
+    float values[ATTRIBUTE_COUNT];
+    for (int i = 0; i < ATTRIBUTE_COUNT; ++i) {
+        values[i] = Evaluate(triangle.attributes[i], dx, dy) * w;
+    }
+    glm::vec3 position(values[0], values[1], values[2]);
+    glm::vec3 normal = glm::normalize(glm::vec3(values[3], values[4], values[5]));
+    glm::vec3 viewVector = glm::normalize(glm::vec3(frame.viewPositions[view]) - position);
+
+    glm::vec4 objectColor(1.0f);
+    float specularStrength = 0.0f;
+    if (triangle.material < m_materials.size()) {
+        objectColor = m_materials[triangle.material].color;
+        specularStrength = m_materials[triangle.material].specularStrength;
+    }
+
+    // ambient term plus the directional light
+    glm::vec3 lightColor(frame.lightColor);
+    glm::vec3 lighting = AMBIENT_STRENGTH * lightColor;
+    lighting += CalculateLight(glm::normalize(-glm::vec3(frame.lightDirection)), lightColor, normal, viewVector,
+        specularStrength);
+
+    // light cluster of the pixel: its screen tile and depth slice
+    // in the camera view, which the clusters were built for
+    glm::vec4 viewSpacePosition = frame.view * glm::vec4(position, 1.0f);
+    glm::vec4 clipPosition = frame.projection * viewSpacePosition;
+    glm::ivec4 grid = frame.clusterGrid;
+    int tileX = std::min(std::max((int)((clipPosition.x / clipPosition.w * 0.5f + 0.5f) * grid.x), 0), grid.x - 1);
+    int tileY = std::min(std::max((int)((clipPosition.y / clipPosition.w * 0.5f + 0.5f) * grid.y), 0), grid.y - 1);
+    float depth = std::max(-viewSpacePosition.z, 1e-4f);
+    int slice = (int)floorf(logf(depth) * frame.clusterSlicing.x + frame.clusterSlicing.y);
+    slice = std::min(std::max(slice, 0), grid.z - 1);
+    size_t clusterIndex = ((size_t)slice * grid.y + tileY) * grid.x + tileX;
+    glm::uvec2 cluster(0u, 0u);
+    if (clusterIndex < lightClusters.clusters.size()) {
+        cluster = lightClusters.clusters[clusterIndex];
+    }
+    // in the other views, pixels outside the camera view get no point lights
+    if (view != 0 && (clipPosition.w <= 0.0f || fabsf(clipPosition.x) > clipPosition.w ||
+        fabsf(clipPosition.y) > clipPosition.w || fabsf(clipPosition.z) > clipPosition.w)) {
+        cluster.y = 0;
+    }
+
+    for (uint32_t i = 0; i < cluster.y; ++i) {
+        const SCENE_POINT_LIGHT& light = m_lights[lightClusters.lightIndices[cluster.x + i]];
+        glm::vec3 toPointLight = light.position - position;
+        float distance = glm::length(toPointLight);
+        float fade = glm::clamp(1.0f - powf(distance / light.radius, 4.0f), 0.0f, 1.0f);
+        float attenuation = light.intensity * fade * fade / (1.0f + 0.09f * distance + 0.032f * distance * distance);
+        lighting += attenuation * CalculateLight(toPointLight / std::max(distance, 1e-4f), light.color,
+            normal, viewVector, specularStrength);
+    }
+
+    glm::vec4 baseColor = objectColor;
+    if (triangle.texture != 0 && triangle.texture <= m_textures.size()) {
+        const SOFTWARE_TEXTURE& texture = m_textures[triangle.texture - 1];
+        glm::vec2 coordinate(values[6], values[7]);
+        // d(U / W) = (dU - u dW) / W with U = u / w and W = 1 / w
+        const PLANE& inverseW = triangle.inverseW;
+        const PLANE& u = triangle.attributes[6];
+        const PLANE& v = triangle.attributes[7];
+        glm::vec2 derivativeX((u.stepX - coordinate.x * inverseW.stepX) * w, (v.stepX - coordinate.y * inverseW.stepX) * w);
+        glm::vec2 derivativeY((u.stepY - coordinate.x * inverseW.stepY) * w, (v.stepY - coordinate.y * inverseW.stepY) * w);
+        glm::vec2 size((float)texture.widths[0], (float)texture.heights[0]);
+        float rho = std::max(glm::length(derivativeX * size), glm::length(derivativeY * size));
+        baseColor = Sample(texture, coordinate, log2f(std::max(rho, 1e-8f)));
+    }
+    return glm::vec4(lighting * glm::vec3(baseColor), baseColor.w);
+}
+
+/***********************************************************
+ *  Sample()
+ *
+ *  This method filters a texture like GL_LINEAR when it is
+ *  magnified and GL_LINEAR_MIPMAP_LINEAR when it is
+ *  minified, repeating the texture in both directions.
+ ***********************************************************/
+glm::vec4 SoftwareRasterizer::Sample(const SOFTWARE_TEXTURE& texture, const glm::vec2& coordinate, float lod) const {
+    if (lod <= 0.0f) {
+        return SampleLevel(texture.levels[0], texture.widths[0], texture.heights[0], coordinate);
+    }
+    int lastLevel = (int)texture.levels.size() - 1;
+    lod = std::min(lod, (float)lastLevel);
+    int level = (int)lod;
+    float fraction = lod - level;
+    glm::vec4 color = SampleLevel(texture.levels[level], texture.widths[level], texture.heights[level], coordinate);
+    if (fraction > 0.0f && level < lastLevel) {
+        color = glm::mix(color, SampleLevel(texture.levels[level + 1], texture.widths[level + 1],
+            texture.heights[level + 1], coordinate), fraction);
+    }
+    return color;
+}
@@ -0,0 +1,214 @@
+///////////////////////////////////////////////////////////////////////////////
+// softwarerasterizer.h
+// ============
+// Multi-threaded tile-binned CPU rasterizer that draws the scene manager's
+// draw lists with the same lighting and texturing as the scene shaders,
+// for machines without a GPU
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "PrimitiveMeshes.h"
+#include "ShaderUniforms.h"
+#include "LightClusters.h"
+#include "TextureCache.h"
+#include "SceneLoader.h"
+#include "JobSystem.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  SOFTWARE_DRAW
+ *
+ *  Instances of one mesh drawn with the same texture and
+ *  blending, read from the frame's instance arrays.
+ ***********************************************************/
+struct SOFTWARE_DRAW
+{
+    MESH_GEOMETRY geometry;
+    // texture handle from LoadTextures(), 0 for untextured draws
+    GLuint texture;
+    bool blend;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+/***********************************************************
+ *  SoftwareRasterizer
+ *
+ *  Draw() runs the pipeline of one view in two parallel
+ *  steps on the job system. First, chunks of instances are
+ *  transformed, clipped to the near and far planes and a
+ *  guard band, snapped to 1/16 pixel and sorted into the
+ *  TILE_SIZE x TILE_SIZE screen tiles they touch; every
+ *  chunk keeps its own bins, so the chunks never share
+ *  memory and the bins stay in draw order. Then every tile
+ *  is finished by a job of its own: the opaque triangles are
+ *  rasterized into the depth buffer and a buffer of the
+ *  nearest triangle of each pixel, each pixel is shaded
+ *  once, and the blended triangles are shaded and blended
+ *  over the result in draw order.
+ *
+ *  The coverage and depth tests run on 8 (AVX2) or 4
+ *  (SSE4.1) pixels at once with integer edge functions and
+ *  a top-left fill rule, so triangles sharing an edge never
+ *  cover a pixel twice. Shading follows the scene shaders:
+ *  perspective correct attributes, Phong lighting from the
+ *  directional light and the point lights of the pixel's
+ *  light cluster, and trilinear filtered, repeating
+ *  textures.
+ *
+ *  The color buffer holds RGBA8 pixels, rows bottom to top
+ *  like an OpenGL framebuffer read back with glReadPixels.
+ ***********************************************************/
+class SoftwareRasterizer
+{
+public:
+    static const int TILE_SIZE = 64;
+    // largest framebuffer width and height
+    static const int MAX_SIZE = 8192;
+
+    // constructor
+    SoftwareRasterizer();
+
+    // pass the job system the frames are drawn on (must be set
+    // before drawing)
+    void SetJobSystem(JobSystem* pJobSystem) {
+        m_pJobSystem = pJobSystem;
+    }
+
+    // resize the framebuffer (clamped to MAX_SIZE)
+    void SetSize(int width, int height);
+    int GetWidth() const { return m_width; }
+    int GetHeight() const { return m_height; }
+
+    // decode the scene textures, each file once, and return each
+    // one's handle in the place of a texture array (layer 0); a
+    // texture that fails to load gets handle 0
+    void LoadTextures(const std::vector<std::string>& paths, std::vector<TEXTURE_LAYER>& layers);
+    // replace the scene materials and point lights
+    void SetMaterials(const std::vector<SCENE_MATERIAL>& materials);
+    void SetLights(const std::vector<SCENE_POINT_LIGHT>& lights);
+
+    // clear the color buffer to a color and the depth buffer to 1
+    void Clear(const glm::vec4& color);
+    // draw one view of a frame into a viewport (x, y, width, height);
+    // the instance arrays hold the model matrix and surface (texture
+    // layer, material id) of every instance of the draws
+    void Draw(const FRAME_UNIFORMS& frame, int view, const int viewport[4],
+        const LIGHT_CLUSTER_LIST& lightClusters, const SOFTWARE_DRAW* draws, size_t drawCount,
+        const glm::mat4* instanceMatrices, const glm::uvec2* instanceSurfaces);
+
+    // RGBA8 color buffer, rows bottom to top
+    const unsigned char* GetPixels() const { return (const unsigned char*)m_color.data(); }
+
+    // interpolated values of a triangle: world position, normal,
+    // texture coordinate
+    enum { ATTRIBUTE_COUNT = 8 };
+
+    // value that changes linearly over the screen: its value at
+    // the triangle's first vertex and its steps per pixel
+    struct PLANE
+    {
+        float origin;
+        float stepX;
+        float stepY;
+    };
+
+    // vertex of an instance in clip space, with its attributes
+    struct CLIP_VERTEX
+    {
+        glm::vec4 position;
+        float attributes[ATTRIBUTE_COUNT];
+    };
+
+    // a triangle after clipping and snapping, counter-clockwise
+    struct TRIANGLE
+    {
+        // vertices in 1/16 pixels
+        int32_t x[3];
+        int32_t y[3];
+        // covered pixel rectangle [minX, endX) x [minY, endY)
+        int minX;
+        int minY;
+        int endX;
+        int endY;
+        // window depth, 1/w and the attributes divided by w
+        PLANE depth;
+        PLANE inverseW;
+        PLANE attributes[ATTRIBUTE_COUNT];
+        GLuint texture;
+        uint32_t material;
+        bool blend;
+    };
+
+private:
+    // a decoded texture and its mip levels, as RGBA8 texels
+    struct SOFTWARE_TEXTURE
+    {
+        std::vector<std::vector<uint32_t> > levels;
+        std::vector<int> widths;
+        std::vector<int> heights;
+    };
+
+    // triangles of a chunk of instances and their tile bins
+    struct GEOMETRY_CHUNK
+    {
+        size_t firstInstance;
+        size_t endInstance;
+        // vertices of the instance being processed and their clip codes
+        std::vector<CLIP_VERTEX> vertices;
+        std::vector<int> clipCodes;
+        std::vector<TRIANGLE> triangles;
+        // triangle indices of each tile, in draw order
+        std::vector<std::vector<uint32_t> > bins;
+    };
+
+    JobSystem* m_pJobSystem;
+    int m_width;
+    int m_height;
+    // row length of the depth and triangle buffers: whole tiles, so
+    // SIMD loads and stores never reach into another tile
+    int m_pitch;
+    int m_tilesX;
+    int m_tilesY;
+    std::vector<uint32_t> m_color;
+    std::vector<float> m_depth;
+    // nearest opaque triangle of each pixel while a view is drawn
+    std::vector<uint32_t> m_triangleIDs;
+
+    std::vector<SOFTWARE_TEXTURE> m_textures;
+    std::unordered_map<std::string, GLuint> m_textureLookup;
+    std::vector<SCENE_MATERIAL> m_materials;
+    std::vector<SCENE_POINT_LIGHT> m_lights;
+
+    // draw and instance of every instance of the view being drawn
+    std::vector<glm::uvec2> m_instances;
+    std::vector<GEOMETRY_CHUNK> m_chunks;
+    // global triangle index of each chunk's first triangle
+    std::vector<uint32_t> m_chunkBases;
+    // tiles the viewport touches and their binned triangles
+    std::vector<glm::uvec2> m_viewTiles;
+
+    // snap a clipped triangle to the viewport and bin it; false
+    // when it covers no pixel center
+    bool AddTriangle(GEOMETRY_CHUNK& chunk, const CLIP_VERTEX& a, const CLIP_VERTEX& b, const CLIP_VERTEX& c,
+        const int viewport[4], const int bounds[4], const SOFTWARE_DRAW& draw, uint32_t material);
+    // transform, clip and bin the instances of one chunk
+    void ProcessChunk(GEOMETRY_CHUNK& chunk, const FRAME_UNIFORMS& frame, int view, const int viewport[4],
+        const int bounds[4], const SOFTWARE_DRAW* draws, const glm::mat4* instanceMatrices, const glm::uvec2* instanceSurfaces);
+    // rasterize and shade one tile
+    void DrawTile(int tile, const FRAME_UNIFORMS& frame, int view, const int bounds[4],
+        const LIGHT_CLUSTER_LIST& lightClusters);
+    // find a triangle by its global index
+    const TRIANGLE& GetTriangle(uint32_t id) const;
+    // color of a triangle at a pixel center, before blending
+    glm::vec4 Shade(const TRIANGLE& triangle, float x, float y, const FRAME_UNIFORMS& frame, int view,
+        const LIGHT_CLUSTER_LIST& lightClusters) const;
+    // trilinear filtered texture color
+    glm::vec4 Sample(const SOFTWARE_TEXTURE& texture, const glm::vec2& coordinate, float lod) const;
+};
@@ -0,0 +1,619 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.cpp
+// ============
+// Deduplicating texture loader - uploads precompressed KTX2 caches
+// straight from memory mapped files, or decodes the image files on worker
+// threads and uploads them to OpenGL in batches through pixel buffer objects
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureCache.h"
+#include "MappedFile.h"
+#ifndef STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#endif
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace {
+    // upper limit for the size of one pixel unpack buffer
+    const size_t MAX_BATCH_BYTES = 64 * 1024 * 1024;
+
+    // read a whole file into memory
+    bool ReadFile(const std::string& path, std::vector<unsigned char>& data) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (file == NULL) {
+            return false;
+        }
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        if (size <= 0) {
+            fclose(file);
+            return false;
+        }
+        data.resize((size_t)size);
+        size_t bytesRead = fread(data.data(), 1, data.size(), file);
+        fclose(file);
+        return bytesRead == data.size();
+    }
+
+    // 64-bit FNV-1a hash of a memory block
+    uint64_t HashBytes(const unsigned char* data, size_t size) {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // number of worker threads to use for a given amount of work
+    unsigned int WorkerCount(size_t jobs) {
+        unsigned int cores = std::thread::hardware_concurrency();
+        if (cores == 0) {
+            cores = 1;
+        }
+        return (unsigned int)std::min<size_t>(cores, std::max<size_t>(jobs, 1));
+    }
+
+    // OpenGL pixel formats for an image channel count
+    void GetFormats(int channels, GLenum& format, GLenum& internalFormat) {
+        switch (channels) {
+        case 1: format = GL_RED;  internalFormat = GL_R8;    break;
+        case 2: format = GL_RG;   internalFormat = GL_RG8;   break;
+        case 4: format = GL_RGBA; internalFormat = GL_RGBA8; break;
+        default: format = GL_RGB; internalFormat = GL_RGB8;  break;
+        }
+    }
+
+    GLenum GetCompressedFormat(BLOCK_FORMAT format) {
+        return (format == BLOCK_BC3) ?
+            GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    }
+
+    // size of one S3TC compressed image
+    GLsizei CompressedImageBytes(GLenum internalFormat, int width, int height) {
+        GLsizei blockBytes = (internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) ? 8 : 16;
+        return ((width + 3) / 4) * ((height + 3) / 4) * blockBytes;
+    }
+
+    // length of the full mip chain glGenerateMipmap creates
+    int MipLevelCount(int width, int height) {
+        int levels = 1;
+        while (width > 1 || height > 1) {
+            width = std::max(1, width / 2);
+            height = std::max(1, height / 2);
+            ++levels;
+        }
+        return levels;
+    }
+}
+
+/***********************************************************
+ *  TextureCache()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TextureCache::TextureCache() {
+    m_firstPending = 0;
+    m_decodedCount = 0;
+    m_compressedCount = 0;
+}
+
+/***********************************************************
+ *  ~TextureCache()
+ *
+ *  The destructor for the class - frees the OpenGL textures
+ ***********************************************************/
+TextureCache::~TextureCache() {
+    ReleaseTextureArrays();
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        // aliases share the texture of the entry they point to
+        if (m_entries[i].aliasOf < 0 && m_entries[i].textureID != 0) {
+            glDeleteTextures(1, &m_entries[i].textureID);
+        }
+        stbi_image_free(m_entries[i].pixels);
+    }
+}
+
+/***********************************************************
+ *  Request()
+ *
+ *  This method queues an image file for loading. Requesting
+ *  the same path again returns the existing handle.
+ ***********************************************************/
+int TextureCache::Request(const char* filename) {
+    std::string path = filename;
+    std::replace(path.begin(), path.end(), '\\', '/');
+
+    std::unordered_map<std::string, int>::iterator found = m_pathLookup.find(path);
+    if (found != m_pathLookup.end()) {
+        return found->second;
+    }
+
+    TEXTURE_ENTRY entry;
+    entry.path = path;
+    entry.contentHash = 0;
+    entry.contentSize = 0;
+    entry.aliasOf = -1;
+    entry.pixels = NULL;
+    entry.width = 0;
+    entry.height = 0;
+    entry.channels = 0;
+    entry.internalFormat = 0;
+    entry.levelCount = 0;
+    entry.compressed = false;
+    entry.textureID = 0;
+    entry.loaded = false;
+
+    int handle = (int)m_entries.size();
+    m_entries.push_back(entry);
+    m_pathLookup[path] = handle;
+    return handle;
+}
+
+/***********************************************************
+ *  GetTextureID()
+ *
+ *  This method returns the OpenGL texture for a handle.
+ ***********************************************************/
+GLuint TextureCache::GetTextureID(int handle) const {
+    if (handle < 0 || handle >= (int)m_entries.size()) {
+        return 0;
+    }
+    return m_entries[handle].textureID;
+}
+
+/***********************************************************
+ *  LoadPending()
+ *
+ *  This method loads every queued file. The files are read
+ *  (or their compressed caches mapped) and hashed in
+ *  parallel, and identical source images are collapsed,
+ *  whether they come with a cache or not. The remaining images
+ *  are decoded on worker threads while this (context)
+ *  thread uploads the compressed caches and the finished
+ *  images. The caches are only used when the driver
+ *  supports S3TC; otherwise the images are decoded.
+ ***********************************************************/
+void TextureCache::LoadPending() {
+    size_t first = m_firstPending;
+    size_t count = m_entries.size() - first;
+    m_firstPending = m_entries.size();
+    if (count == 0) {
+        return;
+    }
+
+    // map the compressed caches, or read the encoded files,
+    // and hash the source images in parallel
+    bool useCompressed = GLEW_EXT_texture_compression_s3tc ? true : false;
+    std::vector<MappedFile> cacheFiles(count);
+    std::vector<COMPRESSED_TEXTURE> compressed(count);
+    std::vector<std::vector<unsigned char> > fileData(count);
+    std::vector<char> readOK(count, 0);
+    {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        unsigned int numWorkers = WorkerCount(count);
+        for (unsigned int w = 0; w < numWorkers; ++w) {
+            workers.push_back(std::thread([&]() {
+                size_t i;
+                while ((i = next++) < count) {
+                    TEXTURE_ENTRY& entry = m_entries[first + i];
+                    if (useCompressed && TextureCompression::IsCacheCurrent(entry.path) &&
+                        cacheFiles[i].Open(TextureCompression::GetCachePath(entry.path).c_str())) {
+                        if (TextureCompression::ParseKTX2(cacheFiles[i].GetData(), cacheFiles[i].GetSize(), compressed[i])) {
+                            // hashed by the source image, so a copy of it that
+                            // has no cache of its own still matches; the cache
+                            // stands in for an image that is not shipped
+                            MappedFile source;
+                            const MappedFile& hashed = source.Open(entry.path.c_str()) ? source : cacheFiles[i];
+                            entry.contentSize = hashed.GetSize();
+                            entry.contentHash = HashBytes(hashed.GetData(), hashed.GetSize());
+                            readOK[i] = 1;
+                            continue;
+                        }
+                        cacheFiles[i].Close();
+                    }
+                    if (ReadFile(entry.path, fileData[i])) {
+                        entry.contentSize = fileData[i].size();
+                        entry.contentHash = HashBytes(fileData[i].data(), fileData[i].size());
+                        readOK[i] = 1;
+                    }
+                }
+            }));
+        }
+        for (size_t w = 0; w < workers.size(); ++w) {
+            workers[w].join();
+        }
+    }
+
+    // collapse entries with identical file contents
+    std::map<std::pair<uint64_t, size_t>, int> contentLookup;
+    for (size_t i = 0; i < first; ++i) {
+        if (m_entries[i].aliasOf < 0 && m_entries[i].loaded) {
+            contentLookup[std::make_pair(m_entries[i].contentHash, m_entries[i].contentSize)] = (int)i;
+        }
+    }
+    std::vector<int> unique;
+    std::vector<int> uniqueCompressed;
+    for (size_t i = 0; i < count; ++i) {
+        TEXTURE_ENTRY& entry = m_entries[first + i];
+        if (!readOK[i]) {
+            std::cout << "Failed to load texture from: " << entry.path << std::endl;
+            continue;
+        }
+        std::pair<uint64_t, size_t> key(entry.contentHash, entry.contentSize);
+        std::map<std::pair<uint64_t, size_t>, int>::iterator found = contentLookup.find(key);
+        if (found != contentLookup.end()) {
+            entry.aliasOf = found->second;
+        }
+        else {
+            contentLookup[key] = (int)(first + i);
+            if (cacheFiles[i].IsOpen()) {
+                uniqueCompressed.push_back((int)i);
+            }
+            else {
+                unique.push_back((int)i);
+            }
+        }
+    }
+
+    // decode the unique images on worker threads, handing each
+    // finished image back to this thread for uploading
+    std::mutex readyMutex;
+    std::condition_variable readyCondition;
+    std::vector<int> ready;
+    {
+        std::atomic<size_t> next(0);
+        std::vector<std::thread> workers;
+        unsigned int numWorkers = WorkerCount(unique.size());
+        for (unsigned int w = 0; w < numWorkers && !unique.empty(); ++w) {
+            workers.push_back(std::thread([&]() {
+                size_t u;
+                while ((u = next++) < unique.size()) {
+                    int i = unique[u];
+                    TEXTURE_ENTRY& entry = m_entries[first + i];
+                    entry.pixels = stbi_load_from_memory(
+                        fileData[i].data(), (int)fileData[i].size(),
+                        &entry.width, &entry.height, &entry.channels, 0);
+                    std::vector<unsigned char>().swap(fileData[i]);
+
+                    std::lock_guard<std::mutex> lock(readyMutex);
+                    ready.push_back((int)first + i);
+                    readyCondition.notify_one();
+                }
+            }));
+        }
+
+        // the compressed images need no decoding, so they are
+        // uploaded while the workers decode the others
+        for (size_t c = 0; c < uniqueCompressed.size(); ++c) {
+            int i = uniqueCompressed[c];
+            UploadCompressed((int)first + i, compressed[i]);
+            cacheFiles[i].Close();
+        }
+
+        // upload in batches as soon as images become available
+        size_t uploaded = 0;
+        while (uploaded < unique.size()) {
+            std::vector<int> batch;
+            {
+                std::unique_lock<std::mutex> lock(readyMutex);
+                readyCondition.wait(lock, [&]() { return !ready.empty(); });
+                batch.swap(ready);
+            }
+            UploadBatch(batch);
+            uploaded += batch.size();
+        }
+
+        for (size_t w = 0; w < workers.size(); ++w) {
+            workers[w].join();
+        }
+    }
+
+    // resolve the aliases to the textures that were uploaded
+    for (size_t i = first; i < m_entries.size(); ++i) {
+        TEXTURE_ENTRY& entry = m_entries[i];
+        if (entry.aliasOf >= 0) {
+            entry.textureID = m_entries[entry.aliasOf].textureID;
+            entry.loaded = m_entries[entry.aliasOf].loaded;
+        }
+    }
+}
+
+/***********************************************************
+ *  UploadBatch()
+ *
+ *  This method copies a batch of decoded images into pixel
+ *  unpack buffers and creates the OpenGL textures from them.
+ ***********************************************************/
+void TextureCache::UploadBatch(const std::vector<int>& batch) {
+    // rows of 1 and 3 channel images are tightly packed
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    size_t start = 0;
+    while (start < batch.size()) {
+        // gather as many images as fit into one buffer
+        std::vector<size_t> offsets;
+        size_t totalBytes = 0;
+        size_t end = start;
+        while (end < batch.size()) {
+            const TEXTURE_ENTRY& entry = m_entries[batch[end]];
+            size_t bytes = (entry.pixels != NULL) ?
+                (size_t)entry.width * entry.height * entry.channels : 0;
+            if (end > start && totalBytes + bytes > MAX_BATCH_BYTES) {
+                break;
+            }
+            offsets.push_back(totalBytes);
+            // keep every image 16 byte aligned inside the buffer
+            totalBytes += (bytes + 15) & ~(size_t)15;
+            ++end;
+        }
+
+        GLuint pbo = 0;
+        unsigned char* mapped = NULL;
+        if (totalBytes > 0) {
+            glGenBuffers(1, &pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, totalBytes, NULL, GL_STREAM_DRAW);
+            mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, totalBytes,
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        }
+        if (mapped != NULL) {
+            for (size_t b = start; b < end; ++b) {
+                const TEXTURE_ENTRY& entry = m_entries[batch[b]];
+                if (entry.pixels != NULL) {
+                    memcpy(mapped + offsets[b - start], entry.pixels,
+                        (size_t)entry.width * entry.height * entry.channels);
+                }
+            }
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+
+        for (size_t b = start; b < end; ++b) {
+            TEXTURE_ENTRY& entry = m_entries[batch[b]];
+            if (entry.pixels == NULL) {
+                std::cout << "Failed to load texture from: " << entry.path << std::endl;
+                continue;
+            }
+
+            GLenum format, internalFormat;
+            GetFormats(entry.channels, format, internalFormat);
+
+            glGenTextures(1, &entry.textureID);
+            glBindTexture(GL_TEXTURE_2D, entry.textureID);
+            // upload from the buffer if it could be mapped, otherwise
+            // fall back to a direct upload from client memory
+            const void* source = (mapped != NULL) ?
+                (const void*)(uintptr_t)offsets[b - start] : (const void*)entry.pixels;
+            if (mapped == NULL) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            }
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, entry.width, entry.height, 0,
+                format, GL_UNSIGNED_BYTE, source);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            entry.internalFormat = internalFormat;
+            entry.levelCount = MipLevelCount(entry.width, entry.height);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+            entry.loaded = true;
+            ++m_decodedCount;
+            std::cout << "Texture loaded successfully from: " << entry.path << std::endl;
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (pbo != 0) {
+            glDeleteBuffers(1, &pbo);
+        }
+
+        // the decoded pixels are no longer needed
+        for (size_t b = start; b < end; ++b) {
+            TEXTURE_ENTRY& entry = m_entries[batch[b]];
+            stbi_image_free(entry.pixels);
+            entry.pixels = NULL;
+        }
+        start = end;
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+/***********************************************************
+ *  UploadCompressed()
+ *
+ *  This method creates an OpenGL texture from the block
+ *  compressed mip levels of a cache file. The levels are
+ *  passed straight from the mapped file, so the data is
+ *  never copied or decoded on the CPU.
+ ***********************************************************/
+void TextureCache::UploadCompressed(int handle, const COMPRESSED_TEXTURE& texture) {
+    TEXTURE_ENTRY& entry = m_entries[handle];
+    GLenum internalFormat = GetCompressedFormat(texture.format);
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glGenTextures(1, &entry.textureID);
+    glBindTexture(GL_TEXTURE_2D, entry.textureID);
+    for (size_t level = 0; level < texture.levels.size(); ++level) {
+        const COMPRESSED_TEXTURE::LEVEL& data = texture.levels[level];
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, internalFormat,
+            data.width, data.height, 0, (GLsizei)data.size, data.data);
+    }
+    // the cache holds the whole chain, so no mipmaps are generated
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    entry.width = texture.width;
+    entry.height = texture.height;
+    entry.internalFormat = internalFormat;
+    entry.levelCount = (int)texture.levels.size();
+    entry.compressed = true;
+    entry.loaded = true;
+    ++m_compressedCount;
+    std::cout << "Texture loaded successfully from: " << TextureCompression::GetCachePath(entry.path)
+        << (texture.format == BLOCK_BC3 ? " (BC3, " : " (BC1, ") << texture.levels.size() << " levels)" << std::endl;
+}
+
+/***********************************************************
+ *  BuildTextureArrays()
+ *
+ *  This method packs the textures of a list of handles into
+ *  texture arrays. Textures of the same size, format and mip
+ *  count share one array, so a scene whose textures all
+ *  match is drawn with a single texture binding. Handles of
+ *  the same image share a layer; handles that failed to load
+ *  get array texture 0.
+ ***********************************************************/
+void TextureCache::BuildTextureArrays(const std::vector<int>& handles, std::vector<TEXTURE_LAYER>& layers) {
+    TEXTURE_LAYER missing = { 0, 0 };
+    layers.assign(handles.size(), missing);
+
+    // group the distinct images by what the layers of an array share
+    typedef std::tuple<int, int, GLenum, int> ARRAY_KEY;
+    std::map<ARRAY_KEY, std::vector<int> > groups;
+    std::vector<int> images(handles.size(), -1);
+    std::map<int, TEXTURE_LAYER> imageLayers;
+    for (size_t i = 0; i < handles.size(); ++i) {
+        if (handles[i] < 0 || handles[i] >= (int)m_entries.size()) {
+            continue;
+        }
+        int image = (m_entries[handles[i]].aliasOf >= 0) ? m_entries[handles[i]].aliasOf : handles[i];
+        const TEXTURE_ENTRY& entry = m_entries[image];
+        if (!entry.loaded || entry.textureID == 0) {
+            continue;
+        }
+        images[i] = image;
+        if (imageLayers.find(image) == imageLayers.end()) {
+            std::vector<int>& group = groups[ARRAY_KEY(entry.width, entry.height, entry.internalFormat, entry.levelCount)];
+            imageLayers[image] = missing;
+            group.push_back(image);
+        }
+    }
+
+    // copies from client memory are tightly packed
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    for (std::map<ARRAY_KEY, std::vector<int> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+        const std::vector<int>& group = it->second;
+        const TEXTURE_ENTRY& first = m_entries[group[0]];
+        GLsizei layerCount = (GLsizei)group.size();
+
+        GLuint arrayTexture = 0;
+        glGenTextures(1, &arrayTexture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, arrayTexture);
+        m_textureArrays.push_back(arrayTexture);
+        for (int level = 0; level < first.levelCount; ++level) {
+            int width = std::max(1, first.width >> level);
+            int height = std::max(1, first.height >> level);
+            if (first.compressed) {
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, first.internalFormat, width, height, layerCount,
+                    0, CompressedImageBytes(first.internalFormat, width, height) * layerCount, NULL);
+            }
+            else {
+                GLenum format, internalFormat;
+                GetFormats(first.channels, format, internalFormat);
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, level, internalFormat, width, height, layerCount,
+                    0, format, GL_UNSIGNED_BYTE, NULL);
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, first.levelCount - 1);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        for (size_t layer = 0; layer < group.size(); ++layer) {
+            CopyToArrayLayer(m_entries[group[layer]], arrayTexture, (int)layer);
+            imageLayers[group[layer]].arrayTexture = arrayTexture;
+            imageLayers[group[layer]].layer = (int)layer;
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    for (size_t i = 0; i < handles.size(); ++i) {
+        if (images[i] >= 0) {
+            layers[i] = imageLayers[images[i]];
+        }
+    }
+    std::cout << "INFO: " << imageLayers.size() << " textures packed into " << groups.size()
+        << " texture arrays" << std::endl;
+}
+
+/***********************************************************
+ *  CopyToArrayLayer()
+ *
+ *  This method copies all mip levels of a texture into one
+ *  layer of an array with the same size and format. The copy
+ *  stays on the GPU when ARB_copy_image is available and goes
+ *  through client memory otherwise.
+ ***********************************************************/
+void TextureCache::CopyToArrayLayer(const TEXTURE_ENTRY& entry, GLuint arrayTexture, int layer) {
+    bool copyImage = GLEW_ARB_copy_image ? true : false;
+    std::vector<unsigned char> pixels;
+    if (!copyImage) {
+        glBindTexture(GL_TEXTURE_2D, entry.textureID);
+    }
+    for (int level = 0; level < entry.levelCount; ++level) {
+        int width = std::max(1, entry.width >> level);
+        int height = std::max(1, entry.height >> level);
+        if (copyImage) {
+            glCopyImageSubData(entry.textureID, GL_TEXTURE_2D, level, 0, 0, 0,
+                arrayTexture, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1);
+        }
+        else if (entry.compressed) {
+            GLsizei bytes = CompressedImageBytes(entry.internalFormat, width, height);
+            pixels.resize(bytes);
+            glGetCompressedTexImage(GL_TEXTURE_2D, level, pixels.data());
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1,
+                entry.internalFormat, bytes, pixels.data());
+        }
+        else {
+            GLenum format, internalFormat;
+            GetFormats(entry.channels, format, internalFormat);
+            pixels.resize((size_t)width * height * entry.channels);
+            glGetTexImage(GL_TEXTURE_2D, level, format, GL_UNSIGNED_BYTE, pixels.data());
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, width, height, 1,
+                format, GL_UNSIGNED_BYTE, pixels.data());
+        }
+    }
+}
+
+/***********************************************************
+ *  ReleaseTextureArrays()
+ *
+ *  This method frees the texture arrays. The textures they
+ *  were built from stay loaded.
+ ***********************************************************/
+void TextureCache::ReleaseTextureArrays() {
+    if (!m_textureArrays.empty()) {
+        glDeleteTextures((GLsizei)m_textureArrays.size(), m_textureArrays.data());
+        m_textureArrays.clear();
+    }
+}
@@ -0,0 +1,104 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.h
+// ============
+// Deduplicating texture loader - uploads precompressed KTX2 caches
+// straight from memory mapped files, or decodes the image files on worker
+// threads and uploads them to OpenGL in batches through pixel buffer objects
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "TextureCompression.h"
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// location of a texture inside a texture array
+struct TEXTURE_LAYER
+{
+    GLuint arrayTexture;    // 0 if the texture failed to load
+    int layer;
+};
+
+/***********************************************************
+ *  TextureCache
+ *
+ *  This class owns every OpenGL texture created from an
+ *  image file. Each file is decoded at most once, even when
+ *  it is requested several times or when two different
+ *  paths contain identical image data. An image with an up
+ *  to date compressed cache (see Tools/TextureCompiler.cpp)
+ *  is not decoded at all - its precomputed mip levels are
+ *  uploaded directly from the mapped cache file.
+ ***********************************************************/
+class TextureCache
+{
+public:
+    // constructor
+    TextureCache();
+    // destructor
+    ~TextureCache();
+
+    // queue an image file for loading and return its handle
+    int Request(const char* filename);
+    // decode all queued files and upload them to OpenGL
+    void LoadPending();
+    // get the OpenGL texture for a handle (0 if loading failed)
+    GLuint GetTextureID(int handle) const;
+
+    // copy loaded textures into GL_TEXTURE_2D_ARRAY textures, one
+    // array per size and format, and return each handle's layer
+    void BuildTextureArrays(const std::vector<int>& handles, std::vector<TEXTURE_LAYER>& layers);
+    // free the texture arrays built so far
+    void ReleaseTextureArrays();
+
+    // number of distinct images that were actually decoded
+    int GetDecodedCount() const { return m_decodedCount; }
+    // number of distinct images that were loaded from compressed caches
+    int GetCompressedCount() const { return m_compressedCount; }
+
+private:
+    struct TEXTURE_ENTRY
+    {
+        std::string path;
+        // FNV-1a hash and size of the encoded image file, or of its
+        // compressed cache when only the cache exists
+        uint64_t contentHash;
+        size_t contentSize;
+        // entry holding the same image data, or -1 if unique
+        int aliasOf;
+        // decoded pixel data, released after the upload
+        unsigned char* pixels;
+        int width;
+        int height;
+        int channels;
+        // OpenGL format and number of mip levels of the texture
+        GLenum internalFormat;
+        int levelCount;
+        bool compressed;
+        GLuint textureID;
+        bool loaded;
+    };
+
+    // all requested entries, indexed by handle
+    std::vector<TEXTURE_ENTRY> m_entries;
+    // lookup from file path to handle
+    std::unordered_map<std::string, int> m_pathLookup;
+    // first entry not yet processed by LoadPending()
+    size_t m_firstPending;
+    // total number of decoded images
+    int m_decodedCount;
+    // total number of images loaded from compressed caches
+    int m_compressedCount;
+    // texture arrays built from the loaded textures
+    std::vector<GLuint> m_textureArrays;
+
+    // upload a batch of decoded entries through one PBO
+    void UploadBatch(const std::vector<int>& batch);
+    // upload the mip levels of a compressed cache file
+    void UploadCompressed(int handle, const COMPRESSED_TEXTURE& texture);
+    // copy every mip level of a texture into an array layer
+    void CopyToArrayLayer(const TEXTURE_ENTRY& entry, GLuint arrayTexture, int layer);
+};
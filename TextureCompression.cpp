@@ -0,0 +1,493 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecompression.cpp
+// ============
+// Block compression (BC1/BC3) with precomputed mip chains, stored in
+// KTX2 containers next to the source images
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/stat.h>
+
+namespace {
+    const unsigned char KTX2_IDENTIFIER[12] = {
+        0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A
+    };
+    // VkFormat values of the supported block formats
+    const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131;
+    const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137;
+    // data format descriptor color models and channel ids
+    const uint32_t KHR_DF_MODEL_BC1A = 128;
+    const uint32_t KHR_DF_MODEL_BC3 = 130;
+    const uint32_t KHR_DF_CHANNEL_BC_COLOR = 0;
+    const uint32_t KHR_DF_CHANNEL_BC3_ALPHA = 15;
+    const uint32_t KHR_DF_PRIMARIES_BT709 = 1;
+    const uint32_t KHR_DF_TRANSFER_LINEAR = 1;
+    // header, section index and one level index entry
+    const size_t KTX2_HEADER_SIZE = 80;
+    const size_t KTX2_LEVEL_ENTRY_SIZE = 24;
+
+    size_t BlockBytes(BLOCK_FORMAT format) {
+        return (format == BLOCK_BC3) ? 16 : 8;
+    }
+
+    // size of one compressed mip level
+    size_t LevelBytes(BLOCK_FORMAT format, int width, int height) {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+    }
+
+    void Put32(std::vector<unsigned char>& out, size_t offset, uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            out[offset + i] = (unsigned char)(value >> (8 * i));
+        }
+    }
+
+    void Put64(std::vector<unsigned char>& out, size_t offset, uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            out[offset + i] = (unsigned char)(value >> (8 * i));
+        }
+    }
+
+    uint32_t Get32(const unsigned char* data) {
+        return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+            ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    uint64_t Get64(const unsigned char* data) {
+        return (uint64_t)Get32(data) | ((uint64_t)Get32(data + 4) << 32);
+    }
+
+    // append one key/value entry, padded to 4 bytes
+    void AppendKeyValue(std::vector<unsigned char>& out, const char* key, const char* value) {
+        size_t keyLength = strlen(key) + 1;
+        size_t valueLength = strlen(value) + 1;
+        size_t offset = out.size();
+        out.resize(offset + 4 + ((keyLength + valueLength + 3) & ~(size_t)3), 0);
+        Put32(out, offset, (uint32_t)(keyLength + valueLength));
+        memcpy(&out[offset + 4], key, keyLength);
+        memcpy(&out[offset + 4 + keyLength], value, valueLength);
+    }
+
+    // expand to RGBA the way OpenGL samples the uncompressed
+    // formats: R8 reads as (r, 0, 0, 1) and RG8 as (r, g, 0, 1)
+    void ExpandToRGBA(const unsigned char* pixels, int width, int height, int channels,
+        std::vector<unsigned char>& rgba) {
+        size_t count = (size_t)width * height;
+        rgba.resize(count * 4);
+        for (size_t i = 0; i < count; ++i) {
+            const unsigned char* source = pixels + i * channels;
+            unsigned char* target = &rgba[i * 4];
+            target[0] = source[0];
+            target[1] = (channels >= 2) ? source[1] : 0;
+            target[2] = (channels >= 3) ? source[2] : 0;
+            target[3] = (channels == 4) ? source[3] : 255;
+        }
+    }
+
+    // next mip level with a 2x2 box filter; the last row or
+    // column of odd sized levels is repeated
+    void Downsample(const std::vector<unsigned char>& source, int width, int height,
+        std::vector<unsigned char>& target, int& targetWidth, int& targetHeight) {
+        targetWidth = std::max(1, width / 2);
+        targetHeight = std::max(1, height / 2);
+        target.resize((size_t)targetWidth * targetHeight * 4);
+        for (int y = 0; y < targetHeight; ++y) {
+            int y0 = std::min(y * 2, height - 1);
+            int y1 = std::min(y * 2 + 1, height - 1);
+            for (int x = 0; x < targetWidth; ++x) {
+                int x0 = std::min(x * 2, width - 1);
+                int x1 = std::min(x * 2 + 1, width - 1);
+                for (int c = 0; c < 4; ++c) {
+                    int sum = source[((size_t)y0 * width + x0) * 4 + c] +
+                        source[((size_t)y0 * width + x1) * 4 + c] +
+                        source[((size_t)y1 * width + x0) * 4 + c] +
+                        source[((size_t)y1 * width + x1) * 4 + c];
+                    target[((size_t)y * targetWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+    uint16_t PackRGB565(const float color[3]) {
+        int r = (int)(std::min(std::max(color[0], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+        int g = (int)(std::min(std::max(color[1], 0.0f), 255.0f) * 63.0f / 255.0f + 0.5f);
+        int b = (int)(std::min(std::max(color[2], 0.0f), 255.0f) * 31.0f / 255.0f + 0.5f);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    void UnpackRGB565(uint16_t packed, int color[3]) {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    /***********************************************************
+     *  EncodeColorBlock()
+     *
+     *  This function encodes the colors of a 4x4 block as BC1
+     *  in four color mode. The endpoints span the range of the
+     *  colors along their principal axis.
+     ***********************************************************/
+    void EncodeColorBlock(const unsigned char block[64], unsigned char* out) {
+        float mean[3] = { 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i) {
+            for (int c = 0; c < 3; ++c) {
+                mean[c] += block[i * 4 + c] / 16.0f;
+            }
+        }
+        float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; ++i) {
+            float r = block[i * 4 + 0] - mean[0];
+            float g = block[i * 4 + 1] - mean[1];
+            float b = block[i * 4 + 2] - mean[2];
+            covariance[0] += r * r;
+            covariance[1] += r * g;
+            covariance[2] += r * b;
+            covariance[3] += g * g;
+            covariance[4] += g * b;
+            covariance[5] += b * b;
+        }
+
+        // principal axis by power iteration
+        float axis[3] = { 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 8; ++iteration) {
+            float next[3] = {
+                covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+                covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+                covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2]
+            };
+            float length = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+            if (length < 1e-6f) {
+                break;
+            }
+            for (int c = 0; c < 3; ++c) {
+                axis[c] = next[c] / length;
+            }
+        }
+
+        float minimum = 1e30f;
+        float maximum = -1e30f;
+        for (int i = 0; i < 16; ++i) {
+            float t = (block[i * 4 + 0] - mean[0]) * axis[0] +
+                (block[i * 4 + 1] - mean[1]) * axis[1] +
+                (block[i * 4 + 2] - mean[2]) * axis[2];
+            minimum = std::min(minimum, t);
+            maximum = std::max(maximum, t);
+        }
+        float high[3], low[3];
+        for (int c = 0; c < 3; ++c) {
+            high[c] = mean[c] + axis[c] * maximum;
+            low[c] = mean[c] + axis[c] * minimum;
+        }
+
+        // four color mode needs the first endpoint to be larger
+        uint16_t color0 = PackRGB565(high);
+        uint16_t color1 = PackRGB565(low);
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        uint32_t indices = 0;
+        if (color0 != color1) {
+            int palette[4][3];
+            UnpackRGB565(color0, palette[0]);
+            UnpackRGB565(color1, palette[1]);
+            for (int c = 0; c < 3; ++c) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            for (int i = 0; i < 16; ++i) {
+                int best = 0;
+                int bestError = 1 << 30;
+                for (int p = 0; p < 4; ++p) {
+                    int error = 0;
+                    for (int c = 0; c < 3; ++c) {
+                        int d = block[i * 4 + c] - palette[p][c];
+                        error += d * d;
+                    }
+                    if (error < bestError) {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (uint32_t)best << (2 * i);
+            }
+        }
+
+        out[0] = (unsigned char)(color0 & 0xFF);
+        out[1] = (unsigned char)(color0 >> 8);
+        out[2] = (unsigned char)(color1 & 0xFF);
+        out[3] = (unsigned char)(color1 >> 8);
+        for (int i = 0; i < 4; ++i) {
+            out[4 + i] = (unsigned char)(indices >> (8 * i));
+        }
+    }
+
+    /***********************************************************
+     *  EncodeAlphaBlock()
+     *
+     *  This function encodes the alpha values of a 4x4 block
+     *  as a BC3 alpha block using the eight value mode between
+     *  the block's minimum and maximum alpha.
+     ***********************************************************/
+    void EncodeAlphaBlock(const unsigned char block[64], unsigned char* out) {
+        int alpha0 = 0;
+        int alpha1 = 255;
+        for (int i = 0; i < 16; ++i) {
+            alpha0 = std::max(alpha0, (int)block[i * 4 + 3]);
+            alpha1 = std::min(alpha1, (int)block[i * 4 + 3]);
+        }
+
+        uint64_t indices = 0;
+        if (alpha0 != alpha1) {
+            int palette[8];
+            palette[0] = alpha0;
+            palette[1] = alpha1;
+            for (int p = 1; p < 7; ++p) {
+                palette[p + 1] = ((7 - p) * alpha0 + p * alpha1) / 7;
+            }
+            for (int i = 0; i < 16; ++i) {
+                int best = 0;
+                int bestError = 256;
+                for (int p = 0; p < 8; ++p) {
+                    int error = abs(block[i * 4 + 3] - palette[p]);
+                    if (error < bestError) {
+                        bestError = error;
+                        best = p;
+                    }
+                }
+                indices |= (uint64_t)best << (3 * i);
+            }
+        }
+
+        out[0] = (unsigned char)alpha0;
+        out[1] = (unsigned char)alpha1;
+        for (int i = 0; i < 6; ++i) {
+            out[2 + i] = (unsigned char)(indices >> (8 * i));
+        }
+    }
+
+    // compress one RGBA level block by block
+    void CompressLevel(const std::vector<unsigned char>& rgba, int width, int height,
+        BLOCK_FORMAT format, std::vector<unsigned char>& out) {
+        out.resize(LevelBytes(format, width, height));
+        unsigned char* target = out.data();
+        unsigned char block[64];
+        for (int by = 0; by < height; by += 4) {
+            for (int bx = 0; bx < width; bx += 4) {
+                // blocks over the image edge repeat the edge pixels
+                for (int y = 0; y < 4; ++y) {
+                    int sy = std::min(by + y, height - 1);
+                    for (int x = 0; x < 4; ++x) {
+                        int sx = std::min(bx + x, width - 1);
+                        memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t)sy * width + sx) * 4], 4);
+                    }
+                }
+                if (format == BLOCK_BC3) {
+                    EncodeAlphaBlock(block, target);
+                    target += 8;
+                }
+                EncodeColorBlock(block, target);
+                target += 8;
+            }
+        }
+    }
+}
+
+/***********************************************************
+ *  GetCachePath()
+ *
+ *  This function returns the image path with its extension
+ *  replaced by .ktx2.
+ ***********************************************************/
+std::string TextureCompression::GetCachePath(const std::string& imagePath) {
+    size_t separator = imagePath.find_last_of("/\\");
+    size_t dot = imagePath.find_last_of('.');
+    if (dot == std::string::npos || (separator != std::string::npos && dot < separator)) {
+        return imagePath + ".ktx2";
+    }
+    return imagePath.substr(0, dot) + ".ktx2";
+}
+
+/***********************************************************
+ *  IsCacheCurrent()
+ *
+ *  This function returns true when the cache file of an
+ *  image exists and was written after the image was last
+ *  changed. A cache without its source image is also used.
+ ***********************************************************/
+bool TextureCompression::IsCacheCurrent(const std::string& imagePath) {
+    struct stat cacheInfo;
+    if (stat(GetCachePath(imagePath).c_str(), &cacheInfo) != 0) {
+        return false;
+    }
+    struct stat imageInfo;
+    if (stat(imagePath.c_str(), &imageInfo) != 0) {
+        return true;
+    }
+    return cacheInfo.st_mtime >= imageInfo.st_mtime;
+}
+
+/***********************************************************
+ *  CompressImage()
+ *
+ *  This function builds the mip chain of an image and block
+ *  compresses every level.
+ ***********************************************************/
+void TextureCompression::CompressImage(const unsigned char* pixels, int width, int height, int channels,
+    BLOCK_FORMAT& format, std::vector<std::vector<unsigned char> >& levels) {
+    std::vector<unsigned char> rgba;
+    ExpandToRGBA(pixels, width, height, channels, rgba);
+
+    format = BLOCK_BC1;
+    for (size_t i = 3; i < rgba.size(); i += 4) {
+        if (rgba[i] != 255) {
+            format = BLOCK_BC3;
+            break;
+        }
+    }
+
+    levels.clear();
+    std::vector<unsigned char> next;
+    while (true) {
+        levels.push_back(std::vector<unsigned char>());
+        CompressLevel(rgba, width, height, format, levels.back());
+        if (width == 1 && height == 1) {
+            break;
+        }
+        Downsample(rgba, width, height, next, width, height);
+        rgba.swap(next);
+    }
+}
+
+/***********************************************************
+ *  WriteKTX2()
+ *
+ *  This function writes a KTX2 file with one 2D image and
+ *  its mip levels. As the format requires, the level data
+ *  is stored smallest level first, aligned to the block
+ *  size, while the level index lists the largest first.
+ ***********************************************************/
+bool TextureCompression::WriteKTX2(const char* filename, BLOCK_FORMAT format, int width, int height,
+    const std::vector<std::vector<unsigned char> >& levels) {
+    uint32_t levelCount = (uint32_t)levels.size();
+    size_t alignment = BlockBytes(format);
+
+    std::vector<unsigned char> out(KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_ENTRY_SIZE, 0);
+    memcpy(&out[0], KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+    Put32(out, 12, (format == BLOCK_BC3) ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK);
+    Put32(out, 16, 1);              // typeSize
+    Put32(out, 20, (uint32_t)width);
+    Put32(out, 24, (uint32_t)height);
+    Put32(out, 28, 0);              // pixelDepth
+    Put32(out, 32, 0);              // layerCount
+    Put32(out, 36, 1);              // faceCount
+    Put32(out, 40, levelCount);
+    Put32(out, 44, 0);              // supercompressionScheme
+
+    // data format descriptor with one basic descriptor block
+    uint32_t sampleCount = (format == BLOCK_BC3) ? 2 : 1;
+    uint32_t blockSize = 24 + 16 * sampleCount;
+    size_t dfdOffset = out.size();
+    out.resize(dfdOffset + 4 + blockSize, 0);
+    Put32(out, dfdOffset, 4 + blockSize);
+    Put32(out, dfdOffset + 4, 0);   // vendor and descriptor type
+    Put32(out, dfdOffset + 8, 2 | (blockSize << 16));
+    Put32(out, dfdOffset + 12, ((format == BLOCK_BC3) ? KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC1A) |
+        (KHR_DF_PRIMARIES_BT709 << 8) | (KHR_DF_TRANSFER_LINEAR << 16));
+    Put32(out, dfdOffset + 16, 3 | (3 << 8));   // 4x4 texel blocks
+    Put32(out, dfdOffset + 20, (uint32_t)BlockBytes(format));
+    for (uint32_t s = 0; s < sampleCount; ++s) {
+        size_t sample = dfdOffset + 28 + 16 * s;
+        uint32_t channel = (s + 1 < sampleCount) ? KHR_DF_CHANNEL_BC3_ALPHA : KHR_DF_CHANNEL_BC_COLOR;
+        Put32(out, sample, (64 * s) | (63 << 16) | (channel << 24));
+        Put32(out, sample + 12, 0xFFFFFFFF);    // sampleUpper
+    }
+    Put32(out, 48, (uint32_t)dfdOffset);
+    Put32(out, 52, 4 + blockSize);
+
+    // key/value data, sorted by key
+    size_t kvdOffset = out.size();
+    AppendKeyValue(out, "KTXorientation", "rd");
+    AppendKeyValue(out, "KTXwriter", "CS-330 TextureCompiler");
+    Put32(out, 56, (uint32_t)kvdOffset);
+    Put32(out, 60, (uint32_t)(out.size() - kvdOffset));
+
+    for (uint32_t i = levelCount; i-- > 0;) {
+        size_t offset = (out.size() + alignment - 1) & ~(alignment - 1);
+        out.resize(offset + levels[i].size(), 0);
+        memcpy(&out[offset], levels[i].data(), levels[i].size());
+
+        size_t entry = KTX2_HEADER_SIZE + i * KTX2_LEVEL_ENTRY_SIZE;
+        Put64(out, entry, offset);
+        Put64(out, entry + 8, levels[i].size());
+        Put64(out, entry + 16, levels[i].size());
+    }
+
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        return false;
+    }
+    size_t written = fwrite(out.data(), 1, out.size(), file);
+    return (fclose(file) == 0) && written == out.size();
+}
+
+/***********************************************************
+ *  ParseKTX2()
+ *
+ *  This function checks a KTX2 file in memory and returns
+ *  views of its mip levels. Anything other than a single
+ *  BC1 or BC3 2D image without supercompression is
+ *  rejected, so the caller can fall back to the source.
+ ***********************************************************/
+bool TextureCompression::ParseKTX2(const unsigned char* data, size_t size, COMPRESSED_TEXTURE& texture) {
+    if (size < KTX2_HEADER_SIZE || memcmp(data, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+        return false;
+    }
+    uint32_t vkFormat = Get32(data + 12);
+    if (vkFormat == VK_FORMAT_BC1_RGB_UNORM_BLOCK) {
+        texture.format = BLOCK_BC1;
+    }
+    else if (vkFormat == VK_FORMAT_BC3_UNORM_BLOCK) {
+        texture.format = BLOCK_BC3;
+    }
+    else {
+        return false;
+    }
+    uint32_t width = Get32(data + 20);
+    uint32_t height = Get32(data + 24);
+    uint32_t levelCount = Get32(data + 40);
+    if (width == 0 || height == 0 || width > 65536 || height > 65536 ||
+        Get32(data + 28) != 0 || Get32(data + 32) > 1 || Get32(data + 36) != 1 ||
+        Get32(data + 44) != 0 || levelCount == 0 || levelCount > 17 ||
+        size < KTX2_HEADER_SIZE + levelCount * KTX2_LEVEL_ENTRY_SIZE) {
+        return false;
+    }
+
+    texture.width = (int)width;
+    texture.height = (int)height;
+    texture.levels.resize(levelCount);
+    for (uint32_t i = 0; i < levelCount; ++i) {
+        const unsigned char* entry = data + KTX2_HEADER_SIZE + i * KTX2_LEVEL_ENTRY_SIZE;
+        uint64_t offset = Get64(entry);
+        uint64_t length = Get64(entry + 8);
+
+        COMPRESSED_TEXTURE::LEVEL& level = texture.levels[i];
+        level.width = std::max(1, (int)(width >> i));
+        level.height = std::max(1, (int)(height >> i));
+        if (length != LevelBytes(texture.format, level.width, level.height) ||
+            offset > size || length > size - offset) {
+            return false;
+        }
+        level.data = data + offset;
+        level.size = (size_t)length;
+    }
+    return true;
+}
@@ -0,0 +1,65 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecompression.h
+// ============
+// Block compression (BC1/BC3) with precomputed mip chains, stored in
+// KTX2 containers next to the source images
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum BLOCK_FORMAT
+{
+    // 8 bytes per 4x4 block, opaque RGB
+    BLOCK_BC1 = 0,
+    // 16 bytes per 4x4 block, RGB with interpolated alpha
+    BLOCK_BC3
+};
+
+/***********************************************************
+ *  COMPRESSED_TEXTURE
+ *
+ *  A block compressed image with its mip levels, largest
+ *  first. The level data points into memory owned by the
+ *  caller - usually a mapped KTX2 file.
+ ***********************************************************/
+struct COMPRESSED_TEXTURE
+{
+    struct LEVEL
+    {
+        int width;
+        int height;
+        const unsigned char* data;
+        size_t size;
+    };
+
+    BLOCK_FORMAT format;
+    int width;
+    int height;
+    std::vector<LEVEL> levels;
+};
+
+namespace TextureCompression
+{
+    // path of the compressed cache file for an image file
+    std::string GetCachePath(const std::string& imagePath);
+    // true when the cache file exists and is not older than the image
+    bool IsCacheCurrent(const std::string& imagePath);
+
+    // compress decoded 8-bit pixels (1 to 4 channels) and their
+    // box filtered mip chain down to 1x1; images with any
+    // transparent pixel become BC3, all others BC1
+    void CompressImage(const unsigned char* pixels, int width, int height, int channels,
+        BLOCK_FORMAT& format, std::vector<std::vector<unsigned char> >& levels);
+
+    // write compressed levels (largest first) to a KTX2 file
+    bool WriteKTX2(const char* filename, BLOCK_FORMAT format, int width, int height,
+        const std::vector<std::vector<unsigned char> >& levels);
+    // read the levels of a KTX2 file in memory without copying
+    // them; only files written by WriteKTX2() are accepted
+    bool ParseKTX2(const unsigned char* data, size_t size, COMPRESSED_TEXTURE& texture);
+}
@@ -0,0 +1,141 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecompiler.cpp
+// ============
+// Offline asset tool - converts the texture images into block compressed
+// KTX2 files with precomputed mip chains, which TextureCache loads instead
+// of decoding the images at startup
+//
+//  usage: TextureCompiler [--force] [image file or directory ...]
+//
+//  Without arguments every image in Textures/ is converted. Each image
+//  is written next to its source as <name>.ktx2; images whose cache file
+//  is already up to date are skipped unless --force is given.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../TextureCompression.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    const char* const DEFAULT_TEXTURE_DIRECTORY = "Textures";
+
+    bool IsImageFile(const std::filesystem::path& path) {
+        std::string extension = path.extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(),
+            [](unsigned char c) { return (char)tolower(c); });
+        return extension == ".jpg" || extension == ".jpeg" || extension == ".png" ||
+            extension == ".bmp" || extension == ".tga";
+    }
+
+    // add an image file, or every image file inside a directory
+    void CollectImages(const std::string& argument, std::vector<std::string>& images) {
+        std::error_code error;
+        if (std::filesystem::is_directory(argument, error)) {
+            std::vector<std::string> found;
+            for (std::filesystem::directory_iterator it(argument, error), end; it != end && !error; it.increment(error)) {
+                if (it->is_regular_file(error) && IsImageFile(it->path())) {
+                    found.push_back(it->path().generic_string());
+                }
+            }
+            std::sort(found.begin(), found.end());
+            images.insert(images.end(), found.begin(), found.end());
+        }
+        else {
+            images.push_back(argument);
+        }
+    }
+
+    // decode, compress and write one image
+    bool CompileImage(const std::string& image, std::string& report) {
+        int width = 0;
+        int height = 0;
+        int channels = 0;
+        unsigned char* pixels = stbi_load(image.c_str(), &width, &height, &channels, 0);
+        if (pixels == NULL) {
+            report = "ERROR: could not decode " + image;
+            return false;
+        }
+
+        BLOCK_FORMAT format;
+        std::vector<std::vector<unsigned char> > levels;
+        TextureCompression::CompressImage(pixels, width, height, channels, format, levels);
+        stbi_image_free(pixels);
+
+        std::string cachePath = TextureCompression::GetCachePath(image);
+        if (!TextureCompression::WriteKTX2(cachePath.c_str(), format, width, height, levels)) {
+            report = "ERROR: could not write " + cachePath;
+            return false;
+        }
+
+        size_t compressedBytes = 0;
+        for (size_t i = 0; i < levels.size(); ++i) {
+            compressedBytes += levels[i].size();
+        }
+        report = "INFO: " + cachePath + " " + std::to_string(width) + "x" + std::to_string(height) +
+            ((format == BLOCK_BC3) ? " BC3, " : " BC1, ") + std::to_string(levels.size()) + " levels, " +
+            std::to_string(compressedBytes / 1024) + " KB";
+        return true;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool force = false;
+    std::vector<std::string> images;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--force") == 0) {
+            force = true;
+        }
+        else {
+            CollectImages(argv[i], images);
+        }
+    }
+    if (argc == 1 || (argc == 2 && force)) {
+        CollectImages(DEFAULT_TEXTURE_DIRECTORY, images);
+    }
+
+    std::vector<std::string> pending;
+    for (size_t i = 0; i < images.size(); ++i) {
+        if (force || !TextureCompression::IsCacheCurrent(images[i])) {
+            pending.push_back(images[i]);
+        }
+    }
+    std::cout << "INFO: " << pending.size() << " of " << images.size() << " images need compressing" << std::endl;
+
+    // one image per worker at a time; the reports are
+    // printed in the order the images finish
+    std::atomic<size_t> next(0);
+    std::atomic<int> failures(0);
+    std::mutex outputMutex;
+    std::vector<std::thread> workers;
+    unsigned int numWorkers = std::max(1u, std::thread::hardware_concurrency());
+    numWorkers = (unsigned int)std::min<size_t>(numWorkers, pending.size());
+    for (unsigned int w = 0; w < numWorkers; ++w) {
+        workers.push_back(std::thread([&]() {
+            size_t i;
+            while ((i = next++) < pending.size()) {
+                std::string report;
+                if (!CompileImage(pending[i], report)) {
+                    ++failures;
+                }
+                std::lock_guard<std::mutex> lock(outputMutex);
+                std::cout << report << std::endl;
+            }
+        }));
+    }
+    for (size_t w = 0; w < workers.size(); ++w) {
+        workers[w].join();
+    }
+
+    return (failures == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
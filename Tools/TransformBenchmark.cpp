@@ -0,0 +1,153 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformbenchmark.cpp
+// ============
+// Microbenchmark of the batched model matrix kernel - times the glm
+// translate * rotate * rotate * rotate * scale product the kernel
+// replaces against every instruction set of the kernel this CPU supports
+//
+//  usage: TransformBenchmark [--repeat <n>] [object count ...]
+//
+//  Without counts it runs 1k, 10k, 100k and 1M objects. Each case is
+//  run --repeat times (default 5) and the fastest run is reported, with
+//  the largest difference of any matrix element from the glm result.
+///////////////////////////////////////////////////////////////////////////////
+
+#include "../TransformKernel.h"
+#include <glm/gtx/transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+namespace {
+    const int DEFAULT_REPEAT = 5;
+    const size_t DEFAULT_COUNTS[] = { 1000, 10000, 100000, 1000000 };
+    const size_t MATRIX_ALIGNMENT = 32;
+
+    // the matrix product the kernel replaces
+    glm::mat4 BuildModelMatrixGLM(const glm::vec3& scaleXYZ, const glm::vec3& rotationDegreesXYZ,
+        const glm::vec3& positionXYZ) {
+        return glm::translate(positionXYZ) *
+            glm::rotate(glm::radians(rotationDegreesXYZ.x), glm::vec3(1, 0, 0)) *
+            glm::rotate(glm::radians(rotationDegreesXYZ.y), glm::vec3(0, 1, 0)) *
+            glm::rotate(glm::radians(rotationDegreesXYZ.z), glm::vec3(0, 0, 1)) *
+            glm::scale(scaleXYZ);
+    }
+
+    // contiguous matrix buffer aligned for the widest stores
+    class MATRIX_BUFFER
+    {
+    public:
+        explicit MATRIX_BUFFER(size_t count)
+            : m_storage(count * sizeof(glm::mat4) + MATRIX_ALIGNMENT) {
+            size_t address = (size_t)m_storage.data();
+            m_matrices = (glm::mat4*)((address + MATRIX_ALIGNMENT - 1) & ~(MATRIX_ALIGNMENT - 1));
+        }
+        glm::mat4* Data() { return m_matrices; }
+
+    private:
+        std::vector<unsigned char> m_storage;
+        glm::mat4* m_matrices;
+    };
+
+    float MaxDifference(const glm::mat4* a, const glm::mat4* b, size_t count) {
+        float difference = 0.0f;
+        for (size_t i = 0; i < count; ++i) {
+            const float* x = (const float*)&a[i];
+            const float* y = (const float*)&b[i];
+            for (int e = 0; e < 16; ++e) {
+                difference = std::max(difference, std::abs(x[e] - y[e]));
+            }
+        }
+        return difference;
+    }
+
+    // fastest of several runs, in nanoseconds per object
+    template <typename FUNCTION>
+    double TimeRuns(int repeat, size_t count, FUNCTION function) {
+        double best = 1e30;
+        for (int run = 0; run < repeat; ++run) {
+            auto start = std::chrono::steady_clock::now();
+            function();
+            std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+            best = std::min(best, elapsed.count() / count);
+        }
+        return best;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int repeat = DEFAULT_REPEAT;
+    std::vector<size_t> counts;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc) {
+            repeat = std::max(1, atoi(argv[++i]));
+        }
+        else if (atol(argv[i]) > 0) {
+            counts.push_back((size_t)atol(argv[i]));
+        }
+        else {
+            std::cout << "ERROR: unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if (counts.empty()) {
+        counts.assign(std::begin(DEFAULT_COUNTS), std::end(DEFAULT_COUNTS));
+    }
+
+    TransformKernel::INSTRUCTION_SET supported = TransformKernel::GetSupportedInstructionSet();
+    std::cout << "INFO: best supported instruction set: "
+        << TransformKernel::GetInstructionSetName(supported) << std::endl;
+
+    for (size_t c = 0; c < counts.size(); ++c) {
+        size_t count = counts[c];
+        // transforms like the generated scenes': mostly upright
+        // objects with some axis-aligned and some arbitrary angles
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<glm::vec3> scale(count);
+        std::vector<glm::vec3> rotation(count);
+        std::vector<glm::vec3> position(count);
+        for (size_t i = 0; i < count; ++i) {
+            scale[i] = glm::vec3(0.2f + 2.0f * unit(random), 0.2f + 2.0f * unit(random), 0.2f + 2.0f * unit(random));
+            rotation[i] = glm::vec3(
+                unit(random) < 0.5f ? 0.0f : 90.0f * (int)(4.0f * unit(random)),
+                360.0f * unit(random) - 180.0f,
+                unit(random) < 0.8f ? 0.0f : 720.0f * unit(random) - 360.0f);
+            position[i] = glm::vec3(100.0f * unit(random) - 50.0f, 5.0f * unit(random), 100.0f * unit(random) - 50.0f);
+        }
+
+        MATRIX_BUFFER reference(count);
+        MATRIX_BUFFER output(count);
+        glm::mat4* referenceMatrices = reference.Data();
+        glm::mat4* outputMatrices = output.Data();
+
+        double glmTime = TimeRuns(repeat, count, [&]() {
+            for (size_t i = 0; i < count; ++i) {
+                referenceMatrices[i] = BuildModelMatrixGLM(scale[i], rotation[i], position[i]);
+            }
+        });
+        std::cout << std::fixed << std::setprecision(2)
+            << "INFO: " << std::setw(8) << count << " objects  glm     "
+            << std::setw(7) << glmTime << " ns/object" << std::endl;
+
+        for (int set = TransformKernel::INSTRUCTIONS_SCALAR; set <= (int)supported; ++set) {
+            TransformKernel::INSTRUCTION_SET instructionSet = (TransformKernel::INSTRUCTION_SET)set;
+            double time = TimeRuns(repeat, count, [&]() {
+                TransformKernel::BuildModelMatrices(instructionSet,
+                    scale.data(), rotation.data(), position.data(), count, outputMatrices);
+            });
+            std::cout << std::fixed << std::setprecision(2)
+                << "INFO: " << std::setw(8) << count << " objects  "
+                << std::left << std::setw(8) << TransformKernel::GetInstructionSetName(instructionSet) << std::right
+                << std::setw(7) << time << " ns/object  x" << glmTime / time
+                << std::scientific << std::setprecision(1)
+                << "  max difference " << MaxDifference(outputMatrices, referenceMatrices, count) << std::endl;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,403 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformkernel.cpp
+// ============
+// Batched model matrix construction from scale, Euler rotation and
+// position arrays, vectorized with SSE4.1 or AVX2 where the CPU has them
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TransformKernel.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define TRANSFORM_KERNEL_X86
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+// MSVC compiles intrinsics of any instruction set without flags
+#define TARGET_SSE4
+#define TARGET_AVX2
+#else
+#define TARGET_SSE4 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// the kernels read the vector arrays as packed floats
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "glm::vec3 must be tightly packed");
+static_assert(sizeof(glm::mat4) == 16 * sizeof(float), "glm::mat4 must be tightly packed");
+
+namespace {
+    // angle reduction: a = q * 90 + r with |r| <= 45 degrees
+    const float QUADRANT_DEGREES = 90.0f;
+    const float INVERSE_QUADRANT_DEGREES = 1.0f / 90.0f;
+    const float RADIANS_PER_DEGREE = 0.01745329251994329577f;
+    // minimax polynomials of sin and cos on [-pi/4, pi/4] (Cephes)
+    const float SIN_C1 = -1.6666654611e-1f;
+    const float SIN_C2 = 8.3321608736e-3f;
+    const float SIN_C3 = -1.9515295891e-4f;
+    const float COS_C1 = 4.166664568298827e-2f;
+    const float COS_C2 = -1.388731625493765e-3f;
+    const float COS_C3 = 2.443315711809948e-5f;
+
+    /***********************************************************
+     *  SinCos()
+     *
+     *  Scalar sine and cosine of an angle in degrees, with the
+     *  same steps as the SIMD versions below.
+     ***********************************************************/
+    void SinCos(float degrees, float& sine, float& cosine) {
+        float quadrant = nearbyintf(degrees * INVERSE_QUADRANT_DEGREES);
+        float x = (degrees - quadrant * QUADRANT_DEGREES) * RADIANS_PER_DEGREE;
+        float x2 = x * x;
+        float s = x + x * x2 * (SIN_C1 + x2 * (SIN_C2 + x2 * SIN_C3));
+        float c = 1.0f - 0.5f * x2 + x2 * x2 * (COS_C1 + x2 * (COS_C2 + x2 * COS_C3));
+
+        int q = (int)quadrant;
+        sine = (q & 1) ? c : s;
+        cosine = (q & 1) ? s : c;
+        if (q & 2) {
+            sine = -sine;
+        }
+        if ((q + 1) & 2) {
+            cosine = -cosine;
+        }
+    }
+
+    /***********************************************************
+     *  BuildScalar()
+     *
+     *  Closed form of T * Rx * Ry * Rz * S for one object at a
+     *  time; also finishes the SIMD versions' last objects.
+     ***********************************************************/
+    void BuildScalar(const glm::vec3* scale, const glm::vec3* rotation, const glm::vec3* position,
+        size_t count, glm::mat4* output) {
+        for (size_t i = 0; i < count; ++i) {
+            float sx, cx, sy, cy, sz, cz;
+            SinCos(rotation[i].x, sx, cx);
+            SinCos(rotation[i].y, sy, cy);
+            SinCos(rotation[i].z, sz, cz);
+            float sxsy = sx * sy;
+            float cxsy = cx * sy;
+
+            float* m = &output[i][0][0];
+            m[0] = (cy * cz) * scale[i].x;
+            m[1] = (cx * sz + sxsy * cz) * scale[i].x;
+            m[2] = (sx * sz - cxsy * cz) * scale[i].x;
+            m[3] = 0.0f;
+            m[4] = -(cy * sz) * scale[i].y;
+            m[5] = (cx * cz - sxsy * sz) * scale[i].y;
+            m[6] = (sx * cz + cxsy * sz) * scale[i].y;
+            m[7] = 0.0f;
+            m[8] = sy * scale[i].z;
+            m[9] = -(sx * cy) * scale[i].z;
+            m[10] = (cx * cy) * scale[i].z;
+            m[11] = 0.0f;
+            m[12] = position[i].x;
+            m[13] = position[i].y;
+            m[14] = position[i].z;
+            m[15] = 1.0f;
+        }
+    }
+
+#ifdef TRANSFORM_KERNEL_X86
+    /***********************************************************
+     *  SSE4.1 kernel - 4 objects per iteration
+     ***********************************************************/
+
+    // split 4 packed vec3s into their x, y and z components
+    TARGET_SSE4 void LoadVec3x4(const glm::vec3* vectors, __m128& x, __m128& y, __m128& z) {
+        const float* data = &vectors[0].x;
+        __m128 m0 = _mm_loadu_ps(data);        // x0 y0 z0 x1
+        __m128 m1 = _mm_loadu_ps(data + 4);    // y1 z1 x2 y2
+        __m128 m2 = _mm_loadu_ps(data + 8);    // z2 x3 y3 z3
+        __m128 t = _mm_shuffle_ps(m1, m2, _MM_SHUFFLE(2, 1, 3, 2));    // x2 y2 x3 y3
+        __m128 u = _mm_shuffle_ps(m0, m1, _MM_SHUFFLE(1, 0, 2, 1));    // y0 z0 y1 z1
+        x = _mm_shuffle_ps(m0, t, _MM_SHUFFLE(2, 0, 3, 0));
+        y = _mm_shuffle_ps(u, t, _MM_SHUFFLE(3, 1, 2, 0));
+        z = _mm_shuffle_ps(u, m2, _MM_SHUFFLE(3, 0, 3, 1));
+    }
+
+    TARGET_SSE4 void SinCos4(__m128 degrees, __m128& sine, __m128& cosine) {
+        __m128 quadrant = _mm_round_ps(_mm_mul_ps(degrees, _mm_set1_ps(INVERSE_QUADRANT_DEGREES)),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m128 x = _mm_mul_ps(_mm_sub_ps(degrees, _mm_mul_ps(quadrant, _mm_set1_ps(QUADRANT_DEGREES))),
+            _mm_set1_ps(RADIANS_PER_DEGREE));
+        __m128 x2 = _mm_mul_ps(x, x);
+        __m128 s = _mm_add_ps(_mm_set1_ps(SIN_C2), _mm_mul_ps(x2, _mm_set1_ps(SIN_C3)));
+        s = _mm_add_ps(_mm_set1_ps(SIN_C1), _mm_mul_ps(x2, s));
+        s = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, x2), s));
+        __m128 c = _mm_add_ps(_mm_set1_ps(COS_C2), _mm_mul_ps(x2, _mm_set1_ps(COS_C3)));
+        c = _mm_add_ps(_mm_set1_ps(COS_C1), _mm_mul_ps(x2, c));
+        c = _mm_add_ps(_mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(0.5f), x2)),
+            _mm_mul_ps(_mm_mul_ps(x2, x2), c));
+
+        // odd quadrants swap sine and cosine; bit 1 of q (sine) and
+        // of q + 1 (cosine) flips the sign
+        __m128i q = _mm_cvtps_epi32(quadrant);
+        __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+        __m128 sineSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30));
+        __m128 cosineSign = _mm_castsi128_ps(_mm_slli_epi32(
+            _mm_and_si128(_mm_add_epi32(q, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+        sine = _mm_xor_ps(_mm_blendv_ps(s, c, swap), sineSign);
+        cosine = _mm_xor_ps(_mm_blendv_ps(c, s, swap), cosineSign);
+    }
+
+    TARGET_SSE4 void BuildSSE4(const glm::vec3* scale, const glm::vec3* rotation, const glm::vec3* position,
+        size_t count, glm::mat4* output) {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128 scaleX, scaleY, scaleZ, angleX, angleY, angleZ, positionX, positionY, positionZ;
+            LoadVec3x4(scale + i, scaleX, scaleY, scaleZ);
+            LoadVec3x4(rotation + i, angleX, angleY, angleZ);
+            LoadVec3x4(position + i, positionX, positionY, positionZ);
+
+            __m128 sx, cx, sy, cy, sz, cz;
+            SinCos4(angleX, sx, cx);
+            SinCos4(angleY, sy, cy);
+            SinCos4(angleZ, sz, cz);
+            __m128 sxsy = _mm_mul_ps(sx, sy);
+            __m128 cxsy = _mm_mul_ps(cx, sy);
+            __m128 negate = _mm_set1_ps(-0.0f);
+
+            // one register per matrix row of each column, for 4 objects
+            __m128 column0[4] = {
+                _mm_mul_ps(_mm_mul_ps(cy, cz), scaleX),
+                _mm_mul_ps(_mm_add_ps(_mm_mul_ps(cx, sz), _mm_mul_ps(sxsy, cz)), scaleX),
+                _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(sx, sz), _mm_mul_ps(cxsy, cz)), scaleX),
+                _mm_setzero_ps() };
+            __m128 column1[4] = {
+                _mm_mul_ps(_mm_xor_ps(_mm_mul_ps(cy, sz), negate), scaleY),
+                _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(cx, cz), _mm_mul_ps(sxsy, sz)), scaleY),
+                _mm_mul_ps(_mm_add_ps(_mm_mul_ps(sx, cz), _mm_mul_ps(cxsy, sz)), scaleY),
+                _mm_setzero_ps() };
+            __m128 column2[4] = {
+                _mm_mul_ps(sy, scaleZ),
+                _mm_mul_ps(_mm_xor_ps(_mm_mul_ps(sx, cy), negate), scaleZ),
+                _mm_mul_ps(_mm_mul_ps(cx, cy), scaleZ),
+                _mm_setzero_ps() };
+            __m128 column3[4] = { positionX, positionY, positionZ, _mm_set1_ps(1.0f) };
+
+            // transposing turns the rows of 4 objects into each object's column
+            _MM_TRANSPOSE4_PS(column0[0], column0[1], column0[2], column0[3]);
+            _MM_TRANSPOSE4_PS(column1[0], column1[1], column1[2], column1[3]);
+            _MM_TRANSPOSE4_PS(column2[0], column2[1], column2[2], column2[3]);
+            _MM_TRANSPOSE4_PS(column3[0], column3[1], column3[2], column3[3]);
+            for (int k = 0; k < 4; ++k) {
+                float* m = &output[i + k][0][0];
+                _mm_storeu_ps(m, column0[k]);
+                _mm_storeu_ps(m + 4, column1[k]);
+                _mm_storeu_ps(m + 8, column2[k]);
+                _mm_storeu_ps(m + 12, column3[k]);
+            }
+        }
+        BuildScalar(scale + i, rotation + i, position + i, count - i, output + i);
+    }
+
+    /***********************************************************
+     *  AVX2 kernel - 8 objects per iteration
+     ***********************************************************/
+
+    // split 8 packed vec3s into their x, y and z components
+    TARGET_AVX2 void LoadVec3x8(const glm::vec3* vectors, __m256& x, __m256& y, __m256& z) {
+        const float* data = &vectors[0].x;
+        __m256 m03 = _mm256_castps128_ps256(_mm_loadu_ps(data));
+        __m256 m14 = _mm256_castps128_ps256(_mm_loadu_ps(data + 4));
+        __m256 m25 = _mm256_castps128_ps256(_mm_loadu_ps(data + 8));
+        m03 = _mm256_insertf128_ps(m03, _mm_loadu_ps(data + 12), 1);
+        m14 = _mm256_insertf128_ps(m14, _mm_loadu_ps(data + 16), 1);
+        m25 = _mm256_insertf128_ps(m25, _mm_loadu_ps(data + 20), 1);
+        // the same shuffles as LoadVec3x4, on both 128-bit halves
+        __m256 t = _mm256_shuffle_ps(m14, m25, _MM_SHUFFLE(2, 1, 3, 2));
+        __m256 u = _mm256_shuffle_ps(m03, m14, _MM_SHUFFLE(1, 0, 2, 1));
+        x = _mm256_shuffle_ps(m03, t, _MM_SHUFFLE(2, 0, 3, 0));
+        y = _mm256_shuffle_ps(u, t, _MM_SHUFFLE(3, 1, 2, 0));
+        z = _mm256_shuffle_ps(u, m25, _MM_SHUFFLE(3, 0, 3, 1));
+    }
+
+    TARGET_AVX2 void SinCos8(__m256 degrees, __m256& sine, __m256& cosine) {
+        __m256 quadrant = _mm256_round_ps(_mm256_mul_ps(degrees, _mm256_set1_ps(INVERSE_QUADRANT_DEGREES)),
+            _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+        __m256 x = _mm256_mul_ps(_mm256_sub_ps(degrees, _mm256_mul_ps(quadrant, _mm256_set1_ps(QUADRANT_DEGREES))),
+            _mm256_set1_ps(RADIANS_PER_DEGREE));
+        __m256 x2 = _mm256_mul_ps(x, x);
+        __m256 s = _mm256_add_ps(_mm256_set1_ps(SIN_C2), _mm256_mul_ps(x2, _mm256_set1_ps(SIN_C3)));
+        s = _mm256_add_ps(_mm256_set1_ps(SIN_C1), _mm256_mul_ps(x2, s));
+        s = _mm256_add_ps(x, _mm256_mul_ps(_mm256_mul_ps(x, x2), s));
+        __m256 c = _mm256_add_ps(_mm256_set1_ps(COS_C2), _mm256_mul_ps(x2, _mm256_set1_ps(COS_C3)));
+        c = _mm256_add_ps(_mm256_set1_ps(COS_C1), _mm256_mul_ps(x2, c));
+        c = _mm256_add_ps(_mm256_sub_ps(_mm256_set1_ps(1.0f), _mm256_mul_ps(_mm256_set1_ps(0.5f), x2)),
+            _mm256_mul_ps(_mm256_mul_ps(x2, x2), c));
+
+        __m256i q = _mm256_cvtps_epi32(quadrant);
+        __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+            _mm256_and_si256(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+        __m256 sineSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30));
+        __m256 cosineSign = _mm256_castsi256_ps(_mm256_slli_epi32(
+            _mm256_and_si256(_mm256_add_epi32(q, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+        sine = _mm256_xor_ps(_mm256_blendv_ps(s, c, swap), sineSign);
+        cosine = _mm256_xor_ps(_mm256_blendv_ps(c, s, swap), cosineSign);
+    }
+
+    // 4x4 transpose inside each 128-bit half
+    TARGET_AVX2 void Transpose4x4x2(__m256& r0, __m256& r1, __m256& r2, __m256& r3) {
+        __m256 t0 = _mm256_unpacklo_ps(r0, r1);
+        __m256 t1 = _mm256_unpacklo_ps(r2, r3);
+        __m256 t2 = _mm256_unpackhi_ps(r0, r1);
+        __m256 t3 = _mm256_unpackhi_ps(r2, r3);
+        r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+        r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+        r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+        r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+    }
+
+    TARGET_AVX2 void BuildAVX2(const glm::vec3* scale, const glm::vec3* rotation, const glm::vec3* position,
+        size_t count, glm::mat4* output) {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256 scaleX, scaleY, scaleZ, angleX, angleY, angleZ, positionX, positionY, positionZ;
+            LoadVec3x8(scale + i, scaleX, scaleY, scaleZ);
+            LoadVec3x8(rotation + i, angleX, angleY, angleZ);
+            LoadVec3x8(position + i, positionX, positionY, positionZ);
+
+            __m256 sx, cx, sy, cy, sz, cz;
+            SinCos8(angleX, sx, cx);
+            SinCos8(angleY, sy, cy);
+            SinCos8(angleZ, sz, cz);
+            __m256 sxsy = _mm256_mul_ps(sx, sy);
+            __m256 cxsy = _mm256_mul_ps(cx, sy);
+            __m256 negate = _mm256_set1_ps(-0.0f);
+
+            __m256 column0[4] = {
+                _mm256_mul_ps(_mm256_mul_ps(cy, cz), scaleX),
+                _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(cx, sz), _mm256_mul_ps(sxsy, cz)), scaleX),
+                _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(sx, sz), _mm256_mul_ps(cxsy, cz)), scaleX),
+                _mm256_setzero_ps() };
+            __m256 column1[4] = {
+                _mm256_mul_ps(_mm256_xor_ps(_mm256_mul_ps(cy, sz), negate), scaleY),
+                _mm256_mul_ps(_mm256_sub_ps(_mm256_mul_ps(cx, cz), _mm256_mul_ps(sxsy, sz)), scaleY),
+                _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(sx, cz), _mm256_mul_ps(cxsy, sz)), scaleY),
+                _mm256_setzero_ps() };
+            __m256 column2[4] = {
+                _mm256_mul_ps(sy, scaleZ),
+                _mm256_mul_ps(_mm256_xor_ps(_mm256_mul_ps(sx, cy), negate), scaleZ),
+                _mm256_mul_ps(_mm256_mul_ps(cx, cy), scaleZ),
+                _mm256_setzero_ps() };
+            __m256 column3[4] = { positionX, positionY, positionZ, _mm256_set1_ps(1.0f) };
+
+            // register k now holds column j of objects k (low half) and k + 4
+            Transpose4x4x2(column0[0], column0[1], column0[2], column0[3]);
+            Transpose4x4x2(column1[0], column1[1], column1[2], column1[3]);
+            Transpose4x4x2(column2[0], column2[1], column2[2], column2[3]);
+            Transpose4x4x2(column3[0], column3[1], column3[2], column3[3]);
+            for (int k = 0; k < 4; ++k) {
+                float* low = &output[i + k][0][0];
+                float* high = &output[i + k + 4][0][0];
+                _mm256_storeu_ps(low, _mm256_permute2f128_ps(column0[k], column1[k], 0x20));
+                _mm256_storeu_ps(low + 8, _mm256_permute2f128_ps(column2[k], column3[k], 0x20));
+                _mm256_storeu_ps(high, _mm256_permute2f128_ps(column0[k], column1[k], 0x31));
+                _mm256_storeu_ps(high + 8, _mm256_permute2f128_ps(column2[k], column3[k], 0x31));
+            }
+        }
+        BuildScalar(scale + i, rotation + i, position + i, count - i, output + i);
+    }
+
+    /***********************************************************
+     *  DetectInstructionSet()
+     *
+     *  CPUID feature bits; AVX2 also needs the operating
+     *  system to save the YMM registers (OSXSAVE and XCR0).
+     ***********************************************************/
+    TransformKernel::INSTRUCTION_SET DetectInstructionSet() {
+#if defined(_MSC_VER)
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool sse41 = (info[2] & (1 << 19)) != 0;
+        bool osAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+            (_xgetbv(0) & 0x6) == 0x6;
+        bool avx2 = false;
+        if (maxLeaf >= 7 && osAvx) {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        bool sse41 = __builtin_cpu_supports("sse4.1") != 0;
+        bool avx2 = __builtin_cpu_supports("avx2") != 0;
+#endif
+        if (avx2) {
+            return TransformKernel::INSTRUCTIONS_AVX2;
+        }
+        return sse41 ? TransformKernel::INSTRUCTIONS_SSE4 : TransformKernel::INSTRUCTIONS_SCALAR;
+    }
+#else
+    TransformKernel::INSTRUCTION_SET DetectInstructionSet() {
+        return TransformKernel::INSTRUCTIONS_SCALAR;
+    }
+#endif
+}
+
+/***********************************************************
+ *  GetSupportedInstructionSet()
+ *
+ *  This function returns the best instruction set of the
+ *  CPU, detected on the first call.
+ ***********************************************************/
+TransformKernel::INSTRUCTION_SET TransformKernel::GetSupportedInstructionSet() {
+    static const INSTRUCTION_SET supported = DetectInstructionSet();
+    return supported;
+}
+
+const char* TransformKernel::GetInstructionSetName(INSTRUCTION_SET instructionSet) {
+    switch (instructionSet) {
+    case INSTRUCTIONS_SSE4: return "SSE4.1";
+    case INSTRUCTIONS_AVX2: return "AVX2";
+    default: return "scalar";
+    }
+}
+
+/***********************************************************
+ *  BuildModelMatrices()
+ *
+ *  This function builds the model matrices with the best
+ *  instruction set the CPU supports.
+ ***********************************************************/
+void TransformKernel::BuildModelMatrices(
+    const glm::vec3* scaleXYZ,
+    const glm::vec3* rotationDegreesXYZ,
+    const glm::vec3* positionXYZ,
+    size_t count,
+    glm::mat4* output) {
+    BuildModelMatrices(GetSupportedInstructionSet(), scaleXYZ, rotationDegreesXYZ, positionXYZ, count, output);
+}
+
+/***********************************************************
+ *  BuildModelMatrices()
+ *
+ *  This function builds the model matrices with a given
+ *  instruction set.
+ ***********************************************************/
+void TransformKernel::BuildModelMatrices(
+    INSTRUCTION_SET instructionSet,
+    const glm::vec3* scaleXYZ,
+    const glm::vec3* rotationDegreesXYZ,
+    const glm::vec3* positionXYZ,
+    size_t count,
+    glm::mat4* output) {
+    switch (instructionSet) {
+#ifdef TRANSFORM_KERNEL_X86
+    case INSTRUCTIONS_AVX2:
+        BuildAVX2(scaleXYZ, rotationDegreesXYZ, positionXYZ, count, output);
+        break;
+    case INSTRUCTIONS_SSE4:
+        BuildSSE4(scaleXYZ, rotationDegreesXYZ, positionXYZ, count, output);
+        break;
+#endif
+    default:
+        BuildScalar(scaleXYZ, rotationDegreesXYZ, positionXYZ, count, output);
+        break;
+    }
+}
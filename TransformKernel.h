@@ -0,0 +1,57 @@
+///////////////////////////////////////////////////////////////////////////////
+// transformkernel.h
+// ============
+// Batched model matrix construction from scale, Euler rotation and
+// position arrays, vectorized with SSE4.1 or AVX2 where the CPU has them
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+
+/***********************************************************
+ *  TransformKernel
+ *
+ *  Builds translate * rotateX * rotateY * rotateZ * scale
+ *  (rotations in degrees) in closed form instead of
+ *  multiplying five matrices: the rotation columns are
+ *  written directly from the sines and cosines of the
+ *  three angles. The SIMD versions build 4 (SSE4.1) or 8
+ *  (AVX2) matrices at once; the instruction set is picked
+ *  at runtime from what the CPU supports. Every version
+ *  uses the same sine/cosine approximation, reduced in
+ *  degrees so multiples of 90 degrees are exact, and the
+ *  same operation order, so all give identical matrices.
+ ***********************************************************/
+namespace TransformKernel
+{
+    enum INSTRUCTION_SET
+    {
+        INSTRUCTIONS_SCALAR = 0,
+        INSTRUCTIONS_SSE4,
+        INSTRUCTIONS_AVX2
+    };
+
+    // best instruction set this CPU supports (detected once)
+    INSTRUCTION_SET GetSupportedInstructionSet();
+    // printable name of an instruction set
+    const char* GetInstructionSetName(INSTRUCTION_SET instructionSet);
+
+    // build count model matrices from the input arrays, using the best
+    // supported instruction set; the output is best 32 byte aligned
+    void BuildModelMatrices(
+        const glm::vec3* scaleXYZ,
+        const glm::vec3* rotationDegreesXYZ,
+        const glm::vec3* positionXYZ,
+        size_t count,
+        glm::mat4* output);
+    // the same with a given instruction set, which must be supported
+    void BuildModelMatrices(
+        INSTRUCTION_SET instructionSet,
+        const glm::vec3* scaleXYZ,
+        const glm::vec3* rotationDegreesXYZ,
+        const glm::vec3* positionXYZ,
+        size_t count,
+        glm::mat4* output);
+}
@@ -0,0 +1,230 @@
+///////////////////////////////////////////////////////////////////////////////
+// uploadring.cpp
+// ============
+// Triple-buffered ring of per-frame dynamic GPU data, written directly
+// into persistently mapped buffer memory from any thread
+///////////////////////////////////////////////////////////////////////////////
+
+#include "UploadRing.h"
+#include "FrameStats.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+namespace {
+    // frame sizes are rounded up to a multiple of this
+    const size_t FRAME_SIZE_GRANULARITY = 64 * 1024;
+    // nanoseconds a fence wait blocks before it is retried
+    const GLuint64 FENCE_TIMEOUT = 1000000000;
+}
+
+/***********************************************************
+ *  UploadRing()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+UploadRing::UploadRing() {
+    m_buffer = 0;
+    m_frameSize = FRAME_SIZE_GRANULARITY;
+    m_persistent = false;
+    m_mapped = NULL;
+    for (int i = 0; i < FRAME_COUNT; ++i) {
+        m_frames[i].used = 0;
+        m_frames[i].fence = NULL;
+    }
+    m_nextFrame = 0;
+}
+
+/***********************************************************
+ *  ~UploadRing()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+UploadRing::~UploadRing() {
+    DeleteBuffer();
+}
+
+/***********************************************************
+ *  CreateBuffer()
+ *
+ *  This method creates the ring's buffer and maps it for
+ *  good where buffer storage is available.
+ ***********************************************************/
+void UploadRing::CreateBuffer() {
+#ifdef __APPLE__
+    // OpenGL 4.1 has no buffer storage
+    bool bufferStorage = false;
+#else
+    bool bufferStorage = GLEW_ARB_buffer_storage ? true : false;
+#endif
+    GLsizeiptr totalSize = (GLsizeiptr)(m_frameSize * FRAME_COUNT);
+    glGenBuffers(1, &m_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    m_persistent = false;
+    if (bufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, totalSize, NULL, flags);
+        m_mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, totalSize, flags);
+        m_persistent = (m_mapped != NULL);
+    }
+    else {
+        glBufferData(GL_ARRAY_BUFFER, totalSize, NULL, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if (!m_persistent) {
+        m_staging.resize((size_t)totalSize);
+    }
+    std::cout << "INFO: upload ring of " << FRAME_COUNT << " x " << m_frameSize / 1024 << " KB, "
+        << (m_persistent ? "persistently mapped" : "copied per frame") << std::endl;
+}
+
+/***********************************************************
+ *  DeleteBuffer()
+ *
+ *  This method waits for every frame and deletes the buffer.
+ ***********************************************************/
+void UploadRing::DeleteBuffer() {
+    for (int i = 0; i < FRAME_COUNT; ++i) {
+        WaitForFrame(i);
+        m_frames[i].used = 0;
+    }
+    if (m_buffer != 0) {
+        if (m_persistent) {
+            glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+    }
+    m_mapped = NULL;
+    m_persistent = false;
+    std::vector<unsigned char>().swap(m_staging);
+}
+
+/***********************************************************
+ *  Reserve()
+ *
+ *  This method grows the frames to hold at least frameSize
+ *  bytes. The old buffer is only deleted once the GPU has
+ *  finished with all of it.
+ ***********************************************************/
+void UploadRing::Reserve(size_t frameSize) {
+    if (m_buffer != 0 && frameSize <= m_frameSize) {
+        return;
+    }
+    DeleteBuffer();
+    size_t granules = (frameSize + FRAME_SIZE_GRANULARITY - 1) / FRAME_SIZE_GRANULARITY;
+    m_frameSize = std::max(m_frameSize, std::max(granules, (size_t)1) * FRAME_SIZE_GRANULARITY);
+    CreateBuffer();
+}
+
+/***********************************************************
+ *  WaitForFrame()
+ *
+ *  This method blocks until the GPU has passed the fence of
+ *  a frame, then deletes the fence.
+ ***********************************************************/
+void UploadRing::WaitForFrame(int frame) {
+    GLsync& fence = m_frames[frame].fence;
+    if (fence == NULL) {
+        return;
+    }
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_TIMEOUT_EXPIRED) {
+        PROFILE_CPU_SCOPE("WaitForUploadFrame");
+        do {
+            result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+        } while (result == GL_TIMEOUT_EXPIRED);
+    }
+    if (result == GL_WAIT_FAILED) {
+        std::cout << "ERROR: waiting for an upload frame fence failed" << std::endl;
+    }
+    glDeleteSync(fence);
+    fence = NULL;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method hands out the next frame of the ring once
+ *  the GPU is done with it, emptied.
+ ***********************************************************/
+int UploadRing::BeginFrame() {
+    if (m_buffer == 0) {
+        CreateBuffer();
+    }
+    int frame = m_nextFrame;
+    m_nextFrame = (m_nextFrame + 1) % FRAME_COUNT;
+    WaitForFrame(frame);
+    m_frames[frame].used = 0;
+    return frame;
+}
+
+/***********************************************************
+ *  Allocate()
+ *
+ *  This method bumps the frame's fill level past an aligned
+ *  block. Threads race on the fill level with a compare and
+ *  swap, so allocating never takes a lock.
+ ***********************************************************/
+UPLOAD_ALLOCATION UploadRing::Allocate(int frame, size_t size, size_t alignment) {
+    UPLOAD_ALLOCATION allocation = { NULL, 0 };
+    std::atomic<size_t>& used = m_frames[frame].used;
+    size_t start;
+    size_t current = used.load(std::memory_order_relaxed);
+    do {
+        start = (current + alignment - 1) / alignment * alignment;
+        if (start + size > m_frameSize) {
+            return allocation;
+        }
+    } while (!used.compare_exchange_weak(current, start + size, std::memory_order_relaxed));
+
+    allocation.offset = (GLintptr)(m_frameSize * frame + start);
+    allocation.data = (m_persistent ? m_mapped : m_staging.data()) + allocation.offset;
+    return allocation;
+}
+
+/***********************************************************
+ *  Flush()
+ *
+ *  This method copies the used part of a frame into the
+ *  buffer when it is not persistently mapped. The frame's
+ *  fence has been waited for, so the mapping needs no
+ *  synchronization; coherent mappings need nothing at all.
+ ***********************************************************/
+void UploadRing::Flush(int frame) {
+    size_t used = m_frames[frame].used.load(std::memory_order_relaxed);
+    if (m_persistent || used == 0) {
+        return;
+    }
+    GLintptr offset = (GLintptr)(m_frameSize * frame);
+    glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset, (GLsizeiptr)used,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if (mapped != NULL) {
+        memcpy(mapped, m_staging.data() + offset, used);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    else {
+        glBufferSubData(GL_ARRAY_BUFFER, offset, (GLsizeiptr)used, m_staging.data() + offset);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    FrameStats::Current().glCalls += 4;
+    ++FrameStats::Current().bufferUploads;
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method fences a frame behind the commands issued so
+ *  far, which include every draw reading it.
+ ***********************************************************/
+void UploadRing::EndFrame(int frame) {
+    if (m_frames[frame].fence != NULL) {
+        glDeleteSync(m_frames[frame].fence);
+    }
+    m_frames[frame].fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ++FrameStats::Current().glCalls;
+}
@@ -0,0 +1,95 @@
+///////////////////////////////////////////////////////////////////////////////
+// uploadring.h
+// ============
+// Triple-buffered ring of per-frame dynamic GPU data, written directly
+// into persistently mapped buffer memory from any thread
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/***********************************************************
+ *  UPLOAD_ALLOCATION
+ *
+ *  Memory handed out by UploadRing::Allocate(): data is
+ *  where the CPU writes, offset where the GPU reads it in
+ *  the ring's buffer. data is NULL when the frame is full.
+ ***********************************************************/
+struct UPLOAD_ALLOCATION
+{
+    void* data;
+    GLintptr offset;
+};
+
+/***********************************************************
+ *  UploadRing
+ *
+ *  One buffer split into FRAME_COUNT equal frames. A frame
+ *  is filled by a lock-free bump allocator, read by the
+ *  draws it was filled for and fenced after them, and is
+ *  not handed out again until the GPU has passed its
+ *  fence, so writing never waits for (or disturbs) draws
+ *  in flight. With ARB_buffer_storage the buffer is mapped
+ *  once, persistently and coherently, and the data needs no
+ *  upload at all. Without it (OpenGL 4.1 on macOS) frames
+ *  are written to CPU memory and Flush() copies the used
+ *  part into the buffer with an unsynchronized mapping.
+ ***********************************************************/
+class UploadRing
+{
+public:
+    static const int FRAME_COUNT = 3;
+
+    // constructor
+    UploadRing();
+    // destructor
+    ~UploadRing();
+
+    // make every frame hold at least frameSize bytes; waits for the
+    // GPU and recreates the buffer when it must grow, so no
+    // allocation may be in use
+    void Reserve(size_t frameSize);
+
+    // start filling the next frame and return its index; waits
+    // until the GPU has finished the draws that read it last
+    int BeginFrame();
+    // reserve memory in a frame (any thread, lock-free)
+    UPLOAD_ALLOCATION Allocate(int frame, size_t size, size_t alignment);
+    // make the frame's data visible to the GPU before drawing it
+    void Flush(int frame);
+    // fence the frame after the draws that read it
+    void EndFrame(int frame);
+
+    // buffer holding every frame
+    GLuint GetBuffer() const { return m_buffer; }
+    // true when the buffer is persistently mapped
+    bool IsPersistent() const { return m_persistent; }
+
+private:
+    struct UPLOAD_FRAME
+    {
+        // bytes handed out since BeginFrame()
+        std::atomic<size_t> used;
+        // signalled when the GPU has finished the frame's draws
+        GLsync fence;
+    };
+
+    GLuint m_buffer;
+    size_t m_frameSize;
+    bool m_persistent;
+    // persistent mapping, or CPU copies of the frames without one
+    unsigned char* m_mapped;
+    std::vector<unsigned char> m_staging;
+    UPLOAD_FRAME m_frames[FRAME_COUNT];
+    int m_nextFrame;
+
+    // wait for and delete the fence of a frame
+    void WaitForFrame(int frame);
+    // create the buffer holding FRAME_COUNT frames of m_frameSize bytes
+    void CreateBuffer();
+    void DeleteBuffer();
+};
@@ -8,6 +8,7 @@
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "ViewManager.h"
+#include "FrameScheduler.h"
 #include "Camera.h"
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
@@ -15,10 +16,18 @@
 
 // Namespace for declaring global variables
 namespace {
-    // Window width and height
+    // Initial window width and height
     const int WINDOW_WIDTH = 1000;
     const int WINDOW_HEIGHT = 800;
 
+    // Current framebuffer size in pixels, which differs from the
+    // window size on high DPI displays and follows window resizes
+    int gFramebufferWidth = WINDOW_WIDTH;
+    int gFramebufferHeight = WINDOW_HEIGHT;
+
+    // Half the height of the orthographic view volume
+    const float ORTHOGRAPHIC_HALF_HEIGHT = 10.0f;
+
     // Camera object for interacting with the scene
     Camera* g_pCamera = nullptr;
 
@@ -26,6 +35,9 @@ namespace {
     float gLastX = WINDOW_WIDTH / 2.0f;
     float gLastY = WINDOW_HEIGHT / 2.0f;
     bool gFirstMouse = true;
+    // Mouse movement received since the camera was last latched
+    float gMouseOffsetX = 0.0f;
+    float gMouseOffsetY = 0.0f;
 
     // Time between current frame and last frame
     float gDeltaTime = 0.0f;
@@ -33,6 +45,16 @@ namespace {
 
     // Track if orthographic projection is active
     bool bOrthographicProjection = false;
+    // Track if the camera is drawn together with the top, front
+    // and side orthographic views
+    bool bMultiView = false;
+
+    // Distance of the orthographic views' eye from the scene origin
+    const float ORTHOGRAPHIC_VIEW_DISTANCE = 50.0f;
+
+    // Longest frame time applied to camera movement, so the first
+    // frame after an idle wait in render-on-demand mode does not jump
+    const float MAX_FRAME_DELTA = 0.1f;
 }
 
 /***********************************************************
@@ -43,6 +65,7 @@ namespace {
 ViewManager::ViewManager(ShaderManager* pShaderManager) {
     // Initialize the member variables
     m_pShaderManager = pShaderManager;
+    m_pShaderUniforms = NULL;
     m_pWindow = NULL;
     g_pCamera = new Camera();
     // Set default camera position and orientation
@@ -81,6 +104,10 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle) {
 
     // Capture all mouse events
     glfwSetCursorPosCallback(window, &ViewManager::Mouse_Position_Callback);
+    // Redraw when the window is resized or needs repainting
+    glfwSetFramebufferSizeCallback(window, &ViewManager::Framebuffer_Size_Callback);
+    glfwSetWindowRefreshCallback(window, &ViewManager::Window_Refresh_Callback);
+    glfwGetFramebufferSize(window, &gFramebufferWidth, &gFramebufferHeight);
 
     // Enable blending for transparent rendering
     glEnable(GL_BLEND);
@@ -95,7 +122,8 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle) {
  *
  *  This method is called to process any keyboard events
  *  that may be waiting in the event queue. Handles camera
- *  movement (WASD, QE) and projection toggling (P/O).
+ *  movement (WASD, QE), projection toggling (P/O) and the
+ *  multi-view mode (M).
  ***********************************************************/
 void ViewManager::ProcessKeyboardEvents() {
     // Close window if ESC key is pressed
@@ -104,13 +132,25 @@ void ViewManager::ProcessKeyboardEvents() {
     }
 
     // Toggle between perspective and orthographic projection
-    if (glfwGetKey(m_pWindow, GLFW_KEY_P) == GLFW_PRESS)
+    // or show the camera with the top, front and side views
+    bool wasOrthographic = bOrthographicProjection;
+    bool wasMultiView = bMultiView;
+    if (glfwGetKey(m_pWindow, GLFW_KEY_P) == GLFW_PRESS) {
         bOrthographicProjection = false;  // Perspective view
-    if (glfwGetKey(m_pWindow, GLFW_KEY_O) == GLFW_PRESS)
+        bMultiView = false;
+    }
+    if (glfwGetKey(m_pWindow, GLFW_KEY_O) == GLFW_PRESS) {
         bOrthographicProjection = true;   // Orthographic view
+        bMultiView = false;
+    }
+    if (glfwGetKey(m_pWindow, GLFW_KEY_M) == GLFW_PRESS)
+        bMultiView = true;                // Perspective plus top/front/side views
+    if (bOrthographicProjection != wasOrthographic || bMultiView != wasMultiView)
+        FrameScheduler::RequestRedraw();
 
     // Camera movement with WASD keys
     float cameraSpeed = 2.5f * gDeltaTime; // Adjust speed based on deltaTime
+    glm::vec3 startPosition = g_pCamera->Position;
     if (glfwGetKey(m_pWindow, GLFW_KEY_W) == GLFW_PRESS)
         g_pCamera->Position += cameraSpeed * g_pCamera->Front;
     if (glfwGetKey(m_pWindow, GLFW_KEY_S) == GLFW_PRESS)
@@ -123,44 +163,144 @@ void ViewManager::ProcessKeyboardEvents() {
         g_pCamera->Position.y += cameraSpeed; // Move up
     if (glfwGetKey(m_pWindow, GLFW_KEY_E) == GLFW_PRESS)
         g_pCamera->Position.y -= cameraSpeed; // Move down
+
+    // A held key keeps moving the camera without sending new events
+    if (g_pCamera->Position != startPosition) {
+        FrameScheduler::MarkInput();
+        FrameScheduler::RequestContinuousRedraw();
+    }
 }
 
 /***********************************************************
- *  PrepareSceneView()
+ *  ApplyMouseMovement()
  *
- *  This method is used for preparing the 3D scene by loading
- *  the shapes, textures in memory to support the 3D scene
- *  rendering.
+ *  This method turns the camera by the mouse movement that
+ *  arrived since the last frame. The callback only gathers
+ *  the movement, so keyboard and mouse input both reach the
+ *  camera at the same point, just before the frame's view
+ *  matrix is built.
  ***********************************************************/
-void ViewManager::PrepareSceneView() {
-    glm::mat4 view;
-    glm::mat4 projection;
+void ViewManager::ApplyMouseMovement() {
+    if (gMouseOffsetX == 0.0f && gMouseOffsetY == 0.0f) {
+        return;
+    }
+
+    float sensitivity = 0.1f; // Adjust the sensitivity if needed
+    g_pCamera->Yaw += gMouseOffsetX * sensitivity;
+    g_pCamera->Pitch += gMouseOffsetY * sensitivity;
+    gMouseOffsetX = 0.0f;
+    gMouseOffsetY = 0.0f;
+
+    // Constrain the pitch to avoid screen flip
+    if (g_pCamera->Pitch > 89.0f)
+        g_pCamera->Pitch = 89.0f;
+    if (g_pCamera->Pitch < -89.0f)
+        g_pCamera->Pitch = -89.0f;
+
+    // Update camera front vector based on yaw and pitch
+    glm::vec3 front;
+    front.x = cos(glm::radians(g_pCamera->Yaw)) * cos(glm::radians(g_pCamera->Pitch));
+    front.y = sin(glm::radians(g_pCamera->Pitch));
+    front.z = sin(glm::radians(g_pCamera->Yaw)) * cos(glm::radians(g_pCamera->Pitch));
+    g_pCamera->Front = glm::normalize(front);
+}
 
+/***********************************************************
+ *  ProcessInput()
+ *
+ *  This method moves the camera by the input that arrived
+ *  since the last loop iteration. It runs whether or not a
+ *  frame is drawn, because the input is what requests
+ *  frames in render-on-demand mode.
+ ***********************************************************/
+void ViewManager::ProcessInput() {
     // Per-frame timing
     float currentFrame = glfwGetTime();
     gDeltaTime = currentFrame - gLastFrame;
     gLastFrame = currentFrame;
+    if (gDeltaTime > MAX_FRAME_DELTA) {
+        gDeltaTime = MAX_FRAME_DELTA;
+    }
 
-    // Process any keyboard events that may be waiting in the event queue
+    // Latch the camera from the input that arrived since the last
+    // frame: the held keys and the gathered mouse movement
     ProcessKeyboardEvents();
+    ApplyMouseMovement();
+}
+
+/***********************************************************
+ *  PrepareSceneView()
+ *
+ *  This method is used for preparing the 3D scene by loading
+ *  the shapes, textures in memory to support the 3D scene
+ *  rendering.
+ ***********************************************************/
+void ViewManager::PrepareSceneView() {
+    glm::mat4 view;
+    glm::mat4 projection;
 
     // Get the current view matrix from the camera
     view = g_pCamera->GetViewMatrix();
 
-    // Define the current projection matrix
+    // Define the current projection matrix for the framebuffer's
+    // aspect ratio (a minimized window has no framebuffer at all)
+    GLfloat aspect = (gFramebufferHeight > 0) ? (GLfloat)gFramebufferWidth / (GLfloat)gFramebufferHeight : 1.0f;
     if (bOrthographicProjection) {
-        projection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 0.1f, 100.0f); // Orthographic
+        float halfWidth = ORTHOGRAPHIC_HALF_HEIGHT * aspect;
+        projection = glm::ortho(-halfWidth, halfWidth, -ORTHOGRAPHIC_HALF_HEIGHT, ORTHOGRAPHIC_HALF_HEIGHT, 0.1f, 100.0f); // Orthographic
     }
     else {
-        projection = glm::perspective(glm::radians(g_pCamera->Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f); // Perspective
+        projection = glm::perspective(glm::radians(g_pCamera->Zoom), aspect, 0.1f, 100.0f); // Perspective
     }
 
-    // Set the view and projection matrices into the shader
-    if (NULL != m_pShaderManager) {
-        m_pShaderManager->setMat4Value("view", view);
-        m_pShaderManager->setMat4Value("projection", projection);
-        m_pShaderManager->setVec3Value("viewPosition", g_pCamera->Position);
+    // Store the view and projection matrices for the per-frame
+    // uniform buffer, which is uploaded once before drawing
+    if (NULL == m_pShaderUniforms) {
+        return;
     }
+    if (!bMultiView) {
+        m_pShaderUniforms->SetCamera(view, projection, g_pCamera->Position);
+        return;
+    }
+
+    // The camera in perspective fills the top left quarter; the top,
+    // front and side views look at the scene origin from outside it.
+    // Every view is a quarter of the framebuffer, so has its aspect.
+    float halfWidth = ORTHOGRAPHIC_HALF_HEIGHT * aspect;
+    glm::mat4 orthographic = glm::ortho(-halfWidth, halfWidth, -ORTHOGRAPHIC_HALF_HEIGHT, ORTHOGRAPHIC_HALF_HEIGHT,
+        0.1f, 2.0f * ORTHOGRAPHIC_VIEW_DISTANCE);
+    glm::vec3 topEye(0.0f, ORTHOGRAPHIC_VIEW_DISTANCE, 0.0f);
+    glm::vec3 frontEye(0.0f, 0.0f, ORTHOGRAPHIC_VIEW_DISTANCE);
+    glm::vec3 sideEye(ORTHOGRAPHIC_VIEW_DISTANCE, 0.0f, 0.0f);
+    CAMERA_VIEW views[4] = {
+        { view, glm::perspective(glm::radians(g_pCamera->Zoom), aspect, 0.1f, 100.0f), g_pCamera->Position },
+        { glm::lookAt(topEye, glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f)), orthographic, topEye },
+        { glm::lookAt(frontEye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), orthographic, frontEye },
+        { glm::lookAt(sideEye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)), orthographic, sideEye }
+    };
+    m_pShaderUniforms->SetViews(views, 4);
+}
+
+/***********************************************************
+ *  SetMultiView()
+ *
+ *  This method switches between drawing the camera alone
+ *  and drawing it with the top, front and side views.
+ ***********************************************************/
+void ViewManager::SetMultiView(bool enabled) {
+    bMultiView = enabled;
+    FrameScheduler::RequestRedraw();
+}
+
+/***********************************************************
+ *  GetFramebufferSize()
+ *
+ *  This method returns the current framebuffer size in
+ *  pixels; both are 0 while the window is minimized.
+ ***********************************************************/
+void ViewManager::GetFramebufferSize(int& width, int& height) const {
+    width = gFramebufferWidth;
+    height = gFramebufferHeight;
 }
 
 /***********************************************************
@@ -168,7 +308,7 @@ void ViewManager::PrepareSceneView() {
  *
  *  This method is automatically called from GLFW whenever
  *  the mouse is moved within the active GLFW display window.
- *  It updates the camera direction based on mouse movement.
+ *  It gathers the movement for the next frame's camera.
  ***********************************************************/
 void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xpos, double ypos) {
     if (gFirstMouse) {
@@ -177,28 +317,37 @@ void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xpos, doubl
         gFirstMouse = false;
     }
 
-    float xoffset = xpos - gLastX;
-    float yoffset = gLastY - ypos; // Reversed since y-coordinates go from bottom to top
+    gMouseOffsetX += xpos - gLastX;
+    gMouseOffsetY += gLastY - ypos; // Reversed since y-coordinates go from bottom to top
     gLastX = xpos;
     gLastY = ypos;
 
-    float sensitivity = 0.1f; // Adjust the sensitivity if needed
-    xoffset *= sensitivity;
-    yoffset *= sensitivity;
-
-    g_pCamera->Yaw += xoffset;
-    g_pCamera->Pitch += yoffset;
+    FrameScheduler::MarkInput();
+    FrameScheduler::RequestRedraw();
+}
 
-    // Constrain the pitch to avoid screen flip
-    if (g_pCamera->Pitch > 89.0f)
-        g_pCamera->Pitch = 89.0f;
-    if (g_pCamera->Pitch < -89.0f)
-        g_pCamera->Pitch = -89.0f;
+/***********************************************************
+ *  Framebuffer_Size_Callback()
+ *
+ *  This method is automatically called from GLFW whenever
+ *  the window's framebuffer is resized. The viewport is set
+ *  at the start of every frame from the stored size.
+ ***********************************************************/
+void ViewManager::Framebuffer_Size_Callback(GLFWwindow* window, int width, int height) {
+    (void)window;
+    gFramebufferWidth = width;
+    gFramebufferHeight = height;
+    FrameScheduler::RequestRedraw();
+}
 
-    // Update camera front vector based on yaw and pitch
-    glm::vec3 front;
-    front.x = cos(glm::radians(g_pCamera->Yaw)) * cos(glm::radians(g_pCamera->Pitch));
-    front.y = sin(glm::radians(g_pCamera->Pitch));
-    front.z = sin(glm::radians(g_pCamera->Yaw)) * cos(glm::radians(g_pCamera->Pitch));
-    g_pCamera->Front = glm::normalize(front);
+/***********************************************************
+ *  Window_Refresh_Callback()
+ *
+ *  This method is automatically called from GLFW whenever
+ *  the window contents need to be drawn again, for example
+ *  after being uncovered.
+ ***********************************************************/
+void ViewManager::Window_Refresh_Callback(GLFWwindow* window) {
+    (void)window;
+    FrameScheduler::RequestRedraw();
 }
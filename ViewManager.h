@@ -10,6 +10,7 @@
 #pragma once
 
 #include "ShaderManager.h"
+#include "ShaderUniforms.h"
 #include "camera.h"
 
 // GLFW library
@@ -26,20 +27,39 @@ public:
 
 	// mouse position callback for mouse interaction with the 3D scene
 	static void Mouse_Position_Callback(GLFWwindow* window, double xMousePos, double yMousePos);
+	// framebuffer size callback to follow window resizes
+	static void Framebuffer_Size_Callback(GLFWwindow* window, int width, int height);
+	// window refresh callback to repaint damaged window contents
+	static void Window_Refresh_Callback(GLFWwindow* window);
 
 private:
 	// pointer to shader manager object
 	ShaderManager* m_pShaderManager;
+	// pointer to the resolved shader uniform handles
+	ShaderUniforms* m_pShaderUniforms;
 	// active OpenGL display window
 	GLFWwindow* m_pWindow;
 
 	// process keyboard events for interaction with the 3D scene
 	void ProcessKeyboardEvents();
+	// turn the camera by the mouse movement gathered since the last frame
+	void ApplyMouseMovement();
 
 public:
 	// create the initial OpenGL display window
 	GLFWwindow* CreateDisplayWindow(const char* windowTitle);
 	
+	// latch the keyboard and mouse input into the camera; runs every
+	// loop iteration, since the input decides whether a frame is drawn
+	void ProcessInput();
 	// prepare the conversion from 3D object display to 2D scene display
 	void PrepareSceneView();
+	// current framebuffer size in pixels (0 x 0 while minimized)
+	void GetFramebufferSize(int& width, int& height) const;
+	// draw the camera view together with top, front and side
+	// orthographic views, one per quarter of the framebuffer
+	void SetMultiView(bool enabled);
+
+	// pass the resolved uniform handles used for the camera data
+	void SetShaderUniforms(ShaderUniforms* pShaderUniforms) { m_pShaderUniforms = pShaderUniforms; }
 };